@@ -0,0 +1,86 @@
+#include "accuracy.h"
+
+#include <stdlib.h>
+
+/*stack for each of the CPU and PPU threads*/
+#define STACK_SIZE (64 * 1024)
+
+static void switchTo( Accuracy* a, CoopThread* from, CoopThread* to ) {
+	a->switches++;
+	coopSwitch( from, to );
+}
+
+/*called on the CPU thread, from the bus or between instructions*/
+static void catchUp( MachineSync* s, Machine* m, unsigned long cycle ) {
+	Accuracy* a = (Accuracy*)s;
+	if( cycle > a->ppuCycles ) {
+		a->target = cycle;
+		switchTo( a, &a->cpu, &a->ppu );
+	}
+}
+
+static void runCpu( void* context ) {
+	Accuracy* a = context;
+	Machine* m = a->m;
+	for( ;; ) {
+		machineExecute( m );
+		if( m->cycles >= a->deadline || a->vblank ) {
+			catchUp( &a->sync, m, m->cycles );
+		}
+		if( a->vblank ) {
+			switchTo( a, &a->cpu, &a->host );
+		}
+	}
+}
+
+/*stop the CPU again before the PPU could next raise vblank, and with it an NMI*/
+static void setDeadline( Accuracy* a ) {
+	int quiet = ppuQuietDots( &a->m->ppu, 0 );
+	a->deadline = a->ppuCycles + (quiet > 0 ? quiet / 3 : 0);
+}
+
+static void runPpu( void* context ) {
+	Accuracy* a = context;
+	for( ;; ) {
+		if( ppuRun( &a->m->ppu, (a->target - a->ppuCycles) * 3, a->frame ) ) {
+			a->vblank = 1;
+		}
+		a->ppuCycles = a->target;
+		setDeadline( a );
+		switchTo( a, &a->ppu, &a->cpu );
+	}
+}
+
+Accuracy* accuracyCreate( Machine* m ) {
+	Accuracy* a = calloc( 1, sizeof( Accuracy ) );
+	if( a == NULL ) {
+		return NULL;
+	}
+	a->sync.catchUp = catchUp;
+	a->m = m;
+	if( coopCreate( &a->cpu, STACK_SIZE, runCpu, a ) != 0 || coopCreate( &a->ppu, STACK_SIZE, runPpu, a ) != 0 ) {
+		accuracyFree( a );
+		return NULL;
+	}
+	return a;
+}
+
+void accuracyFree( Accuracy* a ) {
+	coopFree( &a->cpu );
+	coopFree( &a->ppu );
+	coopFree( &a->host );
+	free( a );
+}
+
+void accuracyRunFrame( Accuracy* a, unsigned char* frame ) {
+	/*between frames the PPU is always up to date with the CPU*/
+	a->frame = frame;
+	a->vblank = 0;
+	a->ppuCycles = a->m->cycles;
+	setDeadline( a );
+
+	machineSync( &a->sync );
+	switchTo( a, &a->host, &a->cpu );
+	machineSync( NULL );
+	a->m->frame++;
+}
@@ -0,0 +1,58 @@
+#ifndef ACCURACY_H
+#define ACCURACY_H
+
+#include "coop.h"
+#include "machine.h"
+
+/*
+ * Accuracy mode, for games that change PPU registers partway through
+ * a scanline. machineRunFrame runs the PPU after each instruction for
+ * all of its cycles, so such a write lands up to an instruction early
+ * as far as the PPU is concerned, and a read of $2002 sees the PPU as
+ * it was when the instruction began.
+ *
+ * Here the CPU and PPU each run as a cooperative thread (coop.h). The
+ * CPU thread executes instructions with machineExecute and runs ahead
+ * of the PPU until it touches a PPU register or gets to where the PPU
+ * could raise vblank; it then switches to the PPU thread, which runs up
+ * to that cycle and switches back. Nothing in processor.c or ppu.c has
+ * to be turned into a state machine for this, and as the PPU is only
+ * caught up when something depends on it, most frames take a few dozen
+ * switches.
+ *
+ * The APU has no thread of its own as it only latches its registers;
+ * nothing reads them back.
+ *
+ * A machine run this way is an ordinary Machine, and can be saved,
+ * forked or run with machineRunFrame between frames. All of its frames
+ * must be run on one OS thread, as the sync is attached to the thread.
+ */
+typedef struct {
+	/*first, so that the catch-up callback can find the rest*/
+	MachineSync sync;
+
+	Machine* m;
+	unsigned char* frame;
+	CoopThread host;
+	CoopThread cpu;
+	CoopThread ppu;
+
+	/*CPU cycle the PPU has been run up to, where it is to run to, and where the CPU must stop for it*/
+	unsigned long ppuCycles;
+	unsigned long target;
+	unsigned long deadline;
+	int vblank;
+
+	/*switches between threads so far*/
+	unsigned long switches;
+} Accuracy;
+
+/*run m in accuracy mode; NULL if out of memory*/
+Accuracy* accuracyCreate( Machine* m );
+
+void accuracyFree( Accuracy* a );
+
+/*machineRunFrame for a machine in accuracy mode*/
+void accuracyRunFrame( Accuracy* a, unsigned char* frame );
+
+#endif
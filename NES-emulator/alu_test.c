@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "processor.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Exhaustive check of the ALU and shift operations of processor.c.
+ * Every operation is run for every accumulator and operand value with
+ * carry and decimal both clear and set, and the result and whole status
+ * register compared with a reference model written from the data sheet
+ * without reference to processor.c. The other status bits come in set
+ * in a pattern that varies with the operands, so clobbering them shows
+ * up too. The 2A03 has no decimal mode, so there D must change nothing
+ * but itself be kept; built for another CPU_VARIANT, ADC and SBC are
+ * checked in decimal mode against the sequences of Bruce Clark's
+ * decimal mode tutorial, invalid BCD operands included.
+ *
+ *     alu_test [-j threads]
+ *
+ * Values of A are split between threads, one per core by default.
+ * Exits with 1 on any mismatch, printing the first few.
+ */
+
+#define C (0x01)
+#define Z (0x02)
+#define I (0x04)
+#define D (0x08)
+#define V (0x40)
+#define N (0x80)
+
+#define SHOWN (4)
+
+/*what the operation gives for a, m and status p: the result goes in *r*/
+typedef void (*Run)( unsigned char* r, unsigned char* p, unsigned char m );
+
+typedef struct {
+	const char* name;
+	Run actual;
+	Run expected;
+
+	/*whether the operand matters, or only A*/
+	int binary;
+} Operation;
+
+/*
+ * processor.c, through the signature all operations share here
+ */
+
+static void runAdc( unsigned char* r, unsigned char* p, unsigned char m ) { adc( (char*)r, (char*)p, m ); }
+static void runSbc( unsigned char* r, unsigned char* p, unsigned char m ) { sbc( (char*)r, (char*)p, m ); }
+static void runAnd( unsigned char* r, unsigned char* p, unsigned char m ) { and( (char*)r, (char*)p, m ); }
+static void runOra( unsigned char* r, unsigned char* p, unsigned char m ) { ora( (char*)r, (char*)p, m ); }
+static void runEor( unsigned char* r, unsigned char* p, unsigned char m ) { eor( (char*)r, (char*)p, m ); }
+static void runCmp( unsigned char* r, unsigned char* p, unsigned char m ) { cmp( *r, (char*)p, m ); }
+static void runCpx( unsigned char* r, unsigned char* p, unsigned char m ) { cpx( *r, (char*)p, m ); }
+static void runCpy( unsigned char* r, unsigned char* p, unsigned char m ) { cpy( *r, (char*)p, m ); }
+static void runBit( unsigned char* r, unsigned char* p, unsigned char m ) { bit( *r, (char*)p, m ); }
+static void runAsl( unsigned char* r, unsigned char* p, unsigned char m ) { asl( (char*)r, (char*)p ); }
+static void runLsr( unsigned char* r, unsigned char* p, unsigned char m ) { lsr( (char*)r, (char*)p ); }
+static void runRol( unsigned char* r, unsigned char* p, unsigned char m ) { rol( (char*)r, (char*)p ); }
+static void runRor( unsigned char* r, unsigned char* p, unsigned char m ) { ror( (char*)r, (char*)p ); }
+static void runInc( unsigned char* r, unsigned char* p, unsigned char m ) { inc( (char*)r, (char*)p ); }
+static void runDec( unsigned char* r, unsigned char* p, unsigned char m ) { dec( (char*)r, (char*)p ); }
+static void runInx( unsigned char* r, unsigned char* p, unsigned char m ) { inx( (char*)r, (char*)p ); }
+static void runDey( unsigned char* r, unsigned char* p, unsigned char m ) { dey( (char*)r, (char*)p ); }
+
+/*
+ * reference model
+ */
+
+static unsigned char flag( unsigned char p, unsigned char bit, int on ) {
+	return on ? p | bit : p & ~bit;
+}
+
+static unsigned char nz( unsigned char p, int value ) {
+	p = flag( p, Z, (value & 0xFF) == 0 );
+	return flag( p, N, value & 0x80 );
+}
+
+#if CPU_VARIANT != CPU_2A03
+/*sequences 1 and 2 of the tutorial: the sum, and the signed sum N and V come from*/
+static void refAdcDecimal( unsigned char* r, unsigned char* p, unsigned char m ) {
+	int c = *p & C, low, sum, signedSum;
+
+	low = (*r & 0x0F) + (m & 0x0F) + c;
+	if( low >= 0x0A ) {
+		low = ((low + 0x06) & 0x0F) + 0x10;
+	}
+	sum = (*r & 0xF0) + (m & 0xF0) + low;
+	signedSum = (signed char)(*r & 0xF0) + (signed char)(m & 0xF0) + low;
+	if( sum >= 0xA0 ) {
+		sum += 0x60;
+	}
+	*p = flag( flag( *p, C, sum >= 0x100 ), V, signedSum < -128 || signedSum > 127 );
+#if CPU_VARIANT == CPU_NMOS
+	*p = flag( flag( *p, N, signedSum & 0x80 ), Z, ((*r + m + c) & 0xFF) == 0 );
+	*r = sum;
+#else
+	*r = sum;
+	*p = nz( *p, *r );
+#endif
+}
+
+/*sequence 3 for the NMOS chip and 4 for the 65C02; flags are as in binary*/
+static unsigned char refSbcDecimal( unsigned char a, unsigned char m, int c ) {
+	int low = (a & 0x0F) - (m & 0x0F) + c - 1, diff;
+#if CPU_VARIANT == CPU_NMOS
+	if( low < 0 ) {
+		low = ((low - 0x06) & 0x0F) - 0x10;
+	}
+	diff = (a & 0xF0) - (m & 0xF0) + low;
+	if( diff < 0 ) {
+		diff -= 0x60;
+	}
+#else
+	diff = a - m + c - 1;
+	if( diff < 0 ) {
+		diff -= 0x60;
+	}
+	if( low < 0 ) {
+		diff -= 0x06;
+	}
+#endif
+	return diff;
+}
+#endif
+
+static void refAdc( unsigned char* r, unsigned char* p, unsigned char m ) {
+	int sum = *r + m + (*p & C);
+#if CPU_VARIANT != CPU_2A03
+	if( *p & D ) {
+		refAdcDecimal( r, p, m );
+		return;
+	}
+#endif
+	*p = flag( *p, V, ~(*r ^ m) & (*r ^ sum) & 0x80 );
+	*p = nz( flag( *p, C, sum > 0xFF ), sum );
+	*r = sum;
+}
+
+static void refSbc( unsigned char* r, unsigned char* p, unsigned char m ) {
+	int c = *p & C, diff = *r - m - !c;
+	unsigned char result = diff;
+#if CPU_VARIANT != CPU_2A03
+	if( *p & D ) {
+		result = refSbcDecimal( *r, m, c );
+	}
+#endif
+	*p = flag( *p, V, (*r ^ m) & (*r ^ diff) & 0x80 );
+	*p = nz( flag( *p, C, diff >= 0 ), diff );
+	*r = result;
+#if CPU_VARIANT == CPU_65C02
+	*p = nz( *p, *r );
+#endif
+}
+
+static void refAnd( unsigned char* r, unsigned char* p, unsigned char m ) { *r &= m; *p = nz( *p, *r ); }
+static void refOra( unsigned char* r, unsigned char* p, unsigned char m ) { *r |= m; *p = nz( *p, *r ); }
+static void refEor( unsigned char* r, unsigned char* p, unsigned char m ) { *r ^= m; *p = nz( *p, *r ); }
+
+static void refCompare( unsigned char* r, unsigned char* p, unsigned char m ) {
+	*p = nz( flag( *p, C, *r >= m ), *r - m );
+}
+
+static void refBit( unsigned char* r, unsigned char* p, unsigned char m ) {
+	*p = flag( flag( flag( *p, Z, (*r & m) == 0 ), N, m & 0x80 ), V, m & 0x40 );
+}
+
+static void refAsl( unsigned char* r, unsigned char* p, unsigned char m ) {
+	*p = nz( flag( *p, C, *r & 0x80 ), *r << 1 );
+	*r <<= 1;
+}
+
+static void refLsr( unsigned char* r, unsigned char* p, unsigned char m ) {
+	*p = nz( flag( *p, C, *r & 0x01 ), *r >> 1 );
+	*r >>= 1;
+}
+
+static void refRol( unsigned char* r, unsigned char* p, unsigned char m ) {
+	int value = (*r << 1) | (*p & C);
+	*p = nz( flag( *p, C, *r & 0x80 ), value );
+	*r = value;
+}
+
+static void refRor( unsigned char* r, unsigned char* p, unsigned char m ) {
+	int value = (*r >> 1) | ((*p & C) << 7);
+	*p = nz( flag( *p, C, *r & 0x01 ), value );
+	*r = value;
+}
+
+static void refInc( unsigned char* r, unsigned char* p, unsigned char m ) { *p = nz( *p, ++*r ); }
+static void refDec( unsigned char* r, unsigned char* p, unsigned char m ) { *p = nz( *p, --*r ); }
+
+static const Operation operations[] = {
+	{ "ADC", runAdc, refAdc, 1 },
+	{ "SBC", runSbc, refSbc, 1 },
+	{ "AND", runAnd, refAnd, 1 },
+	{ "ORA", runOra, refOra, 1 },
+	{ "EOR", runEor, refEor, 1 },
+	{ "CMP", runCmp, refCompare, 1 },
+	{ "CPX", runCpx, refCompare, 1 },
+	{ "CPY", runCpy, refCompare, 1 },
+	{ "BIT", runBit, refBit, 1 },
+	{ "ASL", runAsl, refAsl, 0 },
+	{ "LSR", runLsr, refLsr, 0 },
+	{ "ROL", runRol, refRol, 0 },
+	{ "ROR", runRor, refRor, 0 },
+	{ "INC", runInc, refInc, 0 },
+	{ "DEC", runDec, refDec, 0 },
+	{ "INX", runInx, refInc, 0 },
+	{ "DEY", runDey, refDec, 0 }
+};
+
+#define OPERATIONS ((int)(sizeof( operations ) / sizeof( operations[ 0 ] )))
+
+typedef struct {
+	int first;
+	int last;
+	pthread_t thread;
+
+	/*per operation*/
+	unsigned long cases[ OPERATIONS ];
+	unsigned long mismatches[ OPERATIONS ];
+	char shown[ SHOWN ][ 96 ];
+	int shownCount;
+} Slice;
+
+static void mismatch( Slice* s, const Operation* op, int a, int m, int p,
+                      unsigned char r, unsigned char q, unsigned char er, unsigned char eq ) {
+	if( s->shownCount < SHOWN ) {
+		sprintf( s->shown[ s->shownCount++ ], "%s A=%02X M=%02X P=%02X: got %02X P=%02X, expected %02X P=%02X",
+		         op->name, a, m, p, r, q, er, eq );
+	}
+}
+
+static void* runSlice( void* arg ) {
+	Slice* s = arg;
+	const Operation* op;
+	unsigned char r, q, er, eq;
+	int o, a, m, cd, p;
+
+	for( o = 0; o < OPERATIONS; o++ ) {
+		op = &operations[ o ];
+		for( a = s->first; a < s->last; a++ ) {
+			for( m = 0; m < (op->binary ? 256 : 1); m++ ) {
+				for( cd = 0; cd < 4; cd++ ) {
+					/*carry and decimal from cd, and the rest in a pattern of a and m*/
+					p = ((a ^ (m << 1) ^ (m >> 3)) & (Z | I | V | N)) | 0x20 | (cd & 1 ? C : 0) | (cd & 2 ? D : 0);
+					r = er = a;
+					q = eq = p;
+					op->actual( &r, &q, m );
+					op->expected( &er, &eq, m );
+					s->cases[ o ]++;
+					if( r != er || q != eq ) {
+						s->mismatches[ o ]++;
+						mismatch( s, op, a, m, p, r, q, er, eq );
+					}
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main( int argc, char* argv[] ) {
+	Slice* slices;
+	unsigned long cases, mismatches, total = 0, failed = 0;
+	int threads = sysconf( _SC_NPROCESSORS_ONLN ), i, o, shown = 0;
+	double start;
+
+	if( argc == 3 && strcmp( argv[ 1 ], "-j" ) == 0 ) {
+		threads = atoi( argv[ 2 ] );
+	} else if( argc != 1 ) {
+		fprintf( stderr, "usage: alu_test [-j threads]\n" );
+		return 2;
+	}
+	if( threads < 1 ) {
+		threads = 1;
+	}
+	if( threads > 256 ) {
+		threads = 256;
+	}
+
+	slices = calloc( threads, sizeof( Slice ) );
+	if( slices == NULL ) {
+		fprintf( stderr, "out of memory\n" );
+		return 1;
+	}
+	start = now();
+	for( i = 0; i < threads; i++ ) {
+		slices[ i ].first = 256 * i / threads;
+		slices[ i ].last = 256 * (i + 1) / threads;
+		if( i > 0 && pthread_create( &slices[ i ].thread, NULL, runSlice, &slices[ i ] ) != 0 ) {
+			fprintf( stderr, "cannot start thread %d\n", i );
+			return 1;
+		}
+	}
+	runSlice( &slices[ 0 ] );
+	for( i = 1; i < threads; i++ ) {
+		pthread_join( slices[ i ].thread, NULL );
+	}
+
+	for( o = 0; o < OPERATIONS; o++ ) {
+		cases = mismatches = 0;
+		for( i = 0; i < threads; i++ ) {
+			cases += slices[ i ].cases[ o ];
+			mismatches += slices[ i ].mismatches[ o ];
+		}
+		printf( "%s: %s %8lu cases, %lu mismatches\n", mismatches ? "FAIL" : "ok  ", operations[ o ].name,
+		        cases, mismatches );
+		total += cases;
+		failed += mismatches;
+	}
+	for( i = 0; i < threads; i++ ) {
+		for( o = 0; o < slices[ i ].shownCount && shown < 2 * SHOWN; o++, shown++ ) {
+			printf( "    %s\n", slices[ i ].shown[ o ] );
+		}
+	}
+	printf( "\n%lu cases on %d threads in %.3f s, %lu mismatches\n", total, threads, now() - start, failed );
+	free( slices );
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,502 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "audio.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define PI (3.14159265358979323846)
+
+/*
+ * ring buffer
+ */
+
+int audioRingInit( AudioRing* ring, unsigned long capacity ) {
+	unsigned long size = 1;
+	while( size < capacity ) {
+		size <<= 1;
+	}
+	memset( ring, 0, sizeof( *ring ) );
+	ring->samples = malloc( size * sizeof( short ) );
+	if( ring->samples == NULL ) {
+		return -1;
+	}
+	ring->capacity = size;
+	ring->mask = size - 1;
+	return 0;
+}
+
+void audioRingFree( AudioRing* ring ) {
+	free( ring->samples );
+	ring->samples = NULL;
+}
+
+unsigned long audioRingWrite( AudioRing* ring, const short* samples, unsigned long count ) {
+	unsigned long head = ring->head;
+	unsigned long space, first;
+
+	/*only reload the consumer's index when the cached one says we are full*/
+	space = ring->capacity - (head - ring->cachedTail);
+	if( space < count ) {
+		ring->cachedTail = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+		space = ring->capacity - (head - ring->cachedTail);
+	}
+	if( count > space ) {
+		count = space;
+	}
+
+	first = ring->capacity - (head & ring->mask);
+	if( first > count ) {
+		first = count;
+	}
+	memcpy( ring->samples + (head & ring->mask), samples, first * sizeof( short ) );
+	memcpy( ring->samples, samples + first, (count - first) * sizeof( short ) );
+
+	__atomic_store_n( &ring->head, head + count, __ATOMIC_RELEASE );
+	return count;
+}
+
+unsigned long audioRingRead( AudioRing* ring, short* samples, unsigned long count ) {
+	unsigned long tail = ring->tail;
+	unsigned long avail, first;
+
+	avail = ring->cachedHead - tail;
+	if( avail < count ) {
+		ring->cachedHead = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+		avail = ring->cachedHead - tail;
+	}
+	if( count > avail ) {
+		count = avail;
+	}
+
+	first = ring->capacity - (tail & ring->mask);
+	if( first > count ) {
+		first = count;
+	}
+	memcpy( samples, ring->samples + (tail & ring->mask), first * sizeof( short ) );
+	memcpy( samples + first, ring->samples, (count - first) * sizeof( short ) );
+
+	__atomic_store_n( &ring->tail, tail + count, __ATOMIC_RELEASE );
+	return count;
+}
+
+unsigned long audioRingFill( AudioRing* ring ) {
+	unsigned long tail = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+	unsigned long head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+	return head - tail;
+}
+
+/*
+ * resampler
+ */
+
+static double sinc( double x ) {
+	if( fabs( x ) < 1e-9 ) {
+		return 1.0;
+	}
+	return sin( PI * x ) / (PI * x);
+}
+
+void resamplerInit( Resampler* r, double inputRate, double outputRate ) {
+	double cutoff, t, w, sum;
+	int p, k;
+
+	memset( r, 0, sizeof( *r ) );
+	r->nominalStep = inputRate / outputRate;
+	r->step = r->nominalStep;
+
+	/*low-pass just under the lower of the two Nyquist frequencies*/
+	cutoff = 0.9 * (outputRate < inputRate ? outputRate / inputRate : 1.0);
+
+	for( p = 0; p <= RESAMPLER_PHASES; p++ ) {
+		sum = 0.0;
+		for( k = 0; k < RESAMPLER_TAPS; k++ ) {
+			/*distance of tap k from the output instant, in input samples*/
+			t = k - (RESAMPLER_TAPS / 2 - 1) - (double)p / RESAMPLER_PHASES;
+
+			/*Blackman window over the span of the filter*/
+			w = (t + RESAMPLER_TAPS / 2) / RESAMPLER_TAPS;
+			w = 0.42 - 0.5 * cos( 2 * PI * w ) + 0.08 * cos( 4 * PI * w );
+
+			r->coeffs[ p ][ k ] = cutoff * sinc( cutoff * t ) * w;
+			sum += r->coeffs[ p ][ k ];
+		}
+
+		/*unity gain at DC for every phase*/
+		for( k = 0; k < RESAMPLER_TAPS; k++ ) {
+			r->coeffs[ p ][ k ] /= sum;
+		}
+	}
+
+	/*start with a full history of silence*/
+	r->buffered = RESAMPLER_TAPS;
+}
+
+#ifdef __SSE__
+static float dot( const float* x, const float* c ) {
+	__m128 acc = _mm_mul_ps( _mm_loadu_ps( x ), _mm_loadu_ps( c ) );
+	float lanes[ 4 ];
+	int k;
+	for( k = 4; k < RESAMPLER_TAPS; k += 4 ) {
+		acc = _mm_add_ps( acc, _mm_mul_ps( _mm_loadu_ps( x + k ), _mm_loadu_ps( c + k ) ) );
+	}
+	_mm_storeu_ps( lanes, acc );
+	return (lanes[ 0 ] + lanes[ 1 ]) + (lanes[ 2 ] + lanes[ 3 ]);
+}
+#else
+static float dot( const float* x, const float* c ) {
+	float acc = 0.0f;
+	int k;
+	for( k = 0; k < RESAMPLER_TAPS; k++ ) {
+		acc += x[ k ] * c[ k ];
+	}
+	return acc;
+}
+#endif
+
+static short clampSample( float value ) {
+	value *= 32767.0f;
+	if( value > 32767.0f ) {
+		return 32767;
+	}
+	if( value < -32768.0f ) {
+		return -32768;
+	}
+	return (short)value;
+}
+
+unsigned long resamplerProcess( Resampler* r, const float* in, unsigned long count,
+                                short* out, unsigned long outMax ) {
+	unsigned long produced = 0;
+	unsigned long take, index, consumed;
+	double phase, frac;
+	float* x;
+	float d0, d1;
+	int row;
+
+	while( count > 0 && produced < outMax ) {
+		take = RESAMPLER_TAPS + RESAMPLER_CHUNK - r->buffered;
+		if( take > count ) {
+			take = count;
+		}
+		memcpy( r->buffer + r->buffered, in, take * sizeof( float ) );
+		r->buffered += take;
+		in += take;
+		count -= take;
+
+		for( ;; ) {
+			index = (unsigned long)r->position;
+			if( index + RESAMPLER_TAPS > r->buffered || produced == outMax ) {
+				break;
+			}
+			phase = (r->position - index) * RESAMPLER_PHASES;
+			row = (int)phase;
+			frac = phase - row;
+			x = r->buffer + index;
+			d0 = dot( x, r->coeffs[ row ] );
+			d1 = dot( x, r->coeffs[ row + 1 ] );
+			out[ produced++ ] = clampSample( d0 + (float)frac * (d1 - d0) );
+			r->position += r->step;
+		}
+
+		/*slide the unconsumed tail of the buffer back to the front*/
+		consumed = (unsigned long)r->position;
+		if( consumed > r->buffered ) {
+			consumed = r->buffered;
+		}
+		memmove( r->buffer, r->buffer + consumed, (r->buffered - consumed) * sizeof( float ) );
+		r->buffered -= consumed;
+		r->position -= consumed;
+	}
+	return produced;
+}
+
+/*
+ * sinks
+ */
+
+static int nullWrite( AudioSink* sink, const short* samples, unsigned long count ) {
+	(void)samples;
+	sink->written += count;
+	return 0;
+}
+
+static void nullClose( AudioSink* sink ) {
+	(void)sink;
+}
+
+int audioNullSinkOpen( AudioSink* sink, int paced ) {
+	memset( sink, 0, sizeof( *sink ) );
+	sink->write = nullWrite;
+	sink->close = nullClose;
+	sink->rate = AUDIO_OUTPUT_RATE;
+	sink->paced = paced;
+	return 0;
+}
+
+static void putLittle( unsigned char* p, unsigned long value, int bytes ) {
+	int i;
+	for( i = 0; i < bytes; i++ ) {
+		p[ i ] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+static void wavHeader( unsigned char* header, unsigned long rate, unsigned long samples ) {
+	unsigned long dataBytes = samples * 2;
+	memcpy( header, "RIFF", 4 );
+	putLittle( header + 4, 36 + dataBytes, 4 );
+	memcpy( header + 8, "WAVEfmt ", 8 );
+	putLittle( header + 16, 16, 4 );
+	putLittle( header + 20, 1, 2 );           /*PCM*/
+	putLittle( header + 22, 1, 2 );           /*mono*/
+	putLittle( header + 24, rate, 4 );
+	putLittle( header + 28, rate * 2, 4 );    /*bytes per second*/
+	putLittle( header + 32, 2, 2 );           /*block align*/
+	putLittle( header + 34, 16, 2 );          /*bits per sample*/
+	memcpy( header + 36, "data", 4 );
+	putLittle( header + 40, dataBytes, 4 );
+}
+
+static int wavWrite( AudioSink* sink, const short* samples, unsigned long count ) {
+	unsigned char bytes[ 2 * AUDIO_BLOCK ];
+	unsigned long i, n;
+	while( count > 0 ) {
+		n = count < AUDIO_BLOCK ? count : AUDIO_BLOCK;
+		for( i = 0; i < n; i++ ) {
+			putLittle( bytes + 2 * i, (unsigned short)samples[ i ], 2 );
+		}
+		if( fwrite( bytes, 2, n, (FILE*)sink->context ) != n ) {
+			return -1;
+		}
+		sink->written += n;
+		samples += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static void wavClose( AudioSink* sink ) {
+	FILE* file = sink->context;
+	unsigned char header[ 44 ];
+
+	/*now that the length is known, patch the sizes in the header*/
+	wavHeader( header, sink->rate, sink->written );
+	if( fseek( file, 0, SEEK_SET ) == 0 ) {
+		fwrite( header, 1, sizeof( header ), file );
+	}
+	fclose( file );
+	sink->context = NULL;
+}
+
+int audioWavSinkOpen( AudioSink* sink, const char* path, int paced ) {
+	unsigned char header[ 44 ];
+	FILE* file = fopen( path, "wb" );
+	if( file == NULL ) {
+		return -1;
+	}
+	memset( sink, 0, sizeof( *sink ) );
+	sink->write = wavWrite;
+	sink->close = wavClose;
+	sink->rate = AUDIO_OUTPUT_RATE;
+	sink->paced = paced;
+	sink->context = file;
+
+	wavHeader( header, sink->rate, 0 );
+	if( fwrite( header, 1, sizeof( header ), file ) != sizeof( header ) ) {
+		fclose( file );
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * pipeline
+ */
+
+struct AudioOutput {
+	AudioRing ring;
+	Resampler resampler;
+	AudioSink* sink;
+	pthread_t thread;
+	int running;
+
+	/*box filter from the input rate down to the resampler's input rate*/
+	unsigned long decimation;
+	unsigned long boxCount;
+	float boxSum;
+
+	unsigned long target;
+	double smoothedFill;
+
+	/*written by the emulation thread*/
+	unsigned long samplesIn;
+	unsigned long dropped;
+
+	/*written by the device thread*/
+	unsigned long samplesOut;
+	unsigned long underruns;
+};
+
+static void addNanoseconds( struct timespec* t, long ns ) {
+	t->tv_nsec += ns;
+	while( t->tv_nsec >= 1000000000L ) {
+		t->tv_nsec -= 1000000000L;
+		t->tv_sec += 1;
+	}
+}
+
+static void* deviceThread( void* arg ) {
+	AudioOutput* out = arg;
+	AudioSink* sink = out->sink;
+	short block[ AUDIO_BLOCK ];
+	struct timespec deadline, pause;
+	long period = (long)(1e9 * AUDIO_BLOCK / sink->rate);
+	unsigned long got;
+
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	pause.tv_sec = 0;
+	pause.tv_nsec = 1000000L;
+
+	while( __atomic_load_n( &out->running, __ATOMIC_ACQUIRE ) ) {
+		if( sink->paced ) {
+			/*a device consumes a block per period whether or not we have one*/
+			got = audioRingRead( &out->ring, block, AUDIO_BLOCK );
+			if( got < AUDIO_BLOCK ) {
+				memset( block + got, 0, (AUDIO_BLOCK - got) * sizeof( short ) );
+				__atomic_add_fetch( &out->underruns, 1, __ATOMIC_RELAXED );
+			}
+			sink->write( sink, block, AUDIO_BLOCK );
+			__atomic_add_fetch( &out->samplesOut, AUDIO_BLOCK, __ATOMIC_RELAXED );
+			addNanoseconds( &deadline, period );
+			clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL );
+		} else {
+			got = audioRingRead( &out->ring, block, AUDIO_BLOCK );
+			if( got > 0 ) {
+				sink->write( sink, block, got );
+				__atomic_add_fetch( &out->samplesOut, got, __ATOMIC_RELAXED );
+			} else {
+				nanosleep( &pause, NULL );
+			}
+		}
+	}
+
+	/*whatever the emulator produced before stopping still gets played*/
+	while( (got = audioRingRead( &out->ring, block, AUDIO_BLOCK )) > 0 ) {
+		sink->write( sink, block, got );
+		__atomic_add_fetch( &out->samplesOut, got, __ATOMIC_RELAXED );
+	}
+	return NULL;
+}
+
+AudioOutput* audioOutputCreate( AudioSink* sink, double inputRate, unsigned long latency ) {
+	AudioOutput* out = calloc( 1, sizeof( AudioOutput ) );
+	if( out == NULL ) {
+		return NULL;
+	}
+
+	/*the ring holds twice the target so there is headroom both ways*/
+	if( audioRingInit( &out->ring, 2 * latency ) != 0 ) {
+		free( out );
+		return NULL;
+	}
+
+	/*keep the intermediate rate at least 10% above the output rate*/
+	out->decimation = (unsigned long)(inputRate / (sink->rate * 1.1));
+	if( out->decimation < 1 ) {
+		out->decimation = 1;
+	}
+	resamplerInit( &out->resampler, inputRate / out->decimation, sink->rate );
+
+	out->sink = sink;
+	out->target = out->ring.capacity / 2;
+	out->smoothedFill = out->target;
+
+	/*start at the target latency so the device doesn't underrun at once*/
+	memset( out->ring.samples, 0, out->target * sizeof( short ) );
+	out->ring.head = out->target;
+	out->running = 1;
+	if( pthread_create( &out->thread, NULL, deviceThread, out ) != 0 ) {
+		audioRingFree( &out->ring );
+		free( out );
+		return NULL;
+	}
+	return out;
+}
+
+/*
+ * Dynamic rate control. When the ring is below target we produce
+ * slightly more output per input sample, above target slightly less.
+ * The fill is smoothed so the device thread's block-sized steps
+ * don't show up as pitch jitter.
+ */
+static void adjustRate( AudioOutput* out ) {
+	double error;
+	out->smoothedFill += 0.05 * ((double)audioRingFill( &out->ring ) - out->smoothedFill);
+	error = (out->target - out->smoothedFill) / out->target;
+	if( error > 1.0 ) {
+		error = 1.0;
+	} else if( error < -1.0 ) {
+		error = -1.0;
+	}
+	out->resampler.step = out->resampler.nominalStep / (1.0 + AUDIO_MAX_RATE_DELTA * error);
+}
+
+void audioOutputPush( AudioOutput* out, const float* samples, unsigned long count ) {
+	float decimated[ RESAMPLER_CHUNK ];
+	short resampled[ RESAMPLER_CHUNK * 2 ];
+	unsigned long n = 0, produced, written;
+	unsigned long i;
+
+	adjustRate( out );
+	out->samplesIn += count;
+
+	for( i = 0; i < count; i++ ) {
+		out->boxSum += samples[ i ];
+		if( ++out->boxCount < out->decimation ) {
+			continue;
+		}
+		decimated[ n++ ] = out->boxSum / out->decimation;
+		out->boxSum = 0.0f;
+		out->boxCount = 0;
+
+		if( n == RESAMPLER_CHUNK ) {
+			produced = resamplerProcess( &out->resampler, decimated, n,
+			                             resampled, RESAMPLER_CHUNK * 2 );
+			written = audioRingWrite( &out->ring, resampled, produced );
+			out->dropped += produced - written;
+			n = 0;
+		}
+	}
+	if( n > 0 ) {
+		produced = resamplerProcess( &out->resampler, decimated, n,
+		                             resampled, RESAMPLER_CHUNK * 2 );
+		written = audioRingWrite( &out->ring, resampled, produced );
+		out->dropped += produced - written;
+	}
+}
+
+void audioOutputStats( AudioOutput* out, AudioStats* stats ) {
+	stats->samplesIn = out->samplesIn;
+	stats->samplesOut = __atomic_load_n( &out->samplesOut, __ATOMIC_RELAXED );
+	stats->dropped = out->dropped;
+	stats->underruns = __atomic_load_n( &out->underruns, __ATOMIC_RELAXED );
+	stats->fill = audioRingFill( &out->ring );
+	stats->capacity = out->ring.capacity;
+	stats->ratio = out->resampler.nominalStep / out->resampler.step;
+}
+
+void audioOutputDestroy( AudioOutput* out ) {
+	__atomic_store_n( &out->running, 0, __ATOMIC_RELEASE );
+	pthread_join( out->thread, NULL );
+	out->sink->close( out->sink );
+	audioRingFree( &out->ring );
+	free( out );
+}
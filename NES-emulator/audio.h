@@ -0,0 +1,135 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+/*
+ * Audio output pipeline.
+ *
+ * The emulation thread pushes samples at the emulated rate. They are
+ * box-filtered down to an intermediate rate, run through a polyphase
+ * resampler to AUDIO_OUTPUT_RATE and written into a single-producer
+ * single-consumer ring. A device thread drains the ring into a sink.
+ * Neither side ever blocks on the other: a full ring drops samples on
+ * the producer side and an empty ring plays silence on the device side.
+ *
+ * The resampling ratio is nudged by at most AUDIO_MAX_RATE_DELTA so that
+ * the ring stays about half full, which absorbs the drift between the
+ * 60.0988 Hz emulated video clock and the host's audio clock.
+ */
+
+#define AUDIO_OUTPUT_RATE (48000)
+#define AUDIO_CPU_RATE (1789773.0)
+#define AUDIO_FRAME_RATE (60.0988)
+#define AUDIO_MAX_RATE_DELTA (0.005)
+
+/*number of samples the device thread moves per write*/
+#define AUDIO_BLOCK (256)
+
+#define AUDIO_CACHE_LINE (64)
+
+/*
+ * Lock-free single-producer single-consumer ring of 16-bit samples.
+ * head is only written by the producer and tail only by the consumer,
+ * and each lives on its own cache line.
+ */
+typedef struct {
+	unsigned long head;
+	unsigned long cachedTail;
+	char padHead[ AUDIO_CACHE_LINE - 2 * sizeof( unsigned long ) ];
+	unsigned long tail;
+	unsigned long cachedHead;
+	char padTail[ AUDIO_CACHE_LINE - 2 * sizeof( unsigned long ) ];
+	short* samples;
+	unsigned long capacity;
+	unsigned long mask;
+} AudioRing;
+
+/*capacity is rounded up to a power of two. returns 0 on success*/
+int audioRingInit( AudioRing* ring, unsigned long capacity );
+
+void audioRingFree( AudioRing* ring );
+
+/*producer side. returns the number of samples actually written*/
+unsigned long audioRingWrite( AudioRing* ring, const short* samples, unsigned long count );
+
+/*consumer side. returns the number of samples actually read*/
+unsigned long audioRingRead( AudioRing* ring, short* samples, unsigned long count );
+
+/*number of samples waiting to be read. safe from either side*/
+unsigned long audioRingFill( AudioRing* ring );
+
+#define RESAMPLER_TAPS (16)
+#define RESAMPLER_PHASES (64)
+#define RESAMPLER_CHUNK (1024)
+
+/*
+ * Polyphase windowed-sinc resampler. Each output sample is a dot
+ * product of RESAMPLER_TAPS inputs with a coefficient row, linearly
+ * interpolated between the two nearest of RESAMPLER_PHASES rows.
+ */
+typedef struct {
+	float coeffs[ RESAMPLER_PHASES + 1 ][ RESAMPLER_TAPS ];
+	float buffer[ RESAMPLER_TAPS + RESAMPLER_CHUNK ];
+	unsigned long buffered;
+	double position;
+	double step;
+	double nominalStep;
+} Resampler;
+
+void resamplerInit( Resampler* r, double inputRate, double outputRate );
+
+/*
+ * Resample count input samples, writing at most outMax output samples.
+ * Input that does not yet produce output is kept for the next call.
+ * Returns the number of samples written to out.
+ */
+unsigned long resamplerProcess( Resampler* r, const float* in, unsigned long count,
+                                short* out, unsigned long outMax );
+
+/*
+ * Destination for resampled audio. write is only ever called from the
+ * device thread. A paced sink is drained at its sample rate as a real
+ * device would be; an unpaced sink takes samples as soon as they exist.
+ */
+typedef struct AudioSink {
+	int (*write)( struct AudioSink* sink, const short* samples, unsigned long count );
+	void (*close)( struct AudioSink* sink );
+	unsigned long rate;
+	int paced;
+	unsigned long written;
+	void* context;
+} AudioSink;
+
+/*a sink that discards everything. returns 0 on success*/
+int audioNullSinkOpen( AudioSink* sink, int paced );
+
+/*a sink that records 16-bit mono PCM to a WAV file. returns 0 on success*/
+int audioWavSinkOpen( AudioSink* sink, const char* path, int paced );
+
+typedef struct {
+	unsigned long samplesIn;
+	unsigned long samplesOut;
+	unsigned long dropped;
+	unsigned long underruns;
+	unsigned long fill;
+	unsigned long capacity;
+	double ratio;
+} AudioStats;
+
+typedef struct AudioOutput AudioOutput;
+
+/*
+ * Create the pipeline and start the device thread. inputRate is the rate
+ * samples are pushed at, usually AUDIO_CPU_RATE. latency is the target
+ * ring fill in output samples. returns NULL on failure.
+ */
+AudioOutput* audioOutputCreate( AudioSink* sink, double inputRate, unsigned long latency );
+
+/*emulation thread side. never blocks*/
+void audioOutputPush( AudioOutput* out, const float* samples, unsigned long count );
+
+void audioOutputStats( AudioOutput* out, AudioStats* stats );
+
+/*stop the device thread, drain what is left into the sink and close it*/
+void audioOutputDestroy( AudioOutput* out );
+
+#endif
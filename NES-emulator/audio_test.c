@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "audio.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PI (3.14159265358979323846)
+#define RING_TEST_SAMPLES (2000000UL)
+
+/*self-test functions*/
+
+static int failures = 0;
+
+void check( int condition, const char* what ) {
+	printf( "%s: %s\n", condition ? "ok  " : "FAIL", what );
+	if( !condition ) {
+		failures++;
+	}
+}
+
+void* ringProducer( void* arg ) {
+	AudioRing* ring = arg;
+	short chunk[ 97 ];
+	unsigned long next = 0, sent, i, n;
+	while( next < RING_TEST_SAMPLES ) {
+		n = sizeof( chunk ) / sizeof( short );
+		for( i = 0; i < n; i++ ) {
+			chunk[ i ] = (short)(next + i);
+		}
+		if( next + n > RING_TEST_SAMPLES ) {
+			n = RING_TEST_SAMPLES - next;
+		}
+		sent = audioRingWrite( ring, chunk, n );
+		next += sent;
+	}
+	return NULL;
+}
+
+void testRing( void ) {
+	AudioRing ring;
+	pthread_t producer;
+	short chunk[ 61 ];
+	unsigned long received = 0, got, i;
+	int ordered = 1;
+
+	printf( "=======================================\n" );
+	printf( "SPSC ring under two threads\n" );
+	audioRingInit( &ring, 1000 );
+	check( ring.capacity == 1024, "capacity rounds up to a power of two" );
+
+	pthread_create( &producer, NULL, ringProducer, &ring );
+	while( received < RING_TEST_SAMPLES ) {
+		got = audioRingRead( &ring, chunk, sizeof( chunk ) / sizeof( short ) );
+		for( i = 0; i < got; i++ ) {
+			if( chunk[ i ] != (short)(received + i) ) {
+				ordered = 0;
+			}
+		}
+		received += got;
+	}
+	pthread_join( producer, NULL );
+	check( ordered, "every sample arrives once and in order" );
+	check( audioRingFill( &ring ) == 0, "ring is empty afterwards" );
+	audioRingFree( &ring );
+}
+
+void testResampler( void ) {
+	static Resampler r;
+	float in[ 1000 ];
+	short out[ 48000 ];
+	double inputRate = 54235.5, sumSquares = 0.0;
+	unsigned long total = 0, i, crossings = 0;
+	unsigned long t = 0;
+	int k;
+
+	printf( "=======================================\n" );
+	printf( "1 kHz tone from %.1f Hz to %d Hz\n", inputRate, AUDIO_OUTPUT_RATE );
+	resamplerInit( &r, inputRate, AUDIO_OUTPUT_RATE );
+
+	/*one second of input*/
+	for( k = 0; k < 54; k++ ) {
+		for( i = 0; i < 1000; i++, t++ ) {
+			in[ i ] = 0.5f * (float)sin( 2 * PI * 1000.0 * t / inputRate );
+		}
+		total += resamplerProcess( &r, in, 1000, out + total, 48000 - total );
+	}
+
+	/*skip the filter's start-up transient*/
+	for( i = 100; i + 1 < total; i++ ) {
+		if( (out[ i ] < 0) != (out[ i + 1 ] < 0) ) {
+			crossings++;
+		}
+		sumSquares += (double)out[ i ] * out[ i ];
+	}
+	printf( "output samples %lu, crossings %lu, rms %.0f\n", total, crossings,
+	        sqrt( sumSquares / (total - 101) ) );
+	check( total > 47700 && total <= 48000, "output count matches the ratio" );
+	check( crossings > 1970 && crossings < 2010, "tone stays at 1 kHz" );
+	check( fabs( sqrt( sumSquares / (total - 101) ) - 0.5 * 32767 / sqrt( 2.0 ) ) < 300,
+	       "passband gain is unity" );
+}
+
+void testWavSink( void ) {
+	AudioSink sink;
+	AudioOutput* out;
+	AudioStats stats;
+	float frame[ 29781 ];
+	unsigned char header[ 44 ];
+	struct timespec pause = { 0, 100000L };
+	unsigned long i, bytes;
+	FILE* file;
+	int f;
+
+	printf( "=======================================\n" );
+	printf( "WAV sink, unpaced\n" );
+	check( audioWavSinkOpen( &sink, "audio_test.wav", 0 ) == 0, "sink opens" );
+	out = audioOutputCreate( &sink, AUDIO_CPU_RATE, 4096 );
+	for( i = 0; i < 29781; i++ ) {
+		frame[ i ] = (i / 1000) % 2 ? 0.25f : -0.25f;
+	}
+	for( f = 0; f < 60; f++ ) {
+		audioOutputPush( out, frame, 29781 );
+
+		/*a recording host is never real-time; let the writer keep up*/
+		for( audioOutputStats( out, &stats ); stats.fill > 2048; audioOutputStats( out, &stats ) ) {
+			nanosleep( &pause, NULL );
+		}
+	}
+	audioOutputStats( out, &stats );
+	audioOutputDestroy( out );
+	printf( "in %lu, out %lu, dropped %lu\n", stats.samplesIn, sink.written, stats.dropped );
+
+	file = fopen( "audio_test.wav", "rb" );
+	check( file != NULL, "file exists" );
+	if( file != NULL ) {
+		fread( header, 1, 44, file );
+		fseek( file, 0, SEEK_END );
+		bytes = ftell( file );
+		fclose( file );
+		check( memcmp( header, "RIFF", 4 ) == 0 && memcmp( header + 8, "WAVE", 4 ) == 0,
+		       "RIFF/WAVE header" );
+		check( bytes == 44 + 2 * sink.written, "file length matches samples written" );
+		check( (header[ 40 ] | header[ 41 ] << 8 | (unsigned long)header[ 42 ] << 16)
+		       == 2 * sink.written, "data chunk size is patched on close" );
+	}
+	/*the ring starts primed with the target latency of silence*/
+	check( sink.written - 4096 > 47000 && sink.written - 4096 < 49000, "about one second of audio" );
+	remove( "audio_test.wav" );
+}
+
+void testRateControl( void ) {
+	AudioSink sink;
+	AudioOutput* out;
+	AudioStats stats;
+	float frame[ 29781 ];
+	struct timespec deadline;
+	unsigned long i, minFill = ~0UL, maxFill = 0;
+	int f;
+
+	printf( "=======================================\n" );
+	printf( "rate control: 60.0988 Hz emulation on a 60 Hz host, paced null sink\n" );
+	audioNullSinkOpen( &sink, 1 );
+	out = audioOutputCreate( &sink, AUDIO_CPU_RATE, 2048 );
+	for( i = 0; i < 29781; i++ ) {
+		frame[ i ] = 0.1f * (float)sin( 2 * PI * 440.0 * i / AUDIO_CPU_RATE );
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	for( f = 0; f < 240; f++ ) {
+		/*one emulated frame of samples per host vsync*/
+		audioOutputPush( out, frame, (unsigned long)(AUDIO_CPU_RATE / AUDIO_FRAME_RATE) );
+		deadline.tv_nsec += 1000000000L / 60;
+		if( deadline.tv_nsec >= 1000000000L ) {
+			deadline.tv_nsec -= 1000000000L;
+			deadline.tv_sec += 1;
+		}
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL );
+		if( f >= 120 ) {
+			audioOutputStats( out, &stats );
+			if( stats.fill < minFill ) minFill = stats.fill;
+			if( stats.fill > maxFill ) maxFill = stats.fill;
+		}
+	}
+	audioOutputStats( out, &stats );
+	audioOutputDestroy( out );
+	printf( "ratio %.5f, fill %lu..%lu of %lu, dropped %lu, underruns %lu\n",
+	        stats.ratio, minFill, maxFill, stats.capacity, stats.dropped, stats.underruns );
+	check( stats.ratio > 1.0 - AUDIO_MAX_RATE_DELTA && stats.ratio < 1.0 + AUDIO_MAX_RATE_DELTA,
+	       "ratio stays within bounds" );
+	check( stats.dropped == 0, "nothing dropped" );
+	check( stats.underruns == 0, "device never underruns" );
+	check( minFill > stats.capacity / 8 && maxFill < stats.capacity - stats.capacity / 8,
+	       "ring neither drains nor fills in steady state" );
+}
+
+/*
+ * audio pipeline self-test
+ */
+int main( int argc, char* argv[] ) {
+	testRing();
+	testResampler();
+	testWavSink();
+	testRateControl();
+	printf( "\n%d failure(s)\n", failures );
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,586 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "accuracy.h"
+#include "cartridge.h"
+#include "coop.h"
+#include "machine.h"
+#include "pipeline.h"
+#include "processor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark suite. Writes JSON to stdout with
+ *
+ *   - host and build: machine, kernel, CPU model, cores, compiler,
+ *     the CPU variant built, whether counters are compiled in, and
+ *     when it was run;
+ *   - handlers: ns per call of every processor.c operation, over
+ *     HANDLER_CALLS calls with varying operands, after a warm-up run,
+ *     as the median, minimum, mean and standard deviation of
+ *     REPEATS runs. "baseline" is the cost of the loop and the call
+ *     through a pointer on its own;
+ *   - mixes: emulated MIPS of the whole machine, PPU included, on
+ *     synthetic programs heavy in arithmetic, memory access and
+ *     branches and calls, stepped with machineStep;
+ *   - sync: ns per coopSwitch, from SWITCHES round trips between two
+ *     threads, and ms per frame of a program that reads and writes PPU
+ *     registers all through the frame, run in lockstep with
+ *     machineRunFrame and in accuracy mode, with the switches accuracy
+ *     mode took per frame, and pipelined with the picture drawn on a
+ *     second thread;
+ *   - roms: MIPS on each ROM given, stepped the same way for the
+ *     cycles of ROM_FRAMES frames, frames per second run whole with
+ *     idle loops skipped as a player would, and frames per second drawn
+ *     in accuracy mode, with machineRunFrame and pipelined.
+ *
+ *     benchmark [rom.nes ...] > results.json
+ *
+ * make bench builds and runs it with the ROMs in BENCH_ROMS.
+ */
+
+#if CPU_VARIANT == CPU_NMOS
+#define CPU_NAME "NMOS"
+#elif CPU_VARIANT == CPU_65C02
+#define CPU_NAME "65C02"
+#else
+#define CPU_NAME "2A03"
+#endif
+
+#define REPEATS (9)
+#define HANDLER_CALLS (1000000UL)
+#define MIX_INSTRUCTIONS (2000000UL)
+#define ROM_FRAMES (300)
+#define SWITCHES (1000000UL)
+#define SYNC_FRAMES (60)
+
+/*the registers and memory handlers are run on*/
+typedef struct {
+	char a;
+	char x;
+	char y;
+	char p;
+	unsigned char sp;
+	unsigned short int pc;
+	Memory mem;
+} Cpu6502;
+
+typedef void (*Handler)( Cpu6502* c, unsigned long i );
+
+typedef struct {
+	const char* name;
+	Handler run;
+} Bench;
+
+static void runBaseline( Cpu6502* c, unsigned long i ) { }
+static void runAdc( Cpu6502* c, unsigned long i ) { adc( &c->a, &c->p, i ); }
+static void runAnd( Cpu6502* c, unsigned long i ) { and( &c->a, &c->p, i | 0x80 ); }
+static void runAsl( Cpu6502* c, unsigned long i ) { asl( &c->a, &c->p ); }
+static void runBcc( Cpu6502* c, unsigned long i ) { bcc( &c->pc, i, i ); }
+static void runBcs( Cpu6502* c, unsigned long i ) { bcs( &c->pc, i, i ); }
+static void runBeq( Cpu6502* c, unsigned long i ) { beq( &c->pc, i, i ); }
+static void runBit( Cpu6502* c, unsigned long i ) { bit( c->a, &c->p, i ); }
+static void runBmi( Cpu6502* c, unsigned long i ) { bmi( &c->pc, i, i ); }
+static void runBne( Cpu6502* c, unsigned long i ) { bne( &c->pc, i, i ); }
+static void runBpl( Cpu6502* c, unsigned long i ) { bpl( &c->pc, i, i ); }
+static void runBrk( Cpu6502* c, unsigned long i ) { brk( &c->pc, &c->p, &c->sp, &c->mem ); }
+static void runBvc( Cpu6502* c, unsigned long i ) { bvc( &c->pc, i, i ); }
+static void runBvs( Cpu6502* c, unsigned long i ) { bvs( &c->pc, i, i ); }
+static void runClc( Cpu6502* c, unsigned long i ) { clc( &c->p ); }
+static void runCld( Cpu6502* c, unsigned long i ) { cld( &c->p ); }
+static void runCli( Cpu6502* c, unsigned long i ) { cli( &c->p ); }
+static void runClv( Cpu6502* c, unsigned long i ) { clv( &c->p ); }
+static void runCmp( Cpu6502* c, unsigned long i ) { cmp( c->a, &c->p, i ); }
+static void runCpx( Cpu6502* c, unsigned long i ) { cpx( c->x, &c->p, i ); }
+static void runCpy( Cpu6502* c, unsigned long i ) { cpy( c->y, &c->p, i ); }
+static void runDec( Cpu6502* c, unsigned long i ) { dec( &c->mem.data[ i & 0x7FF ], &c->p ); }
+static void runDex( Cpu6502* c, unsigned long i ) { dex( &c->x, &c->p ); }
+static void runDey( Cpu6502* c, unsigned long i ) { dey( &c->y, &c->p ); }
+static void runEor( Cpu6502* c, unsigned long i ) { eor( &c->a, &c->p, i ); }
+static void runInc( Cpu6502* c, unsigned long i ) { inc( &c->mem.data[ i & 0x7FF ], &c->p ); }
+static void runInx( Cpu6502* c, unsigned long i ) { inx( &c->x, &c->p ); }
+static void runIny( Cpu6502* c, unsigned long i ) { iny( &c->y, &c->p ); }
+static void runJmp( Cpu6502* c, unsigned long i ) { jmp( &c->pc, i ); }
+static void runJsr( Cpu6502* c, unsigned long i ) { jsr( &c->pc, i, &c->sp, &c->mem ); }
+static void runLda( Cpu6502* c, unsigned long i ) { lda( &c->a, &c->p, i ); }
+static void runLdx( Cpu6502* c, unsigned long i ) { ldx( &c->x, &c->p, i ); }
+static void runLdy( Cpu6502* c, unsigned long i ) { ldy( &c->y, &c->p, i ); }
+static void runLsr( Cpu6502* c, unsigned long i ) { c->a ^= i; lsr( &c->a, &c->p ); }
+static void runNop( Cpu6502* c, unsigned long i ) { nop(); }
+static void runOra( Cpu6502* c, unsigned long i ) { ora( &c->a, &c->p, i & 0x7F ); }
+static void runPha( Cpu6502* c, unsigned long i ) { pha( c->a, &c->sp, &c->mem ); }
+static void runPhp( Cpu6502* c, unsigned long i ) { php( c->p, &c->sp, &c->mem ); }
+static void runPla( Cpu6502* c, unsigned long i ) { pla( &c->a, &c->p, &c->sp, &c->mem ); }
+static void runPlp( Cpu6502* c, unsigned long i ) { plp( &c->p, &c->sp, &c->mem ); }
+static void runRol( Cpu6502* c, unsigned long i ) { rol( &c->a, &c->p ); }
+static void runRor( Cpu6502* c, unsigned long i ) { ror( &c->a, &c->p ); }
+static void runRti( Cpu6502* c, unsigned long i ) { rti( &c->pc, &c->sp, &c->p, &c->mem ); }
+static void runRts( Cpu6502* c, unsigned long i ) { rts( &c->pc, &c->sp, &c->mem ); }
+static void runSbc( Cpu6502* c, unsigned long i ) { sbc( &c->a, &c->p, i ); }
+static void runSec( Cpu6502* c, unsigned long i ) { sec( &c->p ); }
+static void runSed( Cpu6502* c, unsigned long i ) { sed( &c->p ); }
+static void runSei( Cpu6502* c, unsigned long i ) { sei( &c->p ); }
+static void runSta( Cpu6502* c, unsigned long i ) { sta( c->a, &c->mem.data[ i & 0x7FF ] ); }
+static void runStx( Cpu6502* c, unsigned long i ) { stx( c->x, &c->mem.data[ i & 0x7FF ] ); }
+static void runSty( Cpu6502* c, unsigned long i ) { sty( c->y, &c->mem.data[ i & 0x7FF ] ); }
+static void runTax( Cpu6502* c, unsigned long i ) { tax( c->a, &c->p, &c->x ); }
+static void runTay( Cpu6502* c, unsigned long i ) { tay( c->a, &c->p, &c->y ); }
+static void runTsx( Cpu6502* c, unsigned long i ) { tsx( c->sp, &c->p, &c->x ); }
+static void runTxa( Cpu6502* c, unsigned long i ) { txa( c->x, &c->p, &c->a ); }
+static void runTxs( Cpu6502* c, unsigned long i ) { txs( c->x, &c->p, (char*)&c->sp ); }
+static void runTya( Cpu6502* c, unsigned long i ) { tya( c->y, &c->p, &c->a ); }
+
+static const Bench handlers[] = {
+	{ "baseline", runBaseline },
+	{ "adc", runAdc }, { "and", runAnd }, { "asl", runAsl }, { "bcc", runBcc }, { "bcs", runBcs },
+	{ "beq", runBeq }, { "bit", runBit }, { "bmi", runBmi }, { "bne", runBne }, { "bpl", runBpl },
+	{ "brk", runBrk }, { "bvc", runBvc }, { "bvs", runBvs }, { "clc", runClc }, { "cld", runCld },
+	{ "cli", runCli }, { "clv", runClv }, { "cmp", runCmp }, { "cpx", runCpx }, { "cpy", runCpy },
+	{ "dec", runDec }, { "dex", runDex }, { "dey", runDey }, { "eor", runEor }, { "inc", runInc },
+	{ "inx", runInx }, { "iny", runIny }, { "jmp", runJmp }, { "jsr", runJsr }, { "lda", runLda },
+	{ "ldx", runLdx }, { "ldy", runLdy }, { "lsr", runLsr }, { "nop", runNop }, { "ora", runOra },
+	{ "pha", runPha }, { "php", runPhp }, { "pla", runPla }, { "plp", runPlp }, { "rol", runRol },
+	{ "ror", runRor }, { "rti", runRti }, { "rts", runRts }, { "sbc", runSbc }, { "sec", runSec },
+	{ "sed", runSed }, { "sei", runSei }, { "sta", runSta }, { "stx", runStx }, { "sty", runSty },
+	{ "tax", runTax }, { "tay", runTay }, { "tsx", runTsx }, { "txa", runTxa }, { "txs", runTxs },
+	{ "tya", runTya }
+};
+
+/*
+ * Synthetic programs at $C000, looping for ever with NMIs off. Each
+ * starts by pointing ($10) at $0300.
+ */
+static const unsigned char arithmetic[] = {
+	0xA9, 0x00, 0x85, 0x10, 0xA9, 0x03, 0x85, 0x11, /*C000 ($10) = $0300*/
+	0xA5, 0x00, 0x69, 0x03, 0x45, 0x01, 0x85, 0x00, /*C008 lda $00 adc #3 eor $01 sta $00*/
+	0x0A, 0x66, 0x02, 0xE8, 0x88, 0xE9, 0x11,       /*C010 asl ror $02 inx dey sbc #$11*/
+	0x29, 0x7F, 0x09, 0x01, 0xC9, 0x40, 0x2A, 0x4A, /*C017 and #$7F ora #1 cmp #$40 rol lsr*/
+	0x4C, 0x08, 0xC0                                /*C01F jmp C008*/
+};
+
+static const unsigned char memory[] = {
+	0xA9, 0x00, 0x85, 0x10, 0xA9, 0x03, 0x85, 0x11, /*C000 ($10) = $0300*/
+	0xBD, 0x00, 0x02, 0x99, 0x00, 0x04, 0xB1, 0x10, /*C008 lda $0200,x sta $0400,y lda ($10),y*/
+	0x95, 0x20, 0xB4, 0x40, 0x96, 0x60, 0xE6, 0x30, /*C010 sta $20,x ldy $40,x stx $60,y inc $30*/
+	0xAE, 0x00, 0x05, 0x8D, 0x00, 0x06, 0xE8, 0xC8, /*C018 ldx $0500 stx $0600 inx iny*/
+	0x4C, 0x08, 0xC0                                /*C020 jmp C008*/
+};
+
+static const unsigned char branches[] = {
+	0xA9, 0x00, 0x85, 0x10, 0xA9, 0x03, 0x85, 0x11, /*C000 ($10) = $0300*/
+	0xA2, 0x08,                                     /*C008 ldx #8*/
+	0x20, 0x20, 0xC0, 0xCA, 0xD0, 0xFA,             /*C00A jsr C020 dex bne C00A*/
+	0x48, 0x08, 0x28, 0x68, 0x30, 0x02, 0x10, 0x00, /*C010 pha php plp pla bmi C018 bpl C018*/
+	0x4C, 0x08, 0xC0, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, /*C018 jmp C008*/
+	0xE6, 0x00, 0xA5, 0x00, 0x29, 0x03, 0xF0, 0x01, /*C020 inc $00 lda $00 and #3 beq C029*/
+	0xEA, 0x60                                      /*C028 nop rts*/
+};
+
+/*
+ * Rendering on and NMIs off, then the scroll is written and $2002 read
+ * every 29 cycles: each access makes accuracy mode catch the PPU up.
+ */
+static const unsigned char raster[] = {
+	0x78, 0xA2, 0xFF, 0x9A,                         /*C000 sei ldx #$FF txs*/
+	0x2C, 0x02, 0x20, 0x10, 0xFB,                   /*C004 bit $2002 bpl C004*/
+	0x2C, 0x02, 0x20, 0x10, 0xFB,                   /*C009 bit $2002 bpl C009*/
+	0xA9, 0x1E, 0x8D, 0x01, 0x20,                   /*C00E rendering on*/
+	0xE8, 0x8E, 0x05, 0x20, 0xAD, 0x02, 0x20,       /*C013 inx stx $2005 lda $2002*/
+	0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, /*C01A nop x 8*/
+	0x4C, 0x13, 0xC0                                /*C022 jmp C013*/
+};
+
+static const struct {
+	const char* name;
+	const unsigned char* program;
+	unsigned long size;
+} mixes[] = {
+	{ "arithmetic", arithmetic, sizeof( arithmetic ) },
+	{ "memory", memory, sizeof( memory ) },
+	{ "branches", branches, sizeof( branches ) }
+};
+
+typedef struct {
+	double median;
+	double min;
+	double mean;
+	double stddev;
+} Stats;
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int ascending( const void* a, const void* b ) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static Stats summarise( double* samples, int count ) {
+	Stats s;
+	int i;
+
+	qsort( samples, count, sizeof( double ), ascending );
+	s.median = samples[ count / 2 ];
+	s.min = samples[ 0 ];
+	s.mean = 0;
+	for( i = 0; i < count; i++ ) {
+		s.mean += samples[ i ] / count;
+	}
+	s.stddev = 0;
+	for( i = 0; i < count; i++ ) {
+		s.stddev += (samples[ i ] - s.mean) * (samples[ i ] - s.mean) / count;
+	}
+	s.stddev = sqrt( s.stddev );
+	return s;
+}
+
+static void writeString( const char* text ) {
+	putchar( '"' );
+	for( ; *text; text++ ) {
+		if( *text == '"' || *text == '\\' ) {
+			printf( "\\%c", *text );
+		} else if( (unsigned char)*text < 0x20 ) {
+			printf( "\\u%04x", *text );
+		} else {
+			putchar( *text );
+		}
+	}
+	putchar( '"' );
+}
+
+static void writeStats( const Stats* s ) {
+	printf( "{ \"median\": %.4f, \"min\": %.4f, \"mean\": %.4f, \"stddev\": %.4f }", s->median, s->min, s->mean,
+	        s->stddev );
+}
+
+static void cpuModel( char* model, int size ) {
+	FILE* file = fopen( "/proc/cpuinfo", "r" );
+	char line[ 256 ], *colon;
+
+	strcpy( model, "unknown" );
+	if( file == NULL ) {
+		return;
+	}
+	while( fgets( line, sizeof( line ), file ) != NULL ) {
+		colon = strchr( line, ':' );
+		if( strncmp( line, "model name", 10 ) == 0 && colon != NULL ) {
+			strncpy( model, colon + 2, size - 1 );
+			model[ size - 1 ] = '\0';
+			model[ strcspn( model, "\n" ) ] = '\0';
+			break;
+		}
+	}
+	fclose( file );
+}
+
+static void writeHost( void ) {
+	struct utsname host;
+	char model[ 128 ], date[ 32 ];
+	time_t t = time( NULL );
+
+	uname( &host );
+	cpuModel( model, sizeof( model ) );
+	strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%SZ", gmtime( &t ) );
+	printf( "  \"host\": { \"machine\": " );
+	writeString( host.machine );
+	printf( ", \"system\": " );
+	writeString( host.sysname );
+	printf( ", \"release\": " );
+	writeString( host.release );
+	printf( ", \"cpu\": " );
+	writeString( model );
+	printf( ", \"cores\": %ld },\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+	printf( "  \"build\": { \"compiler\": " );
+	writeString( __VERSION__ );
+	printf( ", \"cpu\": \"%s\"", CPU_NAME );
+#ifdef __OPTIMIZE__
+	printf( ", \"optimized\": true" );
+#else
+	printf( ", \"optimized\": false" );
+#endif
+#ifdef COUNTERS
+	printf( ", \"counters\": true },\n" );
+#else
+	printf( ", \"counters\": false },\n" );
+#endif
+	printf( "  \"date\": \"%s\",\n", date );
+}
+
+static void benchHandlers( void ) {
+	static Cpu6502 c;
+	double samples[ REPEATS ], start;
+	Stats stats;
+	unsigned long i;
+	int h, r;
+
+	printf( "  \"handlers\": {\n" );
+	for( h = 0; h < (int)(sizeof( handlers ) / sizeof( handlers[ 0 ] )); h++ ) {
+		for( r = -1; r < REPEATS; r++ ) {
+			start = now();
+			for( i = 0; i < HANDLER_CALLS; i++ ) {
+				handlers[ h ].run( &c, i );
+			}
+			if( r >= 0 ) {
+				samples[ r ] = (now() - start) * 1e9 / HANDLER_CALLS;
+			}
+		}
+		stats = summarise( samples, REPEATS );
+		printf( "    \"%s\": ", handlers[ h ].name );
+		writeStats( &stats );
+		printf( "%s\n", h + 1 < (int)(sizeof( handlers ) / sizeof( handlers[ 0 ] )) ? "," : "" );
+	}
+	printf( "  },\n" );
+}
+
+static void buildCartridge( Cartridge* cart, const unsigned char* program, unsigned long size ) {
+	static unsigned char image[ 16 + 0x4000 + 0x2000 ];
+	unsigned char* prg = image + 16;
+	char error[ 128 ];
+
+	memset( image, 0, sizeof( image ) );
+	memcpy( image, "NES\x1A\x01\x01\x01\x00", 8 );
+	memcpy( prg, program, size );
+	prg[ 0x3FFA ] = 0x00; prg[ 0x3FFB ] = 0xC0;
+	prg[ 0x3FFC ] = 0x00; prg[ 0x3FFD ] = 0xC0;
+	prg[ 0x3FFE ] = 0x00; prg[ 0x3FFF ] = 0xC0;
+	if( cartridgeParse( cart, image, sizeof( image ), error ) != 0 ) {
+		fprintf( stderr, "cannot build cartridge: %s\n", error );
+		exit( 1 );
+	}
+}
+
+/*MIPS stepping m for instructions, or for as many cycles as frames take if that is nonzero*/
+static double mips( Machine* m, unsigned long instructions, unsigned long frames ) {
+	unsigned long count = 0, last = m->cycles + frames * (PPU_SCANLINES * PPU_DOTS / 3);
+	double start = now();
+
+	m->idleSkip = 0;
+	while( frames ? m->cycles < last : count < instructions ) {
+		machineStep( m, NULL );
+		count++;
+	}
+	return count / (now() - start) / 1e6;
+}
+
+static void benchMixes( void ) {
+	static Machine m;
+	double samples[ REPEATS ];
+	Cartridge cart;
+	Stats stats;
+	int x, r;
+
+	printf( "  \"mixes\": {\n" );
+	for( x = 0; x < (int)(sizeof( mixes ) / sizeof( mixes[ 0 ] )); x++ ) {
+		buildCartridge( &cart, mixes[ x ].program, mixes[ x ].size );
+		machinePower( &m, &cart );
+		mips( &m, MIX_INSTRUCTIONS / 10, 0 );
+		for( r = 0; r < REPEATS; r++ ) {
+			samples[ r ] = mips( &m, MIX_INSTRUCTIONS, 0 );
+		}
+		stats = summarise( samples, REPEATS );
+		printf( "    \"%s\": { \"mips\": ", mixes[ x ].name );
+		writeStats( &stats );
+		printf( " }%s\n", x + 1 < (int)(sizeof( mixes ) / sizeof( mixes[ 0 ] )) ? "," : "" );
+		cartridgeFree( &cart );
+	}
+	printf( "  },\n" );
+}
+
+static CoopThread benchHost, benchThread;
+
+static void bounce( void* context ) {
+	for( ;; ) {
+		coopSwitch( &benchThread, &benchHost );
+	}
+}
+
+/*ms per frame drawn over SYNC_FRAMES frames, in accuracy mode or pipelined if given one*/
+static double frameTime( Machine* m, Accuracy* accuracy, Pipeline* pipeline ) {
+	static unsigned char frame[ PPU_FRAME_SIZE ];
+	double start = now();
+	int i;
+
+	for( i = 0; i < SYNC_FRAMES; i++ ) {
+		if( accuracy != NULL ) {
+			accuracyRunFrame( accuracy, frame );
+		} else if( pipeline != NULL ) {
+			pipelineRunFrame( pipeline, frame );
+		} else {
+			machineRunFrame( m, frame );
+		}
+	}
+	return (now() - start) * 1e3 / SYNC_FRAMES;
+}
+
+static void benchSync( void ) {
+	static Machine m;
+	double samples[ REPEATS ], start;
+	Accuracy* accuracy;
+	Pipeline* pipeline;
+	Cartridge cart;
+	Stats stats;
+	unsigned long i, switches;
+	int r;
+
+	if( coopCreate( &benchThread, 64 * 1024, bounce, NULL ) != 0 ) {
+		fprintf( stderr, "out of memory\n" );
+		exit( 1 );
+	}
+	for( r = -1; r < REPEATS; r++ ) {
+		start = now();
+		for( i = 0; i < SWITCHES; i++ ) {
+			coopSwitch( &benchHost, &benchThread );
+		}
+		if( r >= 0 ) {
+			samples[ r ] = (now() - start) * 1e9 / (2 * SWITCHES);
+		}
+	}
+	coopFree( &benchThread );
+	stats = summarise( samples, REPEATS );
+	printf( "  \"sync\": { \"switch_ns\": " );
+	writeStats( &stats );
+
+	buildCartridge( &cart, raster, sizeof( raster ) );
+	machinePower( &m, &cart );
+	m.idleSkip = 0;
+	frameTime( &m, NULL, NULL );
+	for( r = 0; r < REPEATS; r++ ) {
+		samples[ r ] = frameTime( &m, NULL, NULL );
+	}
+	stats = summarise( samples, REPEATS );
+	printf( ",\n    \"raster\": { \"lockstep_ms\": " );
+	writeStats( &stats );
+
+	machinePower( &m, &cart );
+	accuracy = accuracyCreate( &m );
+	if( accuracy == NULL ) {
+		fprintf( stderr, "out of memory\n" );
+		exit( 1 );
+	}
+	frameTime( &m, accuracy, NULL );
+	switches = accuracy->switches;
+	for( r = 0; r < REPEATS; r++ ) {
+		samples[ r ] = frameTime( &m, accuracy, NULL );
+	}
+	switches = (accuracy->switches - switches) / (REPEATS * SYNC_FRAMES);
+	stats = summarise( samples, REPEATS );
+	printf( ", \"accuracy_ms\": " );
+	writeStats( &stats );
+	printf( ", \"switches\": %lu", switches );
+	accuracyFree( accuracy );
+
+	machinePower( &m, &cart );
+	pipeline = pipelineCreate( &m );
+	if( pipeline == NULL ) {
+		fprintf( stderr, "cannot start the render thread\n" );
+		exit( 1 );
+	}
+	frameTime( &m, NULL, pipeline );
+	for( r = 0; r < REPEATS; r++ ) {
+		samples[ r ] = frameTime( &m, NULL, pipeline );
+	}
+	stats = summarise( samples, REPEATS );
+	printf( ", \"pipelined_ms\": " );
+	writeStats( &stats );
+	printf( " } },\n" );
+	pipelineFree( pipeline );
+	cartridgeFree( &cart );
+}
+
+static void benchRoms( int count, char* paths[] ) {
+	static Machine m;
+	double samples[ 3 ], start;
+	char error[ 128 ];
+	Accuracy* accuracy;
+	Pipeline* pipeline;
+	Cartridge cart;
+	Stats stats;
+	int i, r, first = 1;
+
+	printf( "  \"roms\": {" );
+	for( i = 0; i < count; i++ ) {
+		if( cartridgeLoad( &cart, paths[ i ], error ) != 0 ) {
+			fprintf( stderr, "%s: %s\n", paths[ i ], error );
+			continue;
+		}
+		printf( "%s\n    ", first ? "" : "," );
+		first = 0;
+		writeString( paths[ i ] );
+		for( r = 0; r < 3; r++ ) {
+			machinePower( &m, &cart );
+			samples[ r ] = mips( &m, 0, ROM_FRAMES );
+		}
+		stats = summarise( samples, 3 );
+		printf( ": { \"frames\": %d, \"mips\": ", ROM_FRAMES );
+		writeStats( &stats );
+
+		for( r = 0; r < 3; r++ ) {
+			machinePower( &m, &cart );
+			start = now();
+			machineFastForward( &m, ROM_FRAMES );
+			samples[ r ] = ROM_FRAMES / (now() - start);
+		}
+		stats = summarise( samples, 3 );
+		printf( ", \"fps\": " );
+		writeStats( &stats );
+
+		for( r = 0; r < 3; r++ ) {
+			machinePower( &m, &cart );
+			accuracy = accuracyCreate( &m );
+			if( accuracy == NULL ) {
+				fprintf( stderr, "out of memory\n" );
+				exit( 1 );
+			}
+			samples[ r ] = 1e3 / frameTime( &m, accuracy, NULL );
+			accuracyFree( accuracy );
+		}
+		stats = summarise( samples, 3 );
+		printf( ", \"accuracy_fps\": " );
+		writeStats( &stats );
+
+		for( r = 0; r < 3; r++ ) {
+			machinePower( &m, &cart );
+			samples[ r ] = 1e3 / frameTime( &m, NULL, NULL );
+		}
+		stats = summarise( samples, 3 );
+		printf( ", \"drawn_fps\": " );
+		writeStats( &stats );
+
+		for( r = 0; r < 3; r++ ) {
+			machinePower( &m, &cart );
+			pipeline = pipelineCreate( &m );
+			if( pipeline == NULL ) {
+				fprintf( stderr, "cannot start the render thread\n" );
+				exit( 1 );
+			}
+			samples[ r ] = 1e3 / frameTime( &m, NULL, pipeline );
+			pipelineFree( pipeline );
+		}
+		stats = summarise( samples, 3 );
+		printf( ", \"pipelined_fps\": " );
+		writeStats( &stats );
+		printf( " }" );
+		cartridgeFree( &cart );
+	}
+	printf( "%s}\n", first ? "" : "\n  " );
+}
+
+int main( int argc, char* argv[] ) {
+	printf( "{\n" );
+	writeHost();
+	benchHandlers();
+	benchMixes();
+	benchSync();
+	benchRoms( argc - 1, argv + 1 );
+	printf( "}\n" );
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "breakpoint.h"
+
+#include <string.h>
+
+/*the address a mirror stands for*/
+static unsigned short int canonical( unsigned short int addr ) {
+	if( addr < 0x2000 ) {
+		return addr & (RAM_SIZE - 1);
+	}
+	if( addr < 0x4000 ) {
+		return addr & 0x2007;
+	}
+	return addr;
+}
+
+static int bitIndex( int kind ) {
+	return kind == BREAK_EXECUTE ? 0 : kind == BREAK_READ ? 1 : 2;
+}
+
+/*recompute the flags of the page holding canonical address addr, and of its mirrors*/
+static void flagPage( Breakpoints* b, unsigned short int addr ) {
+	int page = addr >> 8, kind, i, flags = 0;
+
+	for( kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1 ) {
+		for( i = 0; i < 32; i++ ) {
+			if( b->bits[ bitIndex( kind ) ][ page * 32 + i ] != 0 ) {
+				flags |= kind;
+				break;
+			}
+		}
+	}
+	if( addr < 0x2000 ) {
+		for( i = page; i < 0x20; i += RAM_SIZE >> 8 ) {
+			b->pages[ i ] = flags;
+		}
+	} else if( addr < 0x4000 ) {
+		for( i = 0x20; i < 0x40; i++ ) {
+			b->pages[ i ] = flags;
+		}
+	} else {
+		b->pages[ page ] = flags;
+	}
+}
+
+void breakpointsInit( Breakpoints* b ) {
+	memset( b, 0, sizeof( Breakpoints ) );
+}
+
+void breakpointSet( Breakpoints* b, unsigned short int addr, int kinds ) {
+	int kind;
+
+	addr = canonical( addr );
+	for( kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1 ) {
+		if( kinds & kind ) {
+			b->bits[ bitIndex( kind ) ][ addr >> 3 ] |= 1 << (addr & 7);
+		}
+	}
+	flagPage( b, addr );
+}
+
+void breakpointClear( Breakpoints* b, unsigned short int addr, int kinds ) {
+	int kind;
+
+	addr = canonical( addr );
+	for( kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1 ) {
+		if( kinds & kind ) {
+			b->bits[ bitIndex( kind ) ][ addr >> 3 ] &= ~(1 << (addr & 7));
+		}
+	}
+	flagPage( b, addr );
+}
+
+int breakpointTest( const Breakpoints* b, unsigned short int addr, int kinds ) {
+	int kind;
+
+	addr = canonical( addr );
+	for( kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1 ) {
+		if( (kinds & kind) && (b->bits[ bitIndex( kind ) ][ addr >> 3 ] & (1 << (addr & 7))) ) {
+			return 1;
+		}
+	}
+	return 0;
+}
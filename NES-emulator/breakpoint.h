@@ -0,0 +1,67 @@
+#ifndef BREAKPOINT_H
+#define BREAKPOINT_H
+
+#include "machine.h"
+
+/*kinds of break, which can be combined*/
+#define BREAK_EXECUTE (0x01)
+#define BREAK_READ (0x02)
+#define BREAK_WRITE (0x04)
+
+typedef struct {
+	int kind;
+	unsigned short int addr;
+	unsigned char value;
+
+	/*the instruction that was about to run, or that made the access*/
+	unsigned short int pc;
+} BreakHit;
+
+/*
+ * Execute breakpoints and read/write watchpoints on CPU addresses. A
+ * watch on RAM or a PPU register also catches its mirrors. Accesses
+ * the CPU makes on the bus are watched; instruction fetches, pushes
+ * and pulls are not.
+ *
+ * Each kind has a bit per address, and each 256 byte page a byte of
+ * the kinds set anywhere in it. The CPU and bus only look at the page
+ * byte and go to the bitmap for flagged pages, and with no table
+ * attached they do not look at all. Idle loops are still skipped
+ * unless they touch a flagged page.
+ *
+ * An execute breakpoint stops the machine before the instruction, a
+ * watchpoint after the instruction making the access. Running on from
+ * a stop does not break again on the instruction it stopped at.
+ */
+typedef struct {
+	unsigned char pages[ 256 ];
+	unsigned char bits[ 3 ][ 0x10000 / 8 ];
+
+	BreakHit hit;
+	unsigned long hits;
+
+	/*used while running: the instruction being run, skip its check, stop after it*/
+	unsigned short int pc;
+	unsigned char resume;
+	unsigned char stop;
+} Breakpoints;
+
+void breakpointsInit( Breakpoints* b );
+
+void breakpointSet( Breakpoints* b, unsigned short int addr, int kinds );
+
+void breakpointClear( Breakpoints* b, unsigned short int addr, int kinds );
+
+/*whether one of kinds is set at addr or a mirror of it*/
+int breakpointTest( const Breakpoints* b, unsigned short int addr, int kinds );
+
+/*
+ * Attach b to the calling thread, or detach with NULL. Like observers,
+ * it applies to every machine run on the thread. Stopping works as
+ * for an observer: machineRunFrame returns nonzero and machineStep 0.
+ * A watchpoint hit by the instruction that ends a frame does not stop
+ * it, but is recorded in hit all the same.
+ */
+void machineBreakpoints( Breakpoints* b );
+
+#endif
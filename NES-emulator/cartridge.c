@@ -0,0 +1,97 @@
+#include "cartridge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INES_HEADER (16)
+#define INES_TRAINER (512)
+
+int cartridgeParse( Cartridge* cart, const unsigned char* image, unsigned long size, char* error ) {
+	unsigned long offset = INES_HEADER;
+
+	memset( cart, 0, sizeof( *cart ) );
+	if( size < INES_HEADER || memcmp( image, "NES\x1A", 4 ) != 0 ) {
+		strcpy( error, "not an iNES image" );
+		return -1;
+	}
+
+	cart->prgSize = image[ 4 ] * (unsigned long)CARTRIDGE_PRG_BANK;
+	cart->chrSize = image[ 5 ] * (unsigned long)CARTRIDGE_CHR_BANK;
+	cart->mapper = (image[ 6 ] >> 4) | (image[ 7 ] & 0xF0);
+	cart->mirroring = (image[ 6 ] & 0x01) ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+	cart->battery = (image[ 6 ] & 0x02) != 0;
+
+	/*some dumping tools leave junk in bytes 7-15; trust only the low nibble then*/
+	if( memcmp( image + 12, "\0\0\0\0", 4 ) != 0 ) {
+		cart->mapper &= 0x0F;
+	}
+
+	if( cart->mapper != 0 ) {
+		sprintf( error, "mapper %d is not supported", cart->mapper );
+		return -1;
+	}
+	if( cart->prgSize != CARTRIDGE_PRG_BANK && cart->prgSize != 2 * CARTRIDGE_PRG_BANK ) {
+		sprintf( error, "NROM needs 16 or 32 KB of PRG-ROM, image has %lu", cart->prgSize );
+		return -1;
+	}
+	if( cart->chrSize > CARTRIDGE_CHR_BANK ) {
+		sprintf( error, "NROM has at most 8 KB of CHR-ROM, image has %lu", cart->chrSize );
+		return -1;
+	}
+
+	if( image[ 6 ] & 0x04 ) {
+		offset += INES_TRAINER;
+	}
+	if( size < offset + cart->prgSize + cart->chrSize ) {
+		strcpy( error, "image is truncated" );
+		return -1;
+	}
+
+	cart->prg = malloc( cart->prgSize );
+	cart->chr = malloc( cart->chrSize ? cart->chrSize : 1 );
+	if( cart->prg == NULL || cart->chr == NULL ) {
+		cartridgeFree( cart );
+		strcpy( error, "out of memory" );
+		return -1;
+	}
+	memcpy( cart->prg, image + offset, cart->prgSize );
+	memcpy( cart->chr, image + offset + cart->prgSize, cart->chrSize );
+	return 0;
+}
+
+int cartridgeLoad( Cartridge* cart, const char* path, char* error ) {
+	FILE* file;
+	unsigned char* image;
+	long size;
+	int result;
+
+	file = fopen( path, "rb" );
+	if( file == NULL ) {
+		sprintf( error, "cannot open %.100s", path );
+		return -1;
+	}
+	fseek( file, 0, SEEK_END );
+	size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	image = malloc( size > 0 ? size : 1 );
+	if( image == NULL || fread( image, 1, size, file ) != (unsigned long)size ) {
+		fclose( file );
+		free( image );
+		sprintf( error, "cannot read %.100s", path );
+		return -1;
+	}
+	fclose( file );
+
+	result = cartridgeParse( cart, image, size, error );
+	free( image );
+	return result;
+}
+
+void cartridgeFree( Cartridge* cart ) {
+	free( cart->prg );
+	free( cart->chr );
+	cart->prg = NULL;
+	cart->chr = NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+#define CARTRIDGE_PRG_BANK (0x4000)
+#define CARTRIDGE_CHR_BANK (0x2000)
+
+#define MIRROR_HORIZONTAL (0)
+#define MIRROR_VERTICAL (1)
+
+/*
+ * A cartridge image as loaded from an iNES file. Only mapper 0 (NROM)
+ * is supported: 16 or 32 KB of PRG-ROM and 8 KB of CHR-ROM or CHR-RAM.
+ */
+typedef struct {
+	unsigned char* prg;
+	unsigned long prgSize;
+	unsigned char* chr;
+	unsigned long chrSize;
+	int mapper;
+	int mirroring;
+	int battery;
+} Cartridge;
+
+/*
+ * Load an iNES file. On failure returns nonzero and leaves a
+ * description in error, which must hold at least 128 bytes.
+ */
+int cartridgeLoad( Cartridge* cart, const char* path, char* error );
+
+/*Same as cartridgeLoad but from an image already in memory*/
+int cartridgeParse( Cartridge* cart, const unsigned char* image, unsigned long size, char* error );
+
+void cartridgeFree( Cartridge* cart );
+
+#endif
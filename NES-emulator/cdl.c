@@ -0,0 +1,128 @@
+#include "cdl.h"
+#include "hash.h"
+
+#include <string.h>
+
+#define HEADER_SIZE (32)
+
+static void put32( unsigned char* p, uint32_t value ) {
+	int i;
+	for( i = 0; i < 4; i++ ) {
+		p[ i ] = value >> (8 * i);
+	}
+}
+
+static uint32_t get32( const unsigned char* p ) {
+	return p[ 0 ] | (p[ 1 ] << 8) | ((uint32_t)p[ 2 ] << 16) | ((uint32_t)p[ 3 ] << 24);
+}
+
+void cdlInit( CodeDataLog* log, const Cartridge* cart ) {
+	memset( log, 0, sizeof( CodeDataLog ) );
+	log->prgSize = cart->prgSize;
+	log->chrSize = cart->chrSize != 0 ? cart->chrSize : CARTRIDGE_CHR_BANK;
+	log->game = hash64( cart->prg, cart->prgSize, 0 );
+}
+
+int cdlSave( const CodeDataLog* log, const char* path, char* error ) {
+	unsigned char header[ HEADER_SIZE ];
+	FILE* file = fopen( path, "wb" );
+	int failed;
+
+	if( file == NULL ) {
+		sprintf( error, "cannot create %.100s", path );
+		return -1;
+	}
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "NESCDLOG", 8 );
+	put32( header + 8, CDL_VERSION );
+	put32( header + 12, log->prgSize );
+	put32( header + 16, log->chrSize );
+	put32( header + 24, (uint32_t)log->game );
+	put32( header + 28, (uint32_t)(log->game >> 32) );
+
+	failed = fwrite( header, sizeof( header ), 1, file ) != 1 ||
+	         fwrite( log->prg, log->prgSize, 1, file ) != 1 ||
+	         fwrite( log->chr, log->chrSize, 1, file ) != 1;
+	failed |= fclose( file ) != 0;
+	if( failed ) {
+		sprintf( error, "cannot write %.100s", path );
+		return -1;
+	}
+	return 0;
+}
+
+int cdlMerge( CodeDataLog* log, const char* path, char* error ) {
+	unsigned char flags[ sizeof( log->prg ) + sizeof( log->chr ) ];
+	unsigned char header[ HEADER_SIZE ];
+	FILE* file = fopen( path, "rb" );
+	unsigned long i, size = log->prgSize + log->chrSize;
+	int read;
+
+	if( file == NULL ) {
+		sprintf( error, "cannot open %.100s", path );
+		return -1;
+	}
+	read = fread( header, sizeof( header ), 1, file ) == 1;
+	if( read && memcmp( header, "NESCDLOG", 8 ) == 0 && get32( header + 8 ) == CDL_VERSION ) {
+		if( get32( header + 12 ) != log->prgSize || get32( header + 16 ) != log->chrSize ||
+		    get32( header + 24 ) != (uint32_t)log->game || get32( header + 28 ) != (uint32_t)(log->game >> 32) ) {
+			fclose( file );
+			sprintf( error, "%.100s is a log of another game", path );
+			return -1;
+		}
+		read = fread( flags, size, 1, file ) == 1;
+	} else {
+		read = -1;
+	}
+	fclose( file );
+
+	if( read < 0 ) {
+		sprintf( error, "%.100s is not a code/data log", path );
+		return -1;
+	}
+	if( !read ) {
+		sprintf( error, "%.100s is truncated", path );
+		return -1;
+	}
+	for( i = 0; i < log->prgSize; i++ ) {
+		log->prg[ i ] |= flags[ i ];
+	}
+	for( i = 0; i < log->chrSize; i++ ) {
+		log->chr[ i ] |= flags[ log->prgSize + i ];
+	}
+	return 0;
+}
+
+static unsigned long count( const unsigned char* bytes, unsigned long size, int flags ) {
+	unsigned long i, n = 0;
+	for( i = 0; i < size; i++ ) {
+		n += (bytes[ i ] & flags) != 0;
+	}
+	return n;
+}
+
+unsigned long cdlCountPrg( const CodeDataLog* log, int flags ) {
+	return count( log->prg, log->prgSize, flags );
+}
+
+unsigned long cdlCountChr( const CodeDataLog* log, int flags ) {
+	return count( log->chr, log->chrSize, flags );
+}
+
+static double percent( unsigned long n, unsigned long size ) {
+	return 100.0 * n / size;
+}
+
+void cdlSummary( const CodeDataLog* log, FILE* out ) {
+	unsigned long code = cdlCountPrg( log, CDL_OPCODE | CDL_OPERAND );
+	unsigned long data = cdlCountPrg( log, CDL_DATA );
+	unsigned long used = cdlCountPrg( log, CDL_OPCODE | CDL_OPERAND | CDL_DATA );
+	unsigned long rendered = cdlCountChr( log, CDL_RENDERED );
+	unsigned long read = cdlCountChr( log, CDL_CHR_READ );
+
+	fprintf( out, "PRG %lu bytes: %lu code (%.1f%%), %lu data (%.1f%%), %lu unused (%.1f%%)\n",
+	         log->prgSize, code, percent( code, log->prgSize ), data, percent( data, log->prgSize ),
+	         log->prgSize - used, percent( log->prgSize - used, log->prgSize ) );
+	fprintf( out, "CHR %lu bytes: %lu rendered (%.1f%%), %lu read (%.1f%%)\n",
+	         log->chrSize, rendered, percent( rendered, log->chrSize ), read, percent( read, log->chrSize ) );
+}
@@ -0,0 +1,70 @@
+#ifndef CDL_H
+#define CDL_H
+
+#include "cartridge.h"
+#include "machine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*what a PRG byte has been used as, which can be combined*/
+#define CDL_OPCODE (0x01)
+#define CDL_OPERAND (0x02)
+#define CDL_DATA (0x04)
+
+/*what a CHR byte has been used as*/
+#define CDL_RENDERED PPU_CHR_RENDERED
+#define CDL_CHR_READ PPU_CHR_READ
+
+#define CDL_VERSION (1)
+
+/*
+ * Code/data log: a byte of flags for every byte of the cartridge's
+ * PRG-ROM and CHR, saying how the game has used it. PRG bytes are
+ * marked as they are fetched as an opcode or operand or read as data
+ * by the CPU, including the bytes of idle loops the machine skips over.
+ * Reads made from the host with machineRead are not marked. CHR bytes
+ * are marked as in ppuLogChr.
+ *
+ * Flags are only ever set, so logs of the same game taken in separate
+ * sessions combine by or-ing them together.
+ */
+typedef struct {
+	unsigned char prg[ 2 * CARTRIDGE_PRG_BANK ];
+	unsigned char chr[ CARTRIDGE_CHR_BANK ];
+	unsigned long prgSize;
+	unsigned long chrSize;
+
+	/*hash64 of the PRG-ROM, so a log is not merged into another game's*/
+	uint64_t game;
+} CodeDataLog;
+
+/*an empty log for cart*/
+void cdlInit( CodeDataLog* log, const Cartridge* cart );
+
+/*
+ * Write the log to path, or merge a log saved earlier into it. On failure
+ * these return nonzero and leave a description in error, which must
+ * hold at least 128 bytes. cdlMerge refuses a log of another game.
+ */
+int cdlSave( const CodeDataLog* log, const char* path, char* error );
+
+int cdlMerge( CodeDataLog* log, const char* path, char* error );
+
+/*bytes of PRG (or CHR) with any of flags set*/
+unsigned long cdlCountPrg( const CodeDataLog* log, int flags );
+
+unsigned long cdlCountChr( const CodeDataLog* log, int flags );
+
+/*how much of the cartridge has been seen in use, one line each for PRG and CHR*/
+void cdlSummary( const CodeDataLog* log, FILE* out );
+
+/*
+ * Attach log to the calling thread, or detach with NULL. Like observers
+ * it applies to every machine run on the thread, which must all have
+ * the log's cartridge inserted. Every fetch and data read tests for a
+ * log, attached or not; marking only costs more while one is attached.
+ */
+void machineLog( CodeDataLog* log );
+
+#endif
@@ -0,0 +1,88 @@
+#include "compact.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CART_RAM (0x6000)
+#define CART_RAM_SIZE (0x2000)
+
+struct CompactMachine {
+	unsigned char head[ MACHINE_SNAPSHOT_HEAD ];
+	char ram[ RAM_SIZE ];
+
+	/*NULL for CHR-ROM, and until the game writes to $6000-$7FFF*/
+	unsigned char* chr;
+	char* cartRam;
+};
+
+static int used( const char* data, unsigned long size ) {
+	unsigned long i;
+	for( i = 0; i < size; i++ ) {
+		if( data[ i ] != 0 ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+CompactMachine* compactCreate( const Machine* m ) {
+	CompactMachine* c = calloc( 1, sizeof( CompactMachine ) );
+
+	if( c == NULL ) {
+		return NULL;
+	}
+	if( m->ppu.chrWritable ) {
+		c->chr = malloc( sizeof( m->ppu.chr ) );
+		if( c->chr == NULL ) {
+			free( c );
+			return NULL;
+		}
+	}
+	if( compactStore( c, m ) != 0 ) {
+		compactFree( c );
+		return NULL;
+	}
+	return c;
+}
+
+void compactFree( CompactMachine* c ) {
+	free( c->chr );
+	free( c->cartRam );
+	free( c );
+}
+
+void compactLoad( const CompactMachine* c, Machine* m ) {
+	memcpy( m, c->head, MACHINE_SNAPSHOT_HEAD );
+	memcpy( m->mem.data, c->ram, RAM_SIZE );
+	if( c->cartRam != NULL ) {
+		memcpy( m->mem.data + CART_RAM, c->cartRam, CART_RAM_SIZE );
+	} else {
+		memset( m->mem.data + CART_RAM, 0, CART_RAM_SIZE );
+	}
+	if( c->chr != NULL ) {
+		memcpy( m->ppu.chr, c->chr, sizeof( m->ppu.chr ) );
+	}
+}
+
+int compactStore( CompactMachine* c, const Machine* m ) {
+	memcpy( c->head, m, MACHINE_SNAPSHOT_HEAD );
+	memcpy( c->ram, m->mem.data, RAM_SIZE );
+	if( c->cartRam == NULL && used( m->mem.data + CART_RAM, CART_RAM_SIZE ) ) {
+		c->cartRam = malloc( CART_RAM_SIZE );
+		if( c->cartRam == NULL ) {
+			return -1;
+		}
+	}
+	if( c->cartRam != NULL ) {
+		memcpy( c->cartRam, m->mem.data + CART_RAM, CART_RAM_SIZE );
+	}
+	if( c->chr != NULL ) {
+		memcpy( c->chr, m->ppu.chr, sizeof( m->ppu.chr ) );
+	}
+	return 0;
+}
+
+unsigned long compactSize( const CompactMachine* c ) {
+	return sizeof( CompactMachine ) + (c->chr != NULL ? sizeof( ((Machine*)0)->ppu.chr ) : 0) +
+	       (c->cartRam != NULL ? CART_RAM_SIZE : 0);
+}
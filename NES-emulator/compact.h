@@ -0,0 +1,38 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "machine.h"
+
+/*
+ * Compact machine states for hosting many instances of one game.
+ *
+ * A Machine carries all 64 KB of the CPU's address space, PRG-ROM and
+ * CHR-ROM included, though only 2 KB of it is work RAM. A CompactMachine
+ * keeps just what can change: the registers of the CPU, APU and PPU
+ * with the PPU's palette, OAM and nametables, then work RAM. That is
+ * about 4.5 KB in one block, with the registers in its first two cache
+ * lines. CHR-RAM is added for cartridges that have it, and cartridge
+ * RAM only once the game has written something there. NROM has no
+ * mapper registers to keep.
+ *
+ * Instances are run the way forks are: loaded into an ordinary Machine
+ * powered on with the same cartridge, which holds the ROM for all of
+ * them, stepped, and stored back. One such Machine per thread serves
+ * any number of instances.
+ */
+typedef struct CompactMachine CompactMachine;
+
+/*the state of m, or NULL if out of memory*/
+CompactMachine* compactCreate( const Machine* m );
+
+void compactFree( CompactMachine* c );
+
+void compactLoad( const CompactMachine* c, Machine* m );
+
+/*returns nonzero if out of memory for cartridge RAM, which is then left out*/
+int compactStore( CompactMachine* c, const Machine* m );
+
+/*bytes allocated for c*/
+unsigned long compactSize( const CompactMachine* c );
+
+#endif
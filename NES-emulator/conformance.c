@@ -0,0 +1,237 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "cartridge.h"
+#include "machine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * CPU conformance runner, built with FLAT_BUS so that bare 6502
+ * programs get all 64 KB as RAM.
+ *
+ *     conformance [-m max] [-f functional.bin [-p start] [-s success]]
+ *                 [-n nestest.nes [-l nestest.log]]
+ *
+ * -f runs Klaus Dormann's 6502 functional test: the 64 KB image is
+ * loaded at $0000 and run from start ($0400) at full speed until the
+ * PC loops on itself. The test traps that way on any failure too, so
+ * it passes only if the trap is at success ($3469 in the standard
+ * build). The 2A03 has no decimal mode, and the standard build traps
+ * in its decimal test; either build the runner with CPU=NMOS, or
+ * assemble the test with disable_decimal = 1 and give that build's
+ * success address.
+ *
+ * -n runs nestest from $C000, its automated mode. With -l every
+ * instruction is checked against the reference log: PC, A, X, Y, P,
+ * SP and the CPU cycle count if the log has one. Checking stops before
+ * the first undocumented opcode other than NOP, as machine.c does not
+ * emulate the rest. Without a log it runs until the PC leaves the ROM
+ * or traps, and passes if the error code nestest leaves at $02 is 0.
+ *
+ * Neither runs for more than max instructions (200 million). Progress
+ * and instructions per second go to stderr as they run.
+ *
+ * Exits with 1 if any test fails or cannot be loaded.
+ */
+
+#define FUNCTIONAL_START (0x0400)
+#define FUNCTIONAL_SUCCESS (0x3469)
+#define NESTEST_START (0xC000)
+#define MAX_INSTRUCTIONS (200000000UL)
+
+/*instructions between looks at the clock for progress reports*/
+#define PROGRESS_EVERY (1UL << 22)
+
+static unsigned long maxInstructions = MAX_INSTRUCTIONS;
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*print progress if a second has gone by since it was last shown*/
+static void progress( const char* name, unsigned long instructions, double start, double* shown ) {
+	double t = now();
+	if( t - *shown >= 1 ) {
+		fprintf( stderr, "%s: %lu M instructions, %.1f MIPS\n", name, instructions / 1000000,
+		         instructions / (t - start) / 1e6 );
+		*shown = t;
+	}
+}
+
+static void report( int pass, const char* name, unsigned long instructions, double seconds, const char* what ) {
+	printf( "%s: %s: %s; %lu instructions in %.3f s, %.1f MIPS\n", pass ? "ok  " : "FAIL", name, what,
+	        instructions, seconds, seconds > 0 ? instructions / seconds / 1e6 : 0 );
+}
+
+static int functional( const char* path, unsigned short int start, unsigned short int success ) {
+	static Machine m;
+	static unsigned char chr[ 8192 ];
+	unsigned long count = 0;
+	unsigned short int pc;
+	double begin, shown, seconds;
+	char what[ 96 ];
+	FILE* file;
+
+	memset( &m, 0, sizeof( m ) );
+	file = fopen( path, "rb" );
+	if( file == NULL ) {
+		printf( "FAIL: functional: cannot open %s\n", path );
+		return 1;
+	}
+	fread( m.mem.data, 1, sizeof( m.mem.data ), file );
+	fclose( file );
+
+	ppuPower( &m.ppu, chr, sizeof( chr ), 0 );
+	m.cpu.sp = 0xFD;
+	m.cpu.status = 0x24;
+	m.cpu.pc = start;
+
+	begin = shown = now();
+	do {
+		pc = m.cpu.pc;
+		machineStep( &m, NULL );
+		if( ++count % PROGRESS_EVERY == 0 ) {
+			progress( "functional", count, begin, &shown );
+		}
+	} while( m.cpu.pc != pc && count < maxInstructions );
+	seconds = now() - begin;
+
+	if( m.cpu.pc != pc ) {
+		sprintf( what, "no trap within %lu instructions, at $%04X", count, m.cpu.pc );
+	} else {
+		sprintf( what, "trapped at $%04X%s", pc, pc == success ? "" : " instead of success" );
+	}
+	report( m.cpu.pc == success, "functional", count, seconds, what );
+	return m.cpu.pc != success;
+}
+
+/*a value printed as name:XX in a log line, or -1*/
+static long logField( const char* line, const char* name ) {
+	const char* at = strstr( line, name );
+	return at != NULL ? strtol( at + strlen( name ), NULL, 16 ) : -1;
+}
+
+/*whether the machine is where line of the log says; cycles are compared if it gives them*/
+static int sameAsLog( const Machine* m, const char* line ) {
+	const char* cyc = strstr( line, "CYC:" );
+	return strtol( line, NULL, 16 ) == m->cpu.pc &&
+	       logField( line, " A:" ) == (unsigned char)m->cpu.accum &&
+	       logField( line, " X:" ) == (unsigned char)m->cpu.x &&
+	       logField( line, " Y:" ) == (unsigned char)m->cpu.y &&
+	       logField( line, " P:" ) == (unsigned char)m->cpu.status &&
+	       logField( line, " SP:" ) == m->cpu.sp &&
+	       (cyc == NULL || strstr( line, "SL:" ) != NULL || strtoul( cyc + 4, NULL, 10 ) == m->cycles);
+}
+
+static int nestest( const char* path, const char* logPath ) {
+	static Machine m;
+	Cartridge cart;
+	unsigned long count = 0, lines = 0;
+	unsigned short int pc;
+	double begin, shown, seconds;
+	char error[ 128 ], line[ 256 ], what[ 512 ];
+	FILE* log = NULL;
+	int pass;
+
+	if( cartridgeLoad( &cart, path, error ) != 0 ) {
+		printf( "FAIL: nestest: %s: %s\n", path, error );
+		return 1;
+	}
+	if( logPath != NULL && (log = fopen( logPath, "r" )) == NULL ) {
+		printf( "FAIL: nestest: cannot open %s\n", logPath );
+		cartridgeFree( &cart );
+		return 1;
+	}
+	machinePower( &m, &cart );
+	m.idleSkip = 0;
+	m.cpu.pc = NESTEST_START;
+	what[ 0 ] = '\0';
+
+	begin = shown = now();
+	for( ;; ) {
+		if( log != NULL ) {
+			if( fgets( line, sizeof( line ), log ) == NULL ) {
+				sprintf( what, "all %lu lines of the log match", lines );
+				break;
+			}
+			line[ strcspn( line, "\r\n" ) ] = '\0';
+			lines++;
+			if( strlen( line ) > 16 && line[ 15 ] == '*' && strncmp( line + 16, "NOP", 3 ) != 0 ) {
+				sprintf( what, "%lu lines match, up to %.3s at line %lu", lines - 1, line + 16, lines );
+				break;
+			}
+			if( !sameAsLog( &m, line ) ) {
+				sprintf( what, "line %lu is\n      %s\n    but got PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu",
+				         lines, line, m.cpu.pc, (unsigned char)m.cpu.accum, (unsigned char)m.cpu.x,
+				         (unsigned char)m.cpu.y, (unsigned char)m.cpu.status, m.cpu.sp, m.cycles );
+				break;
+			}
+		} else if( m.cpu.pc < 0x8000 || count >= maxInstructions ) {
+			break;
+		}
+
+		pc = m.cpu.pc;
+		machineStep( &m, NULL );
+		if( ++count % PROGRESS_EVERY == 0 ) {
+			progress( "nestest", count, begin, &shown );
+		}
+		if( log == NULL && m.cpu.pc == pc ) {
+			break;
+		}
+	}
+	seconds = now() - begin;
+
+	if( log != NULL ) {
+		pass = strncmp( what, "line", 4 ) != 0;
+		fclose( log );
+	} else {
+		pass = m.mem.data[ 0x02 ] == 0;
+		sprintf( what, "stopped at $%04X with $02=%02X $03=%02X", m.cpu.pc, (unsigned char)m.mem.data[ 0x02 ],
+		         (unsigned char)m.mem.data[ 0x03 ] );
+	}
+	report( pass, "nestest", count, seconds, what );
+	cartridgeFree( &cart );
+	return !pass;
+}
+
+int main( int argc, char* argv[] ) {
+	const char *functionalPath = NULL, *nestestPath = NULL, *logPath = NULL;
+	unsigned short int start = FUNCTIONAL_START, success = FUNCTIONAL_SUCCESS;
+	int i, failed = 0;
+
+	for( i = 1; i + 1 < argc; i += 2 ) {
+		if( strcmp( argv[ i ], "-f" ) == 0 ) {
+			functionalPath = argv[ i + 1 ];
+		} else if( strcmp( argv[ i ], "-p" ) == 0 ) {
+			start = strtoul( argv[ i + 1 ], NULL, 16 );
+		} else if( strcmp( argv[ i ], "-s" ) == 0 ) {
+			success = strtoul( argv[ i + 1 ], NULL, 16 );
+		} else if( strcmp( argv[ i ], "-n" ) == 0 ) {
+			nestestPath = argv[ i + 1 ];
+		} else if( strcmp( argv[ i ], "-l" ) == 0 ) {
+			logPath = argv[ i + 1 ];
+		} else if( strcmp( argv[ i ], "-m" ) == 0 ) {
+			maxInstructions = strtoul( argv[ i + 1 ], NULL, 10 );
+		} else {
+			break;
+		}
+	}
+	if( i != argc || (functionalPath == NULL && nestestPath == NULL) ) {
+		fprintf( stderr, "usage: conformance [-m max] [-f functional.bin [-p start] [-s success]]\n"
+		                 "                   [-n nestest.nes [-l nestest.log]]\n" );
+		return 2;
+	}
+
+	if( functionalPath != NULL ) {
+		failed += functional( functionalPath, start, success );
+	}
+	if( nestestPath != NULL ) {
+		failed += nestest( nestestPath, logPath );
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#if !defined( __x86_64__ ) || defined( _WIN32 )
+#define COOP_UCONTEXT
+#endif
+
+#ifdef COOP_UCONTEXT
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "coop.h"
+
+#include <stdlib.h>
+
+#ifndef COOP_UCONTEXT
+
+/*
+ * rdi = from, rsi = to. The System V ABI leaves every other register to
+ * the caller, so these six and the stack pointer are the whole thread.
+ */
+__asm__(
+	".text\n"
+	".globl coopSwitch\n"
+	".type coopSwitch, @function\n"
+	"coopSwitch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size coopSwitch, .-coopSwitch\n"
+
+	/*where a new thread's first switch returns to, with entry in r12 and arg in r13*/
+	".type coopStart, @function\n"
+	"coopStart:\n"
+	"	movq %r13, %rdi\n"
+	"	callq *%r12\n"
+	"	ud2\n"
+	".size coopStart, .-coopStart\n"
+);
+
+void coopStart( void );
+
+int coopCreate( CoopThread* t, size_t stackSize, void (*entry)( void* ), void* arg ) {
+	void** sp;
+
+	t->context = NULL;
+	t->stack = malloc( stackSize );
+	if( t->stack == NULL ) {
+		return 1;
+	}
+
+	/*
+	 * what coopSwitch pops: r15, r14, r13, r12, rbx, rbp and the return
+	 * address, placed so that the stack is 16-byte aligned at the call
+	 * of entry as the ABI wants
+	 */
+	sp = (void**)(((size_t)t->stack + stackSize) & ~(size_t)15) - 9;
+	sp[ 0 ] = NULL;
+	sp[ 1 ] = NULL;
+	sp[ 2 ] = arg;
+	sp[ 3 ] = (void*)entry;
+	sp[ 4 ] = NULL;
+	sp[ 5 ] = NULL;
+	sp[ 6 ] = (void*)coopStart;
+	t->sp = sp;
+	return 0;
+}
+
+void coopFree( CoopThread* t ) {
+	free( t->stack );
+	t->stack = NULL;
+}
+
+#else
+
+#include <ucontext.h>
+
+typedef struct {
+	ucontext_t context;
+	void (*entry)( void* );
+	void* arg;
+} Context;
+
+/*the thread being switched to, for start() to find its entry*/
+static __thread CoopThread* starting;
+
+static void start( void ) {
+	Context* c = starting->context;
+	c->entry( c->arg );
+	abort();
+}
+
+int coopCreate( CoopThread* t, size_t stackSize, void (*entry)( void* ), void* arg ) {
+	Context* c = calloc( 1, sizeof( Context ) );
+
+	t->sp = NULL;
+	t->context = c;
+	t->stack = malloc( stackSize );
+	if( c == NULL || t->stack == NULL || getcontext( &c->context ) != 0 ) {
+		coopFree( t );
+		return 1;
+	}
+	c->entry = entry;
+	c->arg = arg;
+	c->context.uc_stack.ss_sp = t->stack;
+	c->context.uc_stack.ss_size = stackSize;
+	c->context.uc_link = NULL;
+	makecontext( &c->context, start, 0 );
+	return 0;
+}
+
+void coopFree( CoopThread* t ) {
+	free( t->stack );
+	free( t->context );
+	t->stack = NULL;
+	t->context = NULL;
+}
+
+void coopSwitch( CoopThread* from, CoopThread* to ) {
+	/*the thread that was running before any was created gets its context here*/
+	if( from->context == NULL ) {
+		from->context = calloc( 1, sizeof( Context ) );
+		if( from->context == NULL ) {
+			abort();
+		}
+	}
+	starting = to;
+	swapcontext( &((Context*)from->context)->context, &((Context*)to->context)->context );
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef COOP_H
+#define COOP_H
+
+#include <stddef.h>
+
+/*
+ * Cooperative threads. Each has its own stack, and runs until it
+ * switches to another with coopSwitch(); nothing is preemptive, and
+ * all of them live on the OS thread that switches between them.
+ *
+ * On x86-64 a switch only saves the callee-saved registers on the old
+ * stack and loads them from the new one, a handful of instructions.
+ * Other hosts fall back on ucontext, which is a good deal slower; so
+ * does a build with COOP_UCONTEXT defined.
+ *
+ * A zeroed CoopThread stands for the code that is running when it first
+ * switches away, and has no stack of its own.
+ */
+typedef struct {
+	void* sp;
+	void* stack;
+	void* context;
+} CoopThread;
+
+/*
+ * Give t a stack of stackSize bytes on which it will call entry( arg )
+ * the first time it is switched to. entry must never return. Returns
+ * nonzero if out of memory.
+ */
+int coopCreate( CoopThread* t, size_t stackSize, void (*entry)( void* ), void* arg );
+
+/*free t's stack; t must not be running*/
+void coopFree( CoopThread* t );
+
+/*save the running thread into from and carry on in to*/
+void coopSwitch( CoopThread* from, CoopThread* to );
+
+#endif
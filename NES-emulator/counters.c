@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "counters.h"
+#include "disasm.h"
+
+#include <string.h>
+#include <time.h>
+
+__thread Counters counters;
+
+static const char* const regionNames[ COUNTER_REGIONS ] = {
+	"zero_page", "stack", "ram", "ppu", "io", "cart_ram", "rom"
+};
+
+static const char* const timeNames[ COUNTER_TIMES ] = {
+	"cpu", "ppu", "apu", "present"
+};
+
+int counterRegion( unsigned short int addr ) {
+	if( addr < 0x2000 ) {
+		addr &= 0x07FF;
+		return addr < 0x100 ? COUNTER_ZERO_PAGE : addr < 0x200 ? COUNTER_STACK : COUNTER_RAM;
+	}
+	if( addr < 0x4000 ) {
+		return COUNTER_PPU;
+	}
+	if( addr < 0x6000 ) {
+		return COUNTER_IO;
+	}
+	return addr < 0x8000 ? COUNTER_CART_RAM : COUNTER_ROM;
+}
+
+uint64_t countersNow( void ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t countersSince( uint64_t start ) {
+	static __thread uint64_t overhead = ~(uint64_t)0;
+	uint64_t now, elapsed;
+	int i;
+
+	if( overhead == ~(uint64_t)0 ) {
+		for( i = 0; i < 100; i++ ) {
+			now = countersNow();
+			elapsed = countersNow() - now;
+			if( elapsed < overhead ) {
+				overhead = elapsed;
+			}
+		}
+	}
+	elapsed = countersNow() - start;
+	return elapsed > overhead ? elapsed - overhead : 0;
+}
+
+void countersAddTime( int part, uint64_t ns ) {
+	counters.ns[ part ] += ns;
+}
+
+void countersSnapshot( Counters* out ) {
+	*out = counters;
+}
+
+void countersReset( void ) {
+	memset( &counters, 0, sizeof( Counters ) );
+}
+
+void countersAdd( Counters* total, const Counters* c ) {
+	int i;
+
+	for( i = 0; i < 256; i++ ) {
+		total->opcodes[ i ] += c->opcodes[ i ];
+	}
+	for( i = 0; i < COUNTER_REGIONS; i++ ) {
+		total->reads[ i ] += c->reads[ i ];
+		total->writes[ i ] += c->writes[ i ];
+	}
+	for( i = 0; i < COUNTER_TIMES; i++ ) {
+		total->ns[ i ] += c->ns[ i ];
+	}
+	total->nmis += c->nmis;
+	total->brks += c->brks;
+	total->dmas += c->dmas;
+	total->frames += c->frames;
+	total->samples += c->samples;
+}
+
+void countersText( const Counters* c, FILE* out ) {
+	unsigned long instructions = 0;
+	int i;
+
+	for( i = 0; i < 256; i++ ) {
+		instructions += c->opcodes[ i ];
+	}
+	fprintf( out, "%lu frames, %lu instructions, %lu NMIs, %lu BRKs, %lu OAM DMAs\n", c->frames, instructions,
+	         c->nmis, c->brks, c->dmas );
+	fprintf( out, "host time per frame:" );
+	for( i = 0; i < COUNTER_TIMES; i++ ) {
+		fprintf( out, " %s %.0f ns", timeNames[ i ], c->frames ? (double)c->ns[ i ] / c->frames : 0.0 );
+	}
+	fprintf( out, "\nmemory      reads       writes\n" );
+	for( i = 0; i < COUNTER_REGIONS; i++ ) {
+		fprintf( out, "  %-9s %11lu %11lu\n", regionNames[ i ], c->reads[ i ], c->writes[ i ] );
+	}
+	fprintf( out, "opcodes dispatched\n" );
+	for( i = 0; i < 256; i++ ) {
+		if( c->opcodes[ i ] != 0 ) {
+			fprintf( out, "  %02X %s %11lu\n", i, disasmMnemonic( i ), c->opcodes[ i ] );
+		}
+	}
+}
+
+void countersJson( const Counters* c, FILE* out ) {
+	int i;
+
+	fprintf( out, "{\n  \"enabled\": %s,\n", COUNTERS_ENABLED ? "true" : "false" );
+	fprintf( out, "  \"frames\": %lu,\n  \"nmis\": %lu,\n  \"brks\": %lu,\n  \"dmas\": %lu,\n", c->frames, c->nmis,
+	         c->brks, c->dmas );
+	fprintf( out, "  \"ns\": {" );
+	for( i = 0; i < COUNTER_TIMES; i++ ) {
+		fprintf( out, "%s\"%s\": %lu", i ? ", " : " ", timeNames[ i ], (unsigned long)c->ns[ i ] );
+	}
+	fprintf( out, " },\n  \"reads\": {" );
+	for( i = 0; i < COUNTER_REGIONS; i++ ) {
+		fprintf( out, "%s\"%s\": %lu", i ? ", " : " ", regionNames[ i ], c->reads[ i ] );
+	}
+	fprintf( out, " },\n  \"writes\": {" );
+	for( i = 0; i < COUNTER_REGIONS; i++ ) {
+		fprintf( out, "%s\"%s\": %lu", i ? ", " : " ", regionNames[ i ], c->writes[ i ] );
+	}
+	fprintf( out, " },\n  \"opcodes\": [" );
+	for( i = 0; i < 256; i++ ) {
+		fprintf( out, "%s%lu", i == 0 ? "" : i % 16 == 0 ? ",\n    " : ", ", c->opcodes[ i ] );
+	}
+	fprintf( out, "]\n}\n" );
+}
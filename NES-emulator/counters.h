@@ -0,0 +1,95 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Host-side instrumentation: what the emulator itself is doing, kept
+ * per thread. The counting is only compiled in with -DCOUNTERS
+ * (make headless COUNTERS=-DCOUNTERS); without it the COUNT macros
+ * expand to nothing, so release builds carry no trace of them in the
+ * CPU and bus paths. The functions below exist either way and then
+ * report zeros.
+ */
+#ifdef COUNTERS
+#define COUNTERS_ENABLED (1)
+#else
+#define COUNTERS_ENABLED (0)
+#endif
+
+/*memory regions of the CPU bus*/
+#define COUNTER_ZERO_PAGE (0)
+#define COUNTER_STACK (1)
+#define COUNTER_RAM (2)
+#define COUNTER_PPU (3)
+#define COUNTER_IO (4)
+#define COUNTER_CART_RAM (5)
+#define COUNTER_ROM (6)
+#define COUNTER_REGIONS (7)
+
+/*where host time goes*/
+#define COUNTER_TIME_CPU (0)
+#define COUNTER_TIME_PPU (1)
+#define COUNTER_TIME_APU (2)
+#define COUNTER_TIME_PRESENT (3)
+#define COUNTER_TIMES (4)
+
+/*
+ * Timing every call into the PPU would cost more than the calls, so
+ * only one in this many is timed and counted that many times over,
+ * less what reading the clock itself costs.
+ */
+#define COUNTER_SAMPLE (64)
+
+typedef struct {
+	unsigned long opcodes[ 256 ];
+	unsigned long reads[ COUNTER_REGIONS ];
+	unsigned long writes[ COUNTER_REGIONS ];
+	unsigned long nmis;
+	unsigned long brks;
+	unsigned long dmas;
+	unsigned long frames;
+
+	/*host nanoseconds; the CPU gets what is left of each frame after the PPU and APU*/
+	uint64_t ns[ COUNTER_TIMES ];
+	unsigned long samples;
+} Counters;
+
+extern __thread Counters counters;
+
+#ifdef COUNTERS
+#define COUNT( field ) (counters.field++)
+#define COUNT_MANY( field, n ) (counters.field += (n))
+#define COUNT_READ( addr ) (counters.reads[ counterRegion( addr ) ]++)
+#define COUNT_WRITE( addr ) (counters.writes[ counterRegion( addr ) ]++)
+#else
+#define COUNT( field ) ((void)0)
+#define COUNT_MANY( field, n ) ((void)0)
+#define COUNT_READ( addr ) ((void)0)
+#define COUNT_WRITE( addr ) ((void)0)
+#endif
+
+int counterRegion( unsigned short int addr );
+
+/*monotonic host time in nanoseconds*/
+uint64_t countersNow( void );
+
+/*time since start, which came from countersNow, without the cost of the two clock reads*/
+uint64_t countersSince( uint64_t start );
+
+void countersAddTime( int part, uint64_t ns );
+
+/*copy or clear the calling thread's counters*/
+void countersSnapshot( Counters* out );
+
+void countersReset( void );
+
+/*add c into total, to sum up several threads*/
+void countersAdd( Counters* total, const Counters* c );
+
+void countersText( const Counters* c, FILE* out );
+
+void countersJson( const Counters* c, FILE* out );
+
+#endif
@@ -0,0 +1,120 @@
+#include "disasm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*mnemonics and addressing modes of all 256 opcodes, undocumented ones included*/
+static const char mnemonics[ 256 ][ 4 ] = {
+/*0*/   "BRK", "ORA", "JAM", "SLO", "NOP", "ORA", "ASL", "SLO", "PHP", "ORA", "ASL", "ANC", "NOP", "ORA", "ASL", "SLO",
+/*1*/   "BPL", "ORA", "JAM", "SLO", "NOP", "ORA", "ASL", "SLO", "CLC", "ORA", "NOP", "SLO", "NOP", "ORA", "ASL", "SLO",
+/*2*/   "JSR", "AND", "JAM", "RLA", "BIT", "AND", "ROL", "RLA", "PLP", "AND", "ROL", "ANC", "BIT", "AND", "ROL", "RLA",
+/*3*/   "BMI", "AND", "JAM", "RLA", "NOP", "AND", "ROL", "RLA", "SEC", "AND", "NOP", "RLA", "NOP", "AND", "ROL", "RLA",
+/*4*/   "RTI", "EOR", "JAM", "SRE", "NOP", "EOR", "LSR", "SRE", "PHA", "EOR", "LSR", "ALR", "JMP", "EOR", "LSR", "SRE",
+/*5*/   "BVC", "EOR", "JAM", "SRE", "NOP", "EOR", "LSR", "SRE", "CLI", "EOR", "NOP", "SRE", "NOP", "EOR", "LSR", "SRE",
+/*6*/   "RTS", "ADC", "JAM", "RRA", "NOP", "ADC", "ROR", "RRA", "PLA", "ADC", "ROR", "ARR", "JMP", "ADC", "ROR", "RRA",
+/*7*/   "BVS", "ADC", "JAM", "RRA", "NOP", "ADC", "ROR", "RRA", "SEI", "ADC", "NOP", "RRA", "NOP", "ADC", "ROR", "RRA",
+/*8*/   "NOP", "STA", "NOP", "SAX", "STY", "STA", "STX", "SAX", "DEY", "NOP", "TXA", "XAA", "STY", "STA", "STX", "SAX",
+/*9*/   "BCC", "STA", "JAM", "AHX", "STY", "STA", "STX", "SAX", "TYA", "STA", "TXS", "TAS", "SHY", "STA", "SHX", "AHX",
+/*A*/   "LDY", "LDA", "LDX", "LAX", "LDY", "LDA", "LDX", "LAX", "TAY", "LDA", "TAX", "LAX", "LDY", "LDA", "LDX", "LAX",
+/*B*/   "BCS", "LDA", "JAM", "LAX", "LDY", "LDA", "LDX", "LAX", "CLV", "LDA", "TSX", "LAS", "LDY", "LDA", "LDX", "LAX",
+/*C*/   "CPY", "CMP", "NOP", "DCP", "CPY", "CMP", "DEC", "DCP", "INY", "CMP", "DEX", "AXS", "CPY", "CMP", "DEC", "DCP",
+/*D*/   "BNE", "CMP", "JAM", "DCP", "NOP", "CMP", "DEC", "DCP", "CLD", "CMP", "NOP", "DCP", "NOP", "CMP", "DEC", "DCP",
+/*E*/   "CPX", "SBC", "NOP", "ISB", "CPX", "SBC", "INC", "ISB", "INX", "SBC", "NOP", "SBC", "CPX", "SBC", "INC", "ISB",
+/*F*/   "BEQ", "SBC", "JAM", "ISB", "NOP", "SBC", "INC", "ISB", "SED", "SBC", "NOP", "ISB", "NOP", "SBC", "INC", "ISB"
+};
+
+#define IMP MODE_IMPLIED
+#define ACC MODE_ACCUMULATOR
+#define IMM MODE_IMMEDIATE
+#define ZP MODE_ZERO_PAGE
+#define ZPX MODE_ZERO_PAGE_X
+#define ZPY MODE_ZERO_PAGE_Y
+#define ABS MODE_ABSOLUTE
+#define ABX MODE_ABSOLUTE_X
+#define ABY MODE_ABSOLUTE_Y
+#define IND MODE_INDIRECT
+#define IZX MODE_INDIRECT_X
+#define IZY MODE_INDIRECT_Y
+#define REL MODE_RELATIVE
+
+static const unsigned char modes[ 256 ] = {
+/*       0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F */
+/*0*/   IMP, IZX, IMP, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+/*1*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+/*2*/   ABS, IZX, IMP, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+/*3*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+/*4*/   IMP, IZX, IMP, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+/*5*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+/*6*/   IMP, IZX, IMP, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, ACC, IMM, IND, ABS, ABS, ABS,
+/*7*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+/*8*/   IMM, IZX, IMM, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+/*9*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPY, ZPY, IMP, ABY, IMP, ABY, ABX, ABX, ABY, ABY,
+/*A*/   IMM, IZX, IMM, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+/*B*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPY, ZPY, IMP, ABY, IMP, ABY, ABX, ABX, ABY, ABY,
+/*C*/   IMM, IZX, IMM, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+/*D*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+/*E*/   IMM, IZX, IMM, IZX, ZP,  ZP,  ZP,  ZP,  IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+/*F*/   REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX
+};
+
+static const unsigned char modeLength[] = {
+	1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2
+};
+
+int disasmMode( unsigned char opcode ) {
+	return modes[ opcode ];
+}
+
+int disasmLength( unsigned char opcode ) {
+	return modeLength[ modes[ opcode ] ];
+}
+
+const char* disasmMnemonic( unsigned char opcode ) {
+	return mnemonics[ opcode ];
+}
+
+int disasmOfficial( unsigned char opcode ) {
+	static const char official[] =
+		"ADCANDASLBCCBCSBEQBITBMIBNEBPLBRKBVCBVSCLCCLDCLICLVCMPCPXCPYDECDEXDEYEOR"
+		"INCINXINYJMPJSRLDALDXLDYLSRORAPHAPHPPLAPLPROLRORRTIRTSSBCSECSEDSEISTA"
+		"STXSTYTAXTAYTSXTXATXSTYA";
+	const char* name = mnemonics[ opcode ];
+	int i;
+
+	if( opcode == 0xEA ) {
+		return 1;
+	}
+	if( opcode == 0xEB ) {
+		return 0;
+	}
+	for( i = 0; official[ i ]; i += 3 ) {
+		if( memcmp( official + i, name, 3 ) == 0 ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int disassemble( unsigned short int pc, const unsigned char* bytes, char* out ) {
+	const char* name = disasmMnemonic( bytes[ 0 ] );
+	unsigned short int word = bytes[ 1 ] | (bytes[ 2 ] << 8);
+
+	switch( modes[ bytes[ 0 ] ] ) {
+	case IMP: sprintf( out, "%s", name ); break;
+	case ACC: sprintf( out, "%s A", name ); break;
+	case IMM: sprintf( out, "%s #$%02X", name, bytes[ 1 ] ); break;
+	case ZP: sprintf( out, "%s $%02X", name, bytes[ 1 ] ); break;
+	case ZPX: sprintf( out, "%s $%02X,X", name, bytes[ 1 ] ); break;
+	case ZPY: sprintf( out, "%s $%02X,Y", name, bytes[ 1 ] ); break;
+	case ABS: sprintf( out, "%s $%04X", name, word ); break;
+	case ABX: sprintf( out, "%s $%04X,X", name, word ); break;
+	case ABY: sprintf( out, "%s $%04X,Y", name, word ); break;
+	case IND: sprintf( out, "%s ($%04X)", name, word ); break;
+	case IZX: sprintf( out, "%s ($%02X,X)", name, bytes[ 1 ] ); break;
+	case IZY: sprintf( out, "%s ($%02X),Y", name, bytes[ 1 ] ); break;
+	case REL:
+		sprintf( out, "%s $%04X", name, (unsigned short int)(pc + 2 + (signed char)bytes[ 1 ]) );
+		break;
+	}
+	return disasmLength( bytes[ 0 ] );
+}
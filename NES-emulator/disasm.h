@@ -0,0 +1,37 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+/*addressing modes*/
+#define MODE_IMPLIED (0)
+#define MODE_ACCUMULATOR (1)
+#define MODE_IMMEDIATE (2)
+#define MODE_ZERO_PAGE (3)
+#define MODE_ZERO_PAGE_X (4)
+#define MODE_ZERO_PAGE_Y (5)
+#define MODE_ABSOLUTE (6)
+#define MODE_ABSOLUTE_X (7)
+#define MODE_ABSOLUTE_Y (8)
+#define MODE_INDIRECT (9)
+#define MODE_INDIRECT_X (10)
+#define MODE_INDIRECT_Y (11)
+#define MODE_RELATIVE (12)
+
+int disasmMode( unsigned char opcode );
+
+/*bytes taken by the instruction, opcode included*/
+int disasmLength( unsigned char opcode );
+
+/*three letter mnemonic*/
+const char* disasmMnemonic( unsigned char opcode );
+
+/*whether the opcode is one of the 151 documented ones*/
+int disasmOfficial( unsigned char opcode );
+
+/*
+ * Write the instruction in bytes (opcode and up to two operands) at pc
+ * as text such as "LDA ($44),Y" into out, which needs 16 bytes.
+ * Returns the length of the instruction.
+ */
+int disassemble( unsigned short int pc, const unsigned char* bytes, char* out );
+
+#endif
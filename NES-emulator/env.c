@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "env.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Brightness of each NES colour, from the usual 2C02 palette weighted
+ * 0.299 R + 0.587 G + 0.114 B
+ */
+static const unsigned char luma[ 64 ] = {
+/*       0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F */
+/*0*/   84,  31,  28,  30,  32,  33,  27,  32,  34,  36,  38,  35,  36,   0,   0,   0,
+/*1*/  151,  69,  71,  71,  72,  71,  69,  71,  78,  79,  75,  74,  74,   0,   0,   0,
+/*2*/  237, 140, 136, 137, 144, 143, 144, 147, 148, 150, 148, 149, 146,  60,   0,   0,
+/*3*/  237, 197, 193, 195, 200, 197, 196, 200, 198, 198, 199, 199, 199, 161,   0,   0
+};
+
+typedef struct {
+	EnvBatch* batch;
+	pthread_t thread;
+	unsigned char* frame;
+} EnvWorker;
+
+struct EnvBatch {
+	EnvConfig config;
+	Machine* machines;
+	MachineSnapshot start;
+	unsigned long observationSize;
+
+	int workerCount;
+	EnvWorker* workers;
+
+	/*workers sleep on wake until generation moves on, and signal done when busy drops to 0*/
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	unsigned long generation;
+	int busy;
+	int quit;
+
+	/*the step being run, and the next env to be taken from it*/
+	const unsigned char* actions;
+	unsigned char* observations;
+	float* rewards;
+	int next;
+};
+
+static void observe( const unsigned char* frame, int scale, unsigned char* out ) {
+	int x, y, i, j, sum;
+	const unsigned char* row;
+
+	for( y = 0; y < PPU_HEIGHT; y += scale ) {
+		for( x = 0; x < PPU_WIDTH; x += scale ) {
+			sum = 0;
+			for( j = 0; j < scale; j++ ) {
+				row = frame + (y + j) * PPU_WIDTH + x;
+				for( i = 0; i < scale; i++ ) {
+					sum += luma[ row[ i ] & 0x3F ];
+				}
+			}
+			*out++ = sum / (scale * scale);
+		}
+	}
+}
+
+static void stepEnv( EnvBatch* b, int env, unsigned char* frame ) {
+	Machine* m = &b->machines[ env ];
+	int f;
+
+	m->input[ 0 ] = b->actions[ env ];
+	for( f = 1; f < b->config.frames; f++ ) {
+		machineRunFrame( m, NULL );
+	}
+	machineRunFrame( m, frame );
+	observe( frame, b->config.scale, b->observations + env * b->observationSize );
+	if( b->rewards != NULL ) {
+		b->rewards[ env ] = b->config.reward != NULL ? b->config.reward( env, m, b->config.context ) : 0;
+	}
+}
+
+/*take envs of the current step until there are none left*/
+static void work( EnvWorker* w ) {
+	EnvBatch* b = w->batch;
+	int env;
+	while( (env = __atomic_fetch_add( &b->next, 1, __ATOMIC_RELAXED )) < b->config.count ) {
+		stepEnv( b, env, w->frame );
+	}
+}
+
+static void* workerMain( void* arg ) {
+	EnvWorker* w = arg;
+	EnvBatch* b = w->batch;
+	unsigned long seen = 0;
+
+	for( ;; ) {
+		pthread_mutex_lock( &b->lock );
+		while( b->generation == seen && !b->quit ) {
+			pthread_cond_wait( &b->wake, &b->lock );
+		}
+		if( b->quit ) {
+			pthread_mutex_unlock( &b->lock );
+			return NULL;
+		}
+		seen = b->generation;
+		pthread_mutex_unlock( &b->lock );
+
+		work( w );
+
+		pthread_mutex_lock( &b->lock );
+		if( --b->busy == 0 ) {
+			pthread_cond_signal( &b->done );
+		}
+		pthread_mutex_unlock( &b->lock );
+	}
+}
+
+EnvBatch* envBatchCreate( const Cartridge* cart, const EnvConfig* config ) {
+	EnvBatch* b;
+	int i;
+
+	if( config->count < 1 || config->frames < 1 || config->scale < 1 || config->scale > 16 ||
+	    PPU_WIDTH % config->scale != 0 || PPU_HEIGHT % config->scale != 0 ) {
+		return NULL;
+	}
+	b = calloc( 1, sizeof( EnvBatch ) );
+	if( b == NULL ) {
+		return NULL;
+	}
+	b->config = *config;
+	b->observationSize = (PPU_WIDTH / config->scale) * (PPU_HEIGHT / config->scale);
+	b->workerCount = config->threads > 0 ? config->threads : sysconf( _SC_NPROCESSORS_ONLN );
+	if( b->workerCount > config->count ) {
+		b->workerCount = config->count;
+	}
+	if( b->workerCount < 1 ) {
+		b->workerCount = 1;
+	}
+
+	b->machines = malloc( config->count * sizeof( Machine ) );
+	b->workers = calloc( b->workerCount, sizeof( EnvWorker ) );
+	if( b->machines == NULL || b->workers == NULL ) {
+		free( b->machines );
+		free( b->workers );
+		free( b );
+		return NULL;
+	}
+	machinePower( &b->machines[ 0 ], cart );
+	machineSave( &b->machines[ 0 ], &b->start );
+	for( i = 1; i < config->count; i++ ) {
+		b->machines[ i ] = b->machines[ 0 ];
+	}
+
+	pthread_mutex_init( &b->lock, NULL );
+	pthread_cond_init( &b->wake, NULL );
+	pthread_cond_init( &b->done, NULL );
+	for( i = 0; i < b->workerCount; i++ ) {
+		b->workers[ i ].batch = b;
+		b->workers[ i ].frame = malloc( PPU_FRAME_SIZE );
+		if( b->workers[ i ].frame == NULL ||
+		    (i > 0 && pthread_create( &b->workers[ i ].thread, NULL, workerMain, &b->workers[ i ] ) != 0) ) {
+			free( b->workers[ i ].frame );
+			b->workerCount = i;
+			envBatchFree( b );
+			return NULL;
+		}
+	}
+	return b;
+}
+
+void envBatchFree( EnvBatch* b ) {
+	int i;
+
+	pthread_mutex_lock( &b->lock );
+	b->quit = 1;
+	pthread_cond_broadcast( &b->wake );
+	pthread_mutex_unlock( &b->lock );
+	for( i = 0; i < b->workerCount; i++ ) {
+		if( i > 0 ) {
+			pthread_join( b->workers[ i ].thread, NULL );
+		}
+		free( b->workers[ i ].frame );
+	}
+	pthread_mutex_destroy( &b->lock );
+	pthread_cond_destroy( &b->wake );
+	pthread_cond_destroy( &b->done );
+	free( b->workers );
+	free( b->machines );
+	free( b );
+}
+
+unsigned long envObservationSize( const EnvBatch* b ) {
+	return b->observationSize;
+}
+
+void envBatchStart( EnvBatch* b, const Machine* m ) {
+	machineSave( m, &b->start );
+}
+
+void envBatchReset( EnvBatch* b, int env ) {
+	machineRestore( &b->machines[ env ], &b->start );
+}
+
+void envBatchStep( EnvBatch* b, const unsigned char* actions, unsigned char* obs, float* rewards ) {
+	b->actions = actions;
+	b->observations = obs;
+	b->rewards = rewards;
+	b->next = 0;
+
+	pthread_mutex_lock( &b->lock );
+	b->busy = b->workerCount - 1;
+	b->generation++;
+	pthread_cond_broadcast( &b->wake );
+	pthread_mutex_unlock( &b->lock );
+
+	/*the caller is worker 0*/
+	work( &b->workers[ 0 ] );
+
+	pthread_mutex_lock( &b->lock );
+	while( b->busy > 0 ) {
+		pthread_cond_wait( &b->done, &b->lock );
+	}
+	pthread_mutex_unlock( &b->lock );
+}
+
+Machine* envBatchMachine( EnvBatch* b, int env ) {
+	return &b->machines[ env ];
+}
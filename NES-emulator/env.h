@@ -0,0 +1,66 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "cartridge.h"
+#include "machine.h"
+
+/*
+ * Batched environments for training agents. A batch holds count
+ * machines running the same cartridge and steps all of them at once on
+ * a pool of threads: each takes the next machine that has not been
+ * stepped, presses its action on controller 1 for the given number of
+ * frames and draws only the last of them. That frame goes straight
+ * from the worker's frame buffer into the caller's observations as
+ * grayscale, averaged over scale by scale blocks.
+ *
+ * Observations of all machines are laid out one after the other in a
+ * single buffer, envObservationSize() bytes each, rows top to bottom.
+ *
+ * Every machine can be put back into a start state shared by the batch:
+ * the state after power-on unless envBatchStart() sets another.
+ */
+typedef struct EnvBatch EnvBatch;
+
+/*reward of env after a step; called from the worker threads, for each env on one at a time*/
+typedef float (*EnvReward)( int env, const Machine* m, void* context );
+
+typedef struct {
+	int count;
+
+	/*threads stepping the batch, the caller's included; 0 for one per core*/
+	int threads;
+
+	/*frames per step, with the action held through all of them*/
+	int frames;
+
+	/*1, 2, 4, 8 or 16; observations are PPU_WIDTH / scale by PPU_HEIGHT / scale*/
+	int scale;
+
+	/*may be NULL for rewards of 0*/
+	EnvReward reward;
+	void* context;
+} EnvConfig;
+
+/*NULL if the configuration is invalid or out of memory*/
+EnvBatch* envBatchCreate( const Cartridge* cart, const EnvConfig* config );
+
+void envBatchFree( EnvBatch* b );
+
+unsigned long envObservationSize( const EnvBatch* b );
+
+/*make the state of m, which must have the batch's cartridge inserted, the one envs reset to*/
+void envBatchStart( EnvBatch* b, const Machine* m );
+
+/*put env back into the start state*/
+void envBatchReset( EnvBatch* b, int env );
+
+/*
+ * Step every env once with actions[ env ] held, writing observations
+ * into obs and a reward per env into rewards. rewards may be NULL.
+ */
+void envBatchStep( EnvBatch* b, const unsigned char* actions, unsigned char* obs, float* rewards );
+
+/*the machine behind env, for reading its RAM or changing it between steps*/
+Machine* envBatchMachine( EnvBatch* b, int env );
+
+#endif
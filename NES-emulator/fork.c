@@ -0,0 +1,151 @@
+#include "fork.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RAM_PAGES (RAM_SIZE / FORK_PAGE)
+#define CART_RAM_PAGES (0x2000 / FORK_PAGE)
+#define OAM_PAGES (1)
+#define VRAM_PAGES (2048 / FORK_PAGE)
+#define CHR_PAGES (8192 / FORK_PAGE)
+#define PAGES (RAM_PAGES + CART_RAM_PAGES + OAM_PAGES + VRAM_PAGES + CHR_PAGES)
+
+/*everything in a Machine up to the paged parts of the PPU*/
+#define HEAD (offsetof( Machine, ppu ) + offsetof( Ppu, oam ))
+
+typedef struct {
+	int refs;
+	unsigned char data[ FORK_PAGE ];
+} Page;
+
+struct MachineFork {
+	unsigned char head[ HEAD ];
+	Page* pages[ PAGES ];
+};
+
+/*where page i lives in a Machine*/
+static unsigned long pageOffset( int i ) {
+	if( i < RAM_PAGES ) {
+		return offsetof( Machine, mem ) + i * FORK_PAGE;
+	}
+	i -= RAM_PAGES;
+	if( i < CART_RAM_PAGES ) {
+		return offsetof( Machine, mem ) + 0x6000 + i * FORK_PAGE;
+	}
+	i -= CART_RAM_PAGES;
+	if( i < OAM_PAGES + VRAM_PAGES ) {
+		return offsetof( Machine, ppu ) + offsetof( Ppu, oam ) + i * FORK_PAGE;
+	}
+	i -= OAM_PAGES + VRAM_PAGES;
+	return offsetof( Machine, ppu ) + offsetof( Ppu, chr ) + i * FORK_PAGE;
+}
+
+/*CHR-ROM never changes, so it need not be copied in or compared*/
+static int pageCount( const Machine* m ) {
+	return m->ppu.chrWritable ? PAGES : PAGES - CHR_PAGES;
+}
+
+static void releasePage( Page* page ) {
+	if( __atomic_sub_fetch( &page->refs, 1, __ATOMIC_ACQ_REL ) == 0 ) {
+		free( page );
+	}
+}
+
+MachineFork* forkCreate( const Machine* m ) {
+	MachineFork* f = malloc( sizeof( MachineFork ) );
+	int i;
+
+	if( f == NULL ) {
+		return NULL;
+	}
+	memcpy( f->head, m, HEAD );
+	for( i = 0; i < PAGES; i++ ) {
+		f->pages[ i ] = malloc( sizeof( Page ) );
+		if( f->pages[ i ] == NULL ) {
+			while( i-- > 0 ) {
+				free( f->pages[ i ] );
+			}
+			free( f );
+			return NULL;
+		}
+		f->pages[ i ]->refs = 1;
+		memcpy( f->pages[ i ]->data, (const unsigned char*)m + pageOffset( i ), FORK_PAGE );
+	}
+	return f;
+}
+
+MachineFork* forkChild( const MachineFork* parent ) {
+	MachineFork* f = malloc( sizeof( MachineFork ) );
+	int i;
+
+	if( f == NULL ) {
+		return NULL;
+	}
+	memcpy( f, parent, sizeof( MachineFork ) );
+	for( i = 0; i < PAGES; i++ ) {
+		__atomic_add_fetch( &f->pages[ i ]->refs, 1, __ATOMIC_RELAXED );
+	}
+	return f;
+}
+
+void forkLoad( const MachineFork* f, Machine* m, const MachineFork* loaded ) {
+	int i, count;
+
+	memcpy( m, f->head, HEAD );
+	count = pageCount( m );
+	for( i = 0; i < count; i++ ) {
+		if( loaded == NULL || loaded->pages[ i ] != f->pages[ i ] ) {
+			memcpy( (unsigned char*)m + pageOffset( i ), f->pages[ i ]->data, FORK_PAGE );
+		}
+	}
+}
+
+int forkStore( MachineFork* f, const Machine* m ) {
+	const unsigned char* data;
+	Page* page;
+	int i, count = pageCount( m );
+
+	memcpy( f->head, m, HEAD );
+	for( i = 0; i < count; i++ ) {
+		data = (const unsigned char*)m + pageOffset( i );
+		page = f->pages[ i ];
+		if( memcmp( page->data, data, FORK_PAGE ) == 0 ) {
+			continue;
+		}
+		if( __atomic_load_n( &page->refs, __ATOMIC_ACQUIRE ) == 1 ) {
+			memcpy( page->data, data, FORK_PAGE );
+			continue;
+		}
+
+		/*shared: this fork gets a copy of its own*/
+		page = malloc( sizeof( Page ) );
+		if( page == NULL ) {
+			return -1;
+		}
+		page->refs = 1;
+		memcpy( page->data, data, FORK_PAGE );
+		releasePage( f->pages[ i ] );
+		f->pages[ i ] = page;
+	}
+	return 0;
+}
+
+void forkRelease( MachineFork* f ) {
+	int i;
+
+	if( f == NULL ) {
+		return;
+	}
+	for( i = 0; i < PAGES; i++ ) {
+		releasePage( f->pages[ i ] );
+	}
+	free( f );
+}
+
+int forkPrivatePages( const MachineFork* f ) {
+	int i, count = 0;
+	for( i = 0; i < PAGES; i++ ) {
+		count += __atomic_load_n( &f->pages[ i ]->refs, __ATOMIC_RELAXED ) == 1;
+	}
+	return count;
+}
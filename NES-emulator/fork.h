@@ -0,0 +1,51 @@
+#ifndef FORK_H
+#define FORK_H
+
+#include "machine.h"
+
+#define FORK_PAGE (256)
+
+/*
+ * Copy-on-write machine states for searching input trees.
+ *
+ * A MachineFork holds the registers of a machine and a table of 256
+ * byte pages: work RAM, cartridge RAM, OAM, nametables and CHR. Pages
+ * are reference counted and shared between a fork and its children
+ * until one of them stores a changed copy, so forking costs the
+ * registers and a table of pointers, and a child only ever owns the
+ * pages it dirtied. PRG-ROM is not part of a fork at all.
+ *
+ * Forks are run by loading them into an ordinary Machine powered on
+ * with the same cartridge, stepping that, and storing the result back
+ * into the fork (or a new child of it).
+ *
+ * Different forks may be used from different threads, but a fork must
+ * not be stored into while it is being forked.
+ */
+typedef struct MachineFork MachineFork;
+
+/*a root fork holding its own copy of m, or NULL if out of memory*/
+MachineFork* forkCreate( const Machine* m );
+
+/*a child sharing all of parent's pages*/
+MachineFork* forkChild( const MachineFork* parent );
+
+/*
+ * Put the state of f into m. If m already holds the state of loaded,
+ * because it was the last fork loaded into or stored from m, only the
+ * pages the two do not share are copied. loaded may be NULL.
+ */
+void forkLoad( const MachineFork* f, Machine* m, const MachineFork* loaded );
+
+/*
+ * Take the state of m into f, giving f its own copy of each page that
+ * changed. Returns nonzero if out of memory, with f partly updated.
+ */
+int forkStore( MachineFork* f, const Machine* m );
+
+void forkRelease( MachineFork* f );
+
+/*number of pages only f refers to*/
+int forkPrivatePages( const MachineFork* f );
+
+#endif
@@ -0,0 +1,75 @@
+#include "hash.h"
+
+#define PRIME1 (0x9E3779B185EBCA87ULL)
+#define PRIME2 (0xC2B2AE3D27D4EB4FULL)
+#define PRIME3 (0x165667B19E3779F9ULL)
+#define PRIME4 (0x85EBCA77C2B2AE63ULL)
+#define PRIME5 (0x27D4EB2F165667C5ULL)
+
+static uint64_t rotate( uint64_t x, int bits ) {
+	return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t read64( const unsigned char* p ) {
+	return (uint64_t)p[ 0 ] | ((uint64_t)p[ 1 ] << 8) | ((uint64_t)p[ 2 ] << 16) |
+	       ((uint64_t)p[ 3 ] << 24) | ((uint64_t)p[ 4 ] << 32) | ((uint64_t)p[ 5 ] << 40) |
+	       ((uint64_t)p[ 6 ] << 48) | ((uint64_t)p[ 7 ] << 56);
+}
+
+static uint64_t round64( uint64_t acc, uint64_t input ) {
+	acc += input * PRIME2;
+	acc = rotate( acc, 31 );
+	return acc * PRIME1;
+}
+
+static uint64_t merge( uint64_t acc, uint64_t lane ) {
+	acc ^= round64( 0, lane );
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hash64( const void* data, unsigned long length, uint64_t seed ) {
+	const unsigned char* p = data;
+	const unsigned char* end = p + length;
+	uint64_t a, b, c, d, h;
+
+	if( length >= 32 ) {
+		a = seed + PRIME1 + PRIME2;
+		b = seed + PRIME2;
+		c = seed;
+		d = seed - PRIME1;
+		do {
+			a = round64( a, read64( p ) );
+			b = round64( b, read64( p + 8 ) );
+			c = round64( c, read64( p + 16 ) );
+			d = round64( d, read64( p + 24 ) );
+			p += 32;
+		} while( p + 32 <= end );
+		h = rotate( a, 1 ) + rotate( b, 7 ) + rotate( c, 12 ) + rotate( d, 18 );
+		h = merge( h, a );
+		h = merge( h, b );
+		h = merge( h, c );
+		h = merge( h, d );
+	} else {
+		h = seed + PRIME5;
+	}
+	h += length;
+
+	while( p + 8 <= end ) {
+		h ^= round64( 0, read64( p ) );
+		h = rotate( h, 27 ) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	while( p < end ) {
+		h ^= *p * PRIME5;
+		h = rotate( h, 11 ) * PRIME1;
+		p++;
+	}
+
+	/*avalanche*/
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
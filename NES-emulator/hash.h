@@ -0,0 +1,13 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/*
+ * Fast non-cryptographic 64-bit hash, xxHash64 style: four independent
+ * lanes of 8 bytes each so a frame hashes at several bytes per cycle.
+ * The result is the same on every host regardless of endianness.
+ */
+uint64_t hash64( const void* data, unsigned long length, uint64_t seed );
+
+#endif
@@ -0,0 +1,662 @@
+#include "breakpoint.h"
+#include "cartridge.h"
+#include "cdl.h"
+#include "counters.h"
+#include "fork.h"
+#include "hash.h"
+#include "machine.h"
+#include "movie.h"
+#include "profile.h"
+#include "recompile.h"
+#include "rewind.h"
+#include "savestate.h"
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Headless batch runner. Loads a ROM, runs it for a number of frames
+ * as fast as the host allows, optionally pressing buttons from a
+ * script, and prints a hash of every frame and of the final RAM.
+ *
+ * Input scripts have one line per change of controller state:
+ *
+ *     <frame> <player 1 buttons> [<player 2 buttons>]
+ *
+ * where buttons are any of A B s(elect) S(tart) U D L R, or - for
+ * none. The state holds until the next line. # starts a comment.
+ * "<frame> reset" and "<frame> power" press those buttons instead.
+ *
+ * -M records everything done to the machine as a movie, and -P plays
+ * one back unthrottled and without drawing, checking the final state.
+ *
+ * With -s n only every nth frame, and always the last, is drawn and
+ * hashed; the others are run without compositing anything. Idle loops
+ * are skipped over unless -x is given; the results are the same.
+ *
+ * With -r n every drawn frame is the one n frames ahead (run-ahead),
+ * and the cost of the snapshots that takes is measured at the end.
+ *
+ * -W writes a save state when done, and -L resumes from one saved with
+ * the same ROM in place of powering on.
+ *
+ * -R kb keeps a rewind buffer of that size while running, then rewinds
+ * a copy of the machine all the way and reports what it cost.
+ *
+ * -F n benchmarks copy-on-write forks at the end: n children of the
+ * final state each run one frame with different input.
+ *
+ * -T writes a binary trace of every instruction run; see tracetool.c
+ * for turning it into text or comparing two of them.
+ *
+ * -p n profiles the game's code and prints the n hottest instructions
+ * and subroutines and where each frame's cycles went.
+ *
+ * -B addr[:xrw] sets a breakpoint (x, the default) or a read or write
+ * watchpoint at a hex address; every hit is printed and the run goes on.
+ *
+ * -c game.so runs the game's code as recompiled to C by recompile, with
+ * the interpreter taking over wherever that has no code. -V checks it:
+ * every frame is run again by the interpreter from the same state and
+ * the two machines compared.
+ *
+ * -D file keeps a code/data log of which ROM bytes the game used. A log
+ * already in the file is added to, so it builds up over several runs.
+ *
+ * Built with COUNTERS=-DCOUNTERS, the emulator's own counters are
+ * printed at the end; -C writes them out as JSON. Hashing a frame
+ * stands in for presenting it.
+ */
+
+#define COMMAND_RESET (1)
+#define COMMAND_POWER (2)
+
+typedef struct {
+	unsigned long frame;
+	unsigned char buttons[ 2 ];
+	unsigned char command;
+} InputEvent;
+
+typedef struct {
+	InputEvent* events;
+	unsigned long count;
+	unsigned long next;
+} InputScript;
+
+static unsigned char parseButtons( const char* text ) {
+	unsigned char buttons = 0;
+	for( ; *text; text++ ) {
+		switch( *text ) {
+		case 'A': buttons |= BUTTON_A; break;
+		case 'B': buttons |= BUTTON_B; break;
+		case 's': buttons |= BUTTON_SELECT; break;
+		case 'S': buttons |= BUTTON_START; break;
+		case 'U': buttons |= BUTTON_UP; break;
+		case 'D': buttons |= BUTTON_DOWN; break;
+		case 'L': buttons |= BUTTON_LEFT; break;
+		case 'R': buttons |= BUTTON_RIGHT; break;
+		}
+	}
+	return buttons;
+}
+
+static int loadInput( InputScript* script, const char* path ) {
+	FILE* file = fopen( path, "r" );
+	char line[ 256 ], first[ 64 ], second[ 64 ];
+	unsigned long capacity = 64, frame;
+	InputEvent* events;
+	int fields;
+
+	if( file == NULL ) {
+		return -1;
+	}
+	script->events = malloc( capacity * sizeof( InputEvent ) );
+	if( script->events == NULL ) {
+		fclose( file );
+		return -1;
+	}
+	script->count = 0;
+	script->next = 0;
+
+	while( fgets( line, sizeof( line ), file ) != NULL ) {
+		if( strchr( line, '#' ) != NULL ) {
+			*strchr( line, '#' ) = '\0';
+		}
+		fields = sscanf( line, "%lu %63s %63s", &frame, first, second );
+		if( fields < 2 ) {
+			continue;
+		}
+		if( script->count == capacity ) {
+			capacity *= 2;
+			events = realloc( script->events, capacity * sizeof( InputEvent ) );
+			if( events == NULL ) {
+				free( script->events );
+				script->events = NULL;
+				fclose( file );
+				return -1;
+			}
+			script->events = events;
+		}
+		script->events[ script->count ].frame = frame;
+		script->events[ script->count ].buttons[ 0 ] = parseButtons( first );
+		script->events[ script->count ].buttons[ 1 ] = fields > 2 ? parseButtons( second ) : 0;
+		script->events[ script->count ].command = 0;
+		if( strcmp( first, "reset" ) == 0 ) {
+			script->events[ script->count ].command = COMMAND_RESET;
+		} else if( strcmp( first, "power" ) == 0 ) {
+			script->events[ script->count ].command = COMMAND_POWER;
+		}
+		script->count++;
+	}
+	fclose( file );
+	return 0;
+}
+
+/*apply the script up to frame, recording into movie if not NULL*/
+static void applyInput( InputScript* script, Machine* m, unsigned long frame, const Cartridge* cart,
+                        MovieWriter* movie ) {
+	InputEvent* e;
+	unsigned char idleSkip;
+
+	while( script->next < script->count && script->events[ script->next ].frame <= frame ) {
+		e = &script->events[ script->next++ ];
+		if( e->command == COMMAND_RESET ) {
+			machineReset( m );
+			if( movie != NULL ) {
+				movieReset( movie );
+			}
+		} else if( e->command == COMMAND_POWER ) {
+			if( cart == NULL ) {
+				fprintf( stderr, "cannot power cycle a resumed state\n" );
+				continue;
+			}
+			idleSkip = m->idleSkip;
+			machinePower( m, cart );
+			m->idleSkip = idleSkip;
+			if( movie != NULL ) {
+				moviePower( movie );
+			}
+		} else {
+			m->input[ 0 ] = e->buttons[ 0 ];
+			m->input[ 1 ] = e->buttons[ 1 ];
+		}
+	}
+	if( movie != NULL ) {
+		movieFrame( movie, m );
+	}
+}
+
+static void reportRewind( Rewind* r, const Machine* m, double pushSeconds, unsigned long pushes ) {
+	static Machine copy;
+	RewindStats stats;
+	unsigned long popped = 0;
+	clock_t start;
+	double seconds;
+
+	rewindStats( r, &stats );
+	fprintf( stderr, "rewind: %lu frames (%.1f s) in %lu of %lu bytes, %lu keyframes, %lu evicted\n",
+	         stats.frames, stats.frames / 60.0988, stats.bytes, stats.budget, stats.keyframes, stats.evicted );
+	fprintf( stderr, "rewind: %.1f:1 against plain snapshots, %.0f bytes and %.2f us per frame\n",
+	         stats.bytes ? (double)stats.rawBytes / stats.bytes : 0.0,
+	         stats.frames ? (double)stats.bytes / stats.frames : 0.0,
+	         pushes ? pushSeconds * 1e6 / pushes : 0.0 );
+
+	copy = *m;
+	start = clock();
+	while( rewindPop( r, &copy ) == 0 ) {
+		popped++;
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	fprintf( stderr, "rewind: back to frame %lu through %lu frames, %.2f us each\n", copy.frame, popped,
+	         popped ? seconds * 1e6 / popped : 0.0 );
+}
+
+static void benchmarkForks( const Machine* m, unsigned long children ) {
+	static Machine executor;
+	MachineFork *root, *previous = NULL;
+	MachineFork** forks = malloc( children * sizeof( MachineFork* ) );
+	unsigned long i, pages = 0;
+	clock_t start;
+	double forking, running;
+
+	if( forks == NULL ) {
+		return;
+	}
+	root = forkCreate( m );
+	executor = *m;
+
+	/*forking alone*/
+	start = clock();
+	for( i = 0; i < children; i++ ) {
+		forks[ i ] = forkChild( root );
+	}
+	forking = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	/*and a search step: load each child, try an input for a frame, keep the result*/
+	start = clock();
+	for( i = 0; i < children; i++ ) {
+		forkLoad( forks[ i ], &executor, previous );
+		executor.input[ 0 ] = i & 0xFF;
+		machineRunFrame( &executor, NULL );
+		forkStore( forks[ i ], &executor );
+		previous = forks[ i ];
+	}
+	running = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	for( i = 0; i < children; i++ ) {
+		pages += forkPrivatePages( forks[ i ] );
+		forkRelease( forks[ i ] );
+	}
+	forkRelease( root );
+	free( forks );
+
+	fprintf( stderr, "fork: %lu children in %.3f ms, %.0f forks/s\n", children, forking * 1e3,
+	         forking > 0 ? children / forking : 0.0 );
+	fprintf( stderr, "fork: load, run a frame and store each in %.1f us, %.0f children/s, %.1f pages dirtied\n",
+	         running * 1e6 / children, running > 0 ? children / running : 0.0, (double)pages / children );
+}
+
+/*time saving and restoring the machine over and over*/
+static void benchmarkSnapshots( Machine* m, MachineSnapshot* snapshot ) {
+	const long rounds = 100000;
+	double save, restore;
+	clock_t start;
+	long i;
+
+	start = clock();
+	for( i = 0; i < rounds; i++ ) {
+		machineSave( m, snapshot );
+	}
+	save = (double)(clock() - start) / CLOCKS_PER_SEC / rounds;
+	start = clock();
+	for( i = 0; i < rounds; i++ ) {
+		machineRestore( m, snapshot );
+	}
+	restore = (double)(clock() - start) / CLOCKS_PER_SEC / rounds;
+	fprintf( stderr, "snapshot of %lu bytes: save %.2f us, restore %.2f us\n",
+	         (unsigned long)(MACHINE_SNAPSHOT_HEAD + RAM_SIZE + sizeof( snapshot->cartRam ) +
+	                         (m->ppu.chrWritable ? sizeof( snapshot->chr ) : 0)),
+	         save * 1e6, restore * 1e6 );
+}
+
+/*parse addr[:xrw] into b. returns nonzero if it is not one*/
+static int parseBreakpoint( Breakpoints* b, const char* spec ) {
+	char* end;
+	unsigned long addr = strtoul( spec, &end, 16 );
+	int kinds = 0;
+
+	if( end == spec || addr > 0xFFFF || (*end != '\0' && *end != ':') ) {
+		return -1;
+	}
+	for( ; *end; end++ ) {
+		switch( *end ) {
+		case 'x': kinds |= BREAK_EXECUTE; break;
+		case 'r': kinds |= BREAK_READ; break;
+		case 'w': kinds |= BREAK_WRITE; break;
+		case ':': break;
+		default: return -1;
+		}
+	}
+	breakpointSet( b, addr, kinds ? kinds : BREAK_EXECUTE );
+	return 0;
+}
+
+/*run a frame, printing every breakpoint hit on the way*/
+static void runFrame( Machine* m, unsigned char* frame, const Breakpoints* b ) {
+	unsigned long seen;
+	int stopped;
+
+	if( b == NULL ) {
+		machineRunFrame( m, frame );
+		return;
+	}
+	seen = b->hits;
+	do {
+		stopped = machineRunFrame( m, frame );
+		if( b->hits != seen ) {
+			seen = b->hits;
+			printf( "break frame %lu: %s $%04X = %02X at $%04X\n", m->frame,
+			        b->hit.kind == BREAK_EXECUTE ? "execute" : b->hit.kind == BREAK_READ ? "read" : "write",
+			        b->hit.addr, b->hit.value, b->hit.pc );
+		}
+	} while( stopped );
+}
+
+/*run the frame m has just run on twin, which held the state before it, without recompiled code*/
+static int sameFrame( const Machine* m, Machine* twin, const RecompiledCode* code ) {
+	machineRecompiled( NULL );
+	machineRunFrame( twin, NULL );
+	machineRecompiled( code );
+	return machineHash( m ) == machineHash( twin );
+}
+
+static void usage( void ) {
+	fprintf( stderr, "usage: headless [options] rom.nes\n" );
+	fprintf( stderr, "  -n frames  number of frames to run (default 600)\n" );
+	fprintf( stderr, "  -i input   scripted controller input\n" );
+	fprintf( stderr, "  -s n       fast-forward: only draw every nth frame\n" );
+	fprintf( stderr, "  -r n       run ahead n frames\n" );
+	fprintf( stderr, "  -L state   resume from a save state of the ROM instead of powering on\n" );
+	fprintf( stderr, "  -W state   write a save state after the last frame\n" );
+	fprintf( stderr, "  -R kb      keep a rewind buffer of kb kilobytes\n" );
+	fprintf( stderr, "  -F n       benchmark forking n children of the final state\n" );
+	fprintf( stderr, "  -M movie   record a movie\n" );
+	fprintf( stderr, "  -P movie   play a movie back and check the final state\n" );
+	fprintf( stderr, "  -T trace   write an instruction trace\n" );
+	fprintf( stderr, "  -p n       profile, reporting the top n hot spots\n" );
+	fprintf( stderr, "  -B addr[:xrw]  break on execute, read or write\n" );
+	fprintf( stderr, "  -c game.so run recompiled code\n" );
+	fprintf( stderr, "  -V         check every recompiled frame against the interpreter\n" );
+	fprintf( stderr, "  -D log     add to a code/data log of the ROM\n" );
+	fprintf( stderr, "  -C file    write the host counters as JSON\n" );
+	fprintf( stderr, "  -x         execute idle loops instead of skipping them\n" );
+	fprintf( stderr, "  -q         only print the last frame's hash\n" );
+}
+
+int main( int argc, char* argv[] ) {
+	static Machine machine;
+	static unsigned char frame[ PPU_FRAME_SIZE ];
+	static MachineSnapshot snapshot;
+	Machine* m = &machine;
+	Cartridge cart;
+	InputScript script;
+	MovieWriter movie;
+	MovieResult played;
+	char error[ 128 ];
+	const char* romPath = NULL;
+	const char* inputPath = NULL;
+	const char* loadPath = NULL;
+	const char* savePath = NULL;
+	const char* recordPath = NULL;
+	const char* playPath = NULL;
+	const char* tracePath = NULL;
+	Tracer* tracer = NULL;
+	long traced;
+	Profiler* profiler = NULL;
+	int top = 0;
+	const char* countersPath = NULL;
+	Counters counted;
+	FILE* file;
+	uint64_t presentStart = 0;
+	static Breakpoints breaks;
+	Breakpoints* breaking = NULL;
+	static CodeDataLog codeData;
+	const char* logPath = NULL;
+	const char* codePath = NULL;
+	RecompiledCode* code = NULL;
+	Machine* twin = NULL;
+	int verify = 0;
+	unsigned long frames = 600, skip = 1, drawn = 0, first, f;
+	unsigned long rewindKb = 0, pushes = 0, children = 0;
+	Rewind* rewinder = NULL;
+	double pushSeconds = 0;
+	clock_t pushStart;
+	int quiet = 0, idleSkip = 1, ahead = 0, i;
+	uint64_t hash = 0;
+	clock_t start;
+	double seconds;
+
+	for( i = 1; i < argc; i++ ) {
+		if( strcmp( argv[ i ], "-n" ) == 0 && i + 1 < argc ) {
+			frames = strtoul( argv[ ++i ], NULL, 10 );
+		} else if( strcmp( argv[ i ], "-i" ) == 0 && i + 1 < argc ) {
+			inputPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-s" ) == 0 && i + 1 < argc ) {
+			skip = strtoul( argv[ ++i ], NULL, 10 );
+			if( skip == 0 ) {
+				skip = 1;
+			}
+		} else if( strcmp( argv[ i ], "-r" ) == 0 && i + 1 < argc ) {
+			ahead = atoi( argv[ ++i ] );
+		} else if( strcmp( argv[ i ], "-L" ) == 0 && i + 1 < argc ) {
+			loadPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-W" ) == 0 && i + 1 < argc ) {
+			savePath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-R" ) == 0 && i + 1 < argc ) {
+			rewindKb = strtoul( argv[ ++i ], NULL, 10 );
+		} else if( strcmp( argv[ i ], "-F" ) == 0 && i + 1 < argc ) {
+			children = strtoul( argv[ ++i ], NULL, 10 );
+		} else if( strcmp( argv[ i ], "-M" ) == 0 && i + 1 < argc ) {
+			recordPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-P" ) == 0 && i + 1 < argc ) {
+			playPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-T" ) == 0 && i + 1 < argc ) {
+			tracePath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-p" ) == 0 && i + 1 < argc ) {
+			top = atoi( argv[ ++i ] );
+		} else if( strcmp( argv[ i ], "-B" ) == 0 && i + 1 < argc ) {
+			breaking = &breaks;
+			if( parseBreakpoint( &breaks, argv[ ++i ] ) != 0 ) {
+				usage();
+				return 2;
+			}
+		} else if( strcmp( argv[ i ], "-c" ) == 0 && i + 1 < argc ) {
+			codePath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-V" ) == 0 ) {
+			verify = 1;
+		} else if( strcmp( argv[ i ], "-D" ) == 0 && i + 1 < argc ) {
+			logPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-C" ) == 0 && i + 1 < argc ) {
+			countersPath = argv[ ++i ];
+		} else if( strcmp( argv[ i ], "-x" ) == 0 ) {
+			idleSkip = 0;
+		} else if( strcmp( argv[ i ], "-q" ) == 0 ) {
+			quiet = 1;
+		} else if( argv[ i ][ 0 ] != '-' && romPath == NULL ) {
+			romPath = argv[ i ];
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if( romPath == NULL || (breaking != NULL && ahead > 0) ||
+	    (verify && codePath == NULL) ) {
+		usage();
+		return 2;
+	}
+
+	script.count = 0;
+	script.next = 0;
+	script.events = NULL;
+	if( inputPath != NULL && loadInput( &script, inputPath ) != 0 ) {
+		fprintf( stderr, "cannot read input script %s\n", inputPath );
+		return 1;
+	}
+
+	if( cartridgeLoad( &cart, romPath, error ) != 0 ) {
+		fprintf( stderr, "%s: %s\n", romPath, error );
+		return 1;
+	}
+	machinePower( m, &cart );
+	if( loadPath != NULL ) {
+		start = clock();
+		if( saveStateRead( m, loadPath, error ) != 0 ) {
+			fprintf( stderr, "%s: %s\n", loadPath, error );
+			return 1;
+		}
+		fprintf( stderr, "resumed frame %lu in %.3f ms\n", m->frame,
+		         (double)(clock() - start) * 1000 / CLOCKS_PER_SEC );
+	}
+	m->idleSkip = idleSkip;
+	if( tracePath != NULL && (tracer = tracerStart( tracePath, error )) == NULL ) {
+		fprintf( stderr, "%s: %s\n", tracePath, error );
+		return 1;
+	}
+	machineBreakpoints( breaking );
+	if( codePath != NULL ) {
+		code = recompiledLoad( codePath, &cart, error );
+		if( code == NULL ) {
+			fprintf( stderr, "%s: %s\n", codePath, error );
+			return 1;
+		}
+		fprintf( stderr, "%lu recompiled instructions\n", code->instructions );
+		machineRecompiled( code );
+		if( verify && (twin = malloc( sizeof( Machine ) )) == NULL ) {
+			fprintf( stderr, "cannot allocate the interpreter's machine\n" );
+			return 1;
+		}
+	}
+	if( logPath != NULL ) {
+		cdlInit( &codeData, &cart );
+		file = fopen( logPath, "rb" );
+		if( file != NULL ) {
+			fclose( file );
+			if( cdlMerge( &codeData, logPath, error ) != 0 ) {
+				fprintf( stderr, "%s\n", error );
+				return 1;
+			}
+		}
+		machineLog( &codeData );
+	}
+	if( top > 0 && (profiler = profilerStart( m )) == NULL ) {
+		fprintf( stderr, "cannot allocate the profiler\n" );
+		return 1;
+	}
+
+	if( playPath != NULL ) {
+		start = clock();
+		if( moviePlay( playPath, m, &cart, &played, error ) != 0 ) {
+			fprintf( stderr, "%s: %s\n", playPath, error );
+			return 1;
+		}
+		seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		printf( "state %016" PRIx64 "\n", machineHash( m ) );
+		fprintf( stderr, "played %lu frames in %.3f s (%.0f fps, %.1fx real time)\n", played.frames, seconds,
+		         seconds > 0 ? played.frames / seconds : 0.0, seconds > 0 ? played.frames / seconds / 60.0988 : 0.0 );
+		if( !played.ended ) {
+			fprintf( stderr, "the movie has no end record, nothing to check\n" );
+		} else {
+			fprintf( stderr, "final state %s\n", played.matched ? "matches" : "DIFFERS" );
+		}
+		return played.ended && !played.matched ? 1 : 0;
+	}
+	if( recordPath != NULL && movieCreate( &movie, recordPath, m, error ) != 0 ) {
+		fprintf( stderr, "%s: %s\n", recordPath, error );
+		return 1;
+	}
+	if( rewindKb > 0 ) {
+		rewinder = rewindCreate( rewindKb * 1024, 60 );
+		if( rewinder == NULL ) {
+			fprintf( stderr, "cannot allocate a %lu KB rewind buffer\n", rewindKb );
+			return 1;
+		}
+	}
+
+	/*input script frames count from power-on, also when resuming*/
+	first = m->frame;
+	start = clock();
+	for( f = 0; f < frames; f++ ) {
+		applyInput( &script, m, first + f, &cart, recordPath != NULL ? &movie : NULL );
+		if( twin != NULL ) {
+			*twin = *m;
+		}
+		if( f % skip != skip - 1 && f != frames - 1 ) {
+			runFrame( m, NULL, breaking );
+		} else {
+			if( ahead > 0 ) {
+				machineRunAhead( m, ahead, frame, &snapshot );
+			} else {
+				runFrame( m, frame, breaking );
+			}
+			if( COUNTERS_ENABLED ) {
+				presentStart = countersNow();
+			}
+			hash = hash64( frame, PPU_FRAME_SIZE, 0 );
+			drawn++;
+			if( !quiet ) {
+				printf( "frame %lu %016" PRIx64 "\n", first + f, hash );
+			}
+			if( COUNTERS_ENABLED ) {
+				countersAddTime( COUNTER_TIME_PRESENT, countersNow() - presentStart );
+			}
+		}
+		if( twin != NULL && !sameFrame( m, twin, code ) ) {
+			fprintf( stderr, "frame %lu: recompiled code and the interpreter differ\n", first + f );
+			return 1;
+		}
+		if( rewinder != NULL ) {
+			pushStart = clock();
+			rewindPush( rewinder, m );
+			pushSeconds += (double)(clock() - pushStart) / CLOCKS_PER_SEC;
+			pushes++;
+		}
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if( tracer != NULL ) {
+		traced = tracerStop( tracer );
+		if( traced < 0 ) {
+			fprintf( stderr, "%s: write error\n", tracePath );
+			return 1;
+		}
+		fprintf( stderr, "traced %ld instructions\n", traced );
+	}
+	if( profiler != NULL ) {
+		profilerStop( profiler );
+	}
+	machineLog( NULL );
+
+	if( quiet ) {
+		printf( "frame %lu %016" PRIx64 "\n", first + frames - 1, hash );
+	}
+	printf( "ram %016" PRIx64 "\n", hash64( m->mem.data, RAM_SIZE, 0 ) );
+	printf( "state %016" PRIx64 "\n", machineHash( m ) );
+
+	fprintf( stderr, "%lu frames (%lu drawn) in %.3f s (%.0f fps, %.1fx real time)\n", frames, drawn, seconds,
+	         seconds > 0 ? frames / seconds : 0.0, seconds > 0 ? frames / seconds / 60.0988 : 0.0 );
+	fprintf( stderr, "%lu of %lu CPU cycles skipped in idle loops\n", m->idleCycles, m->cycles );
+	if( ahead > 0 ) {
+		benchmarkSnapshots( m, &snapshot );
+	}
+	if( children > 0 ) {
+		benchmarkForks( m, children );
+	}
+	if( rewinder != NULL ) {
+		reportRewind( rewinder, m, pushSeconds, pushes );
+		rewindDestroy( rewinder );
+	}
+	countersSnapshot( &counted );
+	if( COUNTERS_ENABLED ) {
+		countersText( &counted, stderr );
+	}
+	if( countersPath != NULL ) {
+		file = fopen( countersPath, "w" );
+		if( file == NULL ) {
+			fprintf( stderr, "cannot create %s\n", countersPath );
+			return 1;
+		}
+		countersJson( &counted, file );
+		fclose( file );
+	}
+	if( profiler != NULL ) {
+		profilerReport( profiler, stderr, top );
+		profilerFree( profiler );
+	}
+	if( logPath != NULL ) {
+		cdlSummary( &codeData, stderr );
+		if( cdlSave( &codeData, logPath, error ) != 0 ) {
+			fprintf( stderr, "%s\n", error );
+			return 1;
+		}
+	}
+	if( recordPath != NULL && movieClose( &movie, m ) != 0 ) {
+		fprintf( stderr, "%s: cannot write movie\n", recordPath );
+		return 1;
+	}
+	if( savePath != NULL && saveStateWrite( m, savePath, error ) != 0 ) {
+		fprintf( stderr, "%s: %s\n", savePath, error );
+		return 1;
+	}
+	if( twin != NULL ) {
+		fprintf( stderr, "every frame matches the interpreter\n" );
+		free( twin );
+	}
+	machineRecompiled( NULL );
+	recompiledFree( code );
+	cartridgeFree( &cart );
+	free( script.events );
+	return 0;
+}
@@ -0,0 +1,460 @@
+#include "lanes.h"
+#include "disasm.h"
+#include "machine.h"
+
+#include <string.h>
+
+#if CPU_VARIANT != CPU_2A03
+#error "the lockstep engine only knows the 2A03"
+#endif
+
+/*a byte for every lane; GCC maps this onto whatever vector unit the target has*/
+typedef unsigned char LaneBytes __attribute__(( vector_size( LANES ) ));
+
+/*instructions lanes that went apart run on their own before they are compared again*/
+#define LANES_BURST (64)
+
+/*registers an operation works on*/
+#define REG_A (0)
+#define REG_X (1)
+#define REG_Y (2)
+#define REG_SP (3)
+
+/*what an opcode does*/
+#define KIND_NONE (0)
+#define KIND_READ (1)
+#define KIND_COMPARE (2)
+#define KIND_STORE (3)
+#define KIND_MODIFY (4)
+#define KIND_REGISTER (5)
+#define KIND_FLAG (6)
+#define KIND_TRANSFER (7)
+#define KIND_BRANCH (8)
+#define KIND_IGNORE (9)
+#define KIND_JMP (10)
+#define KIND_JSR (11)
+#define KIND_RTS (12)
+#define KIND_RTI (13)
+#define KIND_BRK (14)
+#define KIND_PHA (15)
+#define KIND_PHP (16)
+#define KIND_PLA (17)
+#define KIND_PLP (18)
+
+/*an opcode decoded once, for all the lanes that run it*/
+typedef struct {
+	unsigned char kind;
+	unsigned char mode;
+	unsigned char cycles;
+	unsigned char reg;
+	unsigned char to;
+
+	void (*read)( char*, char*, char );
+	void (*compare)( char, char*, char );
+	void (*modify)( char*, char* );
+	void (*flag)( char* );
+	void (*transfer)( char, char*, char* );
+	void (*branch)( unsigned short int*, char, char );
+} Decoded;
+
+static void adcSigned( char* accum, char* status, char arg ) {
+	adc( accum, status, arg );
+}
+
+static const struct {
+	char name[ 4 ];
+	void (*op)( char*, char*, char );
+	int reg;
+} reads[] = {
+	{ "LDA", lda, REG_A }, { "LDX", ldx, REG_X }, { "LDY", ldy, REG_Y },
+	{ "ADC", adcSigned, REG_A }, { "SBC", sbc, REG_A },
+	{ "AND", and, REG_A }, { "ORA", ora, REG_A }, { "EOR", eor, REG_A }
+};
+
+static const struct {
+	char name[ 4 ];
+	void (*op)( char, char*, char );
+	int reg;
+} compares[] = {
+	{ "CMP", cmp, REG_A }, { "CPX", cpx, REG_X }, { "CPY", cpy, REG_Y }, { "BIT", bit, REG_A }
+};
+
+/*shifts and increments go to memory, or to reg in accumulator mode and for the implied ones*/
+static const struct {
+	char name[ 4 ];
+	void (*op)( char*, char* );
+	int reg;
+} modifies[] = {
+	{ "ASL", asl, REG_A }, { "LSR", lsr, REG_A }, { "ROL", rol, REG_A }, { "ROR", ror, REG_A },
+	{ "INC", inc, REG_A }, { "DEC", dec, REG_A },
+	{ "INX", inx, REG_X }, { "INY", iny, REG_Y }, { "DEX", dex, REG_X }, { "DEY", dey, REG_Y }
+};
+
+static const struct {
+	char name[ 4 ];
+	void (*op)( char* );
+} flags[] = {
+	{ "CLC", clc }, { "CLD", cld }, { "CLI", cli }, { "CLV", clv },
+	{ "SEC", sec }, { "SED", sed }, { "SEI", sei }
+};
+
+static const struct {
+	char name[ 4 ];
+	void (*op)( char, char*, char* );
+	int from;
+	int to;
+} transfers[] = {
+	{ "TAX", tax, REG_A, REG_X }, { "TAY", tay, REG_A, REG_Y }, { "TSX", tsx, REG_SP, REG_X },
+	{ "TXA", txa, REG_X, REG_A }, { "TXS", txs, REG_X, REG_SP }, { "TYA", tya, REG_Y, REG_A }
+};
+
+static const struct {
+	char name[ 4 ];
+	int kind;
+	int reg;
+} others[] = {
+	{ "STA", KIND_STORE, REG_A }, { "STX", KIND_STORE, REG_X }, { "STY", KIND_STORE, REG_Y },
+	{ "JMP", KIND_JMP, 0 }, { "JSR", KIND_JSR, 0 }, { "RTS", KIND_RTS, 0 }, { "RTI", KIND_RTI, 0 },
+	{ "BRK", KIND_BRK, 0 }, { "PHA", KIND_PHA, 0 }, { "PHP", KIND_PHP, 0 }, { "PLA", KIND_PLA, 0 },
+	{ "PLP", KIND_PLP, 0 }, { "NOP", KIND_IGNORE, 0 }
+};
+
+/*branches in opcode order: the top two bits pick the flag, bit 5 the value taken on*/
+static void (*const branchOps[ 8 ])( unsigned short int*, char, char ) = {
+	bpl, bmi, bvc, bvs, bcc, bcs, bne, beq
+};
+
+static const int branchFlags[ 4 ] = { STATUS_S, STATUS_V, STATUS_C, STATUS_Z };
+
+static Decoded decoded[ 256 ];
+
+#define FIND( table, name, i ) \
+	for( i = 0; i < (int)(sizeof( table ) / sizeof( table[ 0 ] )) && strcmp( table[ i ].name, name ) != 0; i++ )
+
+#define FOUND( table, i ) (i < (int)(sizeof( table ) / sizeof( table[ 0 ] )))
+
+/*
+ * Work out every opcode from the disassembler's tables. Undocumented
+ * NOPs read their operand like the documented one; the other
+ * undocumented opcodes are one byte no-ops, as in the interpreter.
+ */
+static void decode( void ) {
+	Decoded* d;
+	const char* name;
+	int op, i;
+
+	for( op = 0; op < 256; op++ ) {
+		d = &decoded[ op ];
+		name = disasmMnemonic( op );
+		d->mode = disasmMode( op );
+		d->cycles = machineOpcodeCycles( op );
+		d->kind = KIND_NONE;
+		if( !disasmOfficial( op ) && strcmp( name, "NOP" ) != 0 ) {
+			continue;
+		}
+
+		if( d->mode == MODE_RELATIVE ) {
+			d->kind = KIND_BRANCH;
+			d->branch = branchOps[ op >> 5 ];
+			d->reg = branchFlags[ op >> 6 ];
+			d->to = (op >> 5) & 1;
+			continue;
+		}
+		FIND( reads, name, i );
+		if( FOUND( reads, i ) ) {
+			d->kind = KIND_READ;
+			d->read = reads[ i ].op;
+			d->reg = reads[ i ].reg;
+			continue;
+		}
+		FIND( compares, name, i );
+		if( FOUND( compares, i ) ) {
+			d->kind = KIND_COMPARE;
+			d->compare = compares[ i ].op;
+			d->reg = compares[ i ].reg;
+			continue;
+		}
+		FIND( modifies, name, i );
+		if( FOUND( modifies, i ) ) {
+			d->kind = d->mode == MODE_ACCUMULATOR || d->mode == MODE_IMPLIED ? KIND_REGISTER : KIND_MODIFY;
+			d->modify = modifies[ i ].op;
+			d->reg = modifies[ i ].reg;
+			continue;
+		}
+		FIND( flags, name, i );
+		if( FOUND( flags, i ) ) {
+			d->kind = KIND_FLAG;
+			d->flag = flags[ i ].op;
+			continue;
+		}
+		FIND( transfers, name, i );
+		if( FOUND( transfers, i ) ) {
+			d->kind = KIND_TRANSFER;
+			d->transfer = transfers[ i ].op;
+			d->reg = transfers[ i ].from;
+			d->to = transfers[ i ].to;
+			continue;
+		}
+		FIND( others, name, i );
+		if( FOUND( others, i ) ) {
+			d->kind = others[ i ].kind;
+			d->reg = others[ i ].reg;
+		}
+	}
+}
+
+static char* reg( Lanes* l, int r, int i ) {
+	switch( r ) {
+	case REG_X: return &l->x[ i ];
+	case REG_Y: return &l->y[ i ];
+	case REG_SP: return (char*)&l->sp[ i ];
+	}
+	return &l->a[ i ];
+}
+
+/*
+ * bus of a lane, the same as the machine's with nothing at $2000-$5FFF
+ */
+
+static unsigned char load( Lanes* l, int i, unsigned short int addr ) {
+	if( addr < 0x2000 ) {
+		return l->mem[ i ].data[ addr & (RAM_SIZE - 1) ];
+	}
+	if( addr < 0x6000 ) {
+		return addr >> 8;
+	}
+	return l->mem[ i ].data[ addr ];
+}
+
+static void store( Lanes* l, int i, unsigned short int addr, unsigned char value ) {
+	if( addr < 0x2000 ) {
+		l->mem[ i ].data[ addr & (RAM_SIZE - 1) ] = value;
+	} else if( addr >= 0x6000 && addr < 0x8000 ) {
+		l->mem[ i ].data[ addr ] = value;
+	}
+}
+
+static unsigned char fetch( Lanes* l, int i ) {
+	return load( l, i, l->pc[ i ]++ );
+}
+
+static unsigned short int absolute( Lanes* l, int i ) {
+	unsigned short int low = fetch( l, i );
+	return low | (fetch( l, i ) << 8);
+}
+
+static unsigned short int indexed( unsigned short int base, char index, int* cycles ) {
+	unsigned short int addr = base + (unsigned char)index;
+	if( cycles != NULL && ((base ^ addr) & 0xFF00) ) {
+		*cycles += 1;
+	}
+	return addr;
+}
+
+static unsigned short int zeroPagePointer( Lanes* l, int i, unsigned char ptr ) {
+	return (unsigned char)l->mem[ i ].data[ ptr ] |
+	       ((unsigned char)l->mem[ i ].data[ (unsigned char)(ptr + 1) ] << 8);
+}
+
+/*
+ * The effective address of the operand, leaving pc after it, with the
+ * page crossing cycle added to *cycles if given as in the interpreter.
+ * Immediate operands are addressed where they are in the instruction.
+ */
+static unsigned short int address( Lanes* l, int i, int mode, int* cycles ) {
+	switch( mode ) {
+	case MODE_IMMEDIATE: return l->pc[ i ]++;
+	case MODE_ZERO_PAGE: return fetch( l, i );
+	case MODE_ZERO_PAGE_X: return (fetch( l, i ) + (unsigned char)l->x[ i ]) & 0xFF;
+	case MODE_ZERO_PAGE_Y: return (fetch( l, i ) + (unsigned char)l->y[ i ]) & 0xFF;
+	case MODE_ABSOLUTE: return absolute( l, i );
+	case MODE_ABSOLUTE_X: return indexed( absolute( l, i ), l->x[ i ], cycles );
+	case MODE_ABSOLUTE_Y: return indexed( absolute( l, i ), l->y[ i ], cycles );
+	case MODE_INDIRECT_X: return zeroPagePointer( l, i, fetch( l, i ) + l->x[ i ] );
+	case MODE_INDIRECT_Y: return indexed( zeroPagePointer( l, i, fetch( l, i ) ), l->y[ i ], cycles );
+	}
+	return 0;
+}
+
+/*run one decoded opcode on the count lanes listed, each with pc on its operand*/
+static void runGroup( Lanes* l, const Decoded* d, const int* lanes, int count ) {
+	unsigned short int addr, from;
+	int k, i, cycles;
+	char value;
+
+	for( k = 0; k < count; k++ ) {
+		i = lanes[ k ];
+		cycles = d->cycles;
+
+		switch( d->kind ) {
+		case KIND_READ:
+			d->read( reg( l, d->reg, i ), &l->p[ i ], load( l, i, address( l, i, d->mode, &cycles ) ) );
+			break;
+		case KIND_COMPARE:
+			d->compare( *reg( l, d->reg, i ), &l->p[ i ], load( l, i, address( l, i, d->mode, &cycles ) ) );
+			break;
+		case KIND_STORE:
+			addr = address( l, i, d->mode, NULL );
+			store( l, i, addr, *reg( l, d->reg, i ) );
+			break;
+		case KIND_MODIFY:
+			addr = address( l, i, d->mode, NULL );
+			value = load( l, i, addr );
+			d->modify( &value, &l->p[ i ] );
+			store( l, i, addr, value );
+			break;
+		case KIND_REGISTER:
+			d->modify( reg( l, d->reg, i ), &l->p[ i ] );
+			break;
+		case KIND_FLAG:
+			d->flag( &l->p[ i ] );
+			break;
+		case KIND_TRANSFER:
+			d->transfer( *reg( l, d->reg, i ), &l->p[ i ], reg( l, d->to, i ) );
+			break;
+		case KIND_BRANCH:
+			value = fetch( l, i );
+			from = l->pc[ i ];
+			d->branch( &l->pc[ i ], l->p[ i ], value );
+			if( getStatus( l->p[ i ], d->reg ) == d->to ) {
+				cycles += ((from ^ l->pc[ i ]) & 0xFF00) ? 2 : 1;
+			}
+			break;
+		case KIND_IGNORE:
+			if( d->mode != MODE_IMPLIED ) {
+				load( l, i, address( l, i, d->mode, &cycles ) );
+			}
+			break;
+		case KIND_JMP:
+			addr = absolute( l, i );
+			if( d->mode == MODE_INDIRECT ) {
+				/*the pointer's high byte is fetched without carrying into the next page*/
+				addr = load( l, i, addr ) | (load( l, i, (addr & 0xFF00) | ((addr + 1) & 0x00FF) ) << 8);
+			}
+			jmp( &l->pc[ i ], addr );
+			break;
+		case KIND_JSR:
+			addr = absolute( l, i );
+			jsr( &l->pc[ i ], addr, &l->sp[ i ], &l->mem[ i ] );
+			break;
+		case KIND_RTS: rts( &l->pc[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		case KIND_RTI: rti( &l->pc[ i ], &l->sp[ i ], &l->p[ i ], &l->mem[ i ] ); break;
+		case KIND_BRK: brk( &l->pc[ i ], &l->p[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		case KIND_PHA: pha( l->a[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		case KIND_PHP: php( l->p[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		case KIND_PLA: pla( &l->a[ i ], &l->p[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		case KIND_PLP: plp( &l->p[ i ], &l->sp[ i ], &l->mem[ i ] ); break;
+		}
+		l->cycles[ i ] += cycles;
+	}
+}
+
+void lanesPower( Lanes* l, const Cartridge* cart ) {
+	int i;
+
+	if( decoded[ 0 ].cycles == 0 ) {
+		decode();
+	}
+	memset( l, 0, sizeof( *l ) );
+	for( i = 0; i < LANES; i++ ) {
+		memcpy( l->mem[ i ].data + 0x8000, cart->prg, cart->prgSize );
+		if( cart->prgSize == CARTRIDGE_PRG_BANK ) {
+			memcpy( l->mem[ i ].data + 0xC000, cart->prg, CARTRIDGE_PRG_BANK );
+		}
+		l->sp[ i ] = 0xFD;
+		l->p[ i ] = 0x20 | (1 << STATUS_I);
+		l->pc[ i ] = load( l, i, VECTOR_RESET ) | (load( l, i, VECTOR_RESET + 1 ) << 8);
+		l->cycles[ i ] = 7;
+	}
+}
+
+/*
+ * Gather every lane's opcode into a vector. If one comparison shows
+ * they are all the same the lanes run as one group; otherwise they are
+ * bucketed by opcode in a single pass and each bucket is run, so lanes
+ * that went their own way cost about what a lane on its own does.
+ */
+void lanesStep( Lanes* l ) {
+	LaneBytes ops, apart;
+	unsigned char bucket[ 256 ], bucketOp[ LANES ], of[ LANES ];
+	int lanes[ LANES ], start[ LANES + 1 ], at[ LANES ];
+	int i, b, buckets = 0, together = 1;
+
+	for( i = 0; i < LANES; i++ ) {
+		ops[ i ] = fetch( l, i );
+	}
+	apart = ops != ops[ 0 ];
+	for( i = 0; i < LANES; i++ ) {
+		together &= !apart[ i ];
+	}
+	if( together ) {
+		for( i = 0; i < LANES; i++ ) {
+			lanes[ i ] = i;
+		}
+		runGroup( l, &decoded[ ops[ 0 ] ], lanes, LANES );
+		l->groups++;
+		l->steps += LANES;
+		return;
+	}
+
+	/*count the lanes on each opcode, then list them bucket by bucket*/
+	memset( bucket, 0xFF, sizeof( bucket ) );
+	memset( start, 0, sizeof( start ) );
+	for( i = 0; i < LANES; i++ ) {
+		b = bucket[ ops[ i ] ];
+		if( b == 0xFF ) {
+			b = bucket[ ops[ i ] ] = buckets++;
+			bucketOp[ b ] = ops[ i ];
+		}
+		of[ i ] = b;
+		start[ b + 1 ]++;
+	}
+	for( b = 0; b < buckets; b++ ) {
+		start[ b + 1 ] += start[ b ];
+		at[ b ] = start[ b ];
+	}
+	for( i = 0; i < LANES; i++ ) {
+		lanes[ at[ of[ i ] ]++ ] = i;
+	}
+	for( b = 0; b < buckets; b++ ) {
+		runGroup( l, &decoded[ bucketOp[ b ] ], lanes + start[ b ], start[ b + 1 ] - start[ b ] );
+	}
+	l->groups += buckets;
+	l->steps += LANES;
+}
+
+/*run lane i on its own for steps instructions*/
+static void runLane( Lanes* l, int i, unsigned long steps ) {
+	unsigned long s;
+	for( s = 0; s < steps; s++ ) {
+		runGroup( l, &decoded[ fetch( l, i ) ], &i, 1 );
+	}
+}
+
+/*
+ * Step the lanes together while most of them share opcodes. Once a
+ * step splits them into more than LANES/2 groups, each lane runs
+ * LANES_BURST instructions on its own, which keeps a lane's branches
+ * as predictable as the interpreter's, before they are compared again.
+ * The lanes share nothing, so the order they run in does not matter.
+ */
+void lanesRun( Lanes* l, unsigned long steps ) {
+	unsigned long s, burst, groups;
+	int i;
+
+	for( s = 0; s < steps; ) {
+		groups = l->groups;
+		lanesStep( l );
+		s++;
+		if( l->groups - groups <= LANES / 2 || s == steps ) {
+			continue;
+		}
+		burst = steps - s < LANES_BURST ? steps - s : LANES_BURST;
+		for( i = 0; i < LANES; i++ ) {
+			runLane( l, i, burst );
+		}
+		l->groups += burst * LANES;
+		l->steps += burst * LANES;
+		s += burst;
+	}
+}
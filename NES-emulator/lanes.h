@@ -0,0 +1,58 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include "cartridge.h"
+#include "processor.h"
+
+/*instances run together; 16 fill an SSE register with one byte each, 32 an AVX2 one*/
+#ifndef LANES
+#define LANES (16)
+#endif
+
+/*
+ * Experimental lockstep engine: LANES independent 6502s running the
+ * same cartridge, for fuzzing and the like. Registers are kept as
+ * structure of arrays, one array per register with an element per
+ * lane.
+ *
+ * A step runs one instruction on every lane. The opcodes of all lanes
+ * are gathered into a vector and compared lane-wise, so lanes that are
+ * on the same opcode are grouped and decoded once; lanes that went
+ * another way are bucketed by opcode and run in their own group.
+ * lanesRun lets lanes that have gone apart run on their own for a
+ * while, so divergence costs about what the interpreter does. Each
+ * lane's operation is still the processor.c function the interpreter
+ * calls, so results are the same as machineStep's.
+ *
+ * Only the CPU is there: each lane has its own Memory holding 2 KB of
+ * RAM and cartridge RAM, with the PRG-ROM copied in at $8000. Reads of
+ * $2000-$5FFF return the high byte of the address as nothing drives
+ * the bus, writes there are dropped, and there are no interrupts other
+ * than BRK.
+ */
+typedef struct {
+	char a[ LANES ];
+	char x[ LANES ];
+	char y[ LANES ];
+	char p[ LANES ];
+	unsigned char sp[ LANES ];
+	unsigned short int pc[ LANES ];
+	unsigned long cycles[ LANES ];
+
+	/*instructions run over all lanes, and groups they were run in*/
+	unsigned long steps;
+	unsigned long groups;
+
+	Memory mem[ LANES ];
+} Lanes;
+
+/*power every lane on with cart, in the state machinePower leaves the CPU in*/
+void lanesPower( Lanes* l, const Cartridge* cart );
+
+/*run one instruction on every lane*/
+void lanesStep( Lanes* l );
+
+/*run steps instructions on every lane, not necessarily in lockstep*/
+void lanesRun( Lanes* l, unsigned long steps );
+
+#endif
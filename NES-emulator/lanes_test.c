@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "lanes.h"
+#include "machine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COMPARE_STEPS (20000UL)
+#define BENCH_STEPS (200000UL)
+
+/*
+ * A loop that keeps mixing the seeds at $00-$03 and branches on the
+ * result, so lanes seeded differently keep splitting up and meeting
+ * again. It stays out of $2000-$5FFF, where the lanes have no PPU.
+ */
+static const unsigned char program[] = {
+	0xA9, 0x20, 0x85, 0x06, 0xA9, 0xC0, 0x85, 0x07, /*C000 ($06) = C020*/
+	0xA9, 0xF0, 0x85, 0x04, 0xA9, 0x03, 0x85, 0x05, /*C008 ($04) = 03F0*/
+	0xA2, 0x0E,                                     /*C010 ldx #$0E*/
+	0xA9, 0x03, 0x95, 0x21, 0x8A, 0x95, 0x20,       /*C012 ($20,x) = 03xx*/
+	0xCA, 0xCA, 0x10, 0xF5,                         /*C019 dex dex bpl C012*/
+	0x4C, 0x20, 0xC0,                               /*C01D jmp C020*/
+	0xA5, 0x00, 0x0A, 0x26, 0x01, 0x45, 0x02,       /*C020 lda $00 asl rol $01 eor $02*/
+	0x85, 0x00, 0x90, 0x03, 0x20, 0x70, 0xC0,       /*C027 sta $00 bcc C02E jsr C070*/
+	0xA6, 0x00, 0xBD, 0xF0, 0x02, 0x7D, 0x00, 0xC1, /*C02E ldx $00 lda $02F0,x adc $C100,x*/
+	0xA4, 0x01, 0x91, 0x04, 0xD9, 0x00, 0x03,       /*C036 ldy $01 sta ($04),y cmp $0300,y*/
+	0x30, 0x09, 0x48, 0x08, 0xE8, 0x86, 0x12,       /*C03D bmi C048 pha php inx stx $12*/
+	0x28, 0x68, 0xE5, 0x03,                         /*C044 plp pla sbc $03*/
+	0xC9, 0x40, 0xB0, 0x03, 0x1C, 0xF0, 0x02,       /*C048 cmp #$40 bcs C04F nop $02F0,x*/
+	0x29, 0x07, 0xD0, 0x02, 0x00, 0xEA,             /*C04F and #7 bne C055 brk*/
+	0xE6, 0x03, 0xBA, 0x8A, 0xA8, 0x98, 0x6A, 0x4A, /*C055 inc $03 tsx txa tay tya ror lsr*/
+	0x3E, 0x00, 0x02, 0xCA, 0x88, 0x84, 0x11,       /*C05D rol $0200,x dex dey sty $11*/
+	0x1A, 0x18, 0x6C, 0x06, 0x00,                   /*C064 nop clc jmp ($0006)*/
+	0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+	0xE6, 0x02, 0x8A, 0x29, 0x0E, 0xAA, 0xA1, 0x20, /*C070 inc $02 txa and #$0E tax lda ($20,x)*/
+	0xE0, 0x08, 0x90, 0x02, 0x24, 0x01,             /*C078 cpx #8 bcc C07E bit $01*/
+	0xC0, 0x80, 0x60,                               /*C07E cpy #$80 rts*/
+	0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+	0x40                                            /*C090 rti*/
+};
+
+static int failures = 0;
+
+void check( int condition, const char* what ) {
+	printf( "%s: %s\n", condition ? "ok  " : "FAIL", what );
+	if( !condition ) {
+		failures++;
+	}
+}
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void buildCartridge( Cartridge* cart ) {
+	static unsigned char image[ 16 + 0x4000 + 0x2000 ];
+	unsigned char* prg = image + 16;
+	char error[ 128 ];
+	int i;
+
+	memcpy( image, "NES\x1A\x01\x01\x01\x00", 8 );
+	memcpy( prg, program, sizeof( program ) );
+	for( i = 0; i < 0x200; i++ ) {
+		prg[ 0x100 + i ] = i * 7 + 3;
+	}
+
+	/*NMI and IRQ $C090, reset $C000*/
+	prg[ 0x3FFA ] = 0x90; prg[ 0x3FFB ] = 0xC0;
+	prg[ 0x3FFC ] = 0x00; prg[ 0x3FFD ] = 0xC0;
+	prg[ 0x3FFE ] = 0x90; prg[ 0x3FFF ] = 0xC0;
+
+	if( cartridgeParse( cart, image, sizeof( image ), error ) != 0 ) {
+		printf( "cannot build cartridge: %s\n", error );
+		exit( 1 );
+	}
+}
+
+/*the same random RAM in a lane and a machine; all lanes alike if together is set*/
+void seed( Lanes* l, Machine* machines, unsigned int s, int together ) {
+	int i, j;
+	srand( s );
+	for( i = 0; i < LANES; i++ ) {
+		if( together ) {
+			srand( s );
+		}
+		for( j = 0; j < RAM_SIZE; j++ ) {
+			l->mem[ i ].data[ j ] = machines[ i ].mem.data[ j ] = rand();
+		}
+	}
+}
+
+int sameAsMachine( const Lanes* l, int i, const Machine* m ) {
+	return l->a[ i ] == m->cpu.accum && l->x[ i ] == m->cpu.x && l->y[ i ] == m->cpu.y &&
+	       l->p[ i ] == m->cpu.status && l->sp[ i ] == m->cpu.sp && l->pc[ i ] == m->cpu.pc &&
+	       l->cycles[ i ] == m->cycles && memcmp( l->mem[ i ].data, m->mem.data, RAM_SIZE ) == 0;
+}
+
+void testPowerOn( Lanes* l, const Cartridge* cart ) {
+	Machine* m = malloc( sizeof( Machine ) );
+	int i, same = 1;
+
+	printf( "=======================================\n" );
+	printf( "power on\n" );
+	lanesPower( l, cart );
+	machinePower( m, cart );
+	for( i = 0; i < LANES; i++ ) {
+		same = same && sameAsMachine( l, i, m );
+	}
+	check( same, "every lane starts as a machine does" );
+	free( m );
+}
+
+void testAgainstMachine( Lanes* l, const Cartridge* cart ) {
+	Machine* machines = malloc( LANES * sizeof( Machine ) );
+	unsigned long s;
+	int i, same = 1, apart = 0;
+
+	printf( "=======================================\n" );
+	printf( "%d lanes against the interpreter\n", LANES );
+	lanesPower( l, cart );
+	for( i = 0; i < LANES; i++ ) {
+		machinePower( &machines[ i ], cart );
+		machines[ i ].idleSkip = 0;
+	}
+	seed( l, machines, 1, 0 );
+
+	for( s = 0; s < COMPARE_STEPS && same; s++ ) {
+		lanesStep( l );
+		for( i = 0; i < LANES; i++ ) {
+			machineStep( &machines[ i ], NULL );
+			same = same && sameAsMachine( l, i, &machines[ i ] );
+		}
+		for( i = 1; i < LANES; i++ ) {
+			apart += l->pc[ i ] != l->pc[ 0 ];
+		}
+	}
+	check( same, "registers, RAM and cycles match machineStep on every step" );
+	check( apart > 0, "lanes went their own way" );
+	check( l->groups > COMPARE_STEPS && l->groups < COMPARE_STEPS * LANES, "and were run in groups" );
+	printf( "%.2f lanes per group on average\n", (double)l->steps / l->groups );
+	free( machines );
+}
+
+void testRun( Lanes* l, const Cartridge* cart ) {
+	Machine* machines = malloc( LANES * sizeof( Machine ) );
+	unsigned long s;
+	int i, same = 1;
+
+	printf( "=======================================\n" );
+	printf( "lanes run apart\n" );
+	lanesPower( l, cart );
+	for( i = 0; i < LANES; i++ ) {
+		machinePower( &machines[ i ], cart );
+		machines[ i ].idleSkip = 0;
+	}
+	seed( l, machines, 3, 0 );
+
+	lanesRun( l, COMPARE_STEPS + 7 );
+	for( i = 0; i < LANES; i++ ) {
+		for( s = 0; s < COMPARE_STEPS + 7; s++ ) {
+			machineStep( &machines[ i ], NULL );
+		}
+		same = same && sameAsMachine( l, i, &machines[ i ] );
+	}
+	check( same, "lanesRun ends where machineStep does on every lane" );
+	check( l->steps == (COMPARE_STEPS + 7) * LANES, "and counts every step" );
+	free( machines );
+}
+
+/*instance-steps per second of the lanes and of as many machines, with lanes apart or together*/
+void testSpeed( Lanes* l, const Cartridge* cart, int together ) {
+	Machine* machines = malloc( LANES * sizeof( Machine ) );
+	unsigned long s;
+	double start, lanes, scalar;
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "speed with lanes %s\n", together ? "in step" : "apart" );
+	lanesPower( l, cart );
+	for( i = 0; i < LANES; i++ ) {
+		machinePower( &machines[ i ], cart );
+		machines[ i ].idleSkip = 0;
+	}
+	seed( l, machines, 2, together );
+
+	start = now();
+	lanesRun( l, BENCH_STEPS );
+	lanes = now() - start;
+
+	/*the interpreter also runs the PPU, so this is an upper bound on the gap*/
+	start = now();
+	for( i = 0; i < LANES; i++ ) {
+		for( s = 0; s < BENCH_STEPS; s++ ) {
+			machineStep( &machines[ i ], NULL );
+		}
+	}
+	scalar = now() - start;
+
+	printf( "lanes:   %.1f M instance-steps/s, %.2f lanes per group\n", l->steps / lanes / 1e6,
+	        (double)l->steps / l->groups );
+	printf( "machine: %.1f M instance-steps/s\n", BENCH_STEPS * LANES / scalar / 1e6 );
+	check( l->steps == BENCH_STEPS * LANES, "every lane ran every step" );
+	free( machines );
+}
+
+int main( int argc, char* argv[] ) {
+	Lanes* l = malloc( sizeof( Lanes ) );
+	Cartridge cart;
+
+	buildCartridge( &cart );
+	testPowerOn( l, &cart );
+	testAgainstMachine( l, &cart );
+	testRun( l, &cart );
+	testSpeed( l, &cart, 0 );
+	testSpeed( l, &cart, 1 );
+	cartridgeFree( &cart );
+	free( l );
+	printf( "\n%d failure(s)\n", failures );
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,1157 @@
+#include "machine.h"
+#include "breakpoint.h"
+#include "cdl.h"
+#include "counters.h"
+#include "hash.h"
+#include "profile.h"
+#include "recompile.h"
+
+#include <string.h>
+
+/*
+ * Base cycle count of every opcode. Page crossings, taken branches,
+ * DMA and interrupts are added on top of these.
+ */
+#if CPU_VARIANT == CPU_65C02
+/*the opcodes the 65C02 leaves undefined are NOPs of 1 to 8 cycles*/
+static const unsigned char cycleTable[ 256 ] = {
+/*       0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+/*0*/    7, 6, 2, 1, 5, 3, 5, 1, 3, 2, 2, 1, 6, 4, 6, 1,
+/*1*/    2, 5, 5, 1, 5, 4, 6, 1, 2, 4, 2, 1, 6, 4, 6, 1,
+/*2*/    6, 6, 2, 1, 3, 3, 5, 1, 4, 2, 2, 1, 4, 4, 6, 1,
+/*3*/    2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 2, 1, 4, 4, 6, 1,
+/*4*/    6, 6, 2, 1, 3, 3, 5, 1, 3, 2, 2, 1, 3, 4, 6, 1,
+/*5*/    2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 3, 1, 8, 4, 6, 1,
+/*6*/    6, 6, 2, 1, 3, 3, 5, 1, 4, 2, 2, 1, 6, 4, 6, 1,
+/*7*/    2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 4, 1, 6, 4, 6, 1,
+/*8*/    2, 6, 2, 1, 3, 3, 3, 1, 2, 2, 2, 1, 4, 4, 4, 1,
+/*9*/    2, 6, 5, 1, 4, 4, 4, 1, 2, 5, 2, 1, 4, 5, 5, 1,
+/*A*/    2, 6, 2, 1, 3, 3, 3, 1, 2, 2, 2, 1, 4, 4, 4, 1,
+/*B*/    2, 5, 5, 1, 4, 4, 4, 1, 2, 4, 2, 1, 4, 4, 4, 1,
+/*C*/    2, 6, 2, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1,
+/*D*/    2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 3, 1, 4, 4, 7, 1,
+/*E*/    2, 6, 2, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1,
+/*F*/    2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 4, 1, 4, 4, 7, 1
+};
+
+/*shifts and rotates on abs,X only take their extra cycle when it crosses a page*/
+#define SHIFT_CROSSING (&cycles)
+#else
+static const unsigned char cycleTable[ 256 ] = {
+/*       0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+/*0*/    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+/*1*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/*2*/    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+/*3*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/*4*/    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+/*5*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/*6*/    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+/*7*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/*8*/    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+/*9*/    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+/*A*/    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+/*B*/    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+/*C*/    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+/*D*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/*E*/    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+/*F*/    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7
+};
+
+#define SHIFT_CROSSING NULL
+#endif
+
+int machineOpcodeCycles( unsigned char opcode ) {
+	return cycleTable[ opcode ];
+}
+
+/*
+ * bus
+ */
+
+static __thread Breakpoints* breakpoints;
+
+void machineBreakpoints( Breakpoints* b ) {
+	breakpoints = b;
+}
+
+static void breakHit( Breakpoints* b, int kind, unsigned short int addr, unsigned char value ) {
+	b->hit.kind = kind;
+	b->hit.addr = addr;
+	b->hit.value = value;
+	b->hit.pc = b->pc;
+	b->hits++;
+}
+
+/*the slow path of an access to a flagged page*/
+static void watch( unsigned short int addr, int kind, unsigned char value ) {
+	if( breakpointTest( breakpoints, addr, kind ) ) {
+		breakHit( breakpoints, kind, addr, value );
+		breakpoints->stop = 1;
+	}
+}
+
+static __thread MachineSync* ppuSync;
+
+/*CPU cycles from the start of the running instruction to its bus accesses, for ppuSync*/
+static __thread int accessOffset;
+
+void machineSync( MachineSync* s ) {
+	ppuSync = s;
+}
+
+static __thread MachinePpuLog* ppuLog;
+
+void machineLogPpu( MachinePpuLog* l ) {
+	ppuLog = l;
+}
+
+#ifndef FLAT_BUS
+/*bring the PPU up to the access being made, if something else runs it*/
+static void syncPpu( Machine* m ) {
+	if( ppuSync != NULL ) {
+		ppuSync->catchUp( ppuSync, m, m->cycles + accessOffset );
+	}
+}
+
+static unsigned char readController( Machine* m, int port ) {
+	unsigned char bit;
+	if( m->strobe ) {
+		return 0x40 | (m->input[ port ] & 0x01);
+	}
+
+	/*after eight reads an official controller returns 1s*/
+	bit = m->shift[ port ] & 0x01;
+	m->shift[ port ] = (m->shift[ port ] >> 1) | 0x80;
+	return 0x40 | bit;
+}
+
+static unsigned char readIo( Machine* m, unsigned short int addr ) {
+	if( addr < 0x4000 ) {
+		syncPpu( m );
+		if( ppuLog != NULL ) {
+			ppuLog->access( ppuLog, m, addr & 0x07, -1 );
+		}
+		return ppuReadRegister( &m->ppu, addr & 0x07 );
+	}
+	if( addr == 0x4016 || addr == 0x4017 ) {
+		return readController( m, addr & 0x01 );
+	}
+	if( addr >= 0x6000 ) {
+		return m->mem.data[ addr ];
+	}
+
+	/*nothing drives the bus, so the high byte of the address is left on it*/
+	return addr >> 8;
+}
+#endif
+
+/*a read, without looking for watchpoints*/
+static unsigned char load( Machine* m, unsigned short int addr ) {
+	COUNT_READ( addr );
+#ifdef FLAT_BUS
+	return m->mem.data[ addr ];
+#else
+	if( addr >= 0x8000 ) {
+		return m->mem.data[ addr ];
+	}
+	if( addr < 0x2000 ) {
+		return m->mem.data[ addr & (RAM_SIZE - 1) ];
+	}
+	return readIo( m, addr );
+#endif
+}
+
+static __thread CodeDataLog* codeDataLog;
+
+void machineLog( CodeDataLog* log ) {
+	codeDataLog = log;
+	ppuLogChr( log != NULL ? log->chr : NULL );
+}
+
+/*flag a PRG-ROM byte, mirrors of a 16 KB PRG included*/
+static void logPrg( unsigned short int addr, int flags ) {
+	codeDataLog->prg[ addr & (codeDataLog->prgSize - 1) ] |= flags;
+}
+
+static unsigned char readBus( Machine* m, unsigned short int addr ) {
+	unsigned char value = load( m, addr );
+	if( breakpoints != NULL && (breakpoints->pages[ addr >> 8 ] & BREAK_READ) ) {
+		watch( addr, BREAK_READ, value );
+	}
+	if( codeDataLog != NULL && addr >= 0x8000 ) {
+		logPrg( addr, CDL_DATA );
+	}
+	return value;
+}
+
+#ifndef FLAT_BUS
+static void writeIo( Machine* m, unsigned short int addr, unsigned char value ) {
+	unsigned short int page;
+	unsigned char byte;
+	int i;
+
+	if( addr < 0x4000 ) {
+		syncPpu( m );
+		if( ppuLog != NULL ) {
+			ppuLog->access( ppuLog, m, addr & 0x07, value );
+		}
+		ppuWriteRegister( &m->ppu, addr & 0x07, value );
+	} else if( addr == 0x4014 ) {
+		syncPpu( m );
+		/*OAM DMA halts the CPU for 513 cycles, 514 if started on an odd one*/
+		COUNT( dmas );
+		COUNT_MANY( writes[ COUNTER_PPU ], 256 );
+		page = value << 8;
+		for( i = 0; i < 256; i++ ) {
+			byte = readBus( m, page + i );
+			if( ppuLog != NULL ) {
+				ppuLog->access( ppuLog, m, 4, byte );
+			}
+			ppuWriteRegister( &m->ppu, 4, byte );
+		}
+		m->stall += 513 + (m->cycles & 1);
+	} else if( addr == 0x4016 ) {
+		m->strobe = value & 0x01;
+		m->shift[ 0 ] = m->input[ 0 ];
+		m->shift[ 1 ] = m->input[ 1 ];
+	} else if( addr < 0x4018 ) {
+		m->apu.regs[ addr - 0x4000 ] = value;
+	} else if( addr >= 0x6000 && addr < 0x8000 ) {
+		m->mem.data[ addr ] = value;
+	}
+
+	/*writes to NROM's PRG-ROM are ignored*/
+}
+#endif
+
+static void store( Machine* m, unsigned short int addr, unsigned char value ) {
+	COUNT_WRITE( addr );
+#ifdef FLAT_BUS
+	m->mem.data[ addr ] = value;
+#else
+	if( addr < 0x2000 ) {
+		m->mem.data[ addr & (RAM_SIZE - 1) ] = value;
+	} else {
+		writeIo( m, addr, value );
+	}
+#endif
+}
+
+static void writeBus( Machine* m, unsigned short int addr, unsigned char value ) {
+	if( breakpoints != NULL && (breakpoints->pages[ addr >> 8 ] & BREAK_WRITE) ) {
+		watch( addr, BREAK_WRITE, value );
+	}
+	store( m, addr, value );
+}
+
+unsigned char machinePeek( const Machine* m, unsigned short int addr ) {
+#ifndef FLAT_BUS
+	if( addr < 0x2000 ) {
+		return m->mem.data[ addr & (RAM_SIZE - 1) ];
+	}
+	if( addr < 0x6000 ) {
+		return 0;
+	}
+#endif
+	return m->mem.data[ addr ];
+}
+
+unsigned char machineRead( Machine* m, unsigned short int addr ) {
+	return load( m, addr );
+}
+
+void machineWrite( Machine* m, unsigned short int addr, unsigned char value ) {
+	store( m, addr, value );
+}
+
+/*
+ * addressing modes. Each returns the effective address and leaves
+ * pc after the operand. Indexed modes add the page crossing cycle to
+ * *cycles, if given; stores and read-modify-write pass NULL because
+ * they always take the extra cycle.
+ */
+
+/*instruction bytes are not data reads, and do not trip read watchpoints*/
+static unsigned char fetchAs( Machine* m, int flags ) {
+	if( codeDataLog != NULL && m->cpu.pc >= 0x8000 ) {
+		logPrg( m->cpu.pc, flags );
+	}
+	return load( m, m->cpu.pc++ );
+}
+
+static unsigned char fetch( Machine* m ) {
+	return fetchAs( m, CDL_OPERAND );
+}
+
+static unsigned short int zeroPage( Machine* m ) {
+	return fetch( m );
+}
+
+static unsigned short int zeroPageX( Machine* m ) {
+	return (fetch( m ) + (unsigned char)m->cpu.x) & 0xFF;
+}
+
+static unsigned short int zeroPageY( Machine* m ) {
+	return (fetch( m ) + (unsigned char)m->cpu.y) & 0xFF;
+}
+
+static unsigned short int absolute( Machine* m ) {
+	unsigned short int low = fetch( m );
+	return low | (fetch( m ) << 8);
+}
+
+static unsigned short int indexed( unsigned short int base, char index, int* cycles ) {
+	unsigned short int addr = base + (unsigned char)index;
+	if( cycles != NULL && ((base ^ addr) & 0xFF00) ) {
+		*cycles += 1;
+	}
+	return addr;
+}
+
+static unsigned short int absoluteX( Machine* m, int* cycles ) {
+	return indexed( absolute( m ), m->cpu.x, cycles );
+}
+
+static unsigned short int absoluteY( Machine* m, int* cycles ) {
+	return indexed( absolute( m ), m->cpu.y, cycles );
+}
+
+/*pointers in zero page wrap around within it, and are read like any other data*/
+static unsigned short int zeroPagePointer( Machine* m, unsigned char ptr ) {
+	return readBus( m, ptr ) | (readBus( m, (unsigned char)(ptr + 1) ) << 8);
+}
+
+static unsigned short int indirectX( Machine* m ) {
+	return zeroPagePointer( m, fetch( m ) + m->cpu.x );
+}
+
+static unsigned short int indirectY( Machine* m, int* cycles ) {
+	return indexed( zeroPagePointer( m, fetch( m ) ), m->cpu.y, cycles );
+}
+
+#if CPU_VARIANT == CPU_65C02
+static unsigned short int zeroPageIndirect( Machine* m ) {
+	return zeroPagePointer( m, fetch( m ) );
+}
+#endif
+
+/*
+ * operation helpers
+ */
+
+static void modify( Machine* m, unsigned short int addr, void (*op)( char*, char* ) ) {
+	char value = readBus( m, addr );
+	op( &value, &m->cpu.status );
+	writeBus( m, addr, value );
+}
+
+#if CPU_VARIANT == CPU_65C02
+/*TSB and TRB, which modify memory with A*/
+static void testBits( Machine* m, unsigned short int addr, void (*op)( char, char*, char* ) ) {
+	char value = readBus( m, addr );
+	op( m->cpu.accum, &value, &m->cpu.status );
+	writeBus( m, addr, value );
+}
+#endif
+
+/*returns the extra cycles: one if taken, two if taken to another page*/
+static int branch( Machine* m, void (*op)( unsigned short int*, char, char ), int taken ) {
+	char offset = fetch( m );
+	unsigned short int from = m->cpu.pc;
+	op( &m->cpu.pc, m->cpu.status, offset );
+	if( !taken ) {
+		return 0;
+	}
+	return ((from ^ m->cpu.pc) & 0xFF00) ? 2 : 1;
+}
+
+static void interrupt( Machine* m, unsigned short int vector ) {
+	Cpu* c = &m->cpu;
+	pha( c->pc >> 8, &c->sp, &m->mem );
+	pha( c->pc & 0xFF, &c->sp, &m->mem );
+	pha( (c->status & ~(1 << STATUS_B)) | (1 << STATUS_U), &c->sp, &m->mem );
+	setStatus( &c->status, STATUS_I );
+#if CPU_VARIANT == CPU_65C02
+	clearStatus( &c->status, STATUS_D );
+#endif
+	c->pc = readBus( m, vector ) | (readBus( m, vector + 1 ) << 8);
+}
+
+/*
+ * execute one instruction, returning the cycles it took
+ */
+static int execute( Machine* m ) {
+	Cpu* c = &m->cpu;
+	unsigned char op = fetchAs( m, CDL_OPCODE );
+	int cycles = cycleTable[ op ];
+	unsigned short int addr;
+
+	COUNT( opcodes[ op ] );
+	switch( op ) {
+
+	/*loads*/
+	case 0xA9: lda( &c->accum, &c->status, fetch( m ) ); break;
+	case 0xA5: lda( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xB5: lda( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0xAD: lda( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0xBD: lda( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0xB9: lda( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0xA1: lda( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0xB1: lda( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0xA2: ldx( &c->x, &c->status, fetch( m ) ); break;
+	case 0xA6: ldx( &c->x, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xB6: ldx( &c->x, &c->status, readBus( m, zeroPageY( m ) ) ); break;
+	case 0xAE: ldx( &c->x, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0xBE: ldx( &c->x, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+
+	case 0xA0: ldy( &c->y, &c->status, fetch( m ) ); break;
+	case 0xA4: ldy( &c->y, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xB4: ldy( &c->y, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0xAC: ldy( &c->y, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0xBC: ldy( &c->y, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+
+	/*stores*/
+	case 0x85: writeBus( m, zeroPage( m ), c->accum ); break;
+	case 0x95: writeBus( m, zeroPageX( m ), c->accum ); break;
+	case 0x8D: writeBus( m, absolute( m ), c->accum ); break;
+	case 0x9D: writeBus( m, absoluteX( m, NULL ), c->accum ); break;
+	case 0x99: writeBus( m, absoluteY( m, NULL ), c->accum ); break;
+	case 0x81: writeBus( m, indirectX( m ), c->accum ); break;
+	case 0x91: writeBus( m, indirectY( m, NULL ), c->accum ); break;
+
+	case 0x86: writeBus( m, zeroPage( m ), c->x ); break;
+	case 0x96: writeBus( m, zeroPageY( m ), c->x ); break;
+	case 0x8E: writeBus( m, absolute( m ), c->x ); break;
+
+	case 0x84: writeBus( m, zeroPage( m ), c->y ); break;
+	case 0x94: writeBus( m, zeroPageX( m ), c->y ); break;
+	case 0x8C: writeBus( m, absolute( m ), c->y ); break;
+
+	/*arithmetic*/
+	case 0x69: adc( &c->accum, &c->status, fetch( m ) ); break;
+	case 0x65: adc( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0x75: adc( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0x6D: adc( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0x7D: adc( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0x79: adc( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0x61: adc( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0x71: adc( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0xE9: sbc( &c->accum, &c->status, fetch( m ) ); break;
+	case 0xE5: sbc( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xF5: sbc( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0xED: sbc( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0xFD: sbc( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0xF9: sbc( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0xE1: sbc( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0xF1: sbc( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	/*logic*/
+	case 0x29: and( &c->accum, &c->status, fetch( m ) ); break;
+	case 0x25: and( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0x35: and( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0x2D: and( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0x3D: and( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0x39: and( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0x21: and( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0x31: and( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0x09: ora( &c->accum, &c->status, fetch( m ) ); break;
+	case 0x05: ora( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0x15: ora( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0x0D: ora( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0x1D: ora( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0x19: ora( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0x01: ora( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0x11: ora( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0x49: eor( &c->accum, &c->status, fetch( m ) ); break;
+	case 0x45: eor( &c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0x55: eor( &c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0x4D: eor( &c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0x5D: eor( &c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0x59: eor( &c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0x41: eor( &c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0x51: eor( &c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0x24: bit( c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0x2C: bit( c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+
+	/*comparisons*/
+	case 0xC9: cmp( c->accum, &c->status, fetch( m ) ); break;
+	case 0xC5: cmp( c->accum, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xD5: cmp( c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0xCD: cmp( c->accum, &c->status, readBus( m, absolute( m ) ) ); break;
+	case 0xDD: cmp( c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0xD9: cmp( c->accum, &c->status, readBus( m, absoluteY( m, &cycles ) ) ); break;
+	case 0xC1: cmp( c->accum, &c->status, readBus( m, indirectX( m ) ) ); break;
+	case 0xD1: cmp( c->accum, &c->status, readBus( m, indirectY( m, &cycles ) ) ); break;
+
+	case 0xE0: cpx( c->x, &c->status, fetch( m ) ); break;
+	case 0xE4: cpx( c->x, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xEC: cpx( c->x, &c->status, readBus( m, absolute( m ) ) ); break;
+
+	case 0xC0: cpy( c->y, &c->status, fetch( m ) ); break;
+	case 0xC4: cpy( c->y, &c->status, readBus( m, zeroPage( m ) ) ); break;
+	case 0xCC: cpy( c->y, &c->status, readBus( m, absolute( m ) ) ); break;
+
+	/*shifts and rotates*/
+	case 0x0A: asl( &c->accum, &c->status ); break;
+	case 0x06: modify( m, zeroPage( m ), asl ); break;
+	case 0x16: modify( m, zeroPageX( m ), asl ); break;
+	case 0x0E: modify( m, absolute( m ), asl ); break;
+	case 0x1E: modify( m, absoluteX( m, SHIFT_CROSSING ), asl ); break;
+
+	case 0x4A: lsr( &c->accum, &c->status ); break;
+	case 0x46: modify( m, zeroPage( m ), lsr ); break;
+	case 0x56: modify( m, zeroPageX( m ), lsr ); break;
+	case 0x4E: modify( m, absolute( m ), lsr ); break;
+	case 0x5E: modify( m, absoluteX( m, SHIFT_CROSSING ), lsr ); break;
+
+	case 0x2A: rol( &c->accum, &c->status ); break;
+	case 0x26: modify( m, zeroPage( m ), rol ); break;
+	case 0x36: modify( m, zeroPageX( m ), rol ); break;
+	case 0x2E: modify( m, absolute( m ), rol ); break;
+	case 0x3E: modify( m, absoluteX( m, SHIFT_CROSSING ), rol ); break;
+
+	case 0x6A: ror( &c->accum, &c->status ); break;
+	case 0x66: modify( m, zeroPage( m ), ror ); break;
+	case 0x76: modify( m, zeroPageX( m ), ror ); break;
+	case 0x6E: modify( m, absolute( m ), ror ); break;
+	case 0x7E: modify( m, absoluteX( m, SHIFT_CROSSING ), ror ); break;
+
+	/*increments and decrements*/
+	case 0xE6: modify( m, zeroPage( m ), inc ); break;
+	case 0xF6: modify( m, zeroPageX( m ), inc ); break;
+	case 0xEE: modify( m, absolute( m ), inc ); break;
+	case 0xFE: modify( m, absoluteX( m, NULL ), inc ); break;
+
+	case 0xC6: modify( m, zeroPage( m ), dec ); break;
+	case 0xD6: modify( m, zeroPageX( m ), dec ); break;
+	case 0xCE: modify( m, absolute( m ), dec ); break;
+	case 0xDE: modify( m, absoluteX( m, NULL ), dec ); break;
+
+	case 0xE8: inx( &c->x, &c->status ); break;
+	case 0xC8: iny( &c->y, &c->status ); break;
+	case 0xCA: dex( &c->x, &c->status ); break;
+	case 0x88: dey( &c->y, &c->status ); break;
+
+	/*transfers*/
+	case 0xAA: tax( c->accum, &c->status, &c->x ); break;
+	case 0xA8: tay( c->accum, &c->status, &c->y ); break;
+	case 0xBA: tsx( c->sp, &c->status, &c->x ); break;
+	case 0x8A: txa( c->x, &c->status, &c->accum ); break;
+	case 0x9A: txs( c->x, &c->status, (char*)&c->sp ); break;
+	case 0x98: tya( c->y, &c->status, &c->accum ); break;
+
+	/*stack*/
+	case 0x48: pha( c->accum, &c->sp, &m->mem ); break;
+	case 0x08: php( c->status, &c->sp, &m->mem ); break;
+	case 0x68: pla( &c->accum, &c->status, &c->sp, &m->mem ); break;
+	case 0x28: plp( &c->status, &c->sp, &m->mem ); break;
+
+	/*flags*/
+	case 0x18: clc( &c->status ); break;
+	case 0xD8: cld( &c->status ); break;
+	case 0x58: cli( &c->status ); break;
+	case 0xB8: clv( &c->status ); break;
+	case 0x38: sec( &c->status ); break;
+	case 0xF8: sed( &c->status ); break;
+	case 0x78: sei( &c->status ); break;
+
+	/*branches*/
+	case 0x90: cycles += branch( m, bcc, !getStatus( c->status, STATUS_C ) ); break;
+	case 0xB0: cycles += branch( m, bcs, getStatus( c->status, STATUS_C ) ); break;
+	case 0xF0: cycles += branch( m, beq, getStatus( c->status, STATUS_Z ) ); break;
+	case 0xD0: cycles += branch( m, bne, !getStatus( c->status, STATUS_Z ) ); break;
+	case 0x30: cycles += branch( m, bmi, getStatus( c->status, STATUS_S ) ); break;
+	case 0x10: cycles += branch( m, bpl, !getStatus( c->status, STATUS_S ) ); break;
+	case 0x70: cycles += branch( m, bvs, getStatus( c->status, STATUS_V ) ); break;
+	case 0x50: cycles += branch( m, bvc, !getStatus( c->status, STATUS_V ) ); break;
+
+	/*jumps, calls and returns*/
+	case 0x4C: jmp( &c->pc, absolute( m ) ); break;
+	case 0x6C:
+		addr = absolute( m );
+#if CPU_VARIANT == CPU_65C02
+		jmp( &c->pc, readBus( m, addr ) | (readBus( m, addr + 1 ) << 8) );
+#else
+		/*the pointer's high byte is fetched without carrying into the next page*/
+		jmp( &c->pc, readBus( m, addr ) |
+		             (readBus( m, (addr & 0xFF00) | ((addr + 1) & 0x00FF) ) << 8) );
+#endif
+		break;
+	case 0x20: addr = absolute( m ); jsr( &c->pc, addr, &c->sp, &m->mem ); break;
+	case 0x60: rts( &c->pc, &c->sp, &m->mem ); break;
+	case 0x40: rti( &c->pc, &c->sp, &c->status, &m->mem ); break;
+	case 0x00:
+		COUNT( brks );
+		brk( &c->pc, &c->status, &c->sp, &m->mem );
+#if CPU_VARIANT == CPU_65C02
+		clearStatus( &c->status, STATUS_D );
+#endif
+
+		/*brk reads the vector straight from memory*/
+		if( codeDataLog != NULL ) {
+			logPrg( VECTOR_IRQ, CDL_DATA );
+			logPrg( VECTOR_IRQ + 1, CDL_DATA );
+		}
+		break;
+
+#if CPU_VARIANT == CPU_65C02
+	/*65C02 additions*/
+	case 0x12: ora( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0x32: and( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0x52: eor( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0x72: adc( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0x92: writeBus( m, zeroPageIndirect( m ), c->accum ); break;
+	case 0xB2: lda( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0xD2: cmp( c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+	case 0xF2: sbc( &c->accum, &c->status, readBus( m, zeroPageIndirect( m ) ) ); break;
+
+	case 0x34: bit( c->accum, &c->status, readBus( m, zeroPageX( m ) ) ); break;
+	case 0x3C: bit( c->accum, &c->status, readBus( m, absoluteX( m, &cycles ) ) ); break;
+	case 0x89:
+		/*BIT # only sets Z*/
+		if( c->accum & fetch( m ) ) {
+			clearStatus( &c->status, STATUS_Z );
+		} else {
+			setStatus( &c->status, STATUS_Z );
+		}
+		break;
+
+	case 0x64: writeBus( m, zeroPage( m ), 0 ); break;
+	case 0x74: writeBus( m, zeroPageX( m ), 0 ); break;
+	case 0x9C: writeBus( m, absolute( m ), 0 ); break;
+	case 0x9E: writeBus( m, absoluteX( m, NULL ), 0 ); break;
+
+	case 0x04: testBits( m, zeroPage( m ), tsb ); break;
+	case 0x0C: testBits( m, absolute( m ), tsb ); break;
+	case 0x14: testBits( m, zeroPage( m ), trb ); break;
+	case 0x1C: testBits( m, absolute( m ), trb ); break;
+
+	case 0x1A: inc( &c->accum, &c->status ); break;
+	case 0x3A: dec( &c->accum, &c->status ); break;
+
+	case 0xDA: pha( c->x, &c->sp, &m->mem ); break;
+	case 0x5A: pha( c->y, &c->sp, &m->mem ); break;
+	case 0xFA: pla( &c->x, &c->status, &c->sp, &m->mem ); break;
+	case 0x7A: pla( &c->y, &c->status, &c->sp, &m->mem ); break;
+
+	case 0x80: cycles += branch( m, bra, 1 ); break;
+	case 0x7C:
+		addr = absoluteX( m, NULL );
+		jmp( &c->pc, readBus( m, addr ) | (readBus( m, addr + 1 ) << 8) );
+		break;
+
+	/*the rest are no-ops, of one byte unless they have an operand to skip*/
+	case 0xEA:
+		nop();
+		break;
+	case 0x02: case 0x22: case 0x42: case 0x62: case 0x82: case 0xC2: case 0xE2:
+	case 0x44: case 0x54: case 0xD4: case 0xF4:
+		fetch( m );
+		break;
+	case 0x5C: case 0xDC: case 0xFC:
+		absolute( m );
+		break;
+
+	default:
+		nop();
+		break;
+#else
+	/*no-ops, including the undocumented ones that still read their operand*/
+	case 0xEA: case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA:
+		nop();
+		break;
+	case 0x80: case 0x82: case 0x89: case 0xC2: case 0xE2:
+		fetch( m );
+		break;
+	case 0x04: case 0x44: case 0x64:
+		readBus( m, zeroPage( m ) );
+		break;
+	case 0x14: case 0x34: case 0x54: case 0x74: case 0xD4: case 0xF4:
+		readBus( m, zeroPageX( m ) );
+		break;
+	case 0x0C:
+		readBus( m, absolute( m ) );
+		break;
+	case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0xDC: case 0xFC:
+		readBus( m, absoluteX( m, &cycles ) );
+		break;
+
+	default:
+		/*the remaining undocumented opcodes are not emulated*/
+		nop();
+		break;
+#endif
+	}
+#if CPU_VARIANT == CPU_65C02
+	/*ADC and SBC take a cycle longer in decimal mode*/
+	if( (op & 0x60) == 0x60 && ((op & 0x03) == 0x01 || (op & 0x1F) == 0x12) && getStatus( c->status, STATUS_D ) ) {
+		cycles += 1;
+	}
+#endif
+	return cycles;
+}
+
+static void (*const branchOps[ 8 ])( unsigned short int*, char, char ) = {
+	bpl, bmi, bvc, bvs, bcc, bcs, bne, beq
+};
+
+/*
+ * mark the bytes of an idle loop at pc as run: a load of size bytes
+ * from addr and a branch back, or a JMP to itself if size is 0
+ */
+static void logLoop( unsigned short int pc, int size, unsigned short int addr ) {
+	int i, length = size != 0 ? size : 3;
+
+	logPrg( pc, CDL_OPCODE );
+	for( i = 1; i < length; i++ ) {
+		logPrg( pc + i, CDL_OPERAND );
+	}
+	if( size != 0 ) {
+		logPrg( pc + size, CDL_OPCODE );
+		logPrg( pc + size + 1, CDL_OPERAND );
+		if( addr >= 0x8000 ) {
+			logPrg( addr, CDL_DATA );
+		}
+	}
+}
+
+/*
+ * Idle loops: a load from RAM or $2002 with a branch straight back to
+ * it, or a jump to itself. Each time round does exactly the same until
+ * an NMI comes in or $2002 changes, so the time in between can be
+ * skipped. Returns the number of cycles of whole loop iterations that
+ * can be skipped at pc, or 0.
+ */
+static int idleLoop( Machine* m ) {
+	Cpu cpu = m->cpu;
+	const char* code = m->mem.data + cpu.pc;
+	unsigned char op = code[ 0 ], branchOp;
+	unsigned short int addr, from;
+	int size = 3, value, quiet, period;
+
+	if( cpu.pc < 0x8000 || cpu.pc > 0xFFFA || m->stall || m->ppu.nmi ) {
+		return 0;
+	}
+	addr = (unsigned char)code[ 1 ] | ((unsigned char)code[ 2 ] << 8);
+
+	if( op == 0x4C ) {
+		if( addr != cpu.pc ) {
+			return 0;
+		}
+		period = 3;
+		quiet = ppuQuietDots( &m->ppu, 0 );
+	} else {
+		switch( op ) {
+		case 0xA5: case 0xA6: case 0xA4: case 0x24:
+			size = 2;
+			addr &= 0xFF;
+			break;
+		case 0xAD: case 0xAE: case 0xAC: case 0x2C:
+			break;
+		default:
+			return 0;
+		}
+
+		/*only NMIs write to RAM while the CPU is stuck here*/
+		if( addr < 0x2000 ) {
+			value = (unsigned char)m->mem.data[ addr & (RAM_SIZE - 1) ];
+			quiet = ppuQuietDots( &m->ppu, 0 );
+		} else if( addr < 0x4000 && (addr & 0x07) == 2 ) {
+			value = ppuPeekStatus( &m->ppu );
+			quiet = ppuQuietDots( &m->ppu, 1 );
+		} else if( addr >= 0x6000 ) {
+			value = (unsigned char)m->mem.data[ addr ];
+			quiet = ppuQuietDots( &m->ppu, 0 );
+		} else {
+			return 0;
+		}
+		if( value < 0 ) {
+			return 0;
+		}
+
+		switch( op ) {
+		case 0xA5: case 0xAD: lda( &cpu.accum, &cpu.status, value ); break;
+		case 0xA6: case 0xAE: ldx( &cpu.x, &cpu.status, value ); break;
+		case 0xA4: case 0xAC: ldy( &cpu.y, &cpu.status, value ); break;
+		default: bit( cpu.accum, &cpu.status, value ); break;
+		}
+
+		/*the branch has to be taken and lead back to the load*/
+		branchOp = code[ size ];
+		if( (branchOp & 0x1F) != 0x10 ) {
+			return 0;
+		}
+		cpu.pc += size + 2;
+		from = cpu.pc;
+		branchOps[ branchOp >> 5 ]( &cpu.pc, cpu.status, code[ size + 1 ] );
+		if( cpu.pc != m->cpu.pc ) {
+			return 0;
+		}
+		period = cycleTable[ op ] + cycleTable[ branchOp ] + (((from ^ cpu.pc) & 0xFF00) ? 2 : 1);
+	}
+
+	/*a breakpoint anywhere near the loop has to see it run*/
+	if( breakpoints != NULL && (breakpoints->pages[ cpu.pc >> 8 ] | breakpoints->pages[ (cpu.pc + size + 1) >> 8 ] |
+	                            breakpoints->pages[ addr >> 8 ]) ) {
+		return 0;
+	}
+	if( codeDataLog != NULL ) {
+		logLoop( m->cpu.pc, op == 0x4C ? 0 : size, addr );
+	}
+	return quiet / (period * 3) * period;
+}
+
+/*finish an instruction that took the given cycles: DMA, NMI and the PPU*/
+static int finish( Machine* m, int cycles, unsigned char* frame, int* vblank ) {
+#ifdef COUNTERS
+	uint64_t start = 0;
+#endif
+	cycles += m->stall;
+	m->stall = 0;
+
+	if( m->ppu.nmi ) {
+		COUNT( nmis );
+		m->ppu.nmi = 0;
+		interrupt( m, VECTOR_NMI );
+		cycles += 7;
+	}
+
+	m->cycles += cycles;
+#ifdef COUNTERS
+	if( ++counters.samples % COUNTER_SAMPLE == 0 ) {
+		start = countersNow();
+	}
+#endif
+	if( ppuRun( &m->ppu, cycles * 3, frame ) ) {
+		*vblank = 1;
+	}
+#ifdef COUNTERS
+	if( start != 0 ) {
+		counters.ns[ COUNTER_TIME_PPU ] += countersSince( start ) * COUNTER_SAMPLE;
+	}
+#endif
+	return cycles;
+}
+
+/*skip an idle loop at pc if there is one, returning the cycles skipped*/
+static int skipIdle( Machine* m, unsigned char* frame ) {
+	int cycles = idleLoop( m );
+#ifdef COUNTERS
+	uint64_t start;
+#endif
+
+	if( cycles > 0 ) {
+		m->cycles += cycles;
+		m->idleCycles += cycles;
+#ifdef COUNTERS
+		start = countersNow();
+#endif
+		ppuRun( &m->ppu, cycles * 3, frame );
+#ifdef COUNTERS
+		counters.ns[ COUNTER_TIME_PPU ] += countersSince( start );
+#endif
+	}
+	return cycles;
+}
+
+/*
+ * one instruction plus interrupt service, with the PPU brought level.
+ * *vblank is set if the PPU entered vblank meanwhile.
+ */
+static int step( Machine* m, unsigned char* frame, int* vblank ) {
+	int cycles;
+	if( m->idleSkip && (cycles = skipIdle( m, frame )) > 0 ) {
+		return cycles;
+	}
+	return finish( m, execute( m ), frame, vblank );
+}
+
+int machineExecute( Machine* m ) {
+	int cycles;
+
+	accessOffset = cycleTable[ machinePeek( m, m->cpu.pc ) ] - 1;
+	cycles = execute( m ) + m->stall;
+	m->stall = 0;
+	if( m->ppu.nmi ) {
+		COUNT( nmis );
+		m->ppu.nmi = 0;
+		interrupt( m, VECTOR_NMI );
+		cycles += 7;
+	}
+	m->cycles += cycles;
+	return cycles;
+}
+
+/*
+ * recompiled code
+ */
+
+static __thread const RecompiledCode* recompiled;
+
+void machineRecompiled( const RecompiledCode* code ) {
+	recompiled = code;
+}
+
+unsigned char machineBusRead( Machine* m, unsigned short int addr ) {
+	return readBus( m, addr );
+}
+
+void machineBusWrite( Machine* m, unsigned short int addr, unsigned char value ) {
+	writeBus( m, addr, value );
+}
+
+int machineFinish( Machine* m, int cycles, unsigned char* frame, int* vblank ) {
+	int nmi = m->ppu.nmi;
+	finish( m, cycles, frame, vblank );
+	return nmi || *vblank;
+}
+
+int machineQuietCycles( const Machine* m ) {
+	return m->ppu.nmi ? -1 : ppuQuietDots( &m->ppu, 0 ) / 3;
+}
+
+/*run the block at pc, or interpret one instruction where there is none*/
+static void runBlock( Machine* m, unsigned char* frame, int* vblank ) {
+	RecompiledBlock block = m->cpu.pc >= 0x8000 ? recompiled->blocks[ m->cpu.pc - 0x8000 ] : NULL;
+
+	if( m->idleSkip && skipIdle( m, frame ) > 0 ) {
+		return;
+	}
+	if( block != NULL ) {
+		block( m, frame, vblank );
+	} else {
+		finish( m, execute( m ), frame, vblank );
+	}
+}
+
+/*
+ * profiler
+ */
+
+static __thread ProfileHook* profiling;
+
+void machineProfile( ProfileHook* h ) {
+	profiling = h;
+}
+
+/*
+ * a step counted by the profiler, which is profiling m, skipping idle
+ * loops as step does or not. Skipped cycles are charged to the loop.
+ */
+static int profiledStep( Machine* m, unsigned char* frame, int* vblank, int skip ) {
+	ProfileHook* h = profiling;
+	ProfileCount* count = &h->counts[ m->cpu.pc ];
+	unsigned short int pc = m->cpu.pc;
+	unsigned char sp = m->cpu.sp;
+	int cycles;
+
+	if( skip && m->idleSkip && (cycles = skipIdle( m, frame )) > 0 ) {
+		count->cycles += cycles;
+		return cycles;
+	}
+	cycles = finish( m, execute( m ), frame, vblank );
+	count->instructions++;
+	count->cycles += cycles;
+	if( m->cpu.sp != sp ) {
+		h->event( h, m, pc, sp, m->cycles - cycles );
+	}
+	return cycles;
+}
+
+/*
+ * observers
+ */
+
+static __thread MachineObserver* observers;
+
+void machineObserve( MachineObserver* o ) {
+	o->next = observers;
+	observers = o;
+}
+
+void machineUnobserve( MachineObserver* o ) {
+	MachineObserver** link = &observers;
+	while( *link != NULL && *link != o ) {
+		link = &(*link)->next;
+	}
+	if( *link != NULL ) {
+		*link = o->next;
+	}
+}
+
+/*
+ * a step with observers or breakpoints attached. Observers see every
+ * instruction, so idle loops are only skipped without them. Returns -1
+ * if stopped before the instruction, and sets *stop if a watchpoint
+ * stopped the machine after it.
+ */
+static int checkedStep( Machine* m, unsigned char* frame, int* vblank, int* stop ) {
+	Breakpoints* b = breakpoints;
+	MachineObserver* o;
+	int stopped = 0, cycles;
+
+	for( o = observers; o != NULL; o = o->next ) {
+		stopped |= o->instruction( o, m );
+	}
+	if( stopped ) {
+		return -1;
+	}
+	if( b != NULL ) {
+		if( b->resume ) {
+			b->resume = 0;
+		} else if( (b->pages[ m->cpu.pc >> 8 ] & BREAK_EXECUTE) && breakpointTest( b, m->cpu.pc, BREAK_EXECUTE ) ) {
+			b->pc = m->cpu.pc;
+			breakHit( b, BREAK_EXECUTE, m->cpu.pc, machinePeek( m, m->cpu.pc ) );
+			b->resume = 1;
+			return -1;
+		}
+		b->pc = m->cpu.pc;
+	}
+
+	if( profiling != NULL && profiling->machine == m ) {
+		cycles = profiledStep( m, frame, vblank, observers == NULL );
+	} else {
+		cycles = observers != NULL ? finish( m, execute( m ), frame, vblank ) : step( m, frame, vblank );
+	}
+	if( b != NULL && b->stop ) {
+		b->stop = 0;
+		*stop = 1;
+	}
+	return cycles;
+}
+
+int machineStep( Machine* m, unsigned char* frame ) {
+	int vblank = 0, stop = 0, cycles;
+	if( observers != NULL || breakpoints != NULL ) {
+		cycles = checkedStep( m, frame, &vblank, &stop );
+		return cycles < 0 ? 0 : cycles;
+	}
+	if( profiling != NULL && profiling->machine == m ) {
+		return profiledStep( m, frame, &vblank, 1 );
+	}
+	return step( m, frame, &vblank );
+}
+
+int machineRunFrame( Machine* m, unsigned char* frame ) {
+	int vblank = 0, stopped = 0;
+#ifdef COUNTERS
+	uint64_t start = countersNow();
+	uint64_t others = counters.ns[ COUNTER_TIME_PPU ] + counters.ns[ COUNTER_TIME_APU ];
+#endif
+	if( observers != NULL || breakpoints != NULL ) {
+		while( !vblank && !stopped ) {
+			if( checkedStep( m, frame, &vblank, &stopped ) < 0 ) {
+				stopped = 1;
+			}
+		}
+
+		/*a watchpoint in the instruction that ends the frame does not stop it*/
+		stopped = !vblank;
+	} else if( profiling != NULL && profiling->machine == m ) {
+		while( !vblank ) {
+			profiledStep( m, frame, &vblank, 1 );
+		}
+	} else if( recompiled != NULL && codeDataLog == NULL ) {
+		while( !vblank ) {
+			runBlock( m, frame, &vblank );
+		}
+	} else {
+		while( !vblank ) {
+			step( m, frame, &vblank );
+		}
+	}
+#ifdef COUNTERS
+	/*the PPU is sampled, so its share can come out above the whole*/
+	start = countersNow() - start;
+	others = counters.ns[ COUNTER_TIME_PPU ] + counters.ns[ COUNTER_TIME_APU ] - others;
+	counters.ns[ COUNTER_TIME_CPU ] += start > others ? start - others : 0;
+	counters.frames += !stopped;
+#endif
+	if( stopped ) {
+		return 1;
+	}
+	m->frame++;
+	if( profiling != NULL && profiling->machine == m ) {
+		profiling->event( profiling, m, m->cpu.pc, m->cpu.sp, m->cycles );
+	}
+	return 0;
+}
+
+void machineFastForward( Machine* m, unsigned long frames ) {
+	while( frames-- > 0 ) {
+		machineRunFrame( m, NULL );
+	}
+}
+
+uint64_t machineHash( const Machine* m ) {
+	uint64_t hash = hash64( m, offsetof( Machine, idleSkip ), 0 );
+	return hash64( (const char*)m + offsetof( Machine, cycles ), sizeof( Machine ) - offsetof( Machine, cycles ), hash );
+}
+
+void machineSave( const Machine* m, MachineSnapshot* snapshot ) {
+	memcpy( snapshot->head, m, MACHINE_SNAPSHOT_HEAD );
+	memcpy( snapshot->ram, m->mem.data, RAM_SIZE );
+	memcpy( snapshot->cartRam, m->mem.data + 0x6000, sizeof( snapshot->cartRam ) );
+	if( m->ppu.chrWritable ) {
+		memcpy( snapshot->chr, m->ppu.chr, sizeof( snapshot->chr ) );
+	}
+}
+
+void machineRestore( Machine* m, const MachineSnapshot* snapshot ) {
+	memcpy( m, snapshot->head, MACHINE_SNAPSHOT_HEAD );
+	memcpy( m->mem.data, snapshot->ram, RAM_SIZE );
+	memcpy( m->mem.data + 0x6000, snapshot->cartRam, sizeof( snapshot->cartRam ) );
+	if( m->ppu.chrWritable ) {
+		memcpy( m->ppu.chr, snapshot->chr, sizeof( snapshot->chr ) );
+	}
+}
+
+void machineRunAhead( Machine* m, int ahead, unsigned char* frame, MachineSnapshot* scratch ) {
+	if( ahead <= 0 ) {
+		machineRunFrame( m, frame );
+		return;
+	}
+	machineRunFrame( m, NULL );
+	machineSave( m, scratch );
+	machineFastForward( m, ahead - 1 );
+	machineRunFrame( m, frame );
+	machineRestore( m, scratch );
+}
+
+void machinePower( Machine* m, const Cartridge* cart ) {
+	memset( m, 0, sizeof( *m ) );
+
+	/*a single 16 KB bank shows up at both $8000 and $C000*/
+	memcpy( m->mem.data + 0x8000, cart->prg, cart->prgSize );
+	if( cart->prgSize == CARTRIDGE_PRG_BANK ) {
+		memcpy( m->mem.data + 0xC000, cart->prg, CARTRIDGE_PRG_BANK );
+	}
+	ppuPower( &m->ppu, cart->chr, cart->chrSize, cart->mirroring );
+	m->idleSkip = 1;
+
+	/*the reset sequence leaves SP at $FD with interrupts disabled*/
+	m->cpu.sp = 0x00;
+	m->cpu.status = 0x20;
+	machineReset( m );
+}
+
+void machineReset( Machine* m ) {
+	Cpu* c = &m->cpu;
+
+	/*reset goes through the motions of an interrupt without writing the stack*/
+	c->sp -= 3;
+	setStatus( &c->status, STATUS_I );
+	c->pc = readBus( m, VECTOR_RESET ) | (readBus( m, VECTOR_RESET + 1 ) << 8);
+
+	m->apu.regs[ 0x15 ] = 0;
+	m->stall = 0;
+	ppuReset( &m->ppu );
+
+	m->cycles += 7;
+	ppuRun( &m->ppu, 7 * 3, NULL );
+}
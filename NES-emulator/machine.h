@@ -0,0 +1,226 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "cartridge.h"
+#include "ppu.h"
+#include "processor.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*controller buttons, in the order they are shifted out of $4016*/
+#define BUTTON_A (0x01)
+#define BUTTON_B (0x02)
+#define BUTTON_SELECT (0x04)
+#define BUTTON_START (0x08)
+#define BUTTON_UP (0x10)
+#define BUTTON_DOWN (0x20)
+#define BUTTON_LEFT (0x40)
+#define BUTTON_RIGHT (0x80)
+
+#define VECTOR_NMI (0xFFFA)
+#define VECTOR_RESET (0xFFFC)
+#define VECTOR_IRQ (0xFFFE)
+
+/*size of the 2A03's internal work RAM, mirrored through $0000-$1FFF*/
+#define RAM_SIZE (0x0800)
+
+typedef struct {
+	char accum;
+	char x;
+	char y;
+	char status;
+	unsigned char sp;
+	unsigned short int pc;
+} Cpu;
+
+/*
+ * Audio registers $4000-$4017. There is no sound generation yet;
+ * writes are only latched so they are part of the machine state.
+ */
+typedef struct {
+	unsigned char regs[ 0x18 ];
+} Apu;
+
+/*
+ * The whole console. It holds no pointers: the cartridge's PRG-ROM
+ * is copied into mem at $8000 and its CHR into the PPU when powered
+ * on, so a Machine can be copied, hashed or saved as a block of bytes.
+ *
+ * Work RAM is kept at $0000-$07FF of mem and reached through its
+ * mirrors by the bus; the rest of mem below $8000 is only used for
+ * cartridge RAM at $6000-$7FFF.
+ *
+ * Built with FLAT_BUS the CPU sees all of mem as plain RAM instead,
+ * with no mirrors, I/O registers or read-only PRG, for running bare
+ * 6502 programs such as conformance tests.
+ */
+typedef struct {
+	Cpu cpu;
+
+	/*cycles still owed by an OAM DMA started during the last instruction*/
+	unsigned short int stall;
+
+	/*buttons held on each controller, and the shift registers read through $4016/$4017*/
+	unsigned char input[ 2 ];
+	unsigned char shift[ 2 ];
+	unsigned char strobe;
+
+	/*
+	 * Skip over idle loops instead of running them (on after power-on),
+	 * and the CPU cycles skipped that way. Something that looks at the
+	 * machine between steps should turn this off, as a single step may
+	 * then cover most of a frame.
+	 */
+	unsigned char idleSkip;
+	unsigned long idleCycles;
+
+	unsigned long cycles;
+	unsigned long frame;
+
+	Apu apu;
+	Ppu ppu;
+	Memory mem;
+} Machine;
+
+/*
+ * In-memory snapshot of everything in a Machine that can change. The
+ * PRG-ROM, and CHR unless it is RAM, stay out of it, which keeps a save
+ * or restore down to copying a few kilobytes. Restoring is only valid
+ * into a machine powered on with the same cartridge.
+ */
+#define MACHINE_SNAPSHOT_HEAD (offsetof( Machine, ppu ) + offsetof( Ppu, chr ))
+
+typedef struct {
+	unsigned char head[ MACHINE_SNAPSHOT_HEAD ];
+	char ram[ RAM_SIZE ];
+	char cartRam[ 0x2000 ];
+	unsigned char chr[ 8192 ];
+} MachineSnapshot;
+
+/*
+ * Something watching the CPU from the host side, such as a tracer
+ * (the profiler has a cheaper hook of its own). Observers are attached
+ * to the calling thread and see every instruction any machine runs on
+ * it; with none attached the CPU loop does not look for them at all.
+ */
+typedef struct MachineObserver MachineObserver;
+
+struct MachineObserver {
+	/*
+	 * called before each instruction, with pc at its opcode. Returning
+	 * nonzero stops the machine without running the instruction.
+	 * Idle loops are not skipped while observers are attached.
+	 */
+	int (*instruction)( MachineObserver* o, Machine* m );
+	MachineObserver* next;
+};
+
+void machineObserve( MachineObserver* o );
+
+void machineUnobserve( MachineObserver* o );
+
+/*
+ * Something that runs the PPU itself rather than leaving it to the
+ * CPU loop, such as the accuracy mode (accuracy.h). While one is
+ * attached to the calling thread, every CPU access to $2000-$3FFF and
+ * $4014 first has it bring the PPU up to the CPU cycle the access
+ * happens on. Only machineExecute knows that cycle, so the other ways
+ * of running a machine must not be used while a sync is attached.
+ */
+typedef struct MachineSync MachineSync;
+
+struct MachineSync {
+	/*run the PPU until it has seen every CPU cycle before the given one*/
+	void (*catchUp)( MachineSync* s, Machine* m, unsigned long cycle );
+};
+
+/*attach s to the calling thread, or detach with NULL*/
+void machineSync( MachineSync* s );
+
+/*
+ * Execute one instruction and service a pending NMI, adding their
+ * cycles to m->cycles without running the PPU at all. The PPU is left
+ * to the attached sync. An access within the instruction is taken to
+ * be on its last base cycle, which is exact for the loads and stores
+ * that reach PPU registers unless they cross a page. Observers,
+ * breakpoints and idle loops are not looked at. Returns the cycles
+ * taken.
+ */
+int machineExecute( Machine* m );
+
+/*
+ * Something that sees every CPU access to a PPU register as it is
+ * made, such as the render thread's log (pipeline.h). value is what is
+ * written, or -1 for a read; OAM DMA shows up as 256 writes to reg 4.
+ * When it is called the PPU has been run for three dots per CPU cycle
+ * in m->cycles, which holds for every way of running a machine but the
+ * accuracy mode. Attached to the calling thread, like observers.
+ */
+typedef struct MachinePpuLog MachinePpuLog;
+
+struct MachinePpuLog {
+	void (*access)( MachinePpuLog* l, const Machine* m, int reg, int value );
+};
+
+/*attach l to the calling thread, or detach with NULL*/
+void machineLogPpu( MachinePpuLog* l );
+
+/*base cycles of an opcode, before page crossings, branches and DMA*/
+int machineOpcodeCycles( unsigned char opcode );
+
+/*power on with the given cartridge inserted*/
+void machinePower( Machine* m, const Cartridge* cart );
+
+/*press the reset button*/
+void machineReset( Machine* m );
+
+/*CPU bus, as seen from the host: watchpoints are not checked*/
+unsigned char machineRead( Machine* m, unsigned short int addr );
+
+void machineWrite( Machine* m, unsigned short int addr, unsigned char value );
+
+/*read memory without touching any I/O register; those read as 0*/
+unsigned char machinePeek( const Machine* m, unsigned short int addr );
+
+/*
+ * Execute one instruction, then service a pending NMI. Visible lines
+ * the PPU finishes meanwhile are drawn into frame, which may be NULL.
+ * Returns the number of CPU cycles taken, 0 if an observer stopped it.
+ */
+int machineStep( Machine* m, unsigned char* frame );
+
+/*
+ * Run until the PPU enters vblank, drawing the picture into frame
+ * (PPU_FRAME_SIZE colour indices). With a NULL frame the picture is
+ * skipped but everything the CPU can observe, including sprite 0 hit
+ * and overflow timing, is the same as when drawing.
+ *
+ * Returns 0 at the end of the frame, or nonzero if an observer stopped
+ * the machine partway; running it again carries on from there.
+ */
+int machineRunFrame( Machine* m, unsigned char* frame );
+
+/*run a number of frames without drawing any of them*/
+void machineFastForward( Machine* m, unsigned long frames );
+
+/*
+ * hash64 of the emulated state, leaving out idleSkip and idleCycles,
+ * which only say how the state was reached
+ */
+uint64_t machineHash( const Machine* m );
+
+void machineSave( const Machine* m, MachineSnapshot* snapshot );
+
+void machineRestore( Machine* m, const MachineSnapshot* snapshot );
+
+/*
+ * Run-ahead. Runs one frame, then draws into frame what the picture
+ * will be ahead frames later if the current input is held, and winds
+ * the machine back to the end of the first frame. This hides ahead
+ * frames of the game's own input lag. scratch holds the state while
+ * running ahead; with ahead 0 this is just machineRunFrame.
+ */
+void machineRunAhead( Machine* m, int ahead, unsigned char* frame, MachineSnapshot* scratch );
+
+#endif
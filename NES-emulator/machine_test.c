@@ -0,0 +1,1050 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "accuracy.h"
+#include "fork.h"
+#include "breakpoint.h"
+#include "cdl.h"
+#include "compact.h"
+#include "counters.h"
+#include "env.h"
+#include "hash.h"
+#include "machine.h"
+#include "movie.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "recompile.h"
+#include "rewind.h"
+#include "savestate.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * A small NROM program. It waits two vblanks, sets up a palette,
+ * fills the top of the first nametable with a solid tile, puts sprite
+ * 0 over it and turns on rendering and NMIs. The NMI handler counts
+ * frames in $10, does an OAM DMA from $0200 and stores the eight
+ * controller bits read from $4016 in $20-$27.
+ */
+static const unsigned char program[] = {
+	0x78, 0xD8, 0xA2, 0xFF, 0x9A,                   /*C000 sei cld ldx #$FF txs*/
+	0x2C, 0x02, 0x20, 0x10, 0xFB,                   /*C005 bit $2002 bpl C005*/
+	0x2C, 0x02, 0x20, 0x10, 0xFB,                   /*C00A bit $2002 bpl C00A*/
+	0xA9, 0x3F, 0x8D, 0x06, 0x20,                   /*C00F lda #$3F sta $2006*/
+	0xA9, 0x00, 0x8D, 0x06, 0x20,                   /*C014 lda #$00 sta $2006*/
+	0xA9, 0x0F, 0x8D, 0x07, 0x20,                   /*C019 lda #$0F sta $2007*/
+	0xA9, 0x30, 0x8D, 0x07, 0x20,                   /*C01E lda #$30 sta $2007*/
+	0xA9, 0x20, 0x8D, 0x06, 0x20,                   /*C023 lda #$20 sta $2006*/
+	0xA9, 0x00, 0x8D, 0x06, 0x20,                   /*C028 lda #$00 sta $2006*/
+	0xA9, 0x01, 0xA2, 0x00,                         /*C02D lda #$01 ldx #$00*/
+	0x8D, 0x07, 0x20, 0xE8, 0xD0, 0xFA,             /*C031 sta $2007 inx bne C031*/
+	0xA9, 0x14, 0x8D, 0x00, 0x02,                   /*C037 sprite 0 at y=20*/
+	0xA9, 0x01, 0x8D, 0x01, 0x02,                   /*C03C tile 1*/
+	0xA9, 0x00, 0x8D, 0x02, 0x02,                   /*C041 attributes 0*/
+	0xA9, 0x40, 0x8D, 0x03, 0x02,                   /*C046 x=64*/
+	0xA9, 0x80, 0x8D, 0x00, 0x20,                   /*C04B NMI on*/
+	0xA9, 0x1E, 0x8D, 0x01, 0x20,                   /*C050 rendering on*/
+	0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, /*C055 scroll 0,0*/
+	0x4C, 0x5D, 0xC0,                               /*C05D jmp C05D*/
+	0x00, 0x00,
+	0xE6, 0x10,                                     /*C060 inc $10*/
+	0xA9, 0x02, 0x8D, 0x14, 0x40,                   /*C062 OAM DMA from $0200*/
+	0xA9, 0x01, 0x8D, 0x16, 0x40,                   /*C067 strobe controllers*/
+	0xA9, 0x00, 0x8D, 0x16, 0x40,
+	0xA2, 0x00,                                     /*C071 ldx #0*/
+	0xAD, 0x16, 0x40, 0x95, 0x20,                   /*C073 lda $4016 sta $20,x*/
+	0xE8, 0xE0, 0x08, 0xD0, 0xF6,                   /*C078 inx cpx #8 bne C073*/
+	0x40                                            /*C07D rti*/
+};
+
+static int failures = 0;
+
+void check( int condition, const char* what ) {
+	printf( "%s: %s\n", condition ? "ok  " : "FAIL", what );
+	if( !condition ) {
+		failures++;
+	}
+}
+
+void buildCartridge( Cartridge* cart ) {
+	static unsigned char image[ 16 + 0x4000 + 0x2000 ];
+	unsigned char* prg = image + 16;
+	unsigned char* chr = prg + 0x4000;
+	char error[ 128 ];
+
+	memcpy( image, "NES\x1A\x01\x01\x01\x00", 8 );
+	memcpy( prg, program, sizeof( program ) );
+
+	/*NMI $C060, reset $C000, IRQ $C07D*/
+	prg[ 0x3FFA ] = 0x60; prg[ 0x3FFB ] = 0xC0;
+	prg[ 0x3FFC ] = 0x00; prg[ 0x3FFD ] = 0xC0;
+	prg[ 0x3FFE ] = 0x7D; prg[ 0x3FFF ] = 0xC0;
+
+	/*tile 1 is solid colour 1*/
+	memset( chr + 16, 0xFF, 8 );
+
+	if( cartridgeParse( cart, image, sizeof( image ), error ) != 0 ) {
+		printf( "cannot build cartridge: %s\n", error );
+		exit( 1 );
+	}
+}
+
+void testPowerOn( Machine* m ) {
+	printf( "=======================================\n" );
+	printf( "power on\n" );
+	check( m->cpu.pc == 0xC000, "pc comes from the reset vector" );
+	check( m->cpu.sp == 0xFD, "sp is $FD after the reset sequence" );
+	check( getStatus( m->cpu.status, STATUS_I ), "interrupts are disabled" );
+	check( (unsigned char)m->mem.data[ 0x8000 ] == 0x78, "16 KB PRG is mirrored into $8000" );
+}
+
+/*
+ * Bit 5 of P always reads as set and B only exists on the stack, however
+ * P was pulled. Runs from RAM at $0300.
+ */
+void testStatusFlags( const Cartridge* cart ) {
+	static Machine m;
+	static const unsigned char code[] = {
+		0xA9, 0x00, 0x48, 0x28,             /*0300 lda #$00 pha plp*/
+		0x08, 0x68,                         /*0304 php pla*/
+		0xA9, 0xCF, 0x48, 0x28, 0x08, 0x68, /*0306 lda #$CF pha plp php pla*/
+		0xA9, 0x03, 0x48, 0xA9, 0x20, 0x48, /*030C push $0320*/
+		0xA9, 0x10, 0x48, 0x40              /*0312 push $10 rti*/
+	};
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "status flags\n" );
+	machinePower( &m, cart );
+	memcpy( m.mem.data + 0x300, code, sizeof( code ) );
+	m.cpu.pc = 0x0300;
+	for( i = 0; i < 3; i++ ) {
+		machineStep( &m, NULL );
+	}
+	check( (unsigned char)m.cpu.status == 0x20, "plp of $00 leaves P at $20" );
+	machineStep( &m, NULL );
+	machineStep( &m, NULL );
+	check( (unsigned char)m.cpu.accum == 0x30, "and php pushes it with bits 4 and 5 set" );
+	for( i = 0; i < 3; i++ ) {
+		machineStep( &m, NULL );
+	}
+	check( (unsigned char)m.cpu.status == 0xEF, "plp of $CF leaves P at $EF" );
+	machineStep( &m, NULL );
+	machineStep( &m, NULL );
+	check( (unsigned char)m.cpu.accum == 0xFF, "and php pushes $FF" );
+	for( i = 0; i < 7; i++ ) {
+		machineStep( &m, NULL );
+	}
+	check( m.cpu.pc == 0x0320 && (unsigned char)m.cpu.status == 0x20, "rti of $10 leaves P at $20" );
+}
+
+void testFrames( Machine* m, unsigned char* frame ) {
+	int i;
+	unsigned char before;
+	unsigned long cycles;
+
+	printf( "=======================================\n" );
+	printf( "frames and NMIs\n" );
+	for( i = 0; i < 10; i++ ) {
+		machineRunFrame( m, frame );
+	}
+	before = m->mem.data[ 0x10 ];
+	cycles = m->cycles;
+	machineRunFrame( m, frame );
+	machineRunFrame( m, frame );
+	cycles = m->cycles - cycles;
+	printf( "NMI count %d, two frames in %lu cycles\n", (unsigned char)m->mem.data[ 0x10 ], cycles );
+	check( before > 0, "NMIs are delivered once rendering is set up" );
+	check( (unsigned char)m->mem.data[ 0x10 ] == before + 2, "one NMI per frame" );
+	check( cycles >= 2 * 29780 - 7 && cycles <= 2 * 29781 + 7, "a frame is 29780.5 CPU cycles" );
+	check( frame[ 0 ] == 0x30, "solid tile drawn in palette colour 1" );
+	check( frame[ 200 * PPU_WIDTH ] == 0x0F, "backdrop below the filled rows" );
+	check( m->ppu.oam[ 0 ] == 0x14 && m->ppu.oam[ 3 ] == 0x40, "OAM DMA copied page $02" );
+}
+
+void testController( Machine* m, unsigned char* frame ) {
+	int i, ok = 1;
+	unsigned char expected[ 8 ] = { 1, 0, 0, 0, 0, 0, 0, 1 };
+
+	printf( "=======================================\n" );
+	printf( "controller\n" );
+	m->input[ 0 ] = BUTTON_A | BUTTON_RIGHT;
+	machineRunFrame( m, frame );
+	machineRunFrame( m, frame );
+	for( i = 0; i < 8; i++ ) {
+		printf( "%d", m->mem.data[ 0x20 + i ] & 1 );
+		if( (m->mem.data[ 0x20 + i ] & 1) != expected[ i ] ) {
+			ok = 0;
+		}
+	}
+	printf( "\n" );
+	check( ok, "A and Right read back in order" );
+	m->input[ 0 ] = 0;
+}
+
+void testSprite0( Machine* m, unsigned char* frame ) {
+	int hitLine = -1, hitDot = -1;
+
+	printf( "=======================================\n" );
+	printf( "sprite 0 hit\n" );
+	m->idleSkip = 0;
+	check( (m->ppu.status & PPU_STATUS_SPRITE0) != 0, "hit flag set by vblank" );
+	while( m->ppu.scanline != 0 ) {
+		machineStep( m, frame );
+	}
+	check( (m->ppu.status & PPU_STATUS_SPRITE0) == 0, "hit flag cleared on the pre-render line" );
+
+	while( hitLine < 0 && m->ppu.scanline < PPU_HEIGHT ) {
+		machineStep( m, frame );
+		if( machineRead( m, 0x2002 ) & PPU_STATUS_SPRITE0 ) {
+			hitLine = m->ppu.scanline;
+			hitDot = m->ppu.dot;
+		}
+	}
+	printf( "first seen at line %d dot %d\n", hitLine, hitDot );
+	check( hitLine == 21 && hitDot >= 65, "hit shows up at x=64 on the line after sprite Y" );
+}
+
+void testDeterminism( const Cartridge* cart ) {
+	static Machine a, b;
+	static unsigned char frameA[ PPU_FRAME_SIZE ], frameB[ PPU_FRAME_SIZE ];
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "determinism\n" );
+	machinePower( &a, cart );
+	machinePower( &b, cart );
+	for( i = 0; i < 30; i++ ) {
+		machineRunFrame( &a, frameA );
+		machineRunFrame( &b, frameB );
+	}
+	check( hash64( frameA, PPU_FRAME_SIZE, 0 ) == hash64( frameB, PPU_FRAME_SIZE, 0 ),
+	       "two machines agree on the frame hash" );
+	check( memcmp( &a, &b, sizeof( Machine ) ) == 0, "and on every byte of state" );
+}
+
+void testFastForward( const Cartridge* cart ) {
+	static Machine a, b;
+	static unsigned char frame[ PPU_FRAME_SIZE ];
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "fast-forward\n" );
+	machinePower( &a, cart );
+	machinePower( &b, cart );
+	for( i = 0; i < 30; i++ ) {
+		machineRunFrame( &a, frame );
+	}
+	machineFastForward( &b, 30 );
+	check( (b.ppu.status & PPU_STATUS_SPRITE0) != 0, "sprite 0 hits without drawing" );
+	check( memcmp( &a, &b, sizeof( Machine ) ) == 0, "same state as when drawing every frame" );
+}
+
+void testIdleSkip( const Cartridge* cart ) {
+	static Machine a, b;
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "idle loops\n" );
+	machinePower( &a, cart );
+	machinePower( &b, cart );
+	b.idleSkip = 0;
+	for( i = 0; i < 30; i++ ) {
+		machineRunFrame( &a, NULL );
+		machineRunFrame( &b, NULL );
+	}
+	printf( "%lu of %lu cycles skipped\n", a.idleCycles, a.cycles );
+	check( a.idleCycles > a.cycles / 2, "most of the time is spent in idle loops" );
+	check( b.idleCycles == 0, "nothing skipped when turned off" );
+	check( a.cycles == b.cycles && memcmp( &a.cpu, &b.cpu, sizeof( Cpu ) ) == 0 &&
+	       memcmp( &a.ppu, &b.ppu, sizeof( Ppu ) ) == 0 && memcmp( &a.mem, &b.mem, sizeof( Memory ) ) == 0,
+	       "same state as executing them" );
+}
+
+void testSnapshots( const Cartridge* cart ) {
+	static Machine a, b;
+	static MachineSnapshot snapshot;
+	static unsigned char frameA[ PPU_FRAME_SIZE ], frameB[ PPU_FRAME_SIZE ];
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "snapshots and run-ahead\n" );
+	machinePower( &a, cart );
+	machineFastForward( &a, 10 );
+	b = a;
+	machineSave( &a, &snapshot );
+	machineFastForward( &a, 5 );
+	check( memcmp( &a, &b, sizeof( Machine ) ) != 0, "running on changes the machine" );
+	machineRestore( &a, &snapshot );
+	check( memcmp( &a, &b, sizeof( Machine ) ) == 0, "restore brings back every byte" );
+
+	/*run-ahead by 2 shows now what a plain machine shows two frames later*/
+	a.input[ 0 ] = b.input[ 0 ] = BUTTON_START;
+	for( i = 0; i < 5; i++ ) {
+		machineRunAhead( &a, 2, frameA, &snapshot );
+	}
+	for( i = 0; i < 7; i++ ) {
+		machineRunFrame( &b, frameB );
+	}
+	check( memcmp( frameA, frameB, PPU_FRAME_SIZE ) == 0, "run-ahead picture is two frames early" );
+	check( a.frame + 2 == b.frame, "but the machine only moved on by the frames run" );
+}
+
+void testSaveState( const Cartridge* cart ) {
+	static Machine a, b, c;
+	const char* path = "machine_test.state";
+	char error[ 128 ];
+	const SaveStateImage* mapped;
+	Cartridge other;
+	FILE* file;
+	long size;
+
+	printf( "=======================================\n" );
+	printf( "save states\n" );
+	machinePower( &a, cart );
+	machineFastForward( &a, 20 );
+	check( saveStateWrite( &a, path, error ) == 0, "state written" );
+	machinePower( &b, cart );
+	check( saveStateRead( &b, path, error ) == 0 && memcmp( &a, &b, sizeof( Machine ) ) == 0,
+	       "read back byte for byte" );
+
+	file = fopen( path, "rb" );
+	fseek( file, 0, SEEK_END );
+	size = ftell( file );
+	fclose( file );
+	printf( "%ld bytes\n", size );
+	check( size < 24 * 1024, "without the ROM in it" );
+
+	mapped = saveStateMap( path, error );
+	check( mapped != NULL, "mapped in place" );
+	if( mapped != NULL ) {
+		machinePower( &c, cart );
+		check( saveStateRestore( &c, mapped, error ) == 0, "and restored from the mapping" );
+		machineFastForward( &a, 10 );
+		machineFastForward( &c, 10 );
+		check( memcmp( &a, &c, sizeof( Machine ) ) == 0, "which resumes where it left off" );
+		saveStateUnmap( mapped );
+	}
+
+	other = *cart;
+	other.prgSize = CARTRIDGE_PRG_BANK / 2;
+	machinePower( &c, &other );
+	check( saveStateRead( &c, path, error ) != 0, "a state for another cartridge is refused" );
+	printf( "%s\n", error );
+
+	/*flip a byte of the image hash*/
+	file = fopen( path, "r+b" );
+	fseek( file, 24, SEEK_SET );
+	fputc( 0x5A, file );
+	fclose( file );
+	check( saveStateMap( path, error ) == NULL, "a corrupt state is not mapped" );
+	memcpy( &c, &b, sizeof( Machine ) );
+	check( saveStateRead( &c, path, error ) != 0 && memcmp( &b, &c, sizeof( Machine ) ) == 0,
+	       "nor read, and the machine is left alone" );
+	printf( "%s\n", error );
+
+	/*a file cut short*/
+	saveStateWrite( &a, path, error );
+	file = fopen( path, "r+b" );
+	ftruncate( fileno( file ), 1000 );
+	fclose( file );
+	check( saveStateRead( &c, path, error ) != 0 && memcmp( &b, &c, sizeof( Machine ) ) == 0,
+	       "truncated states are refused too" );
+	printf( "%s\n", error );
+	remove( path );
+}
+
+void testRewind( const Cartridge* cart ) {
+	static Machine m;
+	static uint64_t hashes[ 300 ];
+	Rewind* r;
+	RewindStats stats;
+	int i, ok = 1;
+
+	printf( "=======================================\n" );
+	printf( "rewind\n" );
+	machinePower( &m, cart );
+	r = rewindCreate( 1 << 20, 60 );
+	for( i = 0; i < 300; i++ ) {
+		m.input[ 0 ] = (i / 7) & 0xFF;
+		machineRunFrame( &m, NULL );
+		rewindPush( r, &m );
+		hashes[ i ] = hash64( &m, sizeof( Machine ), 0 );
+	}
+	rewindStats( r, &stats );
+	printf( "%lu frames, %lu keyframes, %lu of %lu bytes\n", stats.frames, stats.keyframes,
+	        stats.bytes, stats.rawBytes );
+	check( stats.frames == 300 && stats.keyframes == 5, "all frames held, a keyframe every 60" );
+	check( stats.bytes * 20 < stats.rawBytes, "compressed better than 20:1" );
+	for( i = 299; i >= 0; i-- ) {
+		ok &= rewindPop( r, &m ) == 0 && hash64( &m, sizeof( Machine ), 0 ) == hashes[ i ];
+	}
+	check( ok, "every frame comes back, newest first" );
+	check( rewindPop( r, &m ) != 0, "then the buffer is empty" );
+	rewindDestroy( r );
+
+	/*a budget too small for everything keeps the newest frames*/
+	machinePower( &m, cart );
+	r = rewindCreate( 8192, 20 );
+	for( i = 0; i < 300; i++ ) {
+		m.input[ 0 ] = (i / 7) & 0xFF;
+		machineRunFrame( &m, NULL );
+		rewindPush( r, &m );
+	}
+	rewindStats( r, &stats );
+	printf( "%lu frames in %lu bytes, %lu evicted\n", stats.frames, stats.bytes, stats.evicted );
+	check( stats.frames > 0 && stats.frames < 300 && stats.bytes <= 8192, "budget respected" );
+	check( stats.keyframes > 0 && stats.frames + stats.evicted == 300, "whole groups evicted" );
+	for( i = 299, ok = 1; rewindPop( r, &m ) == 0; i-- ) {
+		ok &= hash64( &m, sizeof( Machine ), 0 ) == hashes[ i ];
+	}
+	check( ok && i == 299 - (int)stats.frames, "what is left rewinds correctly" );
+	rewindDestroy( r );
+}
+
+void testFork( const Cartridge* cart ) {
+	static Machine m, direct;
+	MachineFork *root, *a, *b;
+	int ok;
+
+	printf( "=======================================\n" );
+	printf( "copy-on-write forks\n" );
+	machinePower( &m, cart );
+	machineFastForward( &m, 20 );
+	root = forkCreate( &m );
+	a = forkChild( root );
+	b = forkChild( root );
+	check( forkPrivatePages( a ) == 0, "a new child owns no pages" );
+
+	/*run the two children with different input*/
+	direct = m;
+	direct.input[ 0 ] = BUTTON_A;
+	machineFastForward( &direct, 2 );
+	forkLoad( a, &m, root );
+	m.input[ 0 ] = BUTTON_A;
+	machineFastForward( &m, 2 );
+	forkStore( a, &m );
+	forkLoad( b, &m, a );
+	m.input[ 0 ] = BUTTON_B;
+	machineFastForward( &m, 2 );
+	forkStore( b, &m );
+	printf( "children own %d and %d pages\n", forkPrivatePages( a ), forkPrivatePages( b ) );
+	check( forkPrivatePages( a ) > 0 && forkPrivatePages( a ) < 8, "a child owns only the pages it dirtied" );
+
+	forkLoad( a, &m, b );
+	check( memcmp( &m, &direct, sizeof( Machine ) ) == 0, "loading a child gives the state it was run to" );
+	forkRelease( a );
+	forkLoad( root, &m, NULL );
+	ok = m.frame == 20 && (m.mem.data[ 0x20 ] & 1) == 0;
+	check( ok, "the parent is untouched" );
+	forkRelease( b );
+	forkRelease( root );
+}
+
+void testMovie( const Cartridge* cart ) {
+	static Machine m, start;
+	const char* path = "machine_test.movie";
+	char error[ 128 ];
+	MovieWriter w;
+	MovieResult result;
+	uint64_t recorded;
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "movies\n" );
+	machinePower( &m, cart );
+	start = m;
+	check( movieCreate( &w, path, &m, error ) == 0, "recording started" );
+	for( i = 0; i < 200; i++ ) {
+		m.input[ 0 ] = (i / 10) & BUTTON_A;
+		if( i == 50 ) {
+			machineReset( &m );
+			movieReset( &w );
+		}
+		movieFrame( &w, &m );
+		machineRunFrame( &m, NULL );
+	}
+	recorded = machineHash( &m );
+	check( movieClose( &w, &m ) == 0, "recording closed" );
+
+	m = start;
+	m.idleSkip = 0;
+	check( moviePlay( path, &m, cart, &result, error ) == 0, "played back" );
+	check( result.frames == 200 && result.ended && result.matched, "the final state matches the recording" );
+	check( machineHash( &m ) == recorded, "with or without idle loop skipping" );
+	check( moviePlay( path, &m, cart, &result, error ) != 0, "a different starting state is refused" );
+	printf( "%s\n", error );
+	remove( path );
+}
+
+typedef struct {
+	MachineObserver observer;
+	unsigned long count;
+	unsigned short int stopAt;
+} Counter;
+
+static int countInstruction( MachineObserver* o, Machine* m ) {
+	Counter* c = (Counter*)o;
+	if( m->cpu.pc == c->stopAt ) {
+		c->stopAt = 0;
+		return 1;
+	}
+	c->count++;
+	return 0;
+}
+
+void testObserver( const Cartridge* cart ) {
+	static Machine m, plain;
+	Counter counter;
+	int stopped;
+
+	printf( "=======================================\n" );
+	printf( "observers\n" );
+	machinePower( &m, cart );
+	machineFastForward( &m, 5 );
+	plain = m;
+	counter.observer.instruction = countInstruction;
+	counter.count = 0;
+	counter.stopAt = 0;
+	machineObserve( &counter.observer );
+	machineRunFrame( &m, NULL );
+	check( counter.count > 29780 / 3 / 2, "every instruction of the idle loop is seen" );
+	counter.stopAt = 0xC07D;
+	stopped = machineRunFrame( &m, NULL );
+	check( stopped && m.cpu.pc == 0xC07D, "an observer stops the machine at the end of the NMI handler" );
+	check( machineRunFrame( &m, NULL ) == 0, "running again finishes the frame" );
+	machineUnobserve( &counter.observer );
+	machineFastForward( &plain, 2 );
+	check( machineHash( &m ) == machineHash( &plain ), "same state as when not observed" );
+}
+
+void testTrace( const Cartridge* cart ) {
+	static Machine m;
+	const char* path = "machine_test.trace";
+	char error[ 128 ];
+	TraceRecord r;
+	char line[ 96 ];
+	Tracer* t;
+	FILE* file;
+	long written;
+
+	printf( "=======================================\n" );
+	printf( "tracing\n" );
+	machinePower( &m, cart );
+	t = tracerStart( path, error );
+	check( t != NULL, "tracer started" );
+	if( t == NULL ) {
+		return;
+	}
+	machineFastForward( &m, 3 );
+	written = tracerStop( t );
+	check( written > 3 * 29780 / 7, "every instruction of three frames recorded" );
+
+	file = fopen( path, "rb" );
+	fseek( file, 0, SEEK_END );
+	check( ftell( file ) == TRACE_HEADER + written * (long)sizeof( TraceRecord ), "and written out" );
+	fseek( file, TRACE_HEADER, SEEK_SET );
+	fread( &r, sizeof( r ), 1, file );
+	fclose( file );
+	traceFormat( &r, line );
+	printf( "%s\n", line );
+	check( strncmp( line, "C000  78        SEI  ", 21 ) == 0 && strstr( line, "SP:FD" ) != NULL,
+	       "first record is the reset vector's SEI" );
+	remove( path );
+}
+
+void testProfiler( const Cartridge* cart ) {
+	static Machine m;
+	const ProfileCount* counts;
+	const ProfileFrame* frames;
+	Profiler* p;
+	Profiler* slow;
+	unsigned long start, total = 0, count, pc;
+	int same = 1;
+
+	printf( "=======================================\n" );
+	printf( "profiler\n" );
+	machinePower( &m, cart );
+	machineFastForward( &m, 5 );
+	start = m.cycles;
+	p = profilerStart( &m );
+	machineFastForward( &m, 10 );
+	profilerStop( p );
+	counts = profilerCounts( p );
+	for( pc = 0; pc < 0x10000; pc++ ) {
+		total += counts[ pc ].cycles;
+	}
+	check( total == m.cycles - start, "every cycle is attributed to an instruction" );
+	check( counts[ 0xC05D ].cycles > total / 2 && counts[ 0xC05D ].instructions < 100,
+	       "most cycles are in the idle jmp, which is still skipped" );
+	check( counts[ 0xC060 ].calls == 10, "one NMI per frame" );
+	check( counts[ 0xC060 ].inclusive > 10 * 513, "handler cycles include the OAM DMA" );
+	frames = profilerFrames( p, &count );
+	check( count >= 10 && frames[ 1 ].cycles >= 29780 && frames[ 1 ].cycles <= 29781 + 7,
+	       "a frame budget for each frame" );
+	check( frames[ 1 ].interrupt * 10 > counts[ 0xC060 ].inclusive - 513, "with the NMI handler's share" );
+	profilerReport( p, stdout, 3 );
+
+	/*the same profile, but for the instruction counts, running the idle loop*/
+	machinePower( &m, cart );
+	m.idleSkip = 0;
+	machineFastForward( &m, 5 );
+	slow = profilerStart( &m );
+	machineFastForward( &m, 10 );
+	profilerStop( slow );
+	for( pc = 0; pc < 0x10000; pc++ ) {
+		same &= counts[ pc ].cycles == profilerCounts( slow )[ pc ].cycles &&
+		        counts[ pc ].inclusive == profilerCounts( slow )[ pc ].inclusive;
+	}
+	check( same, "skipping idle loops changes no cycle counts" );
+	profilerFree( slow );
+	profilerFree( p );
+}
+
+void testCounters( const Cartridge* cart ) {
+	static Machine m;
+	Counters c;
+	unsigned long instructions = 0;
+	int i;
+
+	printf( "=======================================\n" );
+	printf( "host counters (%s)\n", COUNTERS_ENABLED ? "built in" : "compiled out" );
+	machinePower( &m, cart );
+	m.idleSkip = 0;
+	machineFastForward( &m, 3 );
+	countersReset();
+	machineFastForward( &m, 10 );
+	countersSnapshot( &c );
+	for( i = 0; i < 256; i++ ) {
+		instructions += c.opcodes[ i ];
+	}
+	if( COUNTERS_ENABLED ) {
+		check( c.frames == 10 && c.nmis == 10 && c.dmas == 10, "frames, NMIs and DMAs counted" );
+		check( instructions > 10 * 29780 / 4 && c.opcodes[ 0x4C ] > instructions / 2, "dispatch by opcode" );
+		check( c.reads[ COUNTER_STACK ] == 10 * 6 && c.writes[ COUNTER_STACK ] == 10 * 6,
+		       "NMI and BRK each push and pull three bytes" );
+		check( c.writes[ COUNTER_PPU ] == 10 * 256 && c.reads[ COUNTER_RAM ] == 10 * 256,
+		       "OAM DMA reads page 2 and writes $2004" );
+		printf( "cpu %lu ns, ppu %lu ns\n", (unsigned long)c.ns[ COUNTER_TIME_CPU ], (unsigned long)c.ns[ COUNTER_TIME_PPU ] );
+		check( c.ns[ COUNTER_TIME_CPU ] > 0 && c.ns[ COUNTER_TIME_PPU ] > 0, "host time split" );
+	} else {
+		check( instructions == 0 && c.frames == 0 && c.reads[ COUNTER_ROM ] == 0, "nothing counted" );
+	}
+}
+
+void testBreakpoints( const Cartridge* cart ) {
+	static Machine m, plain, pointer;
+	static Breakpoints b;
+	int stopped;
+
+	printf( "=======================================\n" );
+	printf( "breakpoints\n" );
+	machinePower( &m, cart );
+	machineFastForward( &m, 5 );
+	plain = m;
+	breakpointsInit( &b );
+	machineBreakpoints( &b );
+
+	breakpointSet( &b, 0xE000, BREAK_EXECUTE );
+	m.idleCycles = 0;
+	machineFastForward( &m, 2 );
+	check( m.idleCycles > 0 && b.hits == 0, "idle loops are still skipped away from flagged pages" );
+
+	breakpointSet( &b, 0xC060, BREAK_EXECUTE );
+	stopped = machineRunFrame( &m, NULL );
+	check( stopped && m.cpu.pc == 0xC060 && b.hit.kind == BREAK_EXECUTE, "stops before the NMI handler" );
+	check( machineRunFrame( &m, NULL ) == 0, "and runs on from there" );
+	breakpointClear( &b, 0xC060, BREAK_EXECUTE );
+
+	breakpointSet( &b, 0x0810, BREAK_WRITE );
+	stopped = machineRunFrame( &m, NULL );
+	check( stopped && b.hit.addr == 0x0010 && b.hit.pc == 0xC062 && b.hit.value == m.mem.data[ 0x10 ],
+	       "a write watch on a mirror catches inc $10" );
+	check( m.cpu.pc == 0xC064, "after the instruction" );
+	breakpointClear( &b, 0x0010, BREAK_WRITE );
+	check( b.pages[ 0x08 ] == 0 && b.pages[ 0x00 ] == 0, "clearing it unflags every mirror" );
+
+	breakpointSet( &b, 0x4016, BREAK_READ );
+	stopped = machineRunFrame( &m, NULL );
+	check( stopped && b.hit.kind == BREAK_READ && b.hit.pc == 0xC075, "a read watch catches the controller read" );
+	breakpointClear( &b, 0x4016, BREAK_READ );
+	while( machineRunFrame( &m, NULL ) ) {
+	}
+	machineFastForward( &m, 2 );
+
+	/*lda ($10),y run from RAM*/
+	pointer = m;
+	pointer.mem.data[ 0x0300 ] = 0xB1;
+	pointer.mem.data[ 0x0301 ] = 0x10;
+	pointer.mem.data[ 0x0010 ] = 0x00;
+	pointer.mem.data[ 0x0011 ] = 0x02;
+	pointer.cpu.pc = 0x0300;
+	breakpointSet( &b, 0x0011, BREAK_READ );
+	machineStep( &pointer, NULL );
+	check( b.hit.kind == BREAK_READ && b.hit.addr == 0x0011 && b.hit.pc == 0x0300 && b.hit.value == 0x02,
+	       "a read watch catches an indirect pointer" );
+	breakpointClear( &b, 0x0011, BREAK_READ );
+
+	machineBreakpoints( NULL );
+	machineFastForward( &plain, m.frame - plain.frame );
+	check( machineHash( &m ) == machineHash( &plain ), "stopping does not change what the machine does" );
+	printf( "%lu hits\n", b.hits );
+}
+
+void testCodeDataLog( const Cartridge* cart ) {
+	static Machine m, plain;
+	static CodeDataLog log, loaded;
+	static unsigned char frame[ PPU_FRAME_SIZE ];
+	const char* path = "machine_test.cdl";
+	char error[ 128 ];
+	Cartridge other;
+
+	printf( "=======================================\n" );
+	printf( "code/data log\n" );
+	machinePower( &m, cart );
+	plain = m;
+	cdlInit( &log, cart );
+	machineLog( &log );
+	machineFastForward( &m, 5 );
+	machineRunFrame( &m, frame );
+	machineRunFrame( &m, frame );
+	machineLog( NULL );
+
+	check( log.prg[ 0x0000 ] == CDL_OPCODE && log.prg[ 0x0003 ] == CDL_OPERAND, "sei and ldx #$FF" );
+	check( log.prg[ 0x005D ] == CDL_OPCODE && log.prg[ 0x005E ] == CDL_OPERAND && log.prg[ 0x005F ] == CDL_OPERAND,
+	       "the skipped idle loop" );
+	check( log.prg[ 0x3FFA ] == CDL_DATA && log.prg[ 0x3FFE ] == CDL_DATA && log.prg[ 0x3FF0 ] == 0,
+	       "the NMI and IRQ vectors are data" );
+	check( log.chr[ 16 ] == CDL_RENDERED && log.chr[ 0 ] == CDL_RENDERED && log.chr[ 0x1000 ] == 0,
+	       "the tiles drawn" );
+	check( cdlCountPrg( &log, CDL_OPCODE | CDL_OPERAND | CDL_DATA ) < sizeof( program ) + 6, "nothing else" );
+	cdlSummary( &log, stdout );
+
+	machineFastForward( &plain, 7 );
+	check( machineHash( &m ) == machineHash( &plain ), "logging does not change what the machine does" );
+
+	check( cdlSave( &log, path, error ) == 0, "log saved" );
+	cdlInit( &loaded, cart );
+	loaded.prg[ 0x2000 ] = CDL_DATA;
+	check( cdlMerge( &loaded, path, error ) == 0 && memcmp( loaded.prg, log.prg, 0x2000 ) == 0 &&
+	       loaded.prg[ 0x2000 ] == CDL_DATA && memcmp( loaded.chr, log.chr, sizeof( log.chr ) ) == 0,
+	       "merged into another session's log" );
+
+	other = *cart;
+	other.prgSize = CARTRIDGE_PRG_BANK / 2;
+	cdlInit( &loaded, &other );
+	check( cdlMerge( &loaded, path, error ) != 0, "logs of other games are refused" );
+	printf( "%s\n", error );
+	remove( path );
+}
+
+void testRecompiler( const Cartridge* cart ) {
+	static Machine m, twin;
+	static unsigned char frame[ PPU_FRAME_SIZE ], twinFrame[ PPU_FRAME_SIZE ];
+	const char* source = "machine_test_game.c";
+	const char* library = "machine_test_game.so";
+	char error[ 128 ];
+	RecompiledCode* code;
+	Cartridge other;
+	FILE* out;
+	long count;
+	int f, same = 1;
+
+	printf( "=======================================\n" );
+	printf( "recompiler\n" );
+	out = fopen( source, "w" );
+	count = recompile( cart, NULL, out, error );
+	fclose( out );
+	check( count > 50, "the test program is found from its vectors" );
+	check( system( "gcc -O2 -shared -fPIC -o machine_test_game.so machine_test_game.c" ) == 0, "and builds" );
+	code = recompiledLoad( library, cart, error );
+	check( code != NULL && code->instructions == (unsigned long)count, "and loads" );
+	if( code == NULL ) {
+		printf( "%s\n", error );
+		return;
+	}
+
+	/*every frame is run by both from the same state, the last ones running the idle loop*/
+	machinePower( &m, cart );
+	machineRecompiled( code );
+	for( f = 0; f < 120; f++ ) {
+		m.input[ 0 ] = f % 40 < 20 ? BUTTON_A | BUTTON_RIGHT : 0;
+		m.idleSkip = f < 80;
+		twin = m;
+		machineRunFrame( &m, frame );
+		machineRecompiled( NULL );
+		machineRunFrame( &twin, twinFrame );
+		machineRecompiled( code );
+		same &= machineHash( &m ) == machineHash( &twin ) && memcmp( frame, twinFrame, PPU_FRAME_SIZE ) == 0;
+	}
+	machineRecompiled( NULL );
+	check( same && (unsigned char)m.mem.data[ 0x10 ] > 100, "every frame matches the interpreter" );
+
+	other = *cart;
+	other.prgSize = CARTRIDGE_PRG_BANK / 2;
+	check( recompiledLoad( library, &other, error ) == NULL, "other games are refused" );
+	printf( "%s\n", error );
+	recompiledFree( code );
+	remove( source );
+	remove( library );
+}
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*reward of 1 while A reads back as held*/
+float heldA( int env, const Machine* m, void* context ) {
+	(void)env;
+	(void)context;
+	return m->mem.data[ 0x20 ] & 0x01;
+}
+
+void testEnvBatch( const Cartridge* cart ) {
+	static Machine fresh;
+	EnvConfig config = { 8, 3, 4, 4, heldA, NULL }, uneven = { 8, 3, 4, 3, NULL, NULL };
+	unsigned char actions[ 8 ], *obs;
+	float rewards[ 8 ];
+	unsigned long size;
+	EnvBatch* b;
+	double start, seconds;
+	int i, s, rewarded = 1;
+
+	printf( "=======================================\n" );
+	printf( "batched environments\n" );
+	b = envBatchCreate( cart, &config );
+	size = envObservationSize( b );
+	check( size == 64 * 60, "observations are a quarter of the picture each way" );
+	obs = malloc( config.count * size );
+	for( i = 0; i < config.count; i++ ) {
+		actions[ i ] = i & 1 ? BUTTON_A : 0;
+	}
+
+	start = now();
+	for( s = 0; s < 30; s++ ) {
+		envBatchStep( b, actions, obs, rewards );
+		for( i = 0; s > 0 && i < config.count; i++ ) {
+			rewarded &= rewards[ i ] == (i & 1);
+		}
+	}
+	seconds = now() - start;
+	check( rewarded, "each env sees its own action" );
+	check( obs[ 0 ] == 237 && obs[ 50 * 64 ] == 0, "solid tile and backdrop come out as grey levels" );
+	check( memcmp( obs, obs + 2 * size, size ) == 0, "envs given the same actions look the same" );
+
+	machinePower( &fresh, cart );
+	envBatchReset( b, 1 );
+	check( machineHash( envBatchMachine( b, 1 ) ) == machineHash( &fresh ), "reset goes back to power-on" );
+	check( envBatchMachine( b, 0 )->frame == 30 * 4, "other envs carry on" );
+	printf( "%.0f env-frames/s on %d threads\n", 30 * 4 * config.count / seconds, config.threads );
+
+	check( envBatchCreate( cart, &uneven ) == NULL, "scales that do not divide the picture are refused" );
+	free( obs );
+	envBatchFree( b );
+}
+
+void testCompact( const Cartridge* cart ) {
+	static Machine m, direct;
+	CompactMachine* instances[ 1000 ];
+	double start, seconds;
+	unsigned long bytes = 0;
+	int i, f, same = 1;
+
+	printf( "=======================================\n" );
+	printf( "compact machines\n" );
+	machinePower( &m, cart );
+	machineFastForward( &m, 10 );
+	direct = m;
+	for( i = 0; i < 1000; i++ ) {
+		instances[ i ] = compactCreate( &m );
+		bytes += compactSize( instances[ i ] );
+	}
+	printf( "%lu bytes each, registers in the first %lu\n", bytes / 1000,
+	        (unsigned long)(offsetof( Machine, ppu ) + offsetof( Ppu, palette )) );
+	check( bytes / 1000 < 16384, "an instance takes under 16 KB" );
+
+	/*every instance runs a frame in turn on the one machine*/
+	start = now();
+	for( f = 0; f < 5; f++ ) {
+		for( i = 0; i < 1000; i++ ) {
+			compactLoad( instances[ i ], &m );
+			m.input[ 0 ] = i & 1 ? BUTTON_A : 0;
+			machineRunFrame( &m, NULL );
+			compactStore( instances[ i ], &m );
+		}
+	}
+	seconds = now() - start;
+	printf( "%.0f instance-frames/s through one machine\n", 5000 / seconds );
+
+	direct.input[ 0 ] = BUTTON_A;
+	machineFastForward( &direct, 5 );
+	compactLoad( instances[ 1 ], &m );
+	same = memcmp( &m, &direct, sizeof( Machine ) ) == 0;
+	compactLoad( instances[ 0 ], &m );
+	same &= (m.mem.data[ 0x20 ] & 1) == 0;
+	check( same, "each instance carries on from its own state" );
+
+	machineWrite( &m, 0x6000, 0x5A );
+	compactStore( instances[ 0 ], &m );
+	check( compactSize( instances[ 0 ] ) == compactSize( instances[ 1 ] ) + 0x2000, "cartridge RAM is added once written" );
+	compactLoad( instances[ 1 ], &m );
+	compactLoad( instances[ 0 ], &m );
+	check( m.mem.data[ 0x6000 ] == 0x5A, "and comes back" );
+	compactLoad( instances[ 1 ], &m );
+	check( m.mem.data[ 0x6000 ] == 0, "without leaking into the others" );
+
+	for( i = 0; i < 1000; i++ ) {
+		compactFree( instances[ i ] );
+	}
+}
+
+/*records where the PPU is asked to catch up to, without running it*/
+typedef struct {
+	MachineSync sync;
+	unsigned long cycle;
+	int calls;
+} SyncRecorder;
+
+static void recordCatchUp( MachineSync* s, Machine* m, unsigned long cycle ) {
+	SyncRecorder* r = (SyncRecorder*)s;
+	if( r->calls++ == 0 ) {
+		r->cycle = cycle;
+	}
+}
+
+void testAccuracy( const Cartridge* cart ) {
+	static Machine a, b;
+	static unsigned char frameA[ PPU_FRAME_SIZE ], frameB[ PPU_FRAME_SIZE ];
+	SyncRecorder recorder = { { recordCatchUp }, 0, 0 };
+	Accuracy* accuracy;
+	unsigned long start;
+	int i, same = 1;
+
+	printf( "=======================================\n" );
+	printf( "accuracy mode\n" );
+
+	/*sei cld ldx #$FF txs take 8 cycles, then bit $2002 reads on its 4th*/
+	machinePower( &a, cart );
+	start = a.cycles;
+	machineSync( &recorder.sync );
+	for( i = 0; i < 5; i++ ) {
+		machineExecute( &a );
+	}
+	machineSync( NULL );
+	printf( "first catch-up at cycle %lu, %d in all\n", recorder.cycle - start, recorder.calls );
+	check( recorder.calls == 1 && recorder.cycle == start + 8 + 3, "the PPU is caught up to the cycle $2002 is read on" );
+	check( a.ppu.scanline == 0 && a.ppu.dot == 21, "and not run by machineExecute itself" );
+
+	machinePower( &a, cart );
+	machinePower( &b, cart );
+	accuracy = accuracyCreate( &b );
+	for( i = 0; i < 30; i++ ) {
+		machineRunFrame( &a, frameA );
+		accuracyRunFrame( accuracy, frameB );
+		same &= memcmp( frameA, frameB, PPU_FRAME_SIZE ) == 0;
+	}
+	printf( "%lu switches a frame\n", accuracy->switches / 30 );
+	check( same, "pictures are the same as running in lockstep" );
+	check( b.frame == 30 && b.mem.data[ 0x10 ] == a.mem.data[ 0x10 ], "and so are frames and NMIs" );
+	a.idleCycles = 0;
+	a.idleSkip = b.idleSkip;
+	check( memcmp( &a, &b, sizeof( Machine ) ) == 0, "as nothing here depends on the exact dot, so is the state" );
+	check( (b.ppu.status & PPU_STATUS_SPRITE0) != 0 && b.ppu.oam[ 0 ] == 0x14, "sprite 0 hits and OAM DMA work" );
+
+	/*lockstep frames carry on from accuracy mode*/
+	machineRunFrame( &a, frameA );
+	machineRunFrame( &b, frameB );
+	check( memcmp( frameA, frameB, PPU_FRAME_SIZE ) == 0 && b.frame == 31, "and it can be left between frames" );
+	accuracyFree( accuracy );
+}
+
+void testPipeline( const Cartridge* cart ) {
+	static Machine a, b;
+	static unsigned char frameA[ PPU_FRAME_SIZE ], frameB[ PPU_FRAME_SIZE ], blank[ PPU_FRAME_SIZE ];
+	Counter counter;
+	Pipeline* pipeline;
+	int i, same = 1, stopped;
+
+	printf( "=======================================\n" );
+	printf( "pipelined rendering\n" );
+	machinePower( &a, cart );
+	machinePower( &b, cart );
+	pipeline = pipelineCreate( &b );
+	memset( frameB, 0xFF, PPU_FRAME_SIZE );
+	pipelineRunFrame( pipeline, frameB );
+	check( memcmp( frameB, blank, PPU_FRAME_SIZE ) == 0, "the first picture is blank" );
+
+	/*an observer stops one frame partway, which should not show*/
+	counter.observer.instruction = countInstruction;
+	counter.count = 0;
+	counter.stopAt = 0xC07D;
+	for( i = 0; i < 30; i++ ) {
+		machineRunFrame( &a, frameA );
+		if( i == 20 ) {
+			machineObserve( &counter.observer );
+			stopped = pipelineRunFrame( pipeline, frameB );
+			check( stopped && b.cpu.pc == 0xC07D, "an observer stops the machine partway" );
+		}
+		pipelineRunFrame( pipeline, frameB );
+		machineUnobserve( &counter.observer );
+		same &= memcmp( frameA, frameB, PPU_FRAME_SIZE ) == 0;
+	}
+	check( same, "each picture is the frame before's from machineRunFrame" );
+	machineRunFrame( &a, NULL );
+	check( machineHash( &a ) == machineHash( &b ), "and the machine, a frame ahead of it, runs the same" );
+
+	/*states restored between frames are drawn from*/
+	b = a;
+	pipelineRunFrame( pipeline, NULL );
+	pipelineRunFrame( pipeline, frameB );
+	machineRunFrame( &a, frameA );
+	check( memcmp( frameA, frameB, PPU_FRAME_SIZE ) == 0, "a state loaded between frames is drawn from" );
+	pipelineFree( pipeline );
+}
+
+/*
+ * machine self-test
+ */
+int main( int argc, char* argv[] ) {
+	static Machine m;
+	static unsigned char frame[ PPU_FRAME_SIZE ];
+	Cartridge cart;
+
+	buildCartridge( &cart );
+	machinePower( &m, &cart );
+
+	testPowerOn( &m );
+	testStatusFlags( &cart );
+	testFrames( &m, frame );
+	testController( &m, frame );
+	testSprite0( &m, frame );
+	testDeterminism( &cart );
+	testFastForward( &cart );
+	testIdleSkip( &cart );
+	testSnapshots( &cart );
+	testSaveState( &cart );
+	testRewind( &cart );
+	testFork( &cart );
+	testMovie( &cart );
+	testObserver( &cart );
+	testTrace( &cart );
+	testProfiler( &cart );
+	testCounters( &cart );
+	testBreakpoints( &cart );
+	testCodeDataLog( &cart );
+	testRecompiler( &cart );
+	testEnvBatch( &cart );
+	testCompact( &cart );
+	testAccuracy( &cart );
+	testPipeline( &cart );
+
+	cartridgeFree( &cart );
+	printf( "\n%d failure(s)\n", failures );
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include "movie.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_SIZE (24)
+
+#define RECORD_REPEAT (0x00)
+#define RECORD_INPUT (0x01)
+#define RECORD_RESET (0x02)
+#define RECORD_POWER (0x03)
+#define RECORD_END (0x04)
+
+static void put64( unsigned char* p, uint64_t value ) {
+	int i;
+	for( i = 0; i < 8; i++ ) {
+		p[ i ] = value >> (8 * i);
+	}
+}
+
+static unsigned long get32( const unsigned char* p ) {
+	return p[ 0 ] | (p[ 1 ] << 8) | ((unsigned long)p[ 2 ] << 16) | ((unsigned long)p[ 3 ] << 24);
+}
+
+static uint64_t get64( const unsigned char* p ) {
+	uint64_t value = 0;
+	int i;
+	for( i = 7; i >= 0; i-- ) {
+		value = (value << 8) | p[ i ];
+	}
+	return value;
+}
+
+int movieCreate( MovieWriter* w, const char* path, const Machine* m, char* error ) {
+	unsigned char header[ HEADER_SIZE ];
+
+	w->file = fopen( path, "wb" );
+	if( w->file == NULL ) {
+		sprintf( error, "cannot create %.100s", path );
+		return -1;
+	}
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "NESMOVIE", 8 );
+	header[ 8 ] = MOVIE_VERSION;
+	put64( header + 16, machineHash( m ) );
+	fwrite( header, sizeof( header ), 1, w->file );
+
+	/*the first frame always carries its input*/
+	w->input[ 0 ] = ~m->input[ 0 ];
+	w->input[ 1 ] = m->input[ 1 ];
+	w->frames = 0;
+	return 0;
+}
+
+void movieFrame( MovieWriter* w, const Machine* m ) {
+	if( m->input[ 0 ] == w->input[ 0 ] && m->input[ 1 ] == w->input[ 1 ] ) {
+		putc( RECORD_REPEAT, w->file );
+	} else {
+		putc( RECORD_INPUT, w->file );
+		putc( m->input[ 0 ], w->file );
+		putc( m->input[ 1 ], w->file );
+		w->input[ 0 ] = m->input[ 0 ];
+		w->input[ 1 ] = m->input[ 1 ];
+	}
+	w->frames++;
+}
+
+void movieReset( MovieWriter* w ) {
+	putc( RECORD_RESET, w->file );
+}
+
+void moviePower( MovieWriter* w ) {
+	putc( RECORD_POWER, w->file );
+}
+
+int movieClose( MovieWriter* w, const Machine* m ) {
+	unsigned char end[ 13 ];
+	int failed;
+
+	end[ 0 ] = RECORD_END;
+	put64( end + 1, machineHash( m ) );
+	end[ 9 ] = w->frames;
+	end[ 10 ] = w->frames >> 8;
+	end[ 11 ] = w->frames >> 16;
+	end[ 12 ] = w->frames >> 24;
+	failed = fwrite( end, sizeof( end ), 1, w->file ) != 1;
+	failed |= ferror( w->file ) != 0;
+	failed |= fclose( w->file ) != 0;
+	w->file = NULL;
+	return failed ? -1 : 0;
+}
+
+static unsigned char* readAll( const char* path, unsigned long* size ) {
+	FILE* file = fopen( path, "rb" );
+	unsigned char* data = NULL;
+	long length;
+
+	if( file == NULL ) {
+		return NULL;
+	}
+	if( fseek( file, 0, SEEK_END ) == 0 && (length = ftell( file )) >= 0 && fseek( file, 0, SEEK_SET ) == 0 ) {
+		data = malloc( length + 1 );
+		if( data != NULL && fread( data, 1, length, file ) != (unsigned long)length ) {
+			free( data );
+			data = NULL;
+		}
+		*size = length;
+	}
+	fclose( file );
+	return data;
+}
+
+int moviePlay( const char* path, Machine* m, const Cartridge* cart, MovieResult* result, char* error ) {
+	unsigned long size, pos = HEADER_SIZE;
+	unsigned char* data = readAll( path, &size );
+	unsigned char idleSkip;
+	int status = 0;
+
+	memset( result, 0, sizeof( *result ) );
+	if( data == NULL ) {
+		sprintf( error, "cannot read %.100s", path );
+		return -1;
+	}
+	if( size < HEADER_SIZE || memcmp( data, "NESMOVIE", 8 ) != 0 ) {
+		strcpy( error, "not a movie" );
+		free( data );
+		return -1;
+	}
+	if( get32( data + 8 ) != MOVIE_VERSION ) {
+		sprintf( error, "movie version %lu, expected %d", get32( data + 8 ), MOVIE_VERSION );
+		free( data );
+		return -1;
+	}
+	if( get64( data + 16 ) != machineHash( m ) ) {
+		strcpy( error, "the machine is not in the state the movie starts from" );
+		free( data );
+		return -1;
+	}
+
+	while( pos < size && status == 0 ) {
+		switch( data[ pos ] ) {
+		case RECORD_INPUT:
+			if( pos + 3 > size ) {
+				pos = size;
+				break;
+			}
+			m->input[ 0 ] = data[ pos + 1 ];
+			m->input[ 1 ] = data[ pos + 2 ];
+			pos += 2;
+			/*fall through*/
+		case RECORD_REPEAT:
+			machineRunFrame( m, NULL );
+			result->frames++;
+			pos++;
+			break;
+		case RECORD_RESET:
+			machineReset( m );
+			pos++;
+			break;
+		case RECORD_POWER:
+			if( cart == NULL ) {
+				strcpy( error, "the movie power cycles but there is no cartridge" );
+				status = -1;
+				break;
+			}
+			idleSkip = m->idleSkip;
+			machinePower( m, cart );
+			m->idleSkip = idleSkip;
+			pos++;
+			break;
+		case RECORD_END:
+			if( pos + 13 <= size ) {
+				result->ended = 1;
+				result->matched = get64( data + pos + 1 ) == machineHash( m ) &&
+				                  get32( data + pos + 9 ) == (result->frames & 0xFFFFFFFF);
+			}
+			pos = size;
+			break;
+		default:
+			sprintf( error, "bad record %d at offset %lu", data[ pos ], pos );
+			status = -1;
+			break;
+		}
+	}
+	free( data );
+	return status;
+}
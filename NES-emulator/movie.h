@@ -0,0 +1,65 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "machine.h"
+
+#include <stdio.h>
+
+#define MOVIE_VERSION (1)
+
+/*
+ * Input movies: everything done to a machine from a known state, so
+ * that playing it back reaches the same state bit for bit.
+ *
+ * A movie is a 24 byte header ("NESMOVIE", u32 version, u32 zero, u64
+ * machineHash of the starting state) and then a stream of records,
+ * appended one per frame:
+ *
+ *     0x00                   a frame with the same input as the last
+ *     0x01 p1 p2             a frame with new input
+ *     0x02                   reset button
+ *     0x03                   power cycle
+ *     0x04 hash(8) frames(4) end: machineHash of the final state
+ *
+ * All numbers are little-endian. A movie cut short, say by a crash,
+ * still plays; it just has nothing to check the final state against.
+ */
+typedef struct {
+	FILE* file;
+	unsigned char input[ 2 ];
+	unsigned long frames;
+} MovieWriter;
+
+/*
+ * Start recording from the current state of m. Returns 0, or nonzero
+ * with a message in error, which must hold at least 128 bytes.
+ */
+int movieCreate( MovieWriter* w, const char* path, const Machine* m, char* error );
+
+/*record the input of m for the frame about to be run*/
+void movieFrame( MovieWriter* w, const Machine* m );
+
+void movieReset( MovieWriter* w );
+
+void moviePower( MovieWriter* w );
+
+/*write the end record with the state of m and close. returns nonzero on a write error*/
+int movieClose( MovieWriter* w, const Machine* m );
+
+typedef struct {
+	unsigned long frames;
+
+	/*whether the movie has an end record, and if so whether the final state matched it*/
+	int ended;
+	int matched;
+} MovieResult;
+
+/*
+ * Play a movie on m, which must be in the state it was recorded from,
+ * as fast as possible and without drawing. cart is needed for power
+ * cycles and may otherwise be NULL. Returns 0 when the movie played to
+ * the end; check result to see whether the final state matched.
+ */
+int moviePlay( const char* path, Machine* m, const Cartridge* cart, MovieResult* result, char* error );
+
+#endif
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "pipeline.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*kinds of log entry; the last of each frame is an ENTRY_END*/
+#define ENTRY_READ (0)
+#define ENTRY_WRITE (1)
+#define ENTRY_END (2)
+
+/*
+ * the log
+ */
+
+static void append( Pipeline* p, unsigned long cycle, int kind, int reg, int value ) {
+	unsigned long head = p->head;
+	PipelineEntry* e;
+
+	/*only reload the render thread's index when the cached one says we are full*/
+	while( head - p->cachedTail == PIPELINE_LOG_SIZE ) {
+		p->cachedTail = __atomic_load_n( &p->tail, __ATOMIC_ACQUIRE );
+		if( head - p->cachedTail == PIPELINE_LOG_SIZE ) {
+			sched_yield();
+		}
+	}
+
+	e = &p->entries[ head & (PIPELINE_LOG_SIZE - 1) ];
+	e->cycle = cycle - p->frameCycles;
+	e->kind = kind;
+	e->reg = reg;
+	e->value = value;
+	__atomic_store_n( &p->head, head + 1, __ATOMIC_RELEASE );
+}
+
+static void logAccess( MachinePpuLog* l, const Machine* m, int reg, int value ) {
+	append( (Pipeline*)l, m->cycles, value < 0 ? ENTRY_READ : ENTRY_WRITE, reg, value );
+}
+
+/*the next entry, waiting for the machine's thread to log it if need be*/
+static PipelineEntry take( Pipeline* p ) {
+	unsigned long tail = p->tail;
+	PipelineEntry e;
+
+	while( tail == p->cachedHead ) {
+		p->cachedHead = __atomic_load_n( &p->head, __ATOMIC_ACQUIRE );
+		if( tail == p->cachedHead ) {
+			sched_yield();
+		}
+	}
+	e = p->entries[ tail & (PIPELINE_LOG_SIZE - 1) ];
+	__atomic_store_n( &p->tail, tail + 1, __ATOMIC_RELEASE );
+	return e;
+}
+
+/*
+ * render thread
+ */
+
+static void* renderThread( void* arg ) {
+	Pipeline* p = arg;
+	unsigned char* picture;
+	unsigned long frame, at;
+	PipelineEntry e;
+	Ppu ppu;
+
+	for( ;; ) {
+		pthread_mutex_lock( &p->lock );
+		while( p->running && p->rendered == p->started ) {
+			pthread_cond_wait( &p->changed, &p->lock );
+		}
+		if( p->rendered == p->started ) {
+			pthread_mutex_unlock( &p->lock );
+			return NULL;
+		}
+		frame = p->rendered;
+		ppu = p->start[ frame % 2 ];
+		pthread_mutex_unlock( &p->lock );
+
+		/*three dots per CPU cycle, as the machine ran its own PPU*/
+		picture = p->pictures[ frame % 2 ];
+		at = 0;
+		do {
+			e = take( p );
+			ppuRun( &ppu, (e.cycle - at) * 3, picture );
+			at = e.cycle;
+			if( e.kind == ENTRY_READ ) {
+				ppuReadRegister( &ppu, e.reg );
+			} else if( e.kind == ENTRY_WRITE ) {
+				ppuWriteRegister( &ppu, e.reg, e.value );
+			}
+		} while( e.kind != ENTRY_END );
+
+		pthread_mutex_lock( &p->lock );
+		p->rendered++;
+		pthread_cond_broadcast( &p->changed );
+		pthread_mutex_unlock( &p->lock );
+	}
+}
+
+Pipeline* pipelineCreate( Machine* m ) {
+	Pipeline* p = calloc( 1, sizeof( Pipeline ) );
+	if( p == NULL ) {
+		return NULL;
+	}
+	p->entries = malloc( PIPELINE_LOG_SIZE * sizeof( PipelineEntry ) );
+	if( p->entries == NULL ) {
+		free( p );
+		return NULL;
+	}
+	p->log.access = logAccess;
+	p->m = m;
+	p->running = 1;
+	pthread_mutex_init( &p->lock, NULL );
+	pthread_cond_init( &p->changed, NULL );
+	if( pthread_create( &p->thread, NULL, renderThread, p ) != 0 ) {
+		pthread_cond_destroy( &p->changed );
+		pthread_mutex_destroy( &p->lock );
+		free( p->entries );
+		free( p );
+		return NULL;
+	}
+	return p;
+}
+
+void pipelineFree( Pipeline* p ) {
+	/*a frame an observer stopped partway is ended where it is*/
+	if( p->open ) {
+		append( p, p->m->cycles, ENTRY_END, 0, 0 );
+	}
+	pthread_mutex_lock( &p->lock );
+	p->running = 0;
+	pthread_cond_broadcast( &p->changed );
+	pthread_mutex_unlock( &p->lock );
+	pthread_join( p->thread, NULL );
+
+	pthread_cond_destroy( &p->changed );
+	pthread_mutex_destroy( &p->lock );
+	free( p->entries );
+	free( p );
+}
+
+int pipelineRunFrame( Pipeline* p, unsigned char* frame ) {
+	Machine* m = p->m;
+	unsigned long n;
+	int stopped;
+
+	if( !p->open ) {
+		p->frameCycles = m->cycles;
+		p->open = 1;
+		pthread_mutex_lock( &p->lock );
+		p->start[ p->started % 2 ] = m->ppu;
+		p->started++;
+		pthread_cond_broadcast( &p->changed );
+		pthread_mutex_unlock( &p->lock );
+	}
+
+	machineLogPpu( &p->log );
+	stopped = machineRunFrame( m, NULL );
+	machineLogPpu( NULL );
+	if( stopped ) {
+		return 1;
+	}
+	append( p, m->cycles, ENTRY_END, 0, 0 );
+	p->open = 0;
+
+	/*the render thread can carry on with this frame while the one before is handed back*/
+	n = p->started - 1;
+	pthread_mutex_lock( &p->lock );
+	while( p->rendered < n ) {
+		pthread_cond_wait( &p->changed, &p->lock );
+	}
+	pthread_mutex_unlock( &p->lock );
+	if( frame != NULL ) {
+		memcpy( frame, p->pictures[ (n + 1) % 2 ], PPU_FRAME_SIZE );
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "machine.h"
+
+#include <pthread.h>
+
+/*entries in the register log; a power of two*/
+#define PIPELINE_LOG_SIZE (1UL << 16)
+
+/*
+ * Pipelined rendering, for hosts with a core to spare. The machine
+ * runs on the calling thread without drawing, which still gives the
+ * CPU every $2002 flag, sprite 0 hit and NMI at the right time. Each
+ * access it makes to a PPU register, OAM DMA included, goes into a
+ * lock-free log with the CPU cycle it was made on. A render thread
+ * starts every frame from a copy of the PPU as it was when the frame
+ * began and replays the log into it, drawing as it goes, so that it
+ * ends up with the same picture machineRunFrame would have drawn.
+ *
+ * The picture comes out a frame late: pipelineRunFrame runs frame n
+ * while frame n-1 is drawn, and hands back frame n-1. The first call
+ * gives a blank picture.
+ *
+ * The machine is an ordinary Machine and can be saved, restored or
+ * otherwise changed between frames, as each frame is drawn from its
+ * own copy of the PPU. It must not be run in accuracy mode meanwhile.
+ */
+typedef struct {
+	unsigned int cycle;
+	unsigned char reg;
+	unsigned char kind;
+	unsigned char value;
+} PipelineEntry;
+
+typedef struct {
+	/*first, so that the log callback can find the rest*/
+	MachinePpuLog log;
+
+	Machine* m;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int running;
+
+	/*
+	 * frames the machine has begun and the render thread has finished,
+	 * under lock. A frame's PPU is in start[ frame % 2 ] and its
+	 * picture goes into pictures[ frame % 2 ].
+	 */
+	unsigned long started;
+	unsigned long rendered;
+	Ppu start[ 2 ];
+	unsigned char pictures[ 2 ][ PPU_FRAME_SIZE ];
+
+	/*CPU cycle the frame being run began on, and whether one is partway*/
+	unsigned long frameCycles;
+	int open;
+
+	/*the log, written by the machine's thread and read by the render thread*/
+	PipelineEntry* entries;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long cachedTail;
+	unsigned long cachedHead;
+} Pipeline;
+
+/*render m's frames on a thread of their own; NULL if that cannot be started*/
+Pipeline* pipelineCreate( Machine* m );
+
+void pipelineFree( Pipeline* p );
+
+/*
+ * machineRunFrame with the picture one frame behind. Returns nonzero
+ * if an observer stopped the machine partway, in which case frame is
+ * left alone; running it again carries on with the same frame. frame
+ * may be NULL.
+ */
+int pipelineRunFrame( Pipeline* p, unsigned char* frame );
+
+#endif
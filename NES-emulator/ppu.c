@@ -0,0 +1,575 @@
+#include "ppu.h"
+#include "cartridge.h"
+
+#include <string.h>
+
+void ppuPower( Ppu* ppu, const unsigned char* chr, unsigned long chrSize, int mirroring ) {
+	memset( ppu, 0, sizeof( *ppu ) );
+	if( chrSize > sizeof( ppu->chr ) ) {
+		chrSize = sizeof( ppu->chr );
+	}
+	memcpy( ppu->chr, chr, chrSize );
+
+	/*a cartridge without CHR-ROM has CHR-RAM instead*/
+	ppu->chrWritable = (chrSize == 0);
+	ppu->mirroring = mirroring;
+	ppu->sprite0Dot = -1;
+}
+
+void ppuReset( Ppu* ppu ) {
+	ppu->ctrl = 0;
+	ppu->mask = 0;
+	ppu->w = 0;
+	ppu->readBuffer = 0;
+	ppu->dot = 0;
+	ppu->scanline = 0;
+	ppu->sprite0Dot = -1;
+	ppu->oddFrame = 0;
+}
+
+/*
+ * map a nametable address onto the 2 KB of internal VRAM
+ */
+static unsigned short int nametableIndex( const Ppu* ppu, unsigned short int addr ) {
+	if( ppu->mirroring == MIRROR_VERTICAL ) {
+		return addr & 0x07FF;
+	}
+	return ((addr >> 1) & 0x0400) | (addr & 0x03FF);
+}
+
+static unsigned char paletteIndex( unsigned short int addr ) {
+	addr &= 0x1F;
+
+	/*the sprite backdrop entries are mirrors of the background ones*/
+	if( (addr & 0x13) == 0x10 ) {
+		addr &= 0x0F;
+	}
+	return addr;
+}
+
+static __thread unsigned char* chrLog;
+
+void ppuLogChr( unsigned char* log ) {
+	chrLog = log;
+}
+
+unsigned char ppuReadMemory( Ppu* ppu, unsigned short int addr ) {
+	addr &= 0x3FFF;
+	if( addr < 0x2000 ) {
+		if( chrLog != NULL ) {
+			chrLog[ addr ] |= PPU_CHR_READ;
+		}
+		return ppu->chr[ addr ];
+	}
+	if( addr < 0x3F00 ) {
+		return ppu->vram[ nametableIndex( ppu, addr ) ];
+	}
+	return ppu->palette[ paletteIndex( addr ) ];
+}
+
+void ppuWriteMemory( Ppu* ppu, unsigned short int addr, unsigned char value ) {
+	addr &= 0x3FFF;
+	if( addr < 0x2000 ) {
+		if( ppu->chrWritable ) {
+			ppu->chr[ addr ] = value;
+		}
+	} else if( addr < 0x3F00 ) {
+		ppu->vram[ nametableIndex( ppu, addr ) ] = value;
+	} else {
+		ppu->palette[ paletteIndex( addr ) ] = value & 0x3F;
+	}
+}
+
+/*
+ * make a sprite 0 hit that happened earlier on this line visible
+ */
+static void commitSprite0( Ppu* ppu ) {
+	if( ppu->sprite0Dot >= 0 && ppu->dot >= ppu->sprite0Dot ) {
+		ppu->status |= PPU_STATUS_SPRITE0;
+		ppu->sprite0Dot = -1;
+	}
+}
+
+unsigned char ppuReadRegister( Ppu* ppu, int reg ) {
+	unsigned char value = ppu->openBus;
+
+	switch( reg ) {
+	case 2:
+		commitSprite0( ppu );
+		value = (ppu->status & 0xE0) | (ppu->openBus & 0x1F);
+		ppu->status &= ~PPU_STATUS_VBLANK;
+		ppu->w = 0;
+		break;
+	case 4:
+		value = ppu->oam[ ppu->oamAddr ];
+		break;
+	case 7:
+		if( (ppu->v & 0x3FFF) < 0x3F00 ) {
+			/*reads below the palette come through a one byte delay*/
+			value = ppu->readBuffer;
+			ppu->readBuffer = ppuReadMemory( ppu, ppu->v );
+		} else {
+			value = ppuReadMemory( ppu, ppu->v );
+			ppu->readBuffer = ppuReadMemory( ppu, ppu->v - 0x1000 );
+		}
+		ppu->v += (ppu->ctrl & PPU_CTRL_INCREMENT) ? 32 : 1;
+		break;
+	}
+	ppu->openBus = value;
+	return value;
+}
+
+void ppuWriteRegister( Ppu* ppu, int reg, unsigned char value ) {
+	ppu->openBus = value;
+
+	switch( reg ) {
+	case 0:
+		/*turning NMIs on during vblank raises one straight away*/
+		if( !(ppu->ctrl & PPU_CTRL_NMI) && (value & PPU_CTRL_NMI) &&
+		    (ppu->status & PPU_STATUS_VBLANK) ) {
+			ppu->nmi = 1;
+		}
+		ppu->ctrl = value;
+		ppu->t = (ppu->t & 0xF3FF) | ((value & 0x03) << 10);
+		break;
+	case 1:
+		ppu->mask = value;
+		break;
+	case 3:
+		ppu->oamAddr = value;
+		break;
+	case 4:
+		ppu->oam[ ppu->oamAddr++ ] = value;
+		break;
+	case 5:
+		if( ppu->w == 0 ) {
+			ppu->t = (ppu->t & 0xFFE0) | (value >> 3);
+			ppu->fineX = value & 0x07;
+			ppu->w = 1;
+		} else {
+			ppu->t = (ppu->t & 0x8C1F) | ((value & 0x07) << 12) | ((value & 0xF8) << 2);
+			ppu->w = 0;
+		}
+		break;
+	case 6:
+		if( ppu->w == 0 ) {
+			ppu->t = (ppu->t & 0x00FF) | ((value & 0x3F) << 8);
+			ppu->w = 1;
+		} else {
+			ppu->t = (ppu->t & 0xFF00) | value;
+			ppu->v = ppu->t;
+			ppu->w = 0;
+		}
+		break;
+	case 7:
+		ppuWriteMemory( ppu, ppu->v, value );
+		ppu->v += (ppu->ctrl & PPU_CTRL_INCREMENT) ? 32 : 1;
+		break;
+	}
+}
+
+static int renderingEnabled( const Ppu* ppu ) {
+	return (ppu->mask & (PPU_MASK_BG | PPU_MASK_SPRITES)) != 0;
+}
+
+/*
+ * Fill line[] with background pixels as palette indices 0-15,
+ * 0 meaning transparent. Uses a private copy of v, so the scroll
+ * registers are only changed by the per-line updates in ppuRun.
+ */
+static void renderBackground( const Ppu* ppu, unsigned char* line ) {
+	unsigned char tiles[ 33 * 8 ];
+	unsigned short int v = ppu->v;
+	unsigned short int table = (ppu->ctrl & PPU_CTRL_BG_TABLE) ? 0x1000 : 0x0000;
+	unsigned short int fineY = (v >> 12) & 0x07;
+	unsigned char tile, attribute, low, high, palette, c;
+	unsigned short int pattern;
+	int i, bit;
+
+	for( i = 0; i < 33; i++ ) {
+		tile = ppu->vram[ nametableIndex( ppu, 0x2000 | (v & 0x0FFF) ) ];
+		attribute = ppu->vram[ nametableIndex( ppu, 0x23C0 | (v & 0x0C00) |
+		                                       ((v >> 4) & 0x38) | ((v >> 2) & 0x07) ) ];
+		palette = ((attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03) << 2;
+		pattern = table + tile * 16 + fineY;
+		low = ppu->chr[ pattern ];
+		high = ppu->chr[ pattern + 8 ];
+		if( chrLog != NULL ) {
+			chrLog[ pattern ] |= PPU_CHR_RENDERED;
+			chrLog[ pattern + 8 ] |= PPU_CHR_RENDERED;
+		}
+		for( bit = 0; bit < 8; bit++ ) {
+			c = ((low >> (7 - bit)) & 1) | (((high >> (7 - bit)) & 1) << 1);
+			tiles[ i * 8 + bit ] = c ? (palette | c) : 0;
+		}
+
+		/*coarse x increment, wrapping into the next nametable*/
+		if( (v & 0x001F) == 31 ) {
+			v = (v & ~0x001F) ^ 0x0400;
+		} else {
+			v++;
+		}
+	}
+	memcpy( line, tiles + ppu->fineX, PPU_WIDTH );
+
+	if( !(ppu->mask & PPU_MASK_BG_LEFT) ) {
+		memset( line, 0, 8 );
+	}
+}
+
+static int spriteHeight( const Ppu* ppu ) {
+	return (ppu->ctrl & PPU_CTRL_TALL_SPRITES) ? 16 : 8;
+}
+
+/*
+ * Fetch the two pattern bytes of a sprite's row, where row counts
+ * from the top of the sprite as it appears on screen.
+ */
+static void spritePattern( const Ppu* ppu, const unsigned char* sprite, int row,
+                           unsigned char* low, unsigned char* high ) {
+	int height = spriteHeight( ppu );
+	unsigned short int pattern;
+
+	if( sprite[ 2 ] & 0x80 ) {
+		row = height - 1 - row;
+	}
+	if( height == 16 ) {
+		pattern = ((sprite[ 1 ] & 0x01) ? 0x1000 : 0x0000) + (sprite[ 1 ] & 0xFE) * 16;
+		if( row >= 8 ) {
+			pattern += 16;
+			row -= 8;
+		}
+	} else {
+		pattern = ((ppu->ctrl & PPU_CTRL_SPRITE_TABLE) ? 0x1000 : 0x0000) + sprite[ 1 ] * 16;
+	}
+	*low = ppu->chr[ pattern + row ];
+	*high = ppu->chr[ pattern + row + 8 ];
+	if( chrLog != NULL ) {
+		chrLog[ pattern + row ] |= PPU_CHR_RENDERED;
+		chrLog[ pattern + row + 8 ] |= PPU_CHR_RENDERED;
+	}
+}
+
+/*colour 0-3 of pixel px (0 is leftmost on screen) of a sprite row*/
+static unsigned char spritePixel( const unsigned char* sprite, unsigned char low,
+                                  unsigned char high, int px ) {
+	int bit = (sprite[ 2 ] & 0x40) ? px : 7 - px;
+	return ((low >> bit) & 1) | (((high >> bit) & 1) << 1);
+}
+
+/*
+ * Fill line[] with the sprites on this scanline. Each pixel is the
+ * palette index 0x10-0x1F, 0 for none, with 0x20 set for sprites
+ * behind the background and 0x40 set for pixels of sprite 0.
+ * Returns the number of sprites found on the line, which may be more
+ * than the 8 that get drawn.
+ */
+static int renderSprites( const Ppu* ppu, int y, unsigned char* line ) {
+	int height = spriteHeight( ppu );
+	int found = 0, n, row, x, px;
+	const unsigned char* sprite;
+	unsigned char low, high, c, flags;
+
+	memset( line, 0, PPU_WIDTH );
+	for( n = 0; n < 64; n++ ) {
+		sprite = ppu->oam + n * 4;
+
+		/*a sprite shows up on the line after its Y coordinate*/
+		row = y - 1 - sprite[ 0 ];
+		if( row < 0 || row >= height ) {
+			continue;
+		}
+		if( ++found > 8 ) {
+			continue;
+		}
+		spritePattern( ppu, sprite, row, &low, &high );
+
+		flags = 0x10 | ((sprite[ 2 ] & 0x03) << 2);
+		if( sprite[ 2 ] & 0x20 ) {
+			flags |= 0x20;
+		}
+		if( n == 0 ) {
+			flags |= 0x40;
+		}
+
+		for( px = 0; px < 8; px++ ) {
+			x = sprite[ 3 ] + px;
+			if( x >= PPU_WIDTH ) {
+				break;
+			}
+			c = spritePixel( sprite, low, high, px );
+
+			/*lower OAM indices win, so only fill empty pixels*/
+			if( c && !(line[ x ] & 0x0F) ) {
+				line[ x ] = flags | c;
+			}
+		}
+	}
+
+	if( !(ppu->mask & PPU_MASK_SPRITES_LEFT) ) {
+		memset( line, 0, 8 );
+	}
+	return found;
+}
+
+static void renderLine( Ppu* ppu, unsigned char* frame ) {
+	unsigned char background[ PPU_WIDTH ];
+	unsigned char sprites[ PPU_WIDTH ];
+	unsigned char* out = frame + ppu->scanline * PPU_WIDTH;
+	unsigned char greyscale = (ppu->mask & PPU_MASK_GREYSCALE) ? 0x30 : 0x3F;
+	unsigned char b, s, index;
+	int x;
+
+	if( !renderingEnabled( ppu ) ) {
+		memset( out, ppu->palette[ 0 ] & greyscale, PPU_WIDTH );
+		return;
+	}
+
+	if( ppu->mask & PPU_MASK_BG ) {
+		renderBackground( ppu, background );
+	} else {
+		memset( background, 0, PPU_WIDTH );
+	}
+	if( ppu->mask & PPU_MASK_SPRITES ) {
+		if( renderSprites( ppu, ppu->scanline, sprites ) > 8 ) {
+			ppu->status |= PPU_STATUS_OVERFLOW;
+		}
+	} else {
+		memset( sprites, 0, PPU_WIDTH );
+	}
+
+	for( x = 0; x < PPU_WIDTH; x++ ) {
+		b = background[ x ];
+		s = sprites[ x ];
+		if( (s & 0x40) && b && x != 255 && ppu->sprite0Dot < 0 &&
+		    !(ppu->status & PPU_STATUS_SPRITE0) ) {
+			ppu->sprite0Dot = x + 1;
+		}
+		if( (s & 0x0F) && (!b || !(s & 0x20)) ) {
+			index = s & 0x1F;
+		} else {
+			index = b;
+		}
+		out[ x ] = ppu->palette[ index ] & greyscale;
+	}
+}
+
+/*
+ * the background colour 0-3 at screen column x of the current line
+ */
+static unsigned char backgroundPixel( const Ppu* ppu, int x ) {
+	unsigned short int v = ppu->v;
+	unsigned short int table = (ppu->ctrl & PPU_CTRL_BG_TABLE) ? 0x1000 : 0x0000;
+	int column = x + ppu->fineX;
+	int coarseX = (v & 0x001F) + column / 8;
+	unsigned short int pattern;
+	unsigned char tile;
+
+	/*step across into the next nametable if the column runs off this one*/
+	if( coarseX > 31 ) {
+		v ^= 0x0400;
+	}
+	v = (v & ~0x001F) | (coarseX & 0x1F);
+
+	tile = ppu->vram[ nametableIndex( ppu, 0x2000 | (v & 0x0FFF) ) ];
+	pattern = table + tile * 16 + ((v >> 12) & 0x07);
+	column = 7 - column % 8;
+	return ((ppu->chr[ pattern ] >> column) & 1) | (((ppu->chr[ pattern + 8 ] >> column) & 1) << 1);
+}
+
+/*
+ * What a line does to $2002 without drawing it: sprite overflow and
+ * the dot of a sprite 0 hit. Only sprite 0's own eight pixels and the
+ * background under them are looked at.
+ */
+static void skipLine( Ppu* ppu ) {
+	int y = ppu->scanline;
+	int height = spriteHeight( ppu );
+	int found = 0, n, row, x, px;
+	unsigned char low, high;
+
+	if( !(ppu->mask & PPU_MASK_SPRITES) ) {
+		return;
+	}
+
+	if( !(ppu->status & PPU_STATUS_OVERFLOW) ) {
+		for( n = 0; n < 64 && found <= 8; n++ ) {
+			row = y - 1 - ppu->oam[ n * 4 ];
+			if( row >= 0 && row < height ) {
+				found++;
+			}
+		}
+		if( found > 8 ) {
+			ppu->status |= PPU_STATUS_OVERFLOW;
+		}
+	}
+
+	if( (ppu->status & PPU_STATUS_SPRITE0) || ppu->sprite0Dot >= 0 ||
+	    !(ppu->mask & PPU_MASK_BG) ) {
+		return;
+	}
+	row = y - 1 - ppu->oam[ 0 ];
+	if( row < 0 || row >= height ) {
+		return;
+	}
+	spritePattern( ppu, ppu->oam, row, &low, &high );
+	for( px = 0; px < 8; px++ ) {
+		x = ppu->oam[ 3 ] + px;
+		if( x >= PPU_WIDTH - 1 ) {
+			break;
+		}
+		if( x < 8 && (!(ppu->mask & PPU_MASK_BG_LEFT) || !(ppu->mask & PPU_MASK_SPRITES_LEFT)) ) {
+			continue;
+		}
+		if( spritePixel( ppu->oam, low, high, px ) && backgroundPixel( ppu, x ) ) {
+			ppu->sprite0Dot = x + 1;
+			return;
+		}
+	}
+}
+
+static void incrementY( Ppu* ppu ) {
+	unsigned short int v = ppu->v;
+	int coarseY;
+	if( (v & 0x7000) != 0x7000 ) {
+		v += 0x1000;
+	} else {
+		v &= ~0x7000;
+		coarseY = (v & 0x03E0) >> 5;
+		if( coarseY == 29 ) {
+			coarseY = 0;
+			v ^= 0x0800;
+		} else if( coarseY == 31 ) {
+			coarseY = 0;
+		} else {
+			coarseY++;
+		}
+		v = (v & ~0x03E0) | (coarseY << 5);
+	}
+	ppu->v = v;
+}
+
+/*
+ * the dot on the current line where something next happens
+ */
+static short int nextEvent( const Ppu* ppu ) {
+	if( ppu->dot < 1 ) {
+		return 1;
+	}
+	if( ppu->dot < 257 ) {
+		return 257;
+	}
+	if( ppu->scanline == PPU_PRERENDER_LINE ) {
+		if( ppu->dot < 280 ) {
+			return 280;
+		}
+
+		/*odd frames skip the last dot of the pre-render line when rendering*/
+		if( ppu->oddFrame && renderingEnabled( ppu ) ) {
+			return PPU_DOTS - 1;
+		}
+	}
+	return PPU_DOTS;
+}
+
+static int event( Ppu* ppu, unsigned char* frame ) {
+	int line = ppu->scanline;
+
+	if( ppu->dot == 1 ) {
+		if( line < PPU_HEIGHT ) {
+			if( frame != NULL ) {
+				renderLine( ppu, frame );
+			} else if( renderingEnabled( ppu ) ) {
+				skipLine( ppu );
+			}
+		} else if( line == PPU_VBLANK_LINE ) {
+			ppu->status |= PPU_STATUS_VBLANK;
+			if( ppu->ctrl & PPU_CTRL_NMI ) {
+				ppu->nmi = 1;
+			}
+			return 1;
+		} else if( line == PPU_PRERENDER_LINE ) {
+			ppu->status &= ~(PPU_STATUS_VBLANK | PPU_STATUS_SPRITE0 | PPU_STATUS_OVERFLOW);
+		}
+	} else if( ppu->dot == 257 ) {
+		if( renderingEnabled( ppu ) && (line < PPU_HEIGHT || line == PPU_PRERENDER_LINE) ) {
+			incrementY( ppu );
+			ppu->v = (ppu->v & ~0x041F) | (ppu->t & 0x041F);
+		}
+	} else if( ppu->dot == 280 ) {
+		if( renderingEnabled( ppu ) ) {
+			ppu->v = (ppu->v & ~0x7BE0) | (ppu->t & 0x7BE0);
+		}
+	} else {
+		/*end of the line*/
+		commitSprite0( ppu );
+		ppu->sprite0Dot = -1;
+		ppu->dot = 0;
+		if( ++ppu->scanline == PPU_SCANLINES ) {
+			ppu->scanline = 0;
+			ppu->frame++;
+			ppu->oddFrame ^= 1;
+		}
+	}
+	return 0;
+}
+
+int ppuRun( Ppu* ppu, int dots, unsigned char* frame ) {
+	int vblank = 0;
+	short int next;
+	while( dots > 0 ) {
+		next = nextEvent( ppu );
+		if( ppu->dot + dots < next ) {
+			ppu->dot += dots;
+			break;
+		}
+		dots -= next - ppu->dot;
+		ppu->dot = next;
+		vblank |= event( ppu, frame );
+	}
+	return vblank;
+}
+
+int ppuPeekStatus( const Ppu* ppu ) {
+	unsigned char value = (ppu->status & 0xE0) | (ppu->openBus & 0x1F);
+	if( (ppu->status & PPU_STATUS_VBLANK) || ppu->w || ppu->openBus != value ||
+	    (ppu->sprite0Dot >= 0 && ppu->dot >= ppu->sprite0Dot) ) {
+		return -1;
+	}
+	return value;
+}
+
+/*
+ * dots that can be run before the given dot of the given line comes
+ * round, with one to spare in case this is an odd frame that skips one
+ */
+static int dotsUntil( const Ppu* ppu, int line, int dot ) {
+	int dots = (line - ppu->scanline) * PPU_DOTS + dot - ppu->dot;
+	if( dots <= 0 ) {
+		dots += PPU_SCANLINES * PPU_DOTS;
+	}
+	return dots - 2;
+}
+
+static int minimum( int a, int b ) {
+	return a < b ? a : b;
+}
+
+int ppuQuietDots( const Ppu* ppu, int status ) {
+	int quiet = dotsUntil( ppu, PPU_VBLANK_LINE, 1 );
+	int line = ppu->dot < 1 ? ppu->scanline : (ppu->scanline + 1) % PPU_SCANLINES;
+
+	if( !status ) {
+		return quiet;
+	}
+	quiet = minimum( quiet, dotsUntil( ppu, PPU_PRERENDER_LINE, 1 ) );
+
+	/*visible lines can set the sprite 0 and overflow flags*/
+	if( ppu->sprite0Dot > ppu->dot ) {
+		quiet = minimum( quiet, ppu->sprite0Dot - ppu->dot );
+	}
+	if( renderingEnabled( ppu ) && line < PPU_HEIGHT ) {
+		quiet = minimum( quiet, dotsUntil( ppu, line, 1 ) );
+	}
+	return quiet;
+}
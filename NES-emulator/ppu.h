@@ -0,0 +1,125 @@
+#ifndef PPU_H
+#define PPU_H
+
+#define PPU_WIDTH (256)
+#define PPU_HEIGHT (240)
+#define PPU_FRAME_SIZE (PPU_WIDTH * PPU_HEIGHT)
+
+#define PPU_DOTS (341)
+#define PPU_SCANLINES (262)
+#define PPU_VBLANK_LINE (241)
+#define PPU_PRERENDER_LINE (261)
+
+/*$2000 bits*/
+#define PPU_CTRL_INCREMENT (0x04)
+#define PPU_CTRL_SPRITE_TABLE (0x08)
+#define PPU_CTRL_BG_TABLE (0x10)
+#define PPU_CTRL_TALL_SPRITES (0x20)
+#define PPU_CTRL_NMI (0x80)
+
+/*$2001 bits*/
+#define PPU_MASK_GREYSCALE (0x01)
+#define PPU_MASK_BG_LEFT (0x02)
+#define PPU_MASK_SPRITES_LEFT (0x04)
+#define PPU_MASK_BG (0x08)
+#define PPU_MASK_SPRITES (0x10)
+
+/*$2002 bits*/
+#define PPU_STATUS_OVERFLOW (0x20)
+#define PPU_STATUS_SPRITE0 (0x40)
+#define PPU_STATUS_VBLANK (0x80)
+
+/*
+ * Picture processing unit. Everything is plain data so that a Ppu can
+ * be copied, compared or written out byte for byte.
+ *
+ * Rendering is done a scanline at a time at dot 1 of each visible line,
+ * using the scroll position the PPU has at that point. A sprite 0 hit
+ * found while rendering only becomes visible in $2002 once the dot it
+ * happens on has been reached.
+ */
+typedef struct {
+	unsigned char ctrl;
+	unsigned char mask;
+	unsigned char status;
+	unsigned char oamAddr;
+
+	/*loopy's scroll registers: current and temporary address, fine x, write toggle*/
+	unsigned short int v;
+	unsigned short int t;
+	unsigned char fineX;
+	unsigned char w;
+
+	unsigned char readBuffer;
+	unsigned char openBus;
+
+	/*set when an NMI should be delivered to the CPU; cleared by the CPU*/
+	unsigned char nmi;
+	unsigned char mirroring;
+	unsigned char chrWritable;
+	unsigned char oddFrame;
+
+	short int dot;
+	short int scanline;
+	short int sprite0Dot;
+	short int pad;
+	unsigned long frame;
+
+	unsigned char palette[ 32 ];
+	unsigned char oam[ 256 ];
+	unsigned char vram[ 2048 ];
+	unsigned char chr[ 8192 ];
+} Ppu;
+
+/*flags ppuLogChr sets on CHR bytes*/
+#define PPU_CHR_RENDERED (0x01)
+#define PPU_CHR_READ (0x02)
+
+/*mirroring is one of the cartridge MIRROR_ constants*/
+void ppuPower( Ppu* ppu, const unsigned char* chr, unsigned long chrSize, int mirroring );
+
+void ppuReset( Ppu* ppu );
+
+/*CPU access to $2000-$2007. reg is the address with only the low 3 bits kept*/
+unsigned char ppuReadRegister( Ppu* ppu, int reg );
+
+void ppuWriteRegister( Ppu* ppu, int reg, unsigned char value );
+
+/*PPU address space, $0000-$3FFF*/
+unsigned char ppuReadMemory( Ppu* ppu, unsigned short int addr );
+
+void ppuWriteMemory( Ppu* ppu, unsigned short int addr, unsigned char value );
+
+/*
+ * Advance by the given number of dots, drawing visible lines into frame
+ * as 6-bit NES colour indices. Returns nonzero if vblank began during
+ * these dots, which is where one frame ends and the next begins.
+ *
+ * With a NULL frame nothing is composited, but sprite overflow and
+ * sprite 0 hits still reach $2002 at the same dot as when drawing.
+ */
+int ppuRun( Ppu* ppu, int dots, unsigned char* frame );
+
+/*
+ * What a read of $2002 would return right now, or -1 if reading it
+ * would change anything (clear vblank, the write toggle or open bus,
+ * or make a sprite 0 hit visible).
+ */
+int ppuPeekStatus( const Ppu* ppu );
+
+/*
+ * Number of dots the PPU can be run for before it might raise an NMI
+ * or, if status is nonzero, before $2002 might read differently.
+ */
+int ppuQuietDots( const Ppu* ppu, int status );
+
+/*
+ * Mark CHR bytes in log (8 KB, one byte per CHR byte) as PPUs on the
+ * calling thread use them: PPU_CHR_RENDERED when fetched to draw a
+ * line, PPU_CHR_READ when read through $2007. Lines run without a
+ * frame to draw into only fetch sprite 0, so frames skipped while fast
+ * forwarding leave most tiles unmarked. NULL stops marking.
+ */
+void ppuLogChr( unsigned char* log );
+
+#endif
@@ -1,4 +1,5 @@
 #include "processor.h"
+#include "counters.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,13 +54,96 @@ void checkSignStatus( char* status, char reg ) {
 	}
 }
 
+#if CPU_VARIANT != CPU_2A03
+/*
+ * BCD addition, a digit at a time. The NMOS chip leaves N and V as
+ * they are before the high digit is adjusted and Z as in binary; the
+ * 65C02 takes N and Z from the result.
+ */
+static void adcDecimal( char* accum, char* status, unsigned char arg ) {
+	unsigned char a = *accum;
+	int carry = getStatus( *status, STATUS_C );
+	int low = (a & 0x0F) + (arg & 0x0F) + carry;
+	int high;
+
+	if( low > 0x09 ) {
+		low += 0x06;
+	}
+	high = (a >> 4) + (arg >> 4) + (low > 0x0F);
+	if( !((a ^ arg) & 0x80) && ((a ^ (high << 4)) & 0x80) ) {
+		setStatus( status, STATUS_V );
+	} else {
+		clearStatus( status, STATUS_V );
+	}
+#if CPU_VARIANT == CPU_NMOS
+	checkZeroStatus( status, a + arg + carry );
+	checkSignStatus( status, high << 4 );
+#endif
+
+	if( high > 0x09 ) {
+		high += 0x06;
+	}
+	if( high > 0x0F ) {
+		setStatus( status, STATUS_C );
+	} else {
+		clearStatus( status, STATUS_C );
+	}
+	*accum = (low & 0x0F) | (high << 4);
+#if CPU_VARIANT == CPU_65C02
+	checkZeroStatus( status, *accum );
+	checkSignStatus( status, *accum );
+#endif
+}
+
+/*
+ * BCD difference of a and arg. Flags are left to the binary
+ * subtraction, which both chips set the same in decimal mode, except
+ * that the 65C02 takes N and Z from the result.
+ */
+static void sbcDecimal( char* accum, char* status, unsigned char a, unsigned char arg, int borrow ) {
+#if CPU_VARIANT == CPU_NMOS
+	int low = (a & 0x0F) - (arg & 0x0F) - borrow;
+	int high = (a >> 4) - (arg >> 4);
+
+	if( low < 0 ) {
+		low -= 0x06;
+		high -= 1;
+	}
+	if( high < 0 ) {
+		high -= 0x06;
+	}
+	*accum = (low & 0x0F) | (high << 4);
+#else
+	int low = (a & 0x0F) - (arg & 0x0F) - borrow;
+	int diff = a - arg - borrow;
+
+	/*the 65C02 adjusts the whole byte, so a low digit borrow can reach the high digit*/
+	if( diff < 0 ) {
+		diff -= 0x60;
+	}
+	if( low < 0 ) {
+		diff -= 0x06;
+	}
+	*accum = diff;
+	checkZeroStatus( status, *accum );
+	checkSignStatus( status, *accum );
+#endif
+}
+#endif
+
 /*
  * add to accumulator
  */
 void adc( char* accum, char* status, unsigned char arg ) {
 
 	unsigned short int sum;
-	
+
+#if CPU_VARIANT != CPU_2A03
+	if( getStatus( *status, STATUS_D ) ) {
+		adcDecimal( accum, status, arg );
+		return;
+	}
+#endif
 	sum = (unsigned char)(*accum) + arg + getStatus( *status, STATUS_C );
 	if( !((*accum ^ arg) & 0x80) && ((*accum ^ sum) & 0x80) ) {
 		setStatus( status, STATUS_V );
@@ -160,6 +244,10 @@ void bmi( unsigned short int* pc, char status, char arg ) {
 	}
 }
 
+void bra( unsigned short int* pc, char status, char arg ) {
+	*pc += arg;
+}
+
 void bne( unsigned short int* pc, char status, char arg ) {
 
 	/*if the zero bit is clear, branch*/
@@ -180,27 +268,30 @@ void brk( unsigned short int* pc, char* status, unsigned char* sp, Memory* mem )
 
 	char mask;
 
+	COUNT_MANY( writes[ COUNTER_STACK ], 3 );
+	COUNT_MANY( reads[ COUNTER_ROM ], 2 );
+
 	/*increment program counter*/
 	*pc = *pc + 1;
 
 	/*Push high program counter onto stack*/
 	mem->data[ STACK_OFFSET + *sp ] = *pc / 0x0100;
-	*sp = *sp + 1;
+	*sp = *sp - 1;
 
 	/*Push low program counter onto stack*/
 	mem->data[ STACK_OFFSET + *sp ] = *pc % 0x0100;
-	*sp = *sp + 1;
+	*sp = *sp - 1;
 
 	/*push status register*/
-	mask = 1 << STATUS_B;
+	mask = (1 << STATUS_B) | (1 << STATUS_U);
 	mem->data[ STACK_OFFSET + *sp ] = *status | mask;
-	*sp = *sp + 1;
+	*sp = *sp - 1;
 
 	/*set interrupt flag*/
 	setStatus( status, STATUS_I );
 
 	/*load the vector into the PC*/
-	*pc = (mem->data[0xFFFE] << 8) + mem->data[0xFFFF];
+	*pc = (unsigned char)mem->data[0xFFFE] + ((unsigned char)mem->data[0xFFFF] << 8);
 }
 
 void bvc( unsigned short int* pc, char status, char arg ) {
@@ -239,7 +330,7 @@ void cmp( char accum, char* status, char arg ) {
 	char diff = accum - arg;
 	checkZeroStatus( status, diff );
 	checkSignStatus( status, diff );
-	if( accum < arg ) {
+	if( (unsigned char)accum >= (unsigned char)arg ) {
 		setStatus( status, STATUS_C );
 	} else {
 		clearStatus( status, STATUS_C );
@@ -250,7 +341,7 @@ void cpx( char x, char* status, char arg ) {
 	char diff = x - arg;
 	checkZeroStatus( status, diff );
 	checkSignStatus( status, diff );
-	if( x < arg ) {
+	if( (unsigned char)x >= (unsigned char)arg ) {
 		setStatus( status, STATUS_C );
 	} else {
 		clearStatus( status, STATUS_C );
@@ -261,7 +352,7 @@ void cpy( char y, char* status, char arg ) {
 	char diff = y - arg;
 	checkZeroStatus( status, diff );
 	checkSignStatus( status, diff );
-	if( y < arg ) {
+	if( (unsigned char)y >= (unsigned char)arg ) {
 		setStatus( status, STATUS_C );
 	} else {
 		clearStatus( status, STATUS_C );
@@ -316,11 +407,16 @@ void jmp( unsigned short int* pc, unsigned short int target ) {
 
 void jsr( unsigned short int* pc, unsigned short int target, unsigned char* sp, Memory* mem ) {
 
-	/*push the current pc onto the stack*/
-	mem->data[ *sp + STACK_OFFSET ] = *pc;
+	/*the return address pushed is the last byte of the jsr instruction*/
+	unsigned short int ret = *pc - 1;
 
-	/*update the stack pointer*/
-	*sp += 1;
+	COUNT_MANY( writes[ COUNTER_STACK ], 2 );
+
+	/*push the high byte, then the low byte*/
+	mem->data[ *sp + STACK_OFFSET ] = ret / 0x0100;
+	*sp -= 1;
+	mem->data[ *sp + STACK_OFFSET ] = ret % 0x0100;
+	*sp -= 1;
 
 	/*copy the target address to the program counter*/
 	*pc = target;
@@ -350,9 +446,11 @@ void lsr( char* target, char* status ) {
 	} else {
 		setStatus( status, STATUS_C );
 	}
+
+	/*shift as unsigned, or bit 7 would be copied down*/
+	*target = (unsigned char)(*target) >> 1;
 	clearStatus( status, STATUS_S );
 	checkZeroStatus( status, *target );
-	*target = *target >> 1;
 }
 
 void nop( ) {
@@ -367,23 +465,30 @@ void ora( char* accum, char* status, char arg ) {
 }
 
 void pha( char accum, unsigned char* sp, Memory* mem ) {
+	COUNT( writes[ COUNTER_STACK ] );
 	mem->data[ *sp + STACK_OFFSET ] = accum;
-	*sp += 1;
+	*sp -= 1;
 }
 
 void php( char status, unsigned char* sp, Memory* mem ) {
-	mem->data[ *sp + STACK_OFFSET ] = status;
-	*sp += 1;
+	COUNT( writes[ COUNTER_STACK ] );
+	/*the B flag only exists on the stack, and bit 5 always reads as set*/
+	mem->data[ *sp + STACK_OFFSET ] = status | (1 << STATUS_B) | (1 << STATUS_U);
+	*sp -= 1;
 } 
 
-void pla( char* accum, unsigned char* sp, const Memory* mem ) {
-	*sp -= 1;
+void pla( char* accum, char* status, unsigned char* sp, const Memory* mem ) {
+	COUNT( reads[ COUNTER_STACK ] );
+	*sp += 1;
 	*accum = mem->data[ *sp + STACK_OFFSET ];
+	checkZeroStatus( status, *accum );
+	checkSignStatus( status, *accum );
 }
 
 void plp( char* status, unsigned char* sp, const Memory* mem ) {
-	*sp -= 1;
-	*status = mem->data[ *sp + STACK_OFFSET ];
+	COUNT( reads[ COUNTER_STACK ] );
+	*sp += 1;
+	*status = (mem->data[ *sp + STACK_OFFSET ] & ~(1 << STATUS_B)) | (1 << STATUS_U);
 }
 
 void rol( char* target, char* status ) {
@@ -399,13 +504,13 @@ void rol( char* target, char* status ) {
 	} else {
 		setStatus( status, STATUS_C );
 	}
-	checkZeroStatus( status, STATUS_Z );
-	checkSignStatus( status, STATUS_S );
+	checkZeroStatus( status, *target );
+	checkSignStatus( status, *target );
 }
 
 void ror( char* target, char* status ) {
 	int carryOut = (*target & 0x01);
-	*target = *target >> 1;
+	*target = (unsigned char)(*target) >> 1;
 	if( getStatus( *status, STATUS_C ) ) {
 		*target = *target | 0x80;
 	} else {
@@ -416,24 +521,41 @@ void ror( char* target, char* status ) {
 	} else {
 		setStatus( status, STATUS_C );
 	}
-	checkZeroStatus( status, STATUS_Z );
-	checkSignStatus( status, STATUS_S );
+	checkZeroStatus( status, *target );
+	checkSignStatus( status, *target );
 }
 
 void rti( unsigned short int* pc, unsigned char* sp, char* status, const Memory* mem ) {
 	unsigned char pcl, pch;
-	*sp = *sp - 1;
-	*status = 0xEF & mem->data[ STACK_OFFSET + * sp ];
-	*sp = *sp - 1;
+	COUNT_MANY( reads[ COUNTER_STACK ], 3 );
+	*sp = *sp + 1;
+	*status = (mem->data[ STACK_OFFSET + *sp ] & ~(1 << STATUS_B)) | (1 << STATUS_U);
+	*sp = *sp + 1;
 	pcl = mem->data[ STACK_OFFSET + *sp ];
-	*sp = *sp - 1;
+	*sp = *sp + 1;
 	pch = mem->data[ STACK_OFFSET + *sp ];
 	*pc = (pch << 8) + pcl;
 }
 
+void rts( unsigned short int* pc, unsigned char* sp, const Memory* mem ) {
+	unsigned char pcl, pch;
+	COUNT_MANY( reads[ COUNTER_STACK ], 2 );
+	*sp = *sp + 1;
+	pcl = mem->data[ STACK_OFFSET + *sp ];
+	*sp = *sp + 1;
+	pch = mem->data[ STACK_OFFSET + *sp ];
+	*pc = (pch << 8) + pcl + 1;
+}
+
 void sbc( char* accum, char* status, char arg ) {
-	unsigned short int diff = *accum - arg;
-	if( getStatus( *status, STATUS_C ) ) {
+
+	/*the carry flag is an inverted borrow*/
+	unsigned short int diff = (unsigned char)(*accum) - (unsigned char)arg;
+#if CPU_VARIANT != CPU_2A03
+	unsigned char before = *accum;
+	int borrow = !getStatus( *status, STATUS_C );
+#endif
+	if( !getStatus( *status, STATUS_C ) ) {
 		diff -= 1;
 	}
 
@@ -444,11 +566,11 @@ void sbc( char* accum, char* status, char arg ) {
 		clearStatus( status, STATUS_V );
 	}
 
-	/*set or clear carry flag*/
+	/*set or clear carry flag: set unless the subtraction borrowed*/
 	if( diff / 0x0100 ) {
-		setStatus( status, STATUS_C );
-	} else {
 		clearStatus( status, STATUS_C );
+	} else {
+		setStatus( status, STATUS_C );
 	}
 	*accum = diff % 0x0100;
 
@@ -457,6 +579,12 @@ void sbc( char* accum, char* status, char arg ) {
 
 	/*set or clear sign flag*/
 	checkSignStatus( status, *accum );
+
+#if CPU_VARIANT != CPU_2A03
+	if( getStatus( *status, STATUS_D ) ) {
+		sbcDecimal( accum, status, before, arg, borrow );
+	}
+#endif
 }
 
 void sec( char* status ) {
@@ -495,6 +623,16 @@ void tay( char accum, char* status, char* y ) {
 	checkSignStatus( status, *y );
 }
 
+void trb( char accum, char* target, char* status ) {
+	checkZeroStatus( status, accum & *target );
+	*target &= ~accum;
+}
+
+void tsb( char accum, char* target, char* status ) {
+	checkZeroStatus( status, accum & *target );
+	*target |= accum;
+}
+
 void tsx( char sp, char* status, char* x ) {
 	*x = sp;
 	checkZeroStatus( status, *x );
@@ -509,8 +647,6 @@ void txa( char x, char* status, char* a ) {
 
 void txs( char x, char* status, char* sp ) {
 	*sp = x;
-	checkZeroStatus( status, *sp );
-	checkSignStatus( status, *sp );
 }
 
 void tya( char y, char* status, char* a ) {
@@ -1,14 +1,39 @@
+#ifndef PROCESSOR_H
+#define PROCESSOR_H
 
 #define STATUS_C (0)
 #define STATUS_Z (1)
 #define STATUS_I (2)
 #define STATUS_D (3)
 #define STATUS_B (4)
+#define STATUS_U (5)
 #define STATUS_V (6)
 #define STATUS_S (7)
 
 #define STACK_OFFSET (0x100)
 
+/*
+ * CPU variants. The core is built for one of them, chosen with
+ * -DCPU_VARIANT=CPU_NMOS and so on; the NES's 2A03 is the default.
+ *
+ *   - CPU_2A03: an NMOS 6502 with decimal mode cut out. D can be set
+ *     and cleared, but ADC and SBC never look at it.
+ *   - CPU_NMOS: the original 6502, with BCD. In decimal mode N, V and
+ *     Z come out as the chip leaves them, not from the result.
+ *   - CPU_65C02: the CMOS 6502, with BCD giving valid N and Z at the
+ *     cost of a cycle, and its new instructions and addressing mode.
+ *     Interrupts clear D, and JMP ($xxFF) no longer wraps.
+ *
+ * The lockstep engine and the recompiler only know the 2A03.
+ */
+#define CPU_2A03 (0)
+#define CPU_NMOS (1)
+#define CPU_65C02 (2)
+
+#ifndef CPU_VARIANT
+#define CPU_VARIANT CPU_2A03
+#endif
+
 typedef struct {
 	char data[ 65536 ];
 } Memory;
@@ -22,7 +47,7 @@ void clearStatus( char* status, int bit );
 /*
  * Add data to accumulator.
  *
- * C,A <= A + M + C
+ * C,A <= A + M + C, in BCD if D is set and the variant has it
  *
  * N Z C I D V
  * / / / _ _ /
@@ -90,6 +115,15 @@ void bit( char accum, char* status, char arg );
  */
 void bmi( unsigned short int* pc, char status, char arg );
 
+/*
+ * Branch always (65C02)
+ *
+ * N Z C I D V
+ * _ _ _ _ _ _
+ *
+ */
+void bra( unsigned short int* pc, char status, char arg );
+
 /*
  * Branch on Z = 0
  *
@@ -115,8 +149,8 @@ void bpl( unsigned short int* pc, char status, char arg );
  * (PCL) toS
  * (ST)  toS
  *
- * (PCH) <= M[ 0xFFFE ]
- * (PCL) <= M[ 0xFFFF ]
+ * (PCL) <= M[ 0xFFFE ]
+ * (PCH) <= M[ 0xFFFF ]
  *
  * N Z C I D V
  * _ _ _ 1 _ _
@@ -300,10 +334,11 @@ void iny( char* y, char* status );
 void jmp( unsigned short int* pc, unsigned short int target );
 
 /*
- * Jump to instruction and save return address
+ * Jump to instruction and save return address. pc is the address
+ * of the next instruction, so pc - 1 is what gets pushed.
  *
- * PCL toS
- * PCH toS
+ * (PC-1)H toS
+ * (PC-1)L toS
  * PC <= M
  *
  * N Z C I D V
@@ -346,7 +381,7 @@ void ldx( char* x, char* status, char arg );
 void ldy( char* y, char* status, char arg );
 
 /*
- * logical shift left (either memory or accumulator
+ * logical shift right (either memory or accumulator)
  *
  * N Z C I D V
  * 0 / / _ _ _
@@ -398,10 +433,10 @@ void php( char status, unsigned char* sp, Memory* mem );
  * A fromS
  *
  * N Z C I D V
- * _ _ _ _ _ _
+ * / / _ _ _ _
  *
  */
-void pla( char* accum, unsigned char* sp, const Memory* memory );
+void pla( char* accum, char* status, unsigned char* sp, const Memory* memory );
 
 /*
  * Pull status from stack
@@ -448,19 +483,20 @@ void rti( unsigned short* pc, unsigned char* sp, char* status, const Memory* mem
 /*
  * Return from subroutine
  *
- * PC fromS
+ * PCL fromS
+ * PCH fromS
  * PC <= PC + 1
  *
  * N Z C I D V
  * _ _ _ _ _ _
  *
  */
-void rts( char* pc, unsigned char* sp, const Memory* mem );
+void rts( unsigned short int* pc, unsigned char* sp, const Memory* mem );
 
 /*
  * Subtract memory from accumulator with borrow
  *
- * A <= A - M - C
+ * A <= A - M - C, in BCD if D is set and the variant has it
  *
  * N Z C I D V
  * / / / _ _ /
@@ -540,6 +576,28 @@ void tax( char accum, char* status, char* x );
  */
 void tay( char accum, char* status, char* y ); 
 
+/*
+ * Test and reset memory bits against accumulator (65C02)
+ *
+ * Z <= (A and M) = 0, M <= M and not A
+ *
+ * N Z C I D V
+ * _ / _ _ _ _
+ *
+ */
+void trb( char accum, char* target, char* status );
+
+/*
+ * Test and set memory bits against accumulator (65C02)
+ *
+ * Z <= (A and M) = 0, M <= M or A
+ *
+ * N Z C I D V
+ * _ / _ _ _ _
+ *
+ */
+void tsb( char accum, char* target, char* status );
+
 /*
  * Transfer stack pointer to index X
  *
@@ -562,7 +620,7 @@ void txa( char x, char* status, char* accum );
  * Transfer index X to stack pointer
  *
  * N Z C I D V
- * / / _ _ _ _
+ * _ _ _ _ _ _
  *
  */
 void txs( char x, char* status, char* sp );
@@ -575,3 +633,5 @@ void txs( char x, char* status, char* sp );
  *
  */
 void tya( char y, char* status, char* accum );
+
+#endif
@@ -0,0 +1,291 @@
+#include "profile.h"
+#include "disasm.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPCODE_PHP (0x08)
+#define OPCODE_JSR (0x20)
+#define OPCODE_PHA (0x48)
+
+/*the 6502 stack holds at most 128 return addresses*/
+#define MAX_DEPTH (128)
+
+typedef struct {
+	unsigned long start;
+	unsigned short int entry;
+	unsigned char sp;
+	unsigned char interrupt;
+} Call;
+
+struct Profiler {
+	/*first, so that event can find the rest*/
+	ProfileHook hook;
+	const Machine* machine;
+
+	Call stack[ MAX_DEPTH ];
+	int depth;
+	int interrupts;
+
+	/*
+	 * the part of current the running code is charged to, and since
+	 * when; the main program's share is worked out at the end
+	 */
+	unsigned long* charged;
+	unsigned long uncharged;
+	unsigned long chargedSince;
+	unsigned long frameStart;
+
+	ProfileFrame current;
+	ProfileFrame* frames;
+	unsigned long frameCount;
+	unsigned long frameCapacity;
+
+	ProfileCount counts[ 0x10000 ];
+};
+
+typedef struct {
+	unsigned long key;
+	unsigned short int pc;
+} Ranked;
+
+/*charge the cycles up to now and pick the part of the frame the next ones go to*/
+static void charge( Profiler* p, unsigned long now ) {
+	*p->charged += now - p->chargedSince;
+	p->chargedSince = now;
+	if( p->interrupts > 0 ) {
+		p->charged = &p->current.interrupt;
+	} else if( p->depth > 0 ) {
+		p->charged = &p->current.subroutine;
+	} else {
+		p->charged = &p->uncharged;
+	}
+}
+
+/*close the frame being profiled at cycle now and start the given one*/
+static void newFrame( Profiler* p, unsigned long frame, unsigned long now ) {
+	ProfileFrame* grown;
+
+	charge( p, now );
+	p->current.cycles = now - p->frameStart;
+	if( p->current.cycles != 0 && p->frameCount == p->frameCapacity ) {
+		p->frameCapacity = p->frameCapacity ? p->frameCapacity * 2 : 1024;
+		grown = realloc( p->frames, p->frameCapacity * sizeof( ProfileFrame ) );
+		if( grown != NULL ) {
+			p->frames = grown;
+		} else {
+			p->frameCapacity = p->frameCount;
+		}
+	}
+	if( p->current.cycles != 0 && p->frameCount < p->frameCapacity ) {
+		p->current.main = p->current.cycles - p->current.interrupt - p->current.subroutine;
+		p->frames[ p->frameCount++ ] = p->current;
+	}
+	memset( &p->current, 0, sizeof( p->current ) );
+	p->current.frame = frame;
+	p->frameStart = now;
+}
+
+static void call( Profiler* p, unsigned short int entry, unsigned char sp, unsigned long start, int interrupt ) {
+	Call* c;
+
+	p->counts[ entry ].calls++;
+	if( p->depth == MAX_DEPTH ) {
+		return;
+	}
+	c = &p->stack[ p->depth++ ];
+	c->start = start;
+	c->entry = entry;
+	c->sp = sp;
+	c->interrupt = interrupt;
+	p->interrupts += interrupt;
+	charge( p, start );
+}
+
+static void ret( Profiler* p, unsigned long now ) {
+	Call* c = &p->stack[ --p->depth ];
+	p->counts[ c->entry ].inclusive += now - c->start;
+	p->interrupts -= c->interrupt;
+	charge( p, now );
+}
+
+static unsigned short int peek16( const Machine* m, unsigned short int addr ) {
+	return machinePeek( m, addr ) | (machinePeek( m, addr + 1 ) << 8);
+}
+
+/*
+ * the instruction at pc, begun at cycle start with the stack pointer at
+ * from, moved it: look for calls and returns
+ */
+static void stackMoved( Profiler* p, const Machine* m, unsigned short int pc, unsigned char from, unsigned long start ) {
+	unsigned char opcode = machinePeek( m, pc ), pushed, sp = m->cpu.sp;
+	unsigned long now = m->cycles;
+
+	while( p->depth > 0 && sp > p->stack[ p->depth - 1 ].sp ) {
+		ret( p, now );
+	}
+	pushed = from - sp;
+	if( opcode == OPCODE_JSR ) {
+		call( p, peek16( m, pc + 1 ), from - 2, start, 0 );
+		pushed -= 2;
+	} else if( opcode == OPCODE_PHA || opcode == OPCODE_PHP ) {
+		pushed -= 1;
+	}
+	if( pushed == 3 && (m->cpu.pc == peek16( m, VECTOR_NMI ) || m->cpu.pc == peek16( m, VECTOR_IRQ )) ) {
+		call( p, m->cpu.pc, sp, now, 1 );
+	}
+}
+
+/*the instruction at pc moved the stack pointer, which the machine has counted, or a frame ended*/
+static void event( ProfileHook* h, const Machine* m, unsigned short int pc, unsigned char sp, unsigned long start ) {
+	Profiler* p = (Profiler*)h;
+
+	if( m->frame != p->current.frame ) {
+		newFrame( p, m->frame, start );
+	}
+	if( m->cpu.sp != sp ) {
+		stackMoved( p, m, pc, sp, start );
+	}
+}
+
+Profiler* profilerStart( const Machine* m ) {
+	Profiler* p = calloc( 1, sizeof( Profiler ) );
+
+	if( p == NULL ) {
+		return NULL;
+	}
+	p->machine = m;
+	p->current.frame = m->frame;
+	p->frameStart = m->cycles;
+	p->chargedSince = m->cycles;
+	p->charged = &p->uncharged;
+	p->hook.machine = m;
+	p->hook.counts = p->counts;
+	p->hook.event = event;
+	machineProfile( &p->hook );
+	return p;
+}
+
+void profilerStop( Profiler* p ) {
+	machineProfile( NULL );
+	if( p->machine->frame != p->current.frame ) {
+		newFrame( p, p->machine->frame, p->machine->cycles );
+	}
+	while( p->depth > 0 ) {
+		ret( p, p->machine->cycles );
+	}
+	newFrame( p, 0, p->machine->cycles );
+}
+
+const ProfileCount* profilerCounts( const Profiler* p ) {
+	return p->counts;
+}
+
+const ProfileFrame* profilerFrames( const Profiler* p, unsigned long* count ) {
+	*count = p->frameCount;
+	return p->frames;
+}
+
+static int byKey( const void* a, const void* b ) {
+	unsigned long x = ((const Ranked*)a)->key, y = ((const Ranked*)b)->key;
+	return x < y ? 1 : x > y ? -1 : (int)((const Ranked*)a)->pc - (int)((const Ranked*)b)->pc;
+}
+
+/*the addresses with a nonzero counter at the given offset, largest first. returns how many there are*/
+static int rank( const ProfileCount* counts, size_t counter, Ranked* out ) {
+	const unsigned long* value;
+	int n = 0;
+	long pc;
+
+	for( pc = 0; pc < 0x10000; pc++ ) {
+		value = (const unsigned long*)((const char*)&counts[ pc ] + counter);
+		if( *value != 0 ) {
+			out[ n ].key = *value;
+			out[ n ].pc = pc;
+			n++;
+		}
+	}
+	qsort( out, n, sizeof( Ranked ), byKey );
+	return n;
+}
+
+static void disassembleAt( const Machine* m, unsigned short int pc, char* text ) {
+	unsigned char bytes[ 3 ];
+	int i;
+
+	for( i = 0; i < 3; i++ ) {
+		bytes[ i ] = machinePeek( m, pc + i );
+	}
+	disassemble( pc, bytes, text );
+}
+
+static double percent( unsigned long part, unsigned long whole ) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+void profilerReport( const Profiler* p, FILE* out, int top ) {
+	const ProfileCount* c = p->counts;
+	const ProfileFrame* f;
+	Ranked* ranked = malloc( 0x10000 * sizeof( Ranked ) );
+	unsigned long total = 0, interrupt = 0, subroutine = 0, program = 0, peak = 0, i;
+	unsigned long busiest = 0;
+	char text[ 16 ];
+	long pc;
+	int n, j;
+
+	if( ranked == NULL ) {
+		return;
+	}
+	for( pc = 0; pc < 0x10000; pc++ ) {
+		total += c[ pc ].cycles;
+	}
+
+	fprintf( out, "hot spots: %lu cycles\n", total );
+	fprintf( out, "  addr  instruction          cycles      %%  instructions\n" );
+	n = rank( c, offsetof( ProfileCount, cycles ), ranked );
+	for( j = 0; j < n && j < top; j++ ) {
+		disassembleAt( p->machine, ranked[ j ].pc, text );
+		fprintf( out, "  %04X  %-16s %10lu %6.2f %13lu\n", ranked[ j ].pc, text, ranked[ j ].key,
+		         percent( ranked[ j ].key, total ), c[ ranked[ j ].pc ].instructions );
+	}
+
+	fprintf( out, "subroutines, inclusive of what they call\n" );
+	fprintf( out, "  entry      calls      cycles      %%  cycles/call\n" );
+	n = rank( c, offsetof( ProfileCount, inclusive ), ranked );
+	for( j = 0; j < n && j < top; j++ ) {
+		fprintf( out, "  %04X %10lu %11lu %6.2f %12.1f\n", ranked[ j ].pc, c[ ranked[ j ].pc ].calls,
+		         ranked[ j ].key, percent( ranked[ j ].key, total ),
+		         c[ ranked[ j ].pc ].calls ? (double)ranked[ j ].key / c[ ranked[ j ].pc ].calls : 0.0 );
+	}
+	free( ranked );
+
+	if( p->frameCount == 0 ) {
+		return;
+	}
+	for( i = 0; i < p->frameCount; i++ ) {
+		f = &p->frames[ i ];
+		interrupt += f->interrupt;
+		subroutine += f->subroutine;
+		program += f->main;
+		if( f->interrupt + f->subroutine > peak ) {
+			peak = f->interrupt + f->subroutine;
+			busiest = i;
+		}
+	}
+	fprintf( out, "frame budget of %d cycles, average over %lu frames\n", PROFILE_FRAME_CYCLES, p->frameCount );
+	fprintf( out, "  interrupts   %8.1f %6.2f%%\n", (double)interrupt / p->frameCount,
+	         percent( interrupt, (unsigned long)PROFILE_FRAME_CYCLES * p->frameCount ) );
+	fprintf( out, "  subroutines  %8.1f %6.2f%%\n", (double)subroutine / p->frameCount,
+	         percent( subroutine, (unsigned long)PROFILE_FRAME_CYCLES * p->frameCount ) );
+	fprintf( out, "  main program %8.1f %6.2f%%\n", (double)program / p->frameCount,
+	         percent( program, (unsigned long)PROFILE_FRAME_CYCLES * p->frameCount ) );
+	f = &p->frames[ busiest ];
+	fprintf( out, "  busiest frame %lu: %lu cycles in interrupts and subroutines (%.2f%%)\n", f->frame, peak,
+	         percent( peak, PROFILE_FRAME_CYCLES ) );
+}
+
+void profilerFree( Profiler* p ) {
+	free( p->frames );
+	free( p );
+}
@@ -0,0 +1,86 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "machine.h"
+
+#include <stdio.h>
+
+/*CPU cycles in one NTSC frame*/
+#define PROFILE_FRAME_CYCLES (29781)
+
+/*
+ * Guest code profiler. Every instruction one machine runs is counted
+ * at its address, with the cycles it took (an OAM DMA or NMI entry
+ * included in the instruction it follows). Idle loops are still
+ * skipped over; the cycles skipped are charged to the loop's first
+ * instruction without adding to its count.
+ *
+ * Subroutines are found by following jsr/rts, and interrupts by entry
+ * at a vector with three bytes pushed; their cycles, including those
+ * of everything they call, are added to inclusive at the entry point
+ * when they return. A return is noticed by the stack pointer rising
+ * above where it was on entry, so rts tricks that push an address and
+ * "return" to it stay inside the routine they are used in.
+ *
+ * The counters of an address are kept together, so that counting an
+ * instruction touches a single cache line.
+ */
+typedef struct {
+	unsigned long instructions;
+	unsigned long cycles;
+	unsigned long inclusive;
+	unsigned long calls;
+} ProfileCount;
+
+/*where the cycles of one frame went*/
+typedef struct {
+	unsigned long frame;
+	unsigned long cycles;
+
+	/*in interrupt handlers, in subroutines called from the main program, and the rest*/
+	unsigned long interrupt;
+	unsigned long subroutine;
+	unsigned long main;
+} ProfileFrame;
+
+typedef struct ProfileHook ProfileHook;
+
+/*
+ * The part of a profiler the machine looks after itself. It counts each
+ * instruction in counts, and only calls event after one that moved the
+ * stack pointer, with the pc, stack pointer and cycle count it started
+ * with, and at the end of each frame.
+ */
+struct ProfileHook {
+	const Machine* machine;
+	ProfileCount* counts;
+	void (*event)( ProfileHook* h, const Machine* m, unsigned short int pc, unsigned char sp, unsigned long start );
+};
+
+/*attach h to the calling thread, or detach with NULL; other machines run on it are not counted*/
+void machineProfile( ProfileHook* h );
+
+typedef struct Profiler Profiler;
+
+/*start profiling m on the calling thread*/
+Profiler* profilerStart( const Machine* m );
+
+/*stop counting, closing calls still in progress; the results stay until profilerFree*/
+void profilerStop( Profiler* p );
+
+/*counters for each of the 64K addresses*/
+const ProfileCount* profilerCounts( const Profiler* p );
+
+/*the frames profiled, oldest first*/
+const ProfileFrame* profilerFrames( const Profiler* p, unsigned long* count );
+
+/*
+ * Print the top hot spots, the top subroutines by inclusive cycles and
+ * the per-frame budget. Code is disassembled from the machine, which
+ * must still exist.
+ */
+void profilerReport( const Profiler* p, FILE* out, int top );
+
+void profilerFree( Profiler* p );
+
+#endif
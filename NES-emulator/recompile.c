@@ -0,0 +1,554 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "recompile.h"
+#include "disasm.h"
+#include "hash.h"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CPU_VARIANT != CPU_2A03
+#error "the recompiler only knows the 2A03"
+#endif
+
+/*what is known about each address from $8000 up*/
+#define FOUND (0x01)
+#define QUEUED (0x02)
+#define PLACED (0x04)
+
+typedef struct {
+	const Cartridge* cart;
+	unsigned char flags[ 0x8000 ];
+	unsigned short int queue[ 0x8000 ];
+	int queued;
+
+	/*the first instruction of the block each instruction was placed in*/
+	unsigned short int block[ 0x8000 ];
+	FILE* out;
+} Recompiler;
+
+static unsigned char rom( const Recompiler* r, unsigned short int addr ) {
+	return r->cart->prg[ (addr - 0x8000) & (r->cart->prgSize - 1) ];
+}
+
+static void enqueue( Recompiler* r, unsigned long addr ) {
+	if( addr >= 0x8000 && addr <= 0xFFFF && !(r->flags[ addr - 0x8000 ] & QUEUED) ) {
+		r->flags[ addr - 0x8000 ] |= QUEUED;
+		r->queue[ r->queued++ ] = addr;
+	}
+}
+
+static unsigned short int operand( const Recompiler* r, unsigned short int addr ) {
+	return rom( r, addr + 1 ) | (rom( r, addr + 2 ) << 8);
+}
+
+/*
+ * Whether the instruction at addr can be compiled. The undocumented
+ * opcodes, all of them no-ops here, are left to the interpreter.
+ */
+static int compilable( const Recompiler* r, unsigned short int addr ) {
+	unsigned char op = rom( r, addr );
+	return disasmOfficial( op ) && (unsigned long)addr + disasmLength( op ) <= 0x10000;
+}
+
+/*the instruction after addr, if it carries on there, or 0*/
+static unsigned long next( const Recompiler* r, unsigned short int addr ) {
+	switch( rom( r, addr ) ) {
+	case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:
+		return 0;
+	}
+	return addr + disasmLength( rom( r, addr ) );
+}
+
+/*recursive descent from everything queued*/
+static void explore( Recompiler* r ) {
+	unsigned short int addr;
+	unsigned char op;
+
+	while( r->queued > 0 ) {
+		addr = r->queue[ --r->queued ];
+		if( !compilable( r, addr ) ) {
+			continue;
+		}
+		r->flags[ addr - 0x8000 ] |= FOUND;
+		op = rom( r, addr );
+		if( disasmMode( op ) == MODE_RELATIVE ) {
+			enqueue( r, (unsigned short int)(addr + 2 + (signed char)rom( r, addr + 1 )) );
+		}
+		switch( op ) {
+		case 0x4C: enqueue( r, operand( r, addr ) ); break;
+		case 0x20: enqueue( r, operand( r, addr ) ); enqueue( r, addr + 3 ); break;
+
+		/*an RTI from the handler comes back past the padding byte*/
+		case 0x00: enqueue( r, addr + 2 ); break;
+		}
+		if( next( r, addr ) != 0 ) {
+			enqueue( r, next( r, addr ) );
+		}
+	}
+}
+
+/*
+ * code generation
+ */
+
+/*the byte at a fixed address, as the bus would read it*/
+static void readConstant( Recompiler* r, unsigned short int addr, char* out ) {
+	if( addr < 0x2000 ) {
+		sprintf( out, "(unsigned char)m->mem.data[ 0x%04X ]", addr & (RAM_SIZE - 1) );
+	} else if( addr >= 0x8000 ) {
+		sprintf( out, "0x%02X", rom( r, addr ) );
+	} else if( addr >= 0x6000 ) {
+		sprintf( out, "(unsigned char)m->mem.data[ 0x%04X ]", addr );
+	} else {
+		sprintf( out, "machineBusRead( m, 0x%04X )", addr );
+	}
+}
+
+/*
+ * Work out the effective address of the instruction at pc. Fixed
+ * addresses are left in *fixed; the rest are computed into addr, with
+ * the page crossing cycle added to cycles if cross is set. Returns 0
+ * for a fixed address, 1 for one in zero page and 2 for any other.
+ */
+static int address( Recompiler* r, unsigned short int pc, int cross, unsigned short int* fixed ) {
+	unsigned char op = rom( r, pc ), low = rom( r, pc + 1 );
+	int cycles = machineOpcodeCycles( op );
+	FILE* out = r->out;
+
+	switch( disasmMode( op ) ) {
+	case MODE_ZERO_PAGE:
+		*fixed = low;
+		return 0;
+	case MODE_ABSOLUTE:
+		*fixed = operand( r, pc );
+		return 0;
+	case MODE_ZERO_PAGE_X:
+		fprintf( out, "\t\taddr = (0x%02X + (unsigned char)c->x) & 0xFF;\n", low );
+		return 1;
+	case MODE_ZERO_PAGE_Y:
+		fprintf( out, "\t\taddr = (0x%02X + (unsigned char)c->y) & 0xFF;\n", low );
+		return 1;
+	case MODE_ABSOLUTE_X:
+	case MODE_ABSOLUTE_Y:
+		if( cross ) {
+			fprintf( out, "\t\tcycles = %d + (0x%02X + (unsigned char)c->%c > 0xFF);\n",
+			         cycles, low, disasmMode( op ) == MODE_ABSOLUTE_X ? 'x' : 'y' );
+		}
+		fprintf( out, "\t\taddr = 0x%04X + (unsigned char)c->%c;\n",
+		         operand( r, pc ), disasmMode( op ) == MODE_ABSOLUTE_X ? 'x' : 'y' );
+		return 2;
+	case MODE_INDIRECT_X:
+		fprintf( out, "\t\taddr = (unsigned char)(0x%02X + c->x);\n", low );
+		fprintf( out, "\t\taddr = (unsigned char)m->mem.data[ addr ] | "
+		              "((unsigned char)m->mem.data[ (unsigned char)(addr + 1) ] << 8);\n" );
+		return 2;
+	default:
+		fprintf( out, "\t\taddr = (unsigned char)m->mem.data[ 0x%02X ] | "
+		              "((unsigned char)m->mem.data[ 0x%02X ] << 8);\n", low, (low + 1) & 0xFF );
+		if( cross ) {
+			fprintf( out, "\t\tcycles = %d + ((addr & 0xFF) + (unsigned char)c->y > 0xFF);\n", cycles );
+		}
+		fprintf( out, "\t\taddr += (unsigned char)c->y;\n" );
+		return 2;
+	}
+}
+
+/*whether an address is one of the registers from $2000 to $5FFF*/
+static int io( unsigned short int addr ) {
+	return addr >= 0x2000 && addr < 0x6000;
+}
+
+/*
+ * Before an access to the address worked out by address() that might
+ * reach a register: bring the PPU level with the cycles owed, and have
+ * the instruction finished on its own.
+ */
+static void level( Recompiler* r, int kind, unsigned short int fixed ) {
+	const char* indent = "\t\t";
+
+	if( kind == 1 || (kind == 0 && !io( fixed )) ) {
+		return;
+	}
+	if( kind == 2 ) {
+		fprintf( r->out, "\t\tif( addr >= 0x2000 && addr < 0x6000 ) {\n" );
+		indent = "\t\t\t";
+	}
+	fprintf( r->out, "%sif( owed > 0 ) {\n%s\tmachineFinish( m, owed, frame, vblank );\n%s\towed = 0;\n%s}\n",
+	         indent, indent, indent, indent );
+	fprintf( r->out, "%squiet = -1;\n", indent );
+	if( kind == 2 ) {
+		fprintf( r->out, "\t\t}\n" );
+	}
+}
+
+/*
+ * End an instruction whose cycles have been added to owed. They stay
+ * owed while the PPU is quiet, and are finished once it might not be,
+ * or when a branch is taken out of the block.
+ */
+static void settle( Recompiler* r, int branch, unsigned short int after ) {
+	FILE* out = r->out;
+
+	if( branch ) {
+		fprintf( out, "\t\tif( owed > quiet || c->pc != 0x%04X ) {\n", after );
+		fprintf( out, "\t\t\tif( machineFinish( m, owed, frame, vblank ) || c->pc != 0x%04X ) {\n", after );
+	} else {
+		fprintf( out, "\t\tif( owed > quiet ) {\n" );
+		fprintf( out, "\t\t\tif( machineFinish( m, owed, frame, vblank ) ) {\n" );
+	}
+	fprintf( out, "\t\t\t\treturn;\n\t\t\t}\n\t\t\towed = 0;\n\t\t\tquiet = machineQuietCycles( m );\n\t\t}\n" );
+}
+
+/*whether target is in the block the instruction at pc is being placed in, and so already written*/
+static int inBlock( const Recompiler* r, unsigned short int pc, unsigned short int target ) {
+	return target >= 0x8000 && (r->flags[ target - 0x8000 ] & PLACED) &&
+	       r->block[ target - 0x8000 ] == r->block[ pc - 0x8000 ];
+}
+
+/*whether jumping from pc back to target goes round a loop the machine may skip as idle*/
+static int idleShaped( const Recompiler* r, unsigned short int pc, unsigned short int target ) {
+	switch( rom( r, target ) ) {
+	case 0x4C: return target == pc;
+	case 0xA5: case 0xA6: case 0xA4: case 0x24: return target + 2 == pc;
+	case 0xAD: case 0xAE: case 0xAC: case 0x2C: return target + 3 == pc;
+	}
+	return 0;
+}
+
+/*
+ * Go back to target, earlier in the same block, without leaving it;
+ * the cycles owed carry over. Idle loops return instead while they are
+ * being skipped, for the machine to skip them.
+ */
+static void loop( Recompiler* r, unsigned short int pc, unsigned short int target, const char* indent ) {
+	if( idleShaped( r, pc, target ) ) {
+		fprintf( r->out, "%sif( m->idleSkip ) {\n%s\tif( owed > 0 ) {\n%s\t\tmachineFinish( m, owed, frame, vblank );\n"
+		                 "%s\t}\n%s\treturn;\n%s}\n", indent, indent, indent, indent, indent, indent );
+	}
+	fprintf( r->out, "%scontinue;\n", indent );
+}
+
+/*a read of an address worked out by address(), into value, which needs 64 bytes*/
+static void readFrom( Recompiler* r, int kind, unsigned short int fixed, char* value ) {
+	if( kind == 0 ) {
+		readConstant( r, fixed, value );
+	} else {
+		strcpy( value, kind == 1 ? "(unsigned char)m->mem.data[ addr ]" : "machineBusRead( m, addr )" );
+	}
+}
+
+static void writeTo( Recompiler* r, int kind, unsigned short int fixed, const char* value ) {
+	if( kind == 0 && fixed < 0x2000 ) {
+		fprintf( r->out, "\t\tm->mem.data[ 0x%04X ] = %s;\n", fixed & (RAM_SIZE - 1), value );
+	} else if( kind == 0 ) {
+		fprintf( r->out, "\t\tmachineBusWrite( m, 0x%04X, %s );\n", fixed, value );
+	} else if( kind == 1 ) {
+		fprintf( r->out, "\t\tm->mem.data[ addr ] = %s;\n", value );
+	} else {
+		fprintf( r->out, "\t\tmachineBusWrite( m, addr, %s );\n", value );
+	}
+}
+
+static const char* const reads[][ 2 ] = {
+	{ "LDA", "lda( &c->accum, &c->status, %s );" }, { "LDX", "ldx( &c->x, &c->status, %s );" },
+	{ "LDY", "ldy( &c->y, &c->status, %s );" }, { "ADC", "adc( &c->accum, &c->status, %s );" },
+	{ "SBC", "sbc( &c->accum, &c->status, %s );" }, { "AND", "and( &c->accum, &c->status, %s );" },
+	{ "ORA", "ora( &c->accum, &c->status, %s );" }, { "EOR", "eor( &c->accum, &c->status, %s );" },
+	{ "BIT", "bit( c->accum, &c->status, %s );" }, { "CMP", "cmp( c->accum, &c->status, %s );" },
+	{ "CPX", "cpx( c->x, &c->status, %s );" }, { "CPY", "cpy( c->y, &c->status, %s );" }
+};
+
+static const char* const implied[][ 2 ] = {
+	{ "INX", "inx( &c->x, &c->status );" }, { "INY", "iny( &c->y, &c->status );" },
+	{ "DEX", "dex( &c->x, &c->status );" }, { "DEY", "dey( &c->y, &c->status );" },
+	{ "TAX", "tax( c->accum, &c->status, &c->x );" }, { "TAY", "tay( c->accum, &c->status, &c->y );" },
+	{ "TSX", "tsx( c->sp, &c->status, &c->x );" }, { "TXA", "txa( c->x, &c->status, &c->accum );" },
+	{ "TXS", "txs( c->x, &c->status, (char*)&c->sp );" }, { "TYA", "tya( c->y, &c->status, &c->accum );" },
+	{ "PHA", "pha( c->accum, &c->sp, &m->mem );" }, { "PHP", "php( c->status, &c->sp, &m->mem );" },
+	{ "PLA", "pla( &c->accum, &c->status, &c->sp, &m->mem );" }, { "PLP", "plp( &c->status, &c->sp, &m->mem );" },
+	{ "CLC", "clc( &c->status );" }, { "CLD", "cld( &c->status );" }, { "CLI", "cli( &c->status );" },
+	{ "CLV", "clv( &c->status );" }, { "SEC", "sec( &c->status );" }, { "SED", "sed( &c->status );" },
+	{ "SEI", "sei( &c->status );" }, { "NOP", "nop();" }, { "RTS", "rts( &c->pc, &c->sp, &m->mem );" },
+	{ "RTI", "rti( &c->pc, &c->sp, &c->status, &m->mem );" },
+	{ "BRK", "brk( &c->pc, &c->status, &c->sp, &m->mem );" }
+};
+
+/*branch mnemonic, the condition it is taken on*/
+static const char* const branches[][ 2 ] = {
+	{ "BCC", "!getStatus( c->status, STATUS_C )" }, { "BCS", "getStatus( c->status, STATUS_C )" },
+	{ "BEQ", "getStatus( c->status, STATUS_Z )" }, { "BNE", "!getStatus( c->status, STATUS_Z )" },
+	{ "BMI", "getStatus( c->status, STATUS_S )" }, { "BPL", "!getStatus( c->status, STATUS_S )" },
+	{ "BVS", "getStatus( c->status, STATUS_V )" }, { "BVC", "!getStatus( c->status, STATUS_V )" }
+};
+
+static int find( const char* const table[][ 2 ], int count, const char* mnemonic ) {
+	int i;
+	for( i = 0; i < count; i++ ) {
+		if( strcmp( table[ i ][ 0 ], mnemonic ) == 0 ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#define COUNT_OF( table ) ((int)(sizeof( table ) / sizeof( table[ 0 ] )))
+
+/*
+ * One instruction. It leaves pc where the interpreter has it when the
+ * operation runs, after the operands, and ends as execute() and
+ * finish() would, though the PPU may be left behind until a later
+ * instruction. Returns nonzero if the block cannot go on after it.
+ */
+static int emit( Recompiler* r, unsigned short int pc ) {
+	unsigned char op = rom( r, pc );
+	const char* mnemonic = disasmMnemonic( op );
+	int mode = disasmMode( op ), cycles = machineOpcodeCycles( op ), length = disasmLength( op ), i, kind, crossed = 0;
+	unsigned short int after = pc + length, target, fixed = 0;
+	unsigned char bytes[ 3 ];
+	char text[ 16 ], value[ 64 ], lower[ 4 ];
+	FILE* out = r->out;
+
+	bytes[ 0 ] = op;
+	bytes[ 1 ] = rom( r, pc + 1 );
+	bytes[ 2 ] = rom( r, pc + 2 );
+	disassemble( pc, bytes, text );
+	for( i = 0; i < 3; i++ ) {
+		lower[ i ] = mnemonic[ i ] - 'A' + 'a';
+	}
+	lower[ 3 ] = '\0';
+
+	fprintf( out, "\tcase 0x%04X: /*%s*/\n", pc, text );
+	if( op == 0x00 ) {
+		/*brk skips the padding byte itself*/
+		after = pc + 1;
+	}
+	fprintf( out, "\t\tc->pc = 0x%04X;\n", after );
+
+	if( (i = find( branches, COUNT_OF( branches ), mnemonic )) >= 0 ) {
+		target = after + (signed char)bytes[ 1 ];
+		fprintf( out, "\t\towed += %s ? %d : %d;\n", branches[ i ][ 1 ],
+		         cycles + (((after ^ target) & 0xFF00) ? 2 : 1), cycles );
+		fprintf( out, "\t\t%s( &c->pc, c->status, %d );\n", lower, (signed char)bytes[ 1 ] );
+		if( inBlock( r, pc, target ) ) {
+			settle( r, 0, after );
+			fprintf( out, "\t\tif( c->pc != 0x%04X ) {\n", after );
+			loop( r, pc, target, "\t\t\t" );
+			fprintf( out, "\t\t}\n" );
+		} else {
+			settle( r, 1, after );
+		}
+		return 0;
+	}
+	if( (i = find( reads, COUNT_OF( reads ), mnemonic )) >= 0 ) {
+		if( mode == MODE_IMMEDIATE ) {
+			sprintf( value, "0x%02X", bytes[ 1 ] );
+		} else {
+			kind = address( r, pc, 1, &fixed );
+			level( r, kind, fixed );
+			readFrom( r, kind, fixed, value );
+			crossed = mode == MODE_ABSOLUTE_X || mode == MODE_ABSOLUTE_Y || mode == MODE_INDIRECT_Y;
+		}
+		fprintf( out, "\t\t" );
+		fprintf( out, reads[ i ][ 1 ], value );
+		fprintf( out, "\n" );
+	} else if( strcmp( mnemonic, "STA" ) == 0 ) {
+		kind = address( r, pc, 0, &fixed );
+		level( r, kind, fixed );
+		writeTo( r, kind, fixed, "c->accum" );
+	} else if( strcmp( mnemonic, "STX" ) == 0 ) {
+		kind = address( r, pc, 0, &fixed );
+		level( r, kind, fixed );
+		writeTo( r, kind, fixed, "c->x" );
+	} else if( strcmp( mnemonic, "STY" ) == 0 ) {
+		kind = address( r, pc, 0, &fixed );
+		level( r, kind, fixed );
+		writeTo( r, kind, fixed, "c->y" );
+	} else if( mode == MODE_ACCUMULATOR ) {
+		fprintf( out, "\t\t%s( &c->accum, &c->status );\n", lower );
+	} else if( op == 0x4C ) {
+		fprintf( out, "\t\tjmp( &c->pc, 0x%04X );\n", operand( r, pc ) );
+	} else if( op == 0x6C ) {
+		target = operand( r, pc );
+		level( r, 0, target );
+		readConstant( r, target, value );
+		fprintf( out, "\t\taddr = %s;\n", value );
+		readConstant( r, (target & 0xFF00) | ((target + 1) & 0x00FF), value );
+		fprintf( out, "\t\tjmp( &c->pc, addr | (%s << 8) );\n", value );
+	} else if( op == 0x20 ) {
+		fprintf( out, "\t\tjsr( &c->pc, 0x%04X, &c->sp, &m->mem );\n", operand( r, pc ) );
+	} else if( (i = find( implied, COUNT_OF( implied ), mnemonic )) >= 0 ) {
+		fprintf( out, "\t\t%s\n", implied[ i ][ 1 ] );
+	} else {
+		/*read-modify-write*/
+		kind = address( r, pc, 0, &fixed );
+		level( r, kind, fixed );
+		readFrom( r, kind, fixed, value );
+		fprintf( out, "\t\tvalue = %s;\n", value );
+		fprintf( out, "\t\t%s( &value, &c->status );\n", lower );
+		writeTo( r, kind, fixed, "value" );
+	}
+
+	if( op == 0x4C && inBlock( r, pc, operand( r, pc ) ) ) {
+		fprintf( out, "\t\towed += %d;\n", cycles );
+		settle( r, 0, after );
+		loop( r, pc, operand( r, pc ), "\t\t" );
+		return 1;
+	}
+	if( next( r, pc ) == 0 ) {
+		fprintf( out, "\t\tmachineFinish( m, owed + %d, frame, vblank );\n\t\treturn;\n", cycles );
+		return 1;
+	}
+	if( crossed ) {
+		fprintf( out, "\t\towed += cycles;\n" );
+	} else {
+		fprintf( out, "\t\towed += %d;\n", cycles );
+	}
+	settle( r, 0, after );
+	return 0;
+}
+
+/*
+ * Write the block starting at pc: the instructions it runs straight
+ * through until one that transfers control, or one that is already
+ * in another block. Branches and jumps back into it stay inside.
+ * Returns the number of instructions.
+ */
+static long emitBlock( Recompiler* r, unsigned short int pc ) {
+	unsigned long addr = pc;
+	long count = 0;
+
+	fprintf( r->out, "static void block%04X( Machine* m, unsigned char* frame, int* vblank ) {\n", pc );
+	fprintf( r->out, "\tCpu* c = &m->cpu;\n\tunsigned short int addr;\n\tchar value;\n\tint cycles;\n" );
+	fprintf( r->out, "\tint owed = 0, quiet = machineQuietCycles( m );\n\n" );
+	fprintf( r->out, "\t(void)addr;\n\t(void)value;\n\t(void)cycles;\n\t(void)quiet;\n" );
+	fprintf( r->out, "\tfor( ;; ) switch( c->pc ) {\n" );
+	for( ;; ) {
+		r->flags[ addr - 0x8000 ] |= PLACED;
+		r->block[ addr - 0x8000 ] = pc;
+		count++;
+		if( emit( r, addr ) ) {
+			break;
+		}
+		addr = next( r, addr );
+		if( addr > 0xFFFF || !(r->flags[ addr - 0x8000 ] & FOUND) || (r->flags[ addr - 0x8000 ] & PLACED) ) {
+			/*pc is already there; the next block, or the interpreter, carries on*/
+			fprintf( r->out, "\t\tif( owed > 0 ) {\n\t\t\tmachineFinish( m, owed, frame, vblank );\n\t\t}\n" );
+			fprintf( r->out, "\t\treturn;\n" );
+			break;
+		}
+	}
+	fprintf( r->out, "\tdefault:\n\t\treturn;\n\t}\n}\n\n" );
+	return count;
+}
+
+long recompile( const Cartridge* cart, const CodeDataLog* hints, FILE* out, char* error ) {
+	Recompiler* r;
+	unsigned long i;
+	long count = 0;
+	uint64_t game;
+
+	if( cart->mapper != 0 ) {
+		sprintf( error, "mapper %d is not NROM", cart->mapper );
+		return -1;
+	}
+	r = calloc( 1, sizeof( Recompiler ) );
+	if( r == NULL ) {
+		strcpy( error, "out of memory" );
+		return -1;
+	}
+	r->cart = cart;
+	r->out = out;
+
+	enqueue( r, rom( r, VECTOR_RESET ) | (rom( r, VECTOR_RESET + 1 ) << 8) );
+	enqueue( r, rom( r, VECTOR_NMI ) | (rom( r, VECTOR_NMI + 1 ) << 8) );
+	enqueue( r, rom( r, VECTOR_IRQ ) | (rom( r, VECTOR_IRQ + 1 ) << 8) );
+	explore( r );
+
+	/*opcodes seen run, such as the targets of jump tables, seed more*/
+	if( hints != NULL ) {
+		for( i = 0; i < 0x8000; i++ ) {
+			if( hints->prg[ i & (hints->prgSize - 1) ] & CDL_OPCODE ) {
+				enqueue( r, 0x8000 + i );
+			}
+		}
+		explore( r );
+	}
+
+	game = hash64( cart->prg, cart->prgSize, 0 );
+	fprintf( out, "/*generated by recompile; edits are lost when it is run again*/\n\n" );
+	fprintf( out, "#include \"recompile.h\"\n#include \"processor.h\"\n\n" );
+	for( i = 0; i < 0x8000; i++ ) {
+		if( (r->flags[ i ] & FOUND) && !(r->flags[ i ] & PLACED) ) {
+			count += emitBlock( r, 0x8000 + i );
+		}
+	}
+
+	/*every instruction is an entry into the block holding it*/
+	fprintf( out, "static const RecompiledEntry entries[] = {\n" );
+	for( i = 0; i < 0x8000; i++ ) {
+		if( r->flags[ i ] & PLACED ) {
+			fprintf( out, "\t{ 0x%04lX, block%04X },\n", 0x8000 + i, r->block[ i ] );
+		}
+	}
+	fprintf( out, "};\n\n" );
+	fprintf( out, "const RecompiledProgram recompiledProgram = {\n" );
+	fprintf( out, "\t((uint64_t)0x%08lXUL << 32) | 0x%08lXUL, %luUL,\n",
+	         (unsigned long)(game >> 32), (unsigned long)(game & 0xFFFFFFFFUL), cart->prgSize );
+	fprintf( out, "\tsizeof( entries ) / sizeof( entries[ 0 ] ), entries\n};\n" );
+
+	free( r );
+	if( ferror( out ) ) {
+		strcpy( error, "write error" );
+		return -1;
+	}
+	return count;
+}
+
+RecompiledCode* recompiledLoad( const char* path, const Cartridge* cart, char* error ) {
+	const RecompiledProgram* program;
+	RecompiledCode* code;
+	void* library;
+	char local[ 1024 ];
+	unsigned long i;
+
+	/*without a slash dlopen would search the library path*/
+	if( strchr( path, '/' ) == NULL && strlen( path ) < sizeof( local ) - 2 ) {
+		sprintf( local, "./%s", path );
+		path = local;
+	}
+	library = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+	if( library == NULL ) {
+		sprintf( error, "%.120s", dlerror() );
+		return NULL;
+	}
+	program = dlsym( library, "recompiledProgram" );
+	if( program == NULL ) {
+		sprintf( error, "%.100s has no recompiled program", path );
+	} else if( program->prgSize != cart->prgSize || program->game != hash64( cart->prg, cart->prgSize, 0 ) ) {
+		sprintf( error, "%.100s was recompiled from another game", path );
+		program = NULL;
+	}
+	code = program != NULL ? calloc( 1, sizeof( RecompiledCode ) ) : NULL;
+	if( code == NULL ) {
+		if( program != NULL ) {
+			strcpy( error, "out of memory" );
+		}
+		dlclose( library );
+		return NULL;
+	}
+	for( i = 0; i < program->count; i++ ) {
+		code->blocks[ program->entries[ i ].pc - 0x8000 ] = program->entries[ i ].run;
+	}
+	code->instructions = program->count;
+	code->library = library;
+	return code;
+}
+
+void recompiledFree( RecompiledCode* code ) {
+	if( code != NULL ) {
+		dlclose( code->library );
+		free( code );
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef RECOMPILE_H
+#define RECOMPILE_H
+
+#include "cartridge.h"
+#include "cdl.h"
+#include "machine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Ahead-of-time recompilation of NROM games to C.
+ *
+ * recompile() follows the game's control flow from its vectors, and
+ * from every opcode in a code/data log if one is given, and writes a C
+ * function per run of straight-line code. Each instruction becomes a
+ * call of the same processor.c operation the interpreter makes, with
+ * its operand and any ROM data folded into constants. Their cycles are
+ * added up and given to machineFinish() together: before an access to
+ * $2000-$5FFF, when the block is left, or when the PPU might otherwise
+ * raise an NMI. Every instruction is also a case label, so a block can
+ * be entered wherever an RTI returns to.
+ *
+ * The C is built into a shared object, loaded with recompiledLoad()
+ * and attached with machineRecompiled(). Code that was not found, runs
+ * from RAM, or uses an undocumented opcode is left to the interpreter,
+ * which also takes over while observers, breakpoints or a code/data
+ * log are attached and for machineStep. Idle loops are still skipped.
+ */
+
+/*a block of generated code, entered with the CPU's pc on one of its instructions*/
+typedef void (*RecompiledBlock)( Machine* m, unsigned char* frame, int* vblank );
+
+typedef struct {
+	unsigned short int pc;
+	RecompiledBlock run;
+} RecompiledEntry;
+
+/*what the generated code exports as recompiledProgram*/
+typedef struct {
+	/*hash64 and size of the PRG-ROM it was made from*/
+	uint64_t game;
+	unsigned long prgSize;
+
+	unsigned long count;
+	const RecompiledEntry* entries;
+} RecompiledProgram;
+
+/*a loaded program, with a block for every address from $8000 up*/
+typedef struct {
+	RecompiledBlock blocks[ 0x8000 ];
+	unsigned long instructions;
+	void* library;
+} RecompiledCode;
+
+/*
+ * Write C for cart, which must be NROM, to out. hints may be NULL.
+ * Returns the number of instructions compiled, or -1 with a
+ * description in error, which must hold at least 128 bytes.
+ */
+long recompile( const Cartridge* cart, const CodeDataLog* hints, FILE* out, char* error );
+
+/*load a shared object built from recompile()'s output for cart, or NULL with error set*/
+RecompiledCode* recompiledLoad( const char* path, const Cartridge* cart, char* error );
+
+void recompiledFree( RecompiledCode* code );
+
+/*
+ * Attach code to the calling thread, or detach with NULL. Every machine
+ * run on the thread must have code's cartridge inserted.
+ */
+void machineRecompiled( const RecompiledCode* code );
+
+/*
+ * The machine as generated code sees it. machineFinish ends an
+ * instruction, or several taking that many cycles between them, as the
+ * interpreter does, and returns nonzero if the block has to return:
+ * the frame has ended or an NMI was taken. machineQuietCycles is how
+ * many cycles can be left for it before the PPU might raise an NMI,
+ * or -1 if one is waiting to be taken.
+ */
+unsigned char machineBusRead( Machine* m, unsigned short int addr );
+
+void machineBusWrite( Machine* m, unsigned short int addr, unsigned char value );
+
+int machineFinish( Machine* m, int cycles, unsigned char* frame, int* vblank );
+
+int machineQuietCycles( const Machine* m );
+
+#endif
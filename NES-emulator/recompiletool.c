@@ -0,0 +1,64 @@
+#include "cartridge.h"
+#include "cdl.h"
+#include "recompile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Recompiles an NROM game to C (see recompile.h).
+ *
+ *     recompile [-D log] rom.nes game.c
+ *
+ * -D adds the opcodes of a code/data log (headless -D) to what is found
+ * by following the code, which picks up jump tables and the like. The
+ * output is built as a shared object for headless -c:
+ *
+ *     gcc -O2 -shared -fPIC -o game.so game.c
+ */
+int main( int argc, char* argv[] ) {
+	static CodeDataLog log;
+	const char* logPath = NULL;
+	Cartridge cart;
+	char error[ 128 ];
+	FILE* out;
+	long count;
+	int i = 1;
+
+	if( argc == 5 && strcmp( argv[ 1 ], "-D" ) == 0 ) {
+		logPath = argv[ 2 ];
+		i = 3;
+	} else if( argc != 3 ) {
+		fprintf( stderr, "usage: recompile [-D log] rom.nes game.c\n" );
+		return 2;
+	}
+	if( cartridgeLoad( &cart, argv[ i ], error ) != 0 ) {
+		fprintf( stderr, "%s: %s\n", argv[ i ], error );
+		return 1;
+	}
+	if( logPath != NULL ) {
+		cdlInit( &log, &cart );
+		if( cdlMerge( &log, logPath, error ) != 0 ) {
+			fprintf( stderr, "%s\n", error );
+			return 1;
+		}
+	}
+
+	out = fopen( argv[ i + 1 ], "w" );
+	if( out == NULL ) {
+		fprintf( stderr, "cannot create %s\n", argv[ i + 1 ] );
+		return 1;
+	}
+	count = recompile( &cart, logPath != NULL ? &log : NULL, out, error );
+	if( fclose( out ) != 0 && count >= 0 ) {
+		strcpy( error, "write error" );
+		count = -1;
+	}
+	if( count < 0 ) {
+		fprintf( stderr, "%s: %s\n", argv[ i + 1 ], error );
+		return 1;
+	}
+	fprintf( stderr, "%ld instructions compiled\n", count );
+	cartridgeFree( &cart );
+	return 0;
+}
@@ -0,0 +1,283 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "cartridge.h"
+#include "hash.h"
+#include "machine.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Regression runner. Runs every ROM of a manifest for its number of
+ * frames in one process and checks the hash of the last frame:
+ *
+ *     # rom                  frames  hash of the last frame
+ *     roms/game.nes          3600    5c1e0f2a9b3d4e61
+ *     tests/cpu_timing.nes   1200    -
+ *
+ * A hash of - is not checked; the table shows the one found, ready to
+ * be copied into the manifest. Only the last frame is drawn, as in
+ * headless -s, and its hash is the one headless prints for it.
+ *
+ *     regress [-j threads] manifest
+ *
+ * Jobs run on a pool of threads, one per core unless -j says otherwise,
+ * each with a Machine it reuses for all its jobs. Jobs are dealt out
+ * longest first to per-thread queues; a thread works through its own
+ * queue from the front and, once that is empty, steals from the back
+ * of the others', so a few long ROMs do not leave the rest idle.
+ *
+ * Exits with 1 if any hash differs or a ROM cannot be loaded.
+ */
+
+#define RESULT_PASS (0)
+#define RESULT_NEW (1)
+#define RESULT_FAIL (2)
+#define RESULT_ERROR (3)
+
+typedef struct {
+	char path[ 256 ];
+	unsigned long frames;
+	uint64_t expected;
+	int checked;
+
+	uint64_t hash;
+	int result;
+	int worker;
+	double seconds;
+	char error[ 128 ];
+} Job;
+
+/*a worker's queue of job numbers; the owner takes from head, thieves from tail*/
+typedef struct {
+	pthread_mutex_t lock;
+	int* jobs;
+	int head;
+	int tail;
+} Queue;
+
+typedef struct {
+	int id;
+	pthread_t thread;
+	Machine* machine;
+	unsigned char* frame;
+	unsigned long jobs;
+	unsigned long steals;
+} Worker;
+
+static Job* jobs;
+static int jobCount;
+static Queue* queues;
+static Worker* workers;
+static int workerCount;
+
+static double now( void ) {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int take( Queue* q, int fromTail ) {
+	int job = -1;
+	pthread_mutex_lock( &q->lock );
+	if( q->head < q->tail ) {
+		job = fromTail ? q->jobs[ --q->tail ] : q->jobs[ q->head++ ];
+	}
+	pthread_mutex_unlock( &q->lock );
+	return job;
+}
+
+static void runJob( Worker* w, Job* job ) {
+	Cartridge cart;
+	unsigned long f;
+	double start = now();
+
+	job->worker = w->id;
+	if( cartridgeLoad( &cart, job->path, job->error ) != 0 ) {
+		job->result = RESULT_ERROR;
+		return;
+	}
+	machinePower( w->machine, &cart );
+	for( f = 0; f + 1 < job->frames; f++ ) {
+		machineRunFrame( w->machine, NULL );
+	}
+	machineRunFrame( w->machine, w->frame );
+	job->hash = hash64( w->frame, PPU_FRAME_SIZE, 0 );
+	cartridgeFree( &cart );
+
+	job->seconds = now() - start;
+	if( !job->checked ) {
+		job->result = RESULT_NEW;
+	} else {
+		job->result = job->hash == job->expected ? RESULT_PASS : RESULT_FAIL;
+	}
+}
+
+static void* workerMain( void* arg ) {
+	Worker* w = arg;
+	int job, victim;
+
+	for( ;; ) {
+		job = take( &queues[ w->id ], 0 );
+		for( victim = 1; job < 0 && victim < workerCount; victim++ ) {
+			job = take( &queues[ (w->id + victim) % workerCount ], 1 );
+			w->steals += job >= 0;
+		}
+		if( job < 0 ) {
+			return NULL;
+		}
+		runJob( w, &jobs[ job ] );
+		w->jobs++;
+	}
+}
+
+static int loadManifest( const char* path ) {
+	FILE* file = fopen( path, "r" );
+	char line[ 512 ], hash[ 64 ], *end;
+	int capacity = 0, fields;
+	Job* job;
+
+	if( file == NULL ) {
+		return -1;
+	}
+	while( fgets( line, sizeof( line ), file ) != NULL ) {
+		if( strchr( line, '#' ) != NULL ) {
+			*strchr( line, '#' ) = '\0';
+		}
+		if( jobCount == capacity ) {
+			capacity = capacity ? capacity * 2 : 64;
+			jobs = realloc( jobs, capacity * sizeof( Job ) );
+			if( jobs == NULL ) {
+				fclose( file );
+				return -1;
+			}
+		}
+		job = &jobs[ jobCount ];
+		memset( job, 0, sizeof( Job ) );
+		fields = sscanf( line, "%255s %lu %63s", job->path, &job->frames, hash );
+		if( fields <= 0 ) {
+			continue;
+		}
+		if( fields < 2 || job->frames == 0 ) {
+			fclose( file );
+			return -1;
+		}
+		job->checked = fields == 3 && strcmp( hash, "-" ) != 0;
+		if( job->checked ) {
+			job->expected = strtoull( hash, &end, 16 );
+			if( *end != '\0' ) {
+				fclose( file );
+				return -1;
+			}
+		}
+		jobCount++;
+	}
+	fclose( file );
+	return 0;
+}
+
+static int longerFirst( const void* a, const void* b ) {
+	unsigned long x = jobs[ *(const int*)a ].frames, y = jobs[ *(const int*)b ].frames;
+	return x < y ? 1 : x > y ? -1 : *(const int*)a - *(const int*)b;
+}
+
+int main( int argc, char* argv[] ) {
+	static const char* const results[] = { "pass", "new", "FAIL", "ERROR" };
+	int counts[ 4 ] = { 0, 0, 0, 0 };
+	const char* manifest = NULL;
+	int* order;
+	int i;
+	double start, busy = 0;
+
+	workerCount = sysconf( _SC_NPROCESSORS_ONLN );
+	for( i = 1; i < argc; i++ ) {
+		if( strcmp( argv[ i ], "-j" ) == 0 && i + 1 < argc ) {
+			workerCount = atoi( argv[ ++i ] );
+		} else if( manifest == NULL ) {
+			manifest = argv[ i ];
+		} else {
+			manifest = NULL;
+			break;
+		}
+	}
+	if( manifest == NULL ) {
+		fprintf( stderr, "usage: regress [-j threads] manifest\n" );
+		return 2;
+	}
+	if( loadManifest( manifest ) != 0 ) {
+		fprintf( stderr, "cannot read manifest %s\n", manifest );
+		return 1;
+	}
+	if( workerCount > jobCount ) {
+		workerCount = jobCount;
+	}
+	if( workerCount < 1 ) {
+		workerCount = 1;
+	}
+
+	order = malloc( (jobCount + 1) * sizeof( int ) );
+	queues = calloc( workerCount, sizeof( Queue ) );
+	workers = calloc( workerCount, sizeof( Worker ) );
+	if( order == NULL || queues == NULL || workers == NULL ) {
+		fprintf( stderr, "out of memory\n" );
+		return 1;
+	}
+	for( i = 0; i < jobCount; i++ ) {
+		order[ i ] = i;
+	}
+	qsort( order, jobCount, sizeof( int ), longerFirst );
+	for( i = 0; i < workerCount; i++ ) {
+		pthread_mutex_init( &queues[ i ].lock, NULL );
+		queues[ i ].jobs = malloc( (jobCount / workerCount + 1) * sizeof( int ) );
+		workers[ i ].id = i;
+		workers[ i ].machine = malloc( sizeof( Machine ) );
+		workers[ i ].frame = malloc( PPU_FRAME_SIZE );
+		if( queues[ i ].jobs == NULL || workers[ i ].machine == NULL || workers[ i ].frame == NULL ) {
+			fprintf( stderr, "out of memory\n" );
+			return 1;
+		}
+	}
+	for( i = 0; i < jobCount; i++ ) {
+		queues[ i % workerCount ].jobs[ queues[ i % workerCount ].tail++ ] = order[ i ];
+	}
+
+	start = now();
+	for( i = 1; i < workerCount; i++ ) {
+		if( pthread_create( &workers[ i ].thread, NULL, workerMain, &workers[ i ] ) != 0 ) {
+			fprintf( stderr, "cannot start worker %d\n", i );
+			return 1;
+		}
+	}
+	workerMain( &workers[ 0 ] );
+	for( i = 1; i < workerCount; i++ ) {
+		pthread_join( workers[ i ].thread, NULL );
+	}
+
+	printf( "%-6s %-6s %9s %8s  %-16s  %s\n", "result", "worker", "ms", "frames", "hash", "rom" );
+	for( i = 0; i < jobCount; i++ ) {
+		counts[ jobs[ i ].result ]++;
+		busy += jobs[ i ].seconds;
+		if( jobs[ i ].result == RESULT_ERROR ) {
+			printf( "%-6s %6d %9s %8lu  %-16s  %s: %s\n", results[ RESULT_ERROR ], jobs[ i ].worker, "-",
+			        jobs[ i ].frames, "-", jobs[ i ].path, jobs[ i ].error );
+		} else {
+			printf( "%-6s %6d %9.1f %8lu  %016" PRIx64 "  %s\n", results[ jobs[ i ].result ], jobs[ i ].worker,
+			        jobs[ i ].seconds * 1000, jobs[ i ].frames, jobs[ i ].hash, jobs[ i ].path );
+		}
+	}
+	printf( "%d jobs on %d threads in %.3f s (%.3f s of work); %d passed, %d new, %d failed, %d errors\n",
+	        jobCount, workerCount, now() - start, busy, counts[ RESULT_PASS ], counts[ RESULT_NEW ],
+	        counts[ RESULT_FAIL ], counts[ RESULT_ERROR ] );
+	for( i = 0; i < workerCount; i++ ) {
+		fprintf( stderr, "worker %d: %lu jobs, %lu stolen\n", i, workers[ i ].jobs, workers[ i ].steals );
+		free( workers[ i ].machine );
+		free( workers[ i ].frame );
+		free( queues[ i ].jobs );
+	}
+	return counts[ RESULT_FAIL ] || counts[ RESULT_ERROR ] ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+#include "rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LITERAL_MAX (128)
+#define RUN_MIN (3)
+#define RUN_SHORT_MAX (0xFE - 0x80 + RUN_MIN)
+#define RUN_LONG_MAX (0xFFFF)
+
+/*
+ * delta coder
+ */
+
+static unsigned long flushLiteral( const unsigned char* a, const unsigned char* b, unsigned long start,
+                                   unsigned long length, unsigned char* out ) {
+	unsigned long i;
+	out[ 0 ] = length - 1;
+	for( i = 0; i < length; i++ ) {
+		out[ 1 + i ] = a[ start + i ] ^ b[ start + i ];
+	}
+	return length + 1;
+}
+
+unsigned long deltaEncode( const unsigned char* a, const unsigned char* b, unsigned long n, unsigned char* out ) {
+	unsigned long i = 0, j, run, o = 0, literal = 0;
+	unsigned char value;
+
+	while( i < n ) {
+		value = a[ i ] ^ b[ i ];
+		j = i + 1;
+
+		/*unchanged stretches are the common case, so compare those a word at a time*/
+		if( value == 0 ) {
+			while( j + 8 <= n && memcmp( a + j, b + j, 8 ) == 0 ) {
+				j += 8;
+			}
+		}
+		while( j < n && (a[ j ] ^ b[ j ]) == value ) {
+			j++;
+		}
+		run = j - i;
+
+		if( run < RUN_MIN ) {
+			literal += run;
+			i = j;
+			while( literal >= LITERAL_MAX ) {
+				o += flushLiteral( a, b, i - literal, LITERAL_MAX, out + o );
+				literal -= LITERAL_MAX;
+			}
+			continue;
+		}
+
+		if( literal > 0 ) {
+			o += flushLiteral( a, b, i - literal, literal, out + o );
+			literal = 0;
+		}
+		while( run >= RUN_MIN ) {
+			if( run <= RUN_SHORT_MAX ) {
+				out[ o++ ] = 0x80 + run - RUN_MIN;
+				out[ o++ ] = value;
+				i += run;
+				run = 0;
+			} else {
+				j = run < RUN_LONG_MAX ? run : RUN_LONG_MAX;
+				out[ o++ ] = 0xFF;
+				out[ o++ ] = j & 0xFF;
+				out[ o++ ] = j >> 8;
+				out[ o++ ] = value;
+				i += j;
+				run -= j;
+			}
+		}
+
+		/*a leftover of one or two goes out as a literal*/
+		literal = run;
+		i += run;
+	}
+	if( literal > 0 ) {
+		o += flushLiteral( a, b, i - literal, literal, out + o );
+	}
+	return o;
+}
+
+void deltaApply( unsigned char* dst, const unsigned char* in, unsigned long size ) {
+	const unsigned char* end = in + size;
+	unsigned long length, i;
+	unsigned char c, value;
+
+	while( in < end ) {
+		c = *in++;
+		if( c < 0x80 ) {
+			length = c + 1;
+			for( i = 0; i < length; i++ ) {
+				dst[ i ] ^= in[ i ];
+			}
+			in += length;
+		} else {
+			if( c == 0xFF ) {
+				length = in[ 0 ] | (in[ 1 ] << 8);
+				in += 2;
+			} else {
+				length = c - 0x80 + RUN_MIN;
+			}
+			value = *in++;
+			if( value != 0 ) {
+				for( i = 0; i < length; i++ ) {
+					dst[ i ] ^= value;
+				}
+			}
+		}
+		dst += length;
+	}
+}
+
+/*
+ * rewind ring
+ */
+
+typedef struct {
+	unsigned long offset;
+	unsigned long size;
+	int keyframe;
+} Entry;
+
+struct Rewind {
+	unsigned char* data;
+	unsigned long budget;
+	unsigned long head;
+
+	/*entries, oldest first, in a ring of capacity*/
+	Entry* entries;
+	unsigned long capacity;
+	unsigned long first;
+	unsigned long count;
+
+	int keyframeInterval;
+	int sinceKeyframe;
+	unsigned long evicted;
+	unsigned long bytes;
+
+	/*the newest frame whole, a frame being saved, and room to encode it*/
+	MachineSnapshot top;
+	MachineSnapshot next;
+	MachineSnapshot zero;
+	unsigned char encoded[ DELTA_BOUND( sizeof( MachineSnapshot ) ) ];
+};
+
+static Entry* entry( Rewind* r, unsigned long index ) {
+	return &r->entries[ (r->first + index) % r->capacity ];
+}
+
+Rewind* rewindCreate( unsigned long budget, int keyframeInterval ) {
+	Rewind* r = calloc( 1, sizeof( Rewind ) );
+	if( r == NULL ) {
+		return NULL;
+	}
+
+	/*an unchanged frame encodes to a handful of bytes; allow for that many*/
+	r->capacity = budget / 8 + 1;
+	r->data = malloc( budget );
+	r->entries = malloc( r->capacity * sizeof( Entry ) );
+	if( r->data == NULL || r->entries == NULL ) {
+		rewindDestroy( r );
+		return NULL;
+	}
+	r->budget = budget;
+	r->keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+	return r;
+}
+
+void rewindDestroy( Rewind* r ) {
+	if( r != NULL ) {
+		free( r->data );
+		free( r->entries );
+		free( r );
+	}
+}
+
+/*drop the oldest keyframe and the deltas that depend on it*/
+static void evictGroup( Rewind* r ) {
+	do {
+		r->bytes -= entry( r, 0 )->size;
+		r->first = (r->first + 1) % r->capacity;
+		r->count--;
+		r->evicted++;
+	} while( r->count > 0 && !entry( r, 0 )->keyframe );
+}
+
+/*find size contiguous bytes at head, evicting as needed. returns nonzero if impossible*/
+static int makeRoom( Rewind* r, unsigned long size ) {
+	unsigned long tail;
+
+	if( size > r->budget ) {
+		return -1;
+	}
+	for( ;; ) {
+		if( r->count == 0 ) {
+			r->head = 0;
+			return 0;
+		}
+		if( r->count < r->capacity ) {
+			tail = entry( r, 0 )->offset;
+			if( r->head > tail ) {
+				if( r->budget - r->head >= size ) {
+					return 0;
+				}
+				if( tail >= size ) {
+					r->head = 0;
+					return 0;
+				}
+			} else if( tail - r->head >= size ) {
+				return 0;
+			}
+		}
+		evictGroup( r );
+	}
+}
+
+void rewindPush( Rewind* r, const Machine* m ) {
+	int keyframe = r->count == 0 || r->sinceKeyframe + 1 >= r->keyframeInterval;
+	unsigned long size;
+	Entry* e;
+
+	machineSave( m, &r->next );
+	size = deltaEncode( (unsigned char*)&r->next, (unsigned char*)(keyframe ? &r->zero : &r->top),
+	                    sizeof( MachineSnapshot ), r->encoded );
+	if( makeRoom( r, size ) != 0 ) {
+		r->count = 0;
+		r->bytes = 0;
+		return;
+	}
+
+	/*evicting may have taken the frame this delta is against*/
+	if( r->count == 0 && !keyframe ) {
+		keyframe = 1;
+		size = deltaEncode( (unsigned char*)&r->next, (unsigned char*)&r->zero,
+		                    sizeof( MachineSnapshot ), r->encoded );
+		if( makeRoom( r, size ) != 0 ) {
+			return;
+		}
+	}
+
+	e = entry( r, r->count++ );
+	e->offset = r->head;
+	e->size = size;
+	e->keyframe = keyframe;
+	memcpy( r->data + r->head, r->encoded, size );
+	r->head += size;
+	r->bytes += size;
+	r->sinceKeyframe = keyframe ? 0 : r->sinceKeyframe + 1;
+	memcpy( &r->top, &r->next, sizeof( MachineSnapshot ) );
+}
+
+int rewindPop( Rewind* r, Machine* m ) {
+	Entry* e;
+	unsigned long i, key;
+
+	if( r->count == 0 ) {
+		return -1;
+	}
+	machineRestore( m, &r->top );
+
+	e = entry( r, --r->count );
+	r->head = e->offset;
+	r->bytes -= e->size;
+	if( r->count == 0 ) {
+		return 0;
+	}
+
+	if( !e->keyframe ) {
+		deltaApply( (unsigned char*)&r->top, r->data + e->offset, e->size );
+		r->sinceKeyframe--;
+		return 0;
+	}
+
+	/*rebuild the new newest frame from the keyframe before it*/
+	key = r->count - 1;
+	while( !entry( r, key )->keyframe ) {
+		key--;
+	}
+	memset( &r->top, 0, sizeof( MachineSnapshot ) );
+	for( i = key; i < r->count; i++ ) {
+		e = entry( r, i );
+		deltaApply( (unsigned char*)&r->top, r->data + e->offset, e->size );
+	}
+	r->sinceKeyframe = r->count - 1 - key;
+	return 0;
+}
+
+void rewindStats( const Rewind* r, RewindStats* stats ) {
+	unsigned long i;
+
+	memset( stats, 0, sizeof( *stats ) );
+	stats->frames = r->count;
+	for( i = 0; i < r->count; i++ ) {
+		stats->keyframes += r->entries[ (r->first + i) % r->capacity ].keyframe;
+	}
+	stats->bytes = r->bytes;
+	stats->rawBytes = r->count * sizeof( MachineSnapshot );
+	stats->budget = r->budget;
+	stats->evicted = r->evicted;
+}
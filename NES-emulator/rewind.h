@@ -0,0 +1,62 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "machine.h"
+
+/*
+ * Delta coder for machine snapshots. The input is the XOR of two
+ * buffers, which is mostly zeros between consecutive frames, and the
+ * output is a byte stream of
+ *
+ *     0x00-0x7F            literal: the next c+1 bytes
+ *     0x80-0xFE v          c-0x80+3 copies of v
+ *     0xFF lo hi v         lo+256*hi copies of v
+ *
+ * Encoding against a buffer of zeros gives a plain RLE keyframe.
+ */
+#define DELTA_BOUND( n ) ((n) + (n) / 128 + 1)
+
+/*encode a^b, returning the size written to out (at most DELTA_BOUND( n ))*/
+unsigned long deltaEncode( const unsigned char* a, const unsigned char* b, unsigned long n, unsigned char* out );
+
+/*XOR an encoded delta into dst*/
+void deltaApply( unsigned char* dst, const unsigned char* in, unsigned long size );
+
+/*
+ * Rewind buffer. Every pushed frame is stored as the delta against the
+ * one before, with a keyframe every keyframeInterval frames, in a ring
+ * of budget bytes. When the ring is full the oldest keyframe and its
+ * deltas are dropped together.
+ *
+ * The newest state is also kept whole, so popping a delta costs one
+ * decode. Popping a keyframe rebuilds the state before it from the
+ * keyframe preceding it, once every keyframeInterval frames.
+ */
+typedef struct Rewind Rewind;
+
+typedef struct {
+	unsigned long frames;
+	unsigned long keyframes;
+
+	/*compressed bytes held, and what the same frames take as plain snapshots*/
+	unsigned long bytes;
+	unsigned long rawBytes;
+
+	unsigned long budget;
+
+	/*frames dropped to stay within the budget*/
+	unsigned long evicted;
+} RewindStats;
+
+Rewind* rewindCreate( unsigned long budget, int keyframeInterval );
+
+void rewindPush( Rewind* r, const Machine* m );
+
+/*restore the newest frame into m and drop it. returns nonzero if there is none*/
+int rewindPop( Rewind* r, Machine* m );
+
+void rewindStats( const Rewind* r, RewindStats* stats );
+
+void rewindDestroy( Rewind* r );
+
+#endif
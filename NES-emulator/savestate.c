@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "savestate.h"
+#include "hash.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SIZE (64)
+
+/*the layout is fixed: any padding the compiler put in would make these fail to compile*/
+typedef char ImageHasNoPadding[ offsetof( SaveStateImage, chr ) == 12680 ? 1 : -1 ];
+typedef char ImageSize[ sizeof( SaveStateImage ) == 12680 + 8192 ? 1 : -1 ];
+
+static void put32( unsigned char* p, uint32_t value ) {
+	int i;
+	for( i = 0; i < 4; i++ ) {
+		p[ i ] = value >> (8 * i);
+	}
+}
+
+static void put64( unsigned char* p, uint64_t value ) {
+	int i;
+	for( i = 0; i < 8; i++ ) {
+		p[ i ] = value >> (8 * i);
+	}
+}
+
+static uint32_t get32( const unsigned char* p ) {
+	return p[ 0 ] | (p[ 1 ] << 8) | ((uint32_t)p[ 2 ] << 16) | ((uint32_t)p[ 3 ] << 24);
+}
+
+static uint64_t get64( const unsigned char* p ) {
+	return get32( p ) | ((uint64_t)get32( p + 4 ) << 32);
+}
+
+static int littleEndian( void ) {
+	unsigned short int order = 0x0102;
+	return *(unsigned char*)&order == 0x02;
+}
+
+static uint16_t swap16( uint16_t value ) {
+	return (value >> 8) | (value << 8);
+}
+
+static uint32_t swap32( uint32_t value ) {
+	return (uint32_t)swap16( value ) << 16 | swap16( value >> 16 );
+}
+
+static uint64_t swap64( uint64_t value ) {
+	return (uint64_t)swap32( value ) << 32 | swap32( value >> 32 );
+}
+
+/*between host and file byte order, either way; nothing to do on little-endian hosts*/
+static void swapImage( SaveStateImage* s ) {
+	uint64_t* wide[ 5 ];
+	uint16_t* narrow[ 8 ];
+	int i;
+
+	if( littleEndian() ) {
+		return;
+	}
+	wide[ 0 ] = &s->rom; wide[ 1 ] = &s->cycles; wide[ 2 ] = &s->frame;
+	wide[ 3 ] = &s->idleCycles; wide[ 4 ] = &s->ppuFrame;
+	for( i = 0; i < 5; i++ ) {
+		*wide[ i ] = swap64( *wide[ i ] );
+	}
+	narrow[ 0 ] = &s->pc; narrow[ 1 ] = &s->stall; narrow[ 2 ] = &s->v; narrow[ 3 ] = &s->t;
+	narrow[ 4 ] = &s->dot; narrow[ 5 ] = &s->scanline; narrow[ 6 ] = &s->sprite0Dot; narrow[ 7 ] = &s->pad;
+	for( i = 0; i < 8; i++ ) {
+		*narrow[ i ] = swap16( *narrow[ i ] );
+	}
+}
+
+/*what identifies the cartridge in m: the PRG-ROM, and CHR unless it is RAM*/
+static uint64_t romHash( const Machine* m ) {
+	uint64_t hash = hash64( m->mem.data + 0x8000, 0x8000, m->ppu.chrWritable );
+	if( !m->ppu.chrWritable ) {
+		hash = hash64( m->ppu.chr, sizeof( m->ppu.chr ), hash );
+	}
+	return hash;
+}
+
+static unsigned long imageSize( int chrWritable ) {
+	return offsetof( SaveStateImage, chr ) + (chrWritable ? sizeof( ((SaveStateImage*)0)->chr ) : 0);
+}
+
+/*the state of m in host byte order*/
+static void capture( const Machine* m, SaveStateImage* s ) {
+	const Ppu* ppu = &m->ppu;
+
+	memset( s, 0, sizeof( *s ) );
+	s->rom = romHash( m );
+	s->cycles = m->cycles;
+	s->frame = m->frame;
+	s->idleCycles = m->idleCycles;
+	s->ppuFrame = ppu->frame;
+
+	s->pc = m->cpu.pc;
+	s->stall = m->stall;
+	s->v = ppu->v;
+	s->t = ppu->t;
+	s->dot = ppu->dot;
+	s->scanline = ppu->scanline;
+	s->sprite0Dot = ppu->sprite0Dot;
+
+	s->a = m->cpu.accum;
+	s->x = m->cpu.x;
+	s->y = m->cpu.y;
+	s->p = m->cpu.status;
+	s->sp = m->cpu.sp;
+	memcpy( s->input, m->input, 2 );
+	memcpy( s->shift, m->shift, 2 );
+	s->strobe = m->strobe;
+	s->idleSkip = m->idleSkip;
+
+	s->ctrl = ppu->ctrl;
+	s->mask = ppu->mask;
+	s->status = ppu->status;
+	s->oamAddr = ppu->oamAddr;
+	s->fineX = ppu->fineX;
+	s->w = ppu->w;
+	s->readBuffer = ppu->readBuffer;
+	s->openBus = ppu->openBus;
+	s->nmi = ppu->nmi;
+	s->mirroring = ppu->mirroring;
+	s->chrWritable = ppu->chrWritable;
+	s->oddFrame = ppu->oddFrame;
+
+	memcpy( s->apu, m->apu.regs, sizeof( s->apu ) );
+	memcpy( s->palette, ppu->palette, sizeof( s->palette ) );
+	memcpy( s->oam, ppu->oam, sizeof( s->oam ) );
+	memcpy( s->vram, ppu->vram, sizeof( s->vram ) );
+	memcpy( s->ram, m->mem.data, sizeof( s->ram ) );
+	memcpy( s->cartRam, m->mem.data + 0x6000, sizeof( s->cartRam ) );
+	if( ppu->chrWritable ) {
+		memcpy( s->chr, ppu->chr, sizeof( s->chr ) );
+	}
+}
+
+int saveStateRestore( Machine* m, const SaveStateImage* s, char* error ) {
+	Ppu* ppu = &m->ppu;
+
+	if( s->chrWritable != ppu->chrWritable || s->rom != romHash( m ) ) {
+		strcpy( error, "save state is from another cartridge" );
+		return -1;
+	}
+
+	m->cycles = s->cycles;
+	m->frame = s->frame;
+	m->idleCycles = s->idleCycles;
+	ppu->frame = s->ppuFrame;
+
+	m->cpu.pc = s->pc;
+	m->stall = s->stall;
+	ppu->v = s->v;
+	ppu->t = s->t;
+	ppu->dot = (short int)s->dot;
+	ppu->scanline = (short int)s->scanline;
+	ppu->sprite0Dot = (short int)s->sprite0Dot;
+
+	m->cpu.accum = s->a;
+	m->cpu.x = s->x;
+	m->cpu.y = s->y;
+	m->cpu.status = s->p;
+	m->cpu.sp = s->sp;
+	memcpy( m->input, s->input, 2 );
+	memcpy( m->shift, s->shift, 2 );
+	m->strobe = s->strobe;
+	m->idleSkip = s->idleSkip;
+
+	ppu->ctrl = s->ctrl;
+	ppu->mask = s->mask;
+	ppu->status = s->status;
+	ppu->oamAddr = s->oamAddr;
+	ppu->fineX = s->fineX;
+	ppu->w = s->w;
+	ppu->readBuffer = s->readBuffer;
+	ppu->openBus = s->openBus;
+	ppu->nmi = s->nmi;
+	ppu->mirroring = s->mirroring;
+	ppu->oddFrame = s->oddFrame;
+
+	memcpy( m->apu.regs, s->apu, sizeof( s->apu ) );
+	memcpy( ppu->palette, s->palette, sizeof( s->palette ) );
+	memcpy( ppu->oam, s->oam, sizeof( s->oam ) );
+	memcpy( ppu->vram, s->vram, sizeof( s->vram ) );
+	memcpy( m->mem.data, s->ram, sizeof( s->ram ) );
+	memcpy( m->mem.data + 0x6000, s->cartRam, sizeof( s->cartRam ) );
+	if( ppu->chrWritable ) {
+		memcpy( ppu->chr, s->chr, sizeof( s->chr ) );
+	}
+	return 0;
+}
+
+/*header is as many bytes as the file had, up to HEADER_SIZE*/
+static int checkHeader( const unsigned char* header, unsigned long size, char* error ) {
+	if( size < HEADER_SIZE || memcmp( header, "NESSTATE", 8 ) != 0 ) {
+		strcpy( error, "not a save state" );
+		return -1;
+	}
+	if( get32( header + 8 ) != SAVESTATE_VERSION ) {
+		sprintf( error, "save state version %lu, expected %d",
+		         (unsigned long)get32( header + 8 ), SAVESTATE_VERSION );
+		return -1;
+	}
+	size = get32( header + 20 );
+	if( get32( header + 12 ) != HEADER_SIZE || get32( header + 16 ) != HEADER_SIZE || (size != imageSize( 0 ) && size != imageSize( 1 )) ) {
+		strcpy( error, "save state has a malformed header" );
+		return -1;
+	}
+	return 0;
+}
+
+/*whether the image after header hashes as the header says and is as long as its CHR needs*/
+static int checkImage( const unsigned char* header, const unsigned char* image, char* error ) {
+	unsigned long size = get32( header + 20 );
+	const SaveStateImage* s = (const SaveStateImage*)image;
+
+	if( hash64( image, size, 0 ) != get64( header + 24 ) || size != imageSize( s->chrWritable != 0 ) ) {
+		strcpy( error, "save state is corrupt" );
+		return -1;
+	}
+	return 0;
+}
+
+int saveStateWrite( const Machine* m, const char* path, char* error ) {
+	unsigned char header[ HEADER_SIZE ];
+	SaveStateImage* s = malloc( sizeof( SaveStateImage ) );
+	unsigned long size = imageSize( m->ppu.chrWritable );
+	FILE* file;
+	int failed;
+
+	if( s == NULL ) {
+		strcpy( error, "out of memory" );
+		return -1;
+	}
+	capture( m, s );
+	swapImage( s );
+
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "NESSTATE", 8 );
+	put32( header + 8, SAVESTATE_VERSION );
+	put32( header + 12, HEADER_SIZE );
+	put32( header + 16, HEADER_SIZE );
+	put32( header + 20, size );
+	put64( header + 24, hash64( s, size, 0 ) );
+	put64( header + 32, m->frame );
+
+	file = fopen( path, "wb" );
+	if( file == NULL ) {
+		sprintf( error, "cannot create %.100s", path );
+		free( s );
+		return -1;
+	}
+	failed = fwrite( header, sizeof( header ), 1, file ) != 1 || fwrite( s, size, 1, file ) != 1;
+	failed |= fclose( file ) != 0;
+	free( s );
+	if( failed ) {
+		sprintf( error, "cannot write %.100s", path );
+		return -1;
+	}
+	return 0;
+}
+
+int saveStateRead( Machine* m, const char* path, char* error ) {
+	unsigned char header[ HEADER_SIZE ];
+	SaveStateImage* s;
+	FILE* file = fopen( path, "rb" );
+	unsigned long size;
+	int failed;
+
+	if( file == NULL ) {
+		sprintf( error, "cannot open %.100s", path );
+		return -1;
+	}
+	size = fread( header, 1, sizeof( header ), file );
+	if( checkHeader( header, size, error ) != 0 ) {
+		fclose( file );
+		return -1;
+	}
+
+	/*into scratch: m is only touched once everything checks out*/
+	size = get32( header + 20 );
+	s = calloc( 1, sizeof( SaveStateImage ) );
+	if( s == NULL ) {
+		fclose( file );
+		strcpy( error, "out of memory" );
+		return -1;
+	}
+	if( fread( s, size, 1, file ) != 1 ) {
+		fclose( file );
+		free( s );
+		strcpy( error, "save state is truncated" );
+		return -1;
+	}
+	fclose( file );
+
+	failed = checkImage( header, (const unsigned char*)s, error ) != 0;
+	if( !failed ) {
+		swapImage( s );
+		failed = saveStateRestore( m, s, error ) != 0;
+	}
+	free( s );
+	return failed ? -1 : 0;
+}
+
+const SaveStateImage* saveStateMap( const char* path, char* error ) {
+	int fd;
+	struct stat info;
+	unsigned char* base;
+
+	if( !littleEndian() ) {
+		strcpy( error, "save states can only be mapped on little-endian hosts" );
+		return NULL;
+	}
+	fd = open( path, O_RDONLY );
+	if( fd < 0 || fstat( fd, &info ) != 0 ) {
+		sprintf( error, "cannot open %.100s", path );
+		if( fd >= 0 ) {
+			close( fd );
+		}
+		return NULL;
+	}
+	if( info.st_size < HEADER_SIZE ) {
+		close( fd );
+		strcpy( error, "not a save state" );
+		return NULL;
+	}
+
+	base = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED ) {
+		sprintf( error, "cannot map %.100s", path );
+		return NULL;
+	}
+	if( checkHeader( base, HEADER_SIZE, error ) != 0 ) {
+		munmap( base, info.st_size );
+		return NULL;
+	}
+	if( (unsigned long)info.st_size != HEADER_SIZE + get32( base + 20 ) ) {
+		munmap( base, info.st_size );
+		strcpy( error, "save state is the wrong size" );
+		return NULL;
+	}
+	if( checkImage( base, base + HEADER_SIZE, error ) != 0 ) {
+		munmap( base, info.st_size );
+		return NULL;
+	}
+	return (const SaveStateImage*)(base + HEADER_SIZE);
+}
+
+void saveStateUnmap( const SaveStateImage* image ) {
+	munmap( (unsigned char*)image - HEADER_SIZE, HEADER_SIZE + imageSize( image->chrWritable != 0 ) );
+}
@@ -0,0 +1,110 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "machine.h"
+
+#include <stdint.h>
+
+#define SAVESTATE_VERSION (2)
+
+/*
+ * What a save state holds, as it is laid out in the file: every field
+ * fixed width, little-endian and at its natural alignment, so there is
+ * no padding anywhere. On a little-endian host a mapped file can be
+ * used as it is. PRG-ROM, and CHR unless it is RAM, are left to the
+ * cartridge; rom identifies it.
+ */
+typedef struct {
+	/*hash64 of $8000-$FFFF, then of CHR-ROM if the cartridge has it*/
+	uint64_t rom;
+
+	uint64_t cycles;
+	uint64_t frame;
+	uint64_t idleCycles;
+	uint64_t ppuFrame;
+
+	uint16_t pc;
+	uint16_t stall;
+	uint16_t v;
+	uint16_t t;
+	uint16_t dot;
+	uint16_t scanline;
+	uint16_t sprite0Dot;
+	uint16_t pad;
+
+	/*CPU, controllers*/
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t p;
+	uint8_t sp;
+	uint8_t input[ 2 ];
+	uint8_t shift[ 2 ];
+	uint8_t strobe;
+	uint8_t idleSkip;
+
+	/*PPU registers*/
+	uint8_t ctrl;
+	uint8_t mask;
+	uint8_t status;
+	uint8_t oamAddr;
+	uint8_t fineX;
+	uint8_t w;
+	uint8_t readBuffer;
+	uint8_t openBus;
+	uint8_t nmi;
+	uint8_t mirroring;
+	uint8_t chrWritable;
+	uint8_t oddFrame;
+	uint8_t pad2;
+
+	uint8_t apu[ 0x18 ];
+	uint8_t palette[ 32 ];
+	uint8_t oam[ 256 ];
+	uint8_t vram[ 2048 ];
+	uint8_t ram[ RAM_SIZE ];
+	uint8_t cartRam[ 0x2000 ];
+
+	/*only in the file if chrWritable*/
+	uint8_t chr[ 8192 ];
+} SaveStateImage;
+
+/*
+ * Save-state files. A 64 byte little-endian header:
+ *
+ *      0  "NESSTATE"
+ *      8  u32 version
+ *     12  u32 header size
+ *     16  u32 offset of the image
+ *     20  u32 size of the image
+ *     24  u64 hash64 of the image
+ *     32  u64 frame number, for information
+ *
+ * followed by the SaveStateImage, about 12 KB, or 20 KB with CHR-RAM.
+ * A state is restored into a machine powered on with the cartridge it
+ * was saved from, and only then.
+ *
+ * Functions returning int give 0 on success, or nonzero with a message
+ * in error, which must hold at least 128 bytes.
+ */
+int saveStateWrite( const Machine* m, const char* path, char* error );
+
+/*
+ * Read a state into m, checking its version, hash and cartridge. m is
+ * left alone if any of them is wrong.
+ */
+int saveStateRead( Machine* m, const char* path, char* error );
+
+/*
+ * Map a state read-only and return the image inside it after checking
+ * the header and hash, or NULL. Only on little-endian hosts; elsewhere
+ * use saveStateRead.
+ */
+const SaveStateImage* saveStateMap( const char* path, char* error );
+
+void saveStateUnmap( const SaveStateImage* image );
+
+/*put the state in image into m, if it was saved from m's cartridge*/
+int saveStateRestore( Machine* m, const SaveStateImage* image, char* error );
+
+#endif
@@ -0,0 +1,25 @@
+#include "trace.h"
+#include "disasm.h"
+
+#include <stdio.h>
+
+void traceFormat( const TraceRecord* r, char* out ) {
+	unsigned char bytes[ 3 ];
+	char code[ 16 ], text[ 16 ];
+	int length;
+
+	bytes[ 0 ] = r->opcode;
+	bytes[ 1 ] = r->operand[ 0 ];
+	bytes[ 2 ] = r->operand[ 1 ];
+	length = disassemble( r->pc, bytes, text );
+	if( length == 1 ) {
+		sprintf( code, "%02X", bytes[ 0 ] );
+	} else if( length == 2 ) {
+		sprintf( code, "%02X %02X", bytes[ 0 ], bytes[ 1 ] );
+	} else {
+		sprintf( code, "%02X %02X %02X", bytes[ 0 ], bytes[ 1 ], bytes[ 2 ] );
+	}
+	sprintf( out, "%04X  %-8s %c%-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%lu",
+	         r->pc, code, disasmOfficial( r->opcode ) ? ' ' : '*', text,
+	         r->a, r->x, r->y, r->p, r->sp, r->scanline, r->dot, (unsigned long)r->cycle );
+}
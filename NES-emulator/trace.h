@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_VERSION (1)
+#define TRACE_HEADER (16)
+
+/*
+ * Binary execution traces. A file is a 16 byte header ("NESTRACE", u32
+ * version, u32 record size, both little-endian) followed by one
+ * fixed-size record per instruction, holding the state just before it
+ * ran. Records are in host byte order and naturally aligned, so a
+ * mapped trace can be used as an array of TraceRecord; a trace is read
+ * on a host of the same byte order as the one that wrote it.
+ */
+typedef struct {
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t scanline;
+	uint16_t dot;
+	uint8_t opcode;
+	uint8_t operand[ 2 ];
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t p;
+	uint8_t sp;
+	uint8_t pad[ 3 ];
+} TraceRecord;
+
+/*
+ * Write a record as a line of nestest.log, without the trailing
+ * newline, into out, which needs 96 bytes. nestest also shows the
+ * memory an instruction touches; a trace does not hold that, so that
+ * part is left out.
+ */
+void traceFormat( const TraceRecord* r, char* out );
+
+/*
+ * Recording. A Tracer is a MachineObserver on the thread that starts
+ * it: every instruction run on that thread is put in a ring, and a
+ * writer thread streams the ring to disk. When the ring is full the
+ * emulator waits for the writer rather than lose records.
+ */
+typedef struct Tracer Tracer;
+
+/*returns NULL, with a message in error (128 bytes), if the file cannot be created*/
+Tracer* tracerStart( const char* path, char* error );
+
+/*detach, write out what is left and close. returns the number of records written, or -1 on a write error*/
+long tracerStop( Tracer* t );
+
+#endif
@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "trace.h"
+#include "machine.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*records in the ring; a power of two*/
+#define RING (1 << 16)
+
+/*records handed to fwrite at once*/
+#define CHUNK (4096)
+
+#define CACHE_LINE (64)
+
+struct Tracer {
+	MachineObserver observer;
+
+	/*single producer, single consumer, like the audio ring*/
+	unsigned long head;
+	char padHead[ CACHE_LINE - sizeof( unsigned long ) ];
+	unsigned long tail;
+	char padTail[ CACHE_LINE - sizeof( unsigned long ) ];
+	int stopping;
+	int failed;
+
+	FILE* file;
+	pthread_t writer;
+	TraceRecord ring[ RING ];
+};
+
+static void pause( void ) {
+	struct timespec wait;
+	wait.tv_sec = 0;
+	wait.tv_nsec = 100000;
+	nanosleep( &wait, NULL );
+}
+
+static void* writerMain( void* arg ) {
+	Tracer* t = arg;
+	unsigned long head, tail = t->tail, count;
+
+	for( ;; ) {
+		head = __atomic_load_n( &t->head, __ATOMIC_ACQUIRE );
+		if( head == tail ) {
+			if( __atomic_load_n( &t->stopping, __ATOMIC_ACQUIRE ) &&
+			    head == __atomic_load_n( &t->head, __ATOMIC_ACQUIRE ) ) {
+				break;
+			}
+			pause();
+			continue;
+		}
+
+		/*up to the end of the ring at most*/
+		count = head - tail;
+		if( count > CHUNK ) {
+			count = CHUNK;
+		}
+		if( count > RING - (tail & (RING - 1)) ) {
+			count = RING - (tail & (RING - 1));
+		}
+		if( fwrite( &t->ring[ tail & (RING - 1) ], sizeof( TraceRecord ), count, t->file ) != count ) {
+			t->failed = 1;
+		}
+		tail += count;
+		__atomic_store_n( &t->tail, tail, __ATOMIC_RELEASE );
+	}
+	return NULL;
+}
+
+static int record( MachineObserver* o, Machine* m ) {
+	Tracer* t = (Tracer*)o;
+	unsigned long head = t->head;
+	TraceRecord* r;
+
+	while( head - __atomic_load_n( &t->tail, __ATOMIC_ACQUIRE ) == RING ) {
+		pause();
+	}
+	r = &t->ring[ head & (RING - 1) ];
+	r->cycle = m->cycles;
+	r->pc = m->cpu.pc;
+	r->scanline = m->ppu.scanline;
+	r->dot = m->ppu.dot;
+	r->opcode = machinePeek( m, m->cpu.pc );
+	r->operand[ 0 ] = machinePeek( m, m->cpu.pc + 1 );
+	r->operand[ 1 ] = machinePeek( m, m->cpu.pc + 2 );
+	r->a = m->cpu.accum;
+	r->x = m->cpu.x;
+	r->y = m->cpu.y;
+	r->p = m->cpu.status;
+	r->sp = m->cpu.sp;
+	memset( r->pad, 0, sizeof( r->pad ) );
+	__atomic_store_n( &t->head, head + 1, __ATOMIC_RELEASE );
+	return 0;
+}
+
+Tracer* tracerStart( const char* path, char* error ) {
+	unsigned char header[ TRACE_HEADER ];
+	Tracer* t = calloc( 1, sizeof( Tracer ) );
+
+	if( t == NULL ) {
+		strcpy( error, "out of memory" );
+		return NULL;
+	}
+	t->file = fopen( path, "wb" );
+	if( t->file == NULL ) {
+		sprintf( error, "cannot create %.100s", path );
+		free( t );
+		return NULL;
+	}
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "NESTRACE", 8 );
+	header[ 8 ] = TRACE_VERSION;
+	header[ 12 ] = sizeof( TraceRecord );
+	if( fwrite( header, sizeof( header ), 1, t->file ) != 1 ) {
+		sprintf( error, "cannot write to %.100s", path );
+		fclose( t->file );
+		free( t );
+		return NULL;
+	}
+
+	if( pthread_create( &t->writer, NULL, writerMain, t ) != 0 ) {
+		strcpy( error, "cannot start the trace writer" );
+		fclose( t->file );
+		free( t );
+		return NULL;
+	}
+	t->observer.instruction = record;
+	machineObserve( &t->observer );
+	return t;
+}
+
+long tracerStop( Tracer* t ) {
+	long written = t->head;
+	int failed;
+
+	machineUnobserve( &t->observer );
+	__atomic_store_n( &t->stopping, 1, __ATOMIC_RELEASE );
+	pthread_join( t->writer, NULL );
+	failed = t->failed;
+	failed |= fclose( t->file ) != 0;
+	free( t );
+	return failed ? -1 : written;
+}
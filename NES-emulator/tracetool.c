@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Offline tools for traces written by a Tracer (headless -T).
+ *
+ *     trace log file        print the trace in the format of nestest.log
+ *     trace diff a b        find the first instruction where two traces differ
+ *
+ * Both map the files rather than read them, so traces of any length are
+ * streamed through the page cache. diff compares large blocks with memcmp
+ * and only looks at single records around the first difference; it
+ * prints the last records the traces share and the two that differ, and
+ * exits with 1 if they differ anywhere, including in length.
+ */
+
+/*records before the divergence shown by diff*/
+#define CONTEXT (8)
+
+/*records compared with one memcmp*/
+#define BLOCK (4096)
+
+typedef struct {
+	const TraceRecord* records;
+	unsigned long count;
+	void* base;
+	size_t size;
+} Trace;
+
+static int openTrace( Trace* trace, const char* path ) {
+	struct stat info;
+	const unsigned char* header;
+	int fd = open( path, O_RDONLY );
+
+	if( fd < 0 || fstat( fd, &info ) != 0 ) {
+		fprintf( stderr, "cannot open %s\n", path );
+		return -1;
+	}
+	if( info.st_size < TRACE_HEADER ) {
+		fprintf( stderr, "%s: not a trace\n", path );
+		close( fd );
+		return -1;
+	}
+	trace->size = info.st_size;
+	trace->base = mmap( NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( trace->base == MAP_FAILED ) {
+		fprintf( stderr, "cannot map %s\n", path );
+		return -1;
+	}
+	header = trace->base;
+	if( memcmp( header, "NESTRACE", 8 ) != 0 || header[ 8 ] != TRACE_VERSION ||
+	    header[ 12 ] != sizeof( TraceRecord ) ) {
+		fprintf( stderr, "%s: not a version %d trace\n", path, TRACE_VERSION );
+		munmap( trace->base, trace->size );
+		return -1;
+	}
+	posix_madvise( trace->base, trace->size, POSIX_MADV_SEQUENTIAL );
+	trace->records = (const TraceRecord*)(header + TRACE_HEADER);
+	trace->count = (trace->size - TRACE_HEADER) / sizeof( TraceRecord );
+	return 0;
+}
+
+static void printRecord( const char* prefix, unsigned long index, const TraceRecord* r ) {
+	char line[ 96 ];
+	traceFormat( r, line );
+	printf( "%s%9lu  %s\n", prefix, index, line );
+}
+
+static int logTrace( const char* path ) {
+	Trace trace;
+	char line[ 96 ];
+	unsigned long i;
+
+	if( openTrace( &trace, path ) != 0 ) {
+		return 2;
+	}
+	for( i = 0; i < trace.count; i++ ) {
+		traceFormat( &trace.records[ i ], line );
+		puts( line );
+	}
+	munmap( trace.base, trace.size );
+	return 0;
+}
+
+static int diffTraces( const char* pathA, const char* pathB ) {
+	Trace a, b;
+	unsigned long common, i, n, from;
+
+	if( openTrace( &a, pathA ) != 0 || openTrace( &b, pathB ) != 0 ) {
+		return 2;
+	}
+	common = a.count < b.count ? a.count : b.count;
+	for( i = 0; i < common; i += n ) {
+		n = common - i < BLOCK ? common - i : BLOCK;
+		if( memcmp( &a.records[ i ], &b.records[ i ], n * sizeof( TraceRecord ) ) != 0 ) {
+			while( memcmp( &a.records[ i ], &b.records[ i ], sizeof( TraceRecord ) ) == 0 ) {
+				i++;
+			}
+			break;
+		}
+	}
+
+	if( i == common && a.count == b.count ) {
+		printf( "traces match (%lu instructions)\n", a.count );
+		return 0;
+	}
+	from = i > CONTEXT ? i - CONTEXT : 0;
+	for( ; from < i; from++ ) {
+		printRecord( "  ", from, &a.records[ from ] );
+	}
+	if( i < common ) {
+		printRecord( "< ", i, &a.records[ i ] );
+		printRecord( "> ", i, &b.records[ i ] );
+		printf( "traces differ at instruction %lu\n", i );
+	} else {
+		printf( "%s ends after %lu instructions, %s goes on to %lu\n", a.count < b.count ? pathA : pathB, common,
+		        a.count < b.count ? pathB : pathA, a.count < b.count ? b.count : a.count );
+	}
+	return 1;
+}
+
+int main( int argc, char* argv[] ) {
+	if( argc == 3 && strcmp( argv[ 1 ], "log" ) == 0 ) {
+		return logTrace( argv[ 2 ] );
+	}
+	if( argc == 4 && strcmp( argv[ 1 ], "diff" ) == 0 ) {
+		return diffTraces( argv[ 2 ], argv[ 3 ] );
+	}
+	fprintf( stderr, "usage: trace log file | trace diff a b\n" );
+	return 2;
+}